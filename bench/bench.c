@@ -0,0 +1,273 @@
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE /* syscall */
+#include "bench.h"
+#include "../include/utf8_tools.h"
+#include "../include/utils.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+double bench_scale = 1.0;
+
+/* Counters opened by bench_counters_open, -1 when unavailable. */
+static const struct {
+  const char *name;
+  uint32_t type;
+  uint64_t config;
+} counter_defs[BENCH_COUNTERS] = {
+#ifdef __linux__
+    {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {"instr", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {"LLC-miss", PERF_TYPE_HW_CACHE,
+     PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+         (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+    {"br-miss", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {"dTLB-miss", PERF_TYPE_HW_CACHE,
+     PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+         (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+    {"faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+#else
+    {"cycles", 0, 0}, {"instr", 0, 0},  {"LLC-miss", 0, 0},
+    {"br-miss", 0, 0}, {"dTLB-miss", 0, 0}, {"faults", 0, 0},
+#endif
+};
+static int counter_fd[BENCH_COUNTERS] = {-1, -1, -1, -1, -1, -1};
+static int counters_on;
+
+#ifdef __linux__
+static int open_counter(uint32_t type, uint64_t config) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = type;
+  attr.config = config;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.inherit = 1; /* count the worker threads too */
+  attr.read_format =
+      PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#endif
+
+int bench_counters_open(void) {
+  int opened = 0;
+#ifdef __linux__
+  int first_errno = 0;
+  for (int c = 0; c < BENCH_COUNTERS; ++c) {
+    counter_fd[c] = open_counter(counter_defs[c].type, counter_defs[c].config);
+    if (counter_fd[c] >= 0)
+      opened++;
+    else if (first_errno == 0)
+      first_errno = errno;
+  }
+  if (opened < BENCH_COUNTERS) {
+    fprintf(stderr, "perf counters unavailable:");
+    for (int c = 0; c < BENCH_COUNTERS; ++c)
+      if (counter_fd[c] < 0)
+        fprintf(stderr, " %s", counter_defs[c].name);
+    fprintf(stderr, " (%s)\n", strerror(first_errno));
+  }
+#else
+  fprintf(stderr, "perf counters unavailable on this platform\n");
+#endif
+  counters_on = opened > 0;
+  return opened;
+}
+
+/* Raw reading of one counter: value, time enabled, time running, all 0
+ * when the read fails. Returns 0 or -1. */
+static int read_counter(int fd, uint64_t *raw) {
+  if (read(fd, raw, 3 * sizeof(uint64_t)) == (ssize_t)(3 * sizeof(uint64_t)))
+    return 0;
+  memset(raw, 0, 3 * sizeof(uint64_t));
+  return -1;
+}
+
+void bench_counters_start(bench_counters_t *counters) {
+  counters->valid = counters_on;
+  memset(counters->raw, 0, sizeof(counters->raw));
+  memset(counters->values, 0, sizeof(counters->values));
+  for (int c = 0; c < BENCH_COUNTERS; ++c)
+    if (counters_on && counter_fd[c] >= 0)
+      read_counter(counter_fd[c], counters->raw[c]);
+}
+
+/* The deltas, scaled up by the share of the interval the kernel left each
+ * counter running when it multiplexed them. */
+void bench_counters_stop(bench_counters_t *counters) {
+  for (int c = 0; c < BENCH_COUNTERS; ++c) {
+    if (!counters->valid || counter_fd[c] < 0)
+      continue;
+    uint64_t now[3];
+    const uint64_t *then = counters->raw[c];
+    if (read_counter(counter_fd[c], now) != 0 || then[1] == 0)
+      continue; /* a failed read at either end: 0 */
+    uint64_t value = now[0] - then[0], enabled = now[1] - then[1],
+             running = now[2] - then[2];
+    if (running > 0 && running < enabled)
+      value = (uint64_t)((double)value * (double)enabled / (double)running);
+    counters->values[c] = value;
+  }
+}
+
+/* Second report line: counter deltas per unit of work. */
+static void report_counters(const bench_counters_t *counters, double units,
+                            const char *unit) {
+  if (counters == NULL || !counters->valid || units <= 0)
+    return;
+  const uint64_t *delta = counters->values;
+  printf("%-12s %-36s", "", "");
+  for (int c = 0; c < BENCH_COUNTERS; ++c) {
+    if (counter_fd[c] < 0)
+      printf(" %s -", counter_defs[c].name);
+    else
+      printf(" %s %.3g", counter_defs[c].name, (double)delta[c] / units);
+  }
+  if (counter_fd[0] >= 0 && counter_fd[1] >= 0 && delta[0] > 0)
+    printf(" IPC %.2f", (double)delta[1] / (double)delta[0]);
+  printf("  /%s\n", unit);
+}
+
+static const char *syllables[] = {"ba", "ce", "di", "fo", "gu", "la", "me",
+                                  "ni", "po", "ru", "sa", "te", "vi", "zo",
+                                  "ca", "re", "to", "na", "li", "mo"};
+#define NUM_SYLLABLES (sizeof(syllables) / sizeof(syllables[0]))
+
+uint64_t bench_now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+size_t bench_size(size_t base) {
+  double scaled = (double)base * bench_scale;
+  return scaled < 1.0 ? 1 : (size_t)scaled;
+}
+
+void bench_report(const char *bench, const char *label, uint64_t elapsed_ns,
+                  uint64_t ops, const char *unit,
+                  const bench_counters_t *counters) {
+  double seconds = (double)elapsed_ns / 1e9;
+  double rate = seconds > 0 ? (double)ops / seconds : 0.0;
+  double per_op = ops ? (double)elapsed_ns / (double)ops : 0.0;
+  printf("%-12s %-36s %10.3f ms %14.0f %s/s %10.1f ns/%s\n", bench, label,
+         (double)elapsed_ns / 1e6, rate, unit, per_op, unit);
+  report_counters(counters, (double)ops, unit);
+}
+
+void bench_report_bytes(const char *bench, const char *label,
+                        uint64_t elapsed_ns, uint64_t bytes,
+                        const bench_counters_t *counters) {
+  double seconds = (double)elapsed_ns / 1e9;
+  double mbps = seconds > 0 ? (double)bytes / 1e6 / seconds : 0.0;
+  printf("%-12s %-36s %10.3f ms %14.1f MB/s %10.1f MB\n", bench, label,
+         (double)elapsed_ns / 1e6, mbps, (double)bytes / 1e6);
+  report_counters(counters, (double)bytes / 1024.0, "KiB");
+}
+
+uint64_t bench_rand(uint64_t *state) {
+  uint64_t x = *state;
+  x ^= x >> 12;
+  x ^= x << 25;
+  x ^= x >> 27;
+  *state = x;
+  return x * 0x2545F4914F6CDD1DULL;
+}
+
+/* Word number k spelled as base-20 syllables: unique and pronounceable. */
+static int *make_word(uint32_t k) {
+  int buf[64];
+  int len = 0;
+  uint32_t v = k + 1;
+  while (v > 0 && len < 60) {
+    const char *s = syllables[v % NUM_SYLLABLES];
+    buf[len++] = s[0];
+    buf[len++] = s[1];
+    v /= NUM_SYLLABLES;
+  }
+  int *word = dmalloc(sizeof(int) * (len + 1));
+  memcpy(word, buf, sizeof(int) * len);
+  word[len] = '\0';
+  return word;
+}
+
+bench_corpus_t *bench_corpus_create(size_t num_tokens, uint32_t num_words,
+                                    uint64_t seed) {
+  bench_corpus_t *c = dmalloc(sizeof(bench_corpus_t));
+  c->num_words = num_words ? num_words : 1;
+  c->words = dmalloc(sizeof(int *) * c->num_words);
+  for (uint32_t i = 0; i < c->num_words; ++i)
+    c->words[i] = make_word(i);
+
+  /* Cumulative Zipf(1) weights, sampled by binary search. */
+  double *cdf = dmalloc(sizeof(double) * c->num_words);
+  double sum = 0;
+  for (uint32_t i = 0; i < c->num_words; ++i) {
+    sum += 1.0 / (double)(i + 1);
+    cdf[i] = sum;
+  }
+
+  uint64_t state = seed ? seed : 0x9E3779B97F4A7C15ULL;
+  c->num_tokens = num_tokens;
+  c->tokens = dmalloc(sizeof(uint32_t) * (num_tokens ? num_tokens : 1));
+  for (size_t t = 0; t < num_tokens; ++t) {
+    double u = (double)(bench_rand(&state) >> 11) / 9007199254740992.0 * sum;
+    uint32_t lo = 0, hi = c->num_words - 1;
+    while (lo < hi) {
+      uint32_t mid = lo + (hi - lo) / 2;
+      if (cdf[mid] < u)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    c->tokens[t] = lo;
+  }
+  dfree(cdf);
+  return c;
+}
+
+void bench_corpus_free(bench_corpus_t *c) {
+  if (c == NULL)
+    return;
+  for (uint32_t i = 0; i < c->num_words; ++i)
+    dfree(c->words[i]);
+  dfree(c->words);
+  dfree(c->tokens);
+  dfree(c);
+}
+
+size_t bench_corpus_write(const bench_corpus_t *c, const char *path) {
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    perror(path);
+    return 0;
+  }
+  size_t cap = 1 << 20, used = 0, total = 0;
+  char *buf = dmalloc(cap);
+  for (size_t t = 0; t < c->num_tokens; ++t) {
+    const int *w = c->words[c->tokens[t]];
+    if (used + 256 > cap) {
+      write_all(fd, buf, used);
+      total += used;
+      used = 0;
+    }
+    for (int i = 0; w[i] != '\0'; ++i)
+      buf[used++] = (char)w[i]; /* syllables are ASCII */
+    buf[used++] = (t % 16 == 15) ? '\n' : ' ';
+  }
+  write_all(fd, buf, used);
+  total += used;
+  dfree(buf);
+  close(fd);
+  return total;
+}
@@ -0,0 +1,85 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+/*
+ * Minimal benchmark harness: a monotonic clock, one-line reports and a
+ * synthetic Zipf distributed corpus, so every benchmark measures the same
+ * kind of input. Benchmarks are registered in bench_main.c.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+  const char *name;
+  const char *description;
+  void (*run)(void);
+} bench_t;
+
+/* Multiplier applied to every benchmark size (-s on the command line). */
+extern double bench_scale;
+
+uint64_t bench_now_ns(void);
+
+/* Scale a base size by bench_scale (at least 1). */
+size_t bench_size(size_t base);
+
+/* Hardware counters (-p on the command line): cycles, instructions, last
+ * level cache misses, branch misses, dTLB misses, plus page faults, a
+ * software event that works where there is no PMU (most VMs and
+ * containers). A benchmark snapshots them around its timed region with
+ * bench_counters_start/stop, outside the two bench_now_ns calls, and the
+ * report given the snapshot adds a line of counts per op, "-" for the
+ * counters the kernel refused. */
+#define BENCH_COUNTERS 6
+
+/* Open the counters, telling stderr which are unavailable. Returns the
+ * number opened; with none the reports stay as they were. */
+int bench_counters_open(void);
+
+/* Raw readings (value, time enabled, time running) at bench_counters_start;
+ * values holds the deltas after bench_counters_stop. valid is 0 when
+ * counting is off. */
+typedef struct {
+  int valid;
+  uint64_t raw[BENCH_COUNTERS][3];
+  uint64_t values[BENCH_COUNTERS];
+} bench_counters_t;
+
+/* Call start just before the bench_now_ns that opens the interval and stop
+ * just after the one that closes it. */
+void bench_counters_start(bench_counters_t *counters);
+void bench_counters_stop(bench_counters_t *counters);
+
+/* Print one result line: ops per second and ns per op, then the counter
+ * line of counters (NULL for none). */
+void bench_report(const char *bench, const char *label, uint64_t elapsed_ns,
+                  uint64_t ops, const char *unit,
+                  const bench_counters_t *counters);
+
+/* Print one result line for a byte throughput (MB/s), counters per KiB. */
+void bench_report_bytes(const char *bench, const char *label,
+                        uint64_t elapsed_ns, uint64_t bytes,
+                        const bench_counters_t *counters);
+
+/* Synthetic corpus: num_tokens word indices drawn from a Zipf(1)
+ * distribution over num_words distinct, Italian looking words. */
+typedef struct {
+  int **words;       /* num_words NUL terminated code point strings */
+  uint32_t num_words;
+  uint32_t *tokens;  /* indices into words */
+  size_t num_tokens;
+} bench_corpus_t;
+
+bench_corpus_t *bench_corpus_create(size_t num_tokens, uint32_t num_words,
+                                    uint64_t seed);
+void bench_corpus_free(bench_corpus_t *corpus);
+
+/* Write the corpus as UTF-8 text (space separated, a newline every few
+ * words) to path. Returns the number of bytes written or 0 on error. */
+size_t bench_corpus_write(const bench_corpus_t *corpus, const char *path);
+
+/* xorshift64* generator shared by the benchmarks. */
+uint64_t bench_rand(uint64_t *state);
+
+#endif /* BENCH_H */
@@ -0,0 +1,70 @@
+/*
+ * Beam search generation: latency of one most probable continuation as
+ * the beam widens, for short and long outputs, from start words taken
+ * from the token stream. Expansions are the candidates offered to the
+ * heap; the early exits keep them far below width times the row length.
+ */
+#include "bench.h"
+#include "../include/generate.h"
+#include "../include/train.h"
+#include "../include/utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+void bench_beam(void) {
+  size_t tokens = bench_size(2000000);
+  bench_corpus_t *corpus =
+      bench_corpus_create(tokens, (uint32_t)(tokens / 20 + 100), 10);
+  train_config_t config = {TRAIN_BACKEND_RADIX, 1, {0, NULL}, NULL};
+  trainer_t *trainer = create_trainer(&config);
+  for (size_t i = 0; i < corpus->num_tokens; ++i)
+    trainer_add_word(trainer, corpus->words[corpus->tokens[i]]);
+  model_t *model = trainer_finish(trainer);
+  free_trainer(trainer);
+  printf("%u words, %llu edges\n", model_num_words(model),
+         (unsigned long long)model_num_edges(model));
+
+  enum { STARTS = 64 };
+  uint32_t starts[STARTS];
+  for (size_t s = 0; s < STARTS; ++s)
+    starts[s] = model_find(model,
+                           corpus->words[corpus->tokens[s * 7919 % tokens]]);
+  static const uint32_t widths[] = {1, 4, 16, 64, 256, 1024};
+  static const size_t lengths[] = {20, 200};
+  uint32_t *out = dmalloc(sizeof(uint32_t) * 200);
+  double sum = 0;
+  char label[64];
+  for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); ++l) {
+    size_t length = lengths[l];
+    for (size_t w = 0; w < sizeof(widths) / sizeof(widths[0]); ++w) {
+      generate_beam_t *beam = create_generate_beam(widths[w], length);
+      size_t runs = STARTS, words = 0;
+      uint64_t expansions = 0;
+      if (widths[w] * length > 50000)
+        runs = STARTS / 8; /* the slow end: fewer of them */
+      bench_counters_t counters;
+      bench_counters_start(&counters);
+      uint64_t start = bench_now_ns();
+      for (size_t s = 0; s < runs; ++s) {
+        double lp;
+        words += generate_beam_search(beam, model, starts[s], out, length,
+                                      &lp);
+        expansions += generate_beam_expansions(beam);
+        sum += lp;
+      }
+      uint64_t elapsed = bench_now_ns() - start;
+      bench_counters_stop(&counters);
+      snprintf(label, sizeof label, "length %zu, width %u", length,
+               widths[w]);
+      bench_report("beam", label, elapsed, runs, "search", &counters);
+      printf("%-12s %-40s %10.1f words %12.0f expansions/search\n", "beam",
+             "", (double)words / runs, (double)expansions / runs);
+      free_generate_beam(beam);
+    }
+  }
+  if (sum == 42)
+    printf("\n");
+  dfree(out);
+  free_model(model);
+  bench_corpus_free(corpus);
+}
@@ -0,0 +1,60 @@
+/*
+ * Lowercasing throughput: one utf8_char_to_lower call per code point
+ * against utf8_codepoints_to_lower, on ASCII words and on Italian text
+ * with accented capitals.
+ */
+#include "bench.h"
+#include "../include/utf8_tools.h"
+#include "../include/utils.h"
+#include <stdio.h>
+
+static void run_text(const char *name, const int *text, int *out, size_t n) {
+  char label[64];
+  bench_counters_t counters;
+  bench_counters_start(&counters);
+  uint64_t start = bench_now_ns();
+  for (size_t i = 0; i < n; ++i)
+    out[i] = utf8_char_to_lower(text[i]);
+  uint64_t elapsed = bench_now_ns() - start;
+  bench_counters_stop(&counters);
+  snprintf(label, sizeof label, "%s per char", name);
+  bench_report("case", label, elapsed, n, "cp", &counters);
+
+  /* word by word, as the trainer calls it */
+  bench_counters_start(&counters);
+  start = bench_now_ns();
+  size_t i = 0;
+  while (i < n) {
+    size_t len = 0;
+    while (i + len < n && text[i + len] != ' ')
+      len++;
+    utf8_codepoints_to_lower(out + i, text + i, len);
+    out[i + len] = ' ';
+    i += len + 1;
+  }
+  elapsed = bench_now_ns() - start;
+  bench_counters_stop(&counters);
+  snprintf(label, sizeof label, "%s by word", name);
+  bench_report("case", label, elapsed, n, "cp", &counters);
+}
+
+void bench_case(void) {
+  static const int italian[] = {0xC8, ' ', 'P', 'e', 'r', 'c', 'h', 0xE9,
+                                ' ', 'C', 'I', 'T', 'T', 0xC0, ' ', 'O',
+                                'g', 'g', 'i', ' ', 'U', 'n', 'i', 'v',
+                                'e', 'r', 's', 'i', 't', 0xE0, ' '};
+  size_t n = bench_size(20000000);
+  int *text = dmalloc(sizeof(int) * (n + 1));
+  int *out = dmalloc(sizeof(int) * (n + 1));
+  uint64_t state = 5;
+  for (size_t i = 0; i < n; ++i) {
+    uint64_t r = bench_rand(&state) % 10;
+    text[i] = r == 0 ? ' ' : (r < 4 ? 'A' : 'a') + (int)(r * 3 % 26);
+  }
+  run_text("ascii", text, out, n);
+  for (size_t i = 0; i < n; ++i)
+    text[i] = italian[i % (sizeof(italian) / sizeof(italian[0]))];
+  run_text("italian", text, out, n);
+  dfree(text);
+  dfree(out);
+}
@@ -0,0 +1,95 @@
+/*
+ * Incremental updates: the same batch of new text appended to the delta
+ * logs of base models of growing size, against training again on
+ * everything. Appending should cost the same whatever the base; loading
+ * the base with its log and compacting it are proportional to the model.
+ */
+#include "bench.h"
+#include "../include/delta_log.h"
+#include "../include/train.h"
+#include "../include/utils.h"
+#include <stdio.h>
+#include <unistd.h>
+
+static model_t *train_tokens(const bench_corpus_t *corpus, size_t from,
+                             size_t to) {
+  train_config_t config = {TRAIN_BACKEND_RADIX, 1, {0, NULL}, NULL};
+  trainer_t *trainer = create_trainer(&config);
+  for (size_t i = from; i < to; ++i)
+    trainer_add_word(trainer, corpus->words[corpus->tokens[i]]);
+  model_t *model = trainer_finish(trainer);
+  free_trainer(trainer);
+  return model;
+}
+
+void bench_delta(void) {
+  const char *base_path = "/tmp/markov_bench_delta.bin";
+  const char *log_path = "/tmp/markov_bench_delta.bin.delta";
+  size_t update = bench_size(50000);
+  static const size_t bases[] = {200000, 1000000, 4000000};
+  for (size_t b = 0; b < sizeof(bases) / sizeof(bases[0]); ++b) {
+    size_t tokens = bench_size(bases[b]);
+    bench_corpus_t *corpus = bench_corpus_create(
+        tokens + update, (uint32_t)(tokens / 20 + 100), 21);
+    model_t *base = train_tokens(corpus, 0, tokens);
+    model_save(base, base_path);
+    unlink(log_path);
+    char label[64];
+
+    bench_counters_t counters;
+    bench_counters_start(&counters);
+    uint64_t start = bench_now_ns();
+    model_t *fresh = train_tokens(corpus, tokens, tokens + update);
+    delta_log_t *log = delta_log_open(log_path, base);
+    delta_log_add_model(log, fresh);
+    delta_log_commit(log);
+    uint64_t elapsed = bench_now_ns() - start;
+    bench_counters_stop(&counters);
+    snprintf(label, sizeof label, "base %zu: update %zu", tokens, update);
+    bench_report("delta", label, elapsed, update, "token", &counters);
+
+    bench_counters_start(&counters);
+    start = bench_now_ns();
+    model_t *retrained = train_tokens(corpus, 0, tokens + update);
+    elapsed = bench_now_ns() - start;
+    bench_counters_stop(&counters);
+    snprintf(label, sizeof label, "base %zu: retrain everything", tokens);
+    bench_report("delta", label, elapsed, update, "token", &counters);
+
+    delta_log_stats_t stats;
+    bench_counters_start(&counters);
+    start = bench_now_ns();
+    model_t *loaded = delta_log_load(base_path, log_path, &stats);
+    elapsed = bench_now_ns() - start;
+    bench_counters_stop(&counters);
+    snprintf(label, sizeof label, "base %zu: load base + log", tokens);
+    bench_report("delta", label, elapsed, model_num_edges(loaded), "edge",
+                 &counters);
+
+    bench_counters_start(&counters);
+    start = bench_now_ns();
+    delta_log_compact_start(log, base_path);
+    delta_log_compact_wait(log);
+    elapsed = bench_now_ns() - start;
+    bench_counters_stop(&counters);
+    snprintf(label, sizeof label, "base %zu: compact", tokens);
+    bench_report("delta", label, elapsed, model_num_edges(loaded), "edge",
+                 &counters);
+    printf("base %llu edges, update %llu edges, log %.2f MB, merged %llu "
+           "edges (retrained %llu)\n",
+           (unsigned long long)model_num_edges(base),
+           (unsigned long long)model_num_edges(fresh),
+           (double)stats.bytes / 1e6,
+           (unsigned long long)model_num_edges(loaded),
+           (unsigned long long)model_num_edges(retrained));
+
+    delta_log_close(log);
+    free_model(loaded);
+    free_model(retrained);
+    free_model(fresh);
+    free_model(base);
+    bench_corpus_free(corpus);
+  }
+  unlink(base_path);
+  unlink(log_path);
+}
@@ -0,0 +1,46 @@
+/*
+ * CSV export throughput (MB/s) of a radix-trained model, counts and
+ * probabilities, with one and several formatting threads.
+ */
+#include "bench.h"
+#include "../include/csv.h"
+#include "../include/train.h"
+#include <stdio.h>
+#include <unistd.h>
+
+#define EXPORT_PATH "bench_export.csv"
+
+void bench_export(void) {
+  size_t tokens = bench_size(2000000);
+  bench_corpus_t *corpus =
+      bench_corpus_create(tokens, (uint32_t)(tokens / 20 + 100), 2);
+  train_config_t config = {TRAIN_BACKEND_RADIX, 1, {0, NULL}, NULL};
+  trainer_t *trainer = create_trainer(&config);
+  for (size_t i = 0; i < corpus->num_tokens; ++i)
+    trainer_add_word(trainer, corpus->words[corpus->tokens[i]]);
+  model_t *model = trainer_finish(trainer);
+  free_trainer(trainer);
+  bench_corpus_free(corpus);
+
+  static const int threads[] = {1, 2, 4};
+  for (int v = 0; v < 2; ++v) {
+    for (size_t t = 0; t < sizeof(threads) / sizeof(threads[0]); ++t) {
+      csv_export_config_t export_config = {
+          ',', v ? CSV_VALUE_PROBABILITY : CSV_VALUE_COUNT, 1, threads[t]};
+      bench_counters_t counters;
+      bench_counters_start(&counters);
+      uint64_t start = bench_now_ns();
+      int64_t bytes = model_export_csv(model, EXPORT_PATH, &export_config);
+      uint64_t elapsed = bench_now_ns() - start;
+      bench_counters_stop(&counters);
+      char label[64];
+      snprintf(label, sizeof label, "%s %dt (%llu edges)",
+               v ? "probability" : "count", threads[t],
+               (unsigned long long)model_num_edges(model));
+      bench_report_bytes("export", label, elapsed,
+                         bytes > 0 ? (uint64_t)bytes : 0, &counters);
+    }
+  }
+  unlink(EXPORT_PATH);
+  free_model(model);
+}
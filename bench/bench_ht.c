@@ -0,0 +1,90 @@
+/*
+ * ht_insert / ht_search against their batched, prefetching versions on a
+ * table much larger than the last level cache (about 115 bytes per item
+ * between bucket slot, list, chain node and ht_item: 2M items ~ 230 MB).
+ */
+#include "bench.h"
+#include "../include/hash_table.h"
+#include "../include/utils.h"
+#include <stdio.h>
+
+static unsigned int u64_hash(const void *key, int size) {
+  uint64_t x = *(const uint64_t *)key;
+  x ^= x >> 33;
+  x *= 0xFF51AFD7ED558CCDULL;
+  x ^= x >> 33;
+  return (unsigned int)(x % (uint64_t)size);
+}
+
+static int u64_cmp(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+static ht_item *make_item(uint64_t *key) {
+  return default_create_ht_item(key, key);
+}
+
+static void run(size_t n, int batched) {
+  const char *mode = batched ? "batch" : "scalar";
+  uint64_t *keys = dmalloc(sizeof(uint64_t) * n);
+  uint64_t state = 7;
+  for (size_t i = 0; i < n; ++i)
+    keys[i] = bench_rand(&state);
+  /* sized up front so that resizes do not dominate the inserts */
+  hash_table_t *table = create_hash_table((int)(n + n / 2), u64_hash, u64_cmp);
+  ht_item **items = dmalloc(sizeof(ht_item *) * n);
+  for (size_t i = 0; i < n; ++i)
+    items[i] = make_item(&keys[i]);
+
+  char label[64];
+  bench_counters_t counters;
+  bench_counters_start(&counters);
+  uint64_t start = bench_now_ns();
+  if (batched) {
+    ht_insert_batch(table, items, (int)n);
+  } else {
+    for (size_t i = 0; i < n; ++i)
+      ht_insert(table, items[i]);
+  }
+  uint64_t elapsed = bench_now_ns() - start;
+  bench_counters_stop(&counters);
+  snprintf(label, sizeof label, "insert %s %zu", mode, n);
+  bench_report("ht", label, elapsed, n, "op", &counters);
+
+  /* random lookups, one in four misses */
+  uint64_t *missing = dmalloc(sizeof(uint64_t) * n);
+  const void **probe = dmalloc(sizeof(void *) * n);
+  for (size_t i = 0; i < n; ++i) {
+    missing[i] = bench_rand(&state);
+    probe[i] = i % 4 == 3 ? (const void *)&missing[i]
+                          : (const void *)&keys[bench_rand(&state) % n];
+  }
+  size_t hits = 0;
+  bench_counters_start(&counters);
+  start = bench_now_ns();
+  if (batched) {
+    ht_search_batch(table, probe, (int)n, items);
+    for (size_t i = 0; i < n; ++i)
+      hits += items[i] != NULL;
+  } else {
+    for (size_t i = 0; i < n; ++i)
+      hits += ht_search(table, probe[i]) != NULL;
+  }
+  elapsed = bench_now_ns() - start;
+  bench_counters_stop(&counters);
+  snprintf(label, sizeof label, "search %s (%zu hits)", mode, hits);
+  bench_report("ht", label, elapsed, n, "op", &counters);
+
+  free_hash_table(table);
+  dfree(probe);
+  dfree(missing);
+  dfree(items);
+  dfree(keys);
+}
+
+void bench_ht(void) {
+  size_t n = bench_size(2000000);
+  run(n, 0);
+  run(n, 1);
+}
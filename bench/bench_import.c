@@ -0,0 +1,82 @@
+/*
+ * Loading a transition table from its CSV export against retraining it
+ * from the raw corpus text (tokenizer feeding the radix backend).
+ */
+#include "bench.h"
+#include "../include/csv.h"
+#include "../include/tokenizer.h"
+#include "../include/train.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#define IMPORT_CSV_PATH "bench_import.csv"
+#define IMPORT_TEXT_PATH "bench_import.txt"
+
+static model_t *retrain_from_text(const char *path, size_t *bytes) {
+  *bytes = 0;
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    perror(path);
+    return NULL;
+  }
+  train_config_t config = {TRAIN_BACKEND_RADIX, 1, {0, NULL}, NULL};
+  trainer_t *trainer = create_trainer(&config);
+  tokenizer_t *tok = create_tokenizer(tokenizer_train_sink, trainer);
+  tokenizer_feed_fd(tok, fd);
+  tokenizer_finish(tok);
+  *bytes = (size_t)tokenizer_get_stats(tok)->bytes;
+  free_tokenizer(tok);
+  close(fd);
+  model_t *model = trainer_finish(trainer);
+  free_trainer(trainer);
+  return model;
+}
+
+void bench_import(void) {
+  size_t tokens = bench_size(2000000);
+  bench_corpus_t *corpus =
+      bench_corpus_create(tokens, (uint32_t)(tokens / 20 + 100), 3);
+  bench_corpus_write(corpus, IMPORT_TEXT_PATH);
+  train_config_t config = {TRAIN_BACKEND_RADIX, 1, {0, NULL}, NULL};
+  trainer_t *trainer = create_trainer(&config);
+  for (size_t i = 0; i < corpus->num_tokens; ++i)
+    trainer_add_word(trainer, corpus->words[corpus->tokens[i]]);
+  model_t *model = trainer_finish(trainer);
+  free_trainer(trainer);
+  bench_corpus_free(corpus);
+  int64_t csv_bytes = model_export_csv(model, IMPORT_CSV_PATH, NULL);
+
+  char label[64];
+  size_t text_bytes;
+  bench_counters_t counters;
+  bench_counters_start(&counters);
+  uint64_t start = bench_now_ns();
+  model_t *retrained = retrain_from_text(IMPORT_TEXT_PATH, &text_bytes);
+  uint64_t elapsed = bench_now_ns() - start;
+  bench_counters_stop(&counters);
+  snprintf(label, sizeof label, "retrain %zu tokens", tokens);
+  if (retrained != NULL)
+    bench_report_bytes("import", label, elapsed, text_bytes, &counters);
+  free_model(retrained);
+
+  static const int threads[] = {1, 2, 4};
+  for (size_t t = 0; t < sizeof(threads) / sizeof(threads[0]); ++t) {
+    csv_import_config_t import_config = {',', threads[t]};
+    bench_counters_start(&counters);
+    start = bench_now_ns();
+    model_t *imported = model_import_csv(IMPORT_CSV_PATH, &import_config);
+    elapsed = bench_now_ns() - start;
+    bench_counters_stop(&counters);
+    if (imported == NULL)
+      continue;
+    snprintf(label, sizeof label, "csv %dt (%llu edges)", threads[t],
+             (unsigned long long)model_num_edges(imported));
+    bench_report_bytes("import", label, elapsed,
+                       csv_bytes > 0 ? (uint64_t)csv_bytes : 0, &counters);
+    free_model(imported);
+  }
+  unlink(IMPORT_CSV_PATH);
+  unlink(IMPORT_TEXT_PATH);
+  free_model(model);
+}
@@ -0,0 +1,155 @@
+/*
+ * Reading many corpus files: one blocking read() after the other against
+ * ingest.h with io_uring and with pread threads, for a few queue depths.
+ * Each case runs on a cold page cache (every file dropped with
+ * POSIX_FADV_DONTNEED first, so the disk is really read) and on a warm
+ * one. The sink only touches the data: this is the input side of
+ * training, without the tokenizer.
+ */
+#define _DEFAULT_SOURCE
+#include "bench.h"
+#include "../include/ingest.h"
+#include "../include/utils.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char *dir = "/tmp/markov_bench_ingest";
+
+typedef struct {
+  char **paths;
+  int n;
+  uint64_t bytes;
+} file_set_t;
+
+/* Sum one byte per cache line so the data is really brought in. */
+static int touch_sink(void *ctx, int file, const char *data, size_t len) {
+  uint64_t *sum = ctx;
+  (void)file;
+  for (size_t i = 0; i < len; i += 64)
+    *sum += (unsigned char)data[i];
+  return 0;
+}
+
+static void drop_cache(const file_set_t *set) {
+  for (int i = 0; i < set->n; ++i) {
+    int fd = open(set->paths[i], O_RDONLY);
+    if (fd < 0)
+      continue;
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+  }
+}
+
+static void run_sequential(const file_set_t *set, int cold) {
+  if (cold)
+    drop_cache(set);
+  static char buffer[128 * 1024];
+  uint64_t sum = 0;
+  bench_counters_t counters;
+  bench_counters_start(&counters);
+  uint64_t start = bench_now_ns();
+  for (int i = 0; i < set->n; ++i) {
+    int fd = open(set->paths[i], O_RDONLY);
+    if (fd < 0)
+      continue;
+    ssize_t got;
+    while ((got = read(fd, buffer, sizeof buffer)) > 0)
+      touch_sink(&sum, i, buffer, (size_t)got);
+    close(fd);
+  }
+  uint64_t elapsed = bench_now_ns() - start;
+  bench_counters_stop(&counters);
+  bench_report_bytes("ingest", cold ? "cold, sequential read()"
+                                    : "warm, sequential read()",
+                     elapsed, set->bytes, &counters);
+}
+
+static void run_ingest(const file_set_t *set, int cold,
+                       ingest_backend_t backend, unsigned depth) {
+  if (cold)
+    drop_cache(set);
+  ingest_config_t config = {backend, depth, 0, 0};
+  ingest_stats_t stats;
+  uint64_t sum = 0;
+  bench_counters_t counters;
+  bench_counters_start(&counters);
+  uint64_t start = bench_now_ns();
+  int rc = ingest_files((const char *const *)set->paths, set->n, &config,
+                        touch_sink, &sum, &stats);
+  uint64_t elapsed = bench_now_ns() - start;
+  bench_counters_stop(&counters);
+  char label[96];
+  snprintf(label, sizeof label, "%s, %s depth %u, %.0f%% waiting%s",
+           cold ? "cold" : "warm", ingest_backend_name(stats.backend), depth,
+           elapsed ? 100.0 * (double)stats.wait_ns / (double)elapsed : 0.0,
+           rc == 0 ? "" : " (FAILED)");
+  bench_report_bytes("ingest", label, elapsed, set->bytes, &counters);
+}
+
+void bench_ingest(void) {
+  file_set_t set = {NULL, (int)bench_size(2000), 0};
+  size_t tokens = bench_size(4000000);
+  bench_corpus_t *corpus =
+      bench_corpus_create(tokens, (uint32_t)(tokens / 20 + 100), 7);
+  char whole[128];
+  snprintf(whole, sizeof whole, "%s.txt", dir);
+  size_t total = bench_corpus_write(corpus, whole);
+  bench_corpus_free(corpus);
+  char *text = dmalloc(total);
+  FILE *in = fopen(whole, "rb");
+  if (total == 0 || text == NULL || in == NULL ||
+      fread(text, 1, total, in) != total) {
+    fprintf(stderr, "bench_ingest: cannot build the corpus\n");
+    if (in)
+      fclose(in);
+    dfree(text);
+    unlink(whole);
+    return;
+  }
+  fclose(in);
+  unlink(whole);
+
+  /* cut the text into files of 1/4 to 7/4 of the average size */
+  mkdir(dir, 0700);
+  set.paths = dmalloc(sizeof(char *) * (size_t)set.n);
+  uint64_t state = 11;
+  size_t average = total / (size_t)set.n, offset = 0;
+  for (int i = 0; i < set.n; ++i) {
+    size_t len = average / 4 + bench_rand(&state) % (average * 3 / 2 + 1);
+    if (i == set.n - 1 || offset + len > total)
+      len = total - offset;
+    set.paths[i] = dmalloc(strlen(dir) + 32);
+    sprintf(set.paths[i], "%s/%05d.txt", dir, i);
+    FILE *out = fopen(set.paths[i], "wb");
+    if (out) {
+      fwrite(text + offset, 1, len, out);
+      fclose(out);
+    }
+    offset += len;
+    set.bytes += len;
+  }
+  dfree(text);
+  printf("%d files, %.1f MB\n", set.n, (double)set.bytes / 1e6);
+
+  for (int cold = 1; cold >= 0; --cold) {
+    run_sequential(&set, cold);
+    run_ingest(&set, cold, INGEST_PREAD, 8);
+    run_ingest(&set, cold, INGEST_PREAD, 32);
+    run_ingest(&set, cold, INGEST_IO_URING, 1);
+    run_ingest(&set, cold, INGEST_IO_URING, 8);
+    run_ingest(&set, cold, INGEST_IO_URING, 32);
+    run_ingest(&set, cold, INGEST_IO_URING, 128);
+  }
+
+  for (int i = 0; i < set.n; ++i) {
+    unlink(set.paths[i]);
+    dfree(set.paths[i]);
+  }
+  dfree(set.paths);
+  rmdir(dir);
+}
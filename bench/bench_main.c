@@ -0,0 +1,84 @@
+/*
+ * Benchmark runner.
+ *
+ * Usage: markov_bench [-s scale] [-p] [name ...]
+ *   -s scale   multiply every benchmark size by scale (default 1.0)
+ *   -p         add perf_event_open counters per op to every result
+ *   name       run only the named benchmarks (default: all)
+ */
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void bench_train(void);
+void bench_export(void);
+void bench_import(void);
+void bench_case(void);
+void bench_tokenize(void);
+void bench_ht(void);
+void bench_template(void);
+void bench_pipeline(void);
+void bench_shm(void);
+void bench_ingest(void);
+void bench_trie(void);
+void bench_topk(void);
+void bench_beam(void);
+void bench_timing(void);
+void bench_delta(void);
+void bench_merge(void);
+void bench_packed(void);
+void bench_quant(void);
+
+static const bench_t benches[] = {
+    {"train", "hash table vs radix sort training backends", bench_train},
+    {"export", "CSV export throughput", bench_export},
+    {"import", "CSV import against retraining from text", bench_import},
+    {"case", "table-driven lowercasing, per char and by word", bench_case},
+    {"tokenize", "tokenizer tokens/s, alone and feeding training", bench_tokenize},
+    {"ht", "scalar vs batched prefetching hash table calls", bench_ht},
+    {"template", "generic vs macro specialized hash tables", bench_template},
+    {"pipeline", "in-process vs multi-process training input", bench_pipeline},
+    {"shm", "generator startup and sharing of a published model", bench_shm},
+    {"ingest", "asynchronous reads of many corpus files, cold and warm", bench_ingest},
+    {"trie", "radix tree dictionary against hash tables and binary search", bench_trie},
+    {"topk", "top-k followers: sorting rows against the rank section", bench_topk},
+    {"beam", "beam search generation: latency against beam width", bench_beam},
+    {"timing", "cost of the hot path timers and histograms", bench_timing},
+    {"delta", "delta log updates against retraining, load and compaction", bench_delta},
+    {"merge", "model merge against re-inserting through ht_insert", bench_merge},
+    {"packed", "varint and bit packed models: size against walk and decode speed", bench_packed},
+    {"quant", "8 and 16 bit cumulative and alias tables: size, error, walk speed", bench_quant},
+};
+#define NUM_BENCHES (sizeof(benches) / sizeof(benches[0]))
+
+static void usage(const char *prog) {
+  fprintf(stderr, "Usage: %s [-s scale] [-p] [name ...]\n\nBenchmarks:\n", prog);
+  for (size_t i = 0; i < NUM_BENCHES; ++i)
+    fprintf(stderr, "  %-12s %s\n", benches[i].name, benches[i].description);
+}
+
+int main(int argc, char **argv) {
+  int first = 1;
+  while (first < argc && argv[first][0] == '-') {
+    if (strcmp(argv[first], "-s") == 0 && first + 1 < argc) {
+      bench_scale = atof(argv[first + 1]);
+      first += 2;
+    } else if (strcmp(argv[first], "-p") == 0) {
+      bench_counters_open();
+      first++;
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  for (size_t i = 0; i < NUM_BENCHES; ++i) {
+    int selected = first == argc;
+    for (int a = first; a < argc; ++a)
+      selected |= strcmp(argv[a], benches[i].name) == 0;
+    if (selected)
+      benches[i].run();
+  }
+  return 0;
+}
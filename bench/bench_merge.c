@@ -0,0 +1,94 @@
+/*
+ * Merging two models trained on different sources: re-inserting every
+ * edge of both into a word table with ht_insert, one follower at a time,
+ * and freezing it, against model_merge with 1 to 4 threads. The two
+ * corpora draw from overlapping dictionaries, as news and forum text do.
+ */
+#include "bench.h"
+#include "../include/hash_table.h"
+#include "../include/model_merge.h"
+#include "../include/train.h"
+#include "../include/utils.h"
+#include "../include/word.h"
+#include <stdio.h>
+#include <unistd.h>
+
+static model_t *train_corpus(const bench_corpus_t *corpus, uint32_t shift) {
+  train_config_t config = {TRAIN_BACKEND_RADIX, 1, {0, NULL}, NULL};
+  trainer_t *trainer = create_trainer(&config);
+  for (size_t i = 0; i < corpus->num_tokens; ++i)
+    trainer_add_word(trainer,
+                     corpus->words[(corpus->tokens[i] + shift) %
+                                   corpus->num_words]);
+  model_t *model = trainer_finish(trainer);
+  free_trainer(trainer);
+  return model;
+}
+
+static void insert_edges(hash_table_t *table, const model_t *model) {
+  for (uint32_t id = 0; id < model_num_words(model); ++id) {
+    uint32_t n;
+    const model_edge_t *row = model_followers(model, id, &n);
+    word_t key = {(int *)model_word(model, id), 1};
+    for (uint32_t i = 0; i < n; ++i) {
+      word_t next = {(int *)model_word(model, row[i].next),
+                     (int)row[i].count};
+      ht_insert(table, word_ht_item_create(&key, &next));
+    }
+  }
+}
+
+void bench_merge(void) {
+  const char *path = "/tmp/markov_bench_merge.bin";
+  size_t tokens = bench_size(1000000);
+  uint32_t words = (uint32_t)(tokens / 20 + 100);
+  bench_corpus_t *corpus = bench_corpus_create(tokens, words, 31);
+  model_t *a = train_corpus(corpus, 0);
+  model_t *b = train_corpus(corpus, words / 3); /* other frequent words */
+  uint64_t edges = model_num_edges(a) + model_num_edges(b);
+  printf("a: %u words, %llu edges; b: %u words, %llu edges\n",
+         model_num_words(a), (unsigned long long)model_num_edges(a),
+         model_num_words(b), (unsigned long long)model_num_edges(b));
+
+  bench_counters_t counters;
+  bench_counters_start(&counters);
+  uint64_t start = bench_now_ns();
+  hash_table_t *table = create_hash_table_ops(
+      1024, word_hash, word_hashtable_keycmp, &word_ht_item_ops);
+  insert_edges(table, a);
+  insert_edges(table, b);
+  model_t *reinserted = model_from_word_table(table, 1);
+  uint64_t elapsed = bench_now_ns() - start;
+  bench_counters_stop(&counters);
+  bench_report("merge", "ht_insert every edge, freeze", elapsed, edges, "edge",
+               &counters);
+  free_hash_table(table);
+
+  static const int threads[] = {1, 2, 4};
+  for (size_t t = 0; t < sizeof(threads) / sizeof(threads[0]); ++t) {
+    model_merge_config_t config = {1.0, 1.0, threads[t]};
+    model_merge_stats_t stats;
+    char label[64];
+    bench_counters_start(&counters);
+    start = bench_now_ns();
+    model_merge(a, b, path, &config, &stats);
+    elapsed = bench_now_ns() - start;
+    bench_counters_stop(&counters);
+    snprintf(label, sizeof label, "model_merge, %d thread%s", threads[t],
+             threads[t] > 1 ? "s" : "");
+    bench_report("merge", label, elapsed, edges, "edge", &counters);
+    if (t == 0)
+      printf("merged: %u words (%u shared), %llu edges (ht: %llu), "
+             "%llu rows of b sorted again, %llu chunks\n",
+             stats.words, stats.shared, (unsigned long long)stats.edges,
+             (unsigned long long)model_num_edges(reinserted),
+             (unsigned long long)stats.resorted,
+             (unsigned long long)stats.chunks);
+  }
+
+  free_model(reinserted);
+  free_model(a);
+  free_model(b);
+  bench_corpus_free(corpus);
+  unlink(path);
+}
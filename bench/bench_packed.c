@@ -0,0 +1,119 @@
+/*
+ * Size against speed of the two codes of a packed model: image bytes and
+ * bytes per edge, then random walks (ns per generated word) and full row
+ * decodes (ns per edge), against the raw model whose rows need no
+ * decoding.
+ */
+#include "bench.h"
+#include "../include/generate.h"
+#include "../include/packed_model.h"
+#include "../include/train.h"
+#include "../include/utils.h"
+#include <stdio.h>
+
+#define WALK 256
+
+static model_t *train_corpus(const bench_corpus_t *corpus) {
+  train_config_t config = {TRAIN_BACKEND_RADIX, 1, {0, NULL}, NULL};
+  trainer_t *trainer = create_trainer(&config);
+  for (size_t i = 0; i < corpus->num_tokens; ++i)
+    trainer_add_word(trainer, corpus->words[corpus->tokens[i]]);
+  model_t *model = trainer_finish(trainer);
+  free_trainer(trainer);
+  return model;
+}
+
+void bench_packed(void) {
+  size_t tokens = bench_size(2000000);
+  size_t steps = bench_size(500000);
+  bench_corpus_t *corpus =
+      bench_corpus_create(tokens, (uint32_t)(tokens / 20 + 100), 37);
+  model_t *model = train_corpus(corpus);
+  uint32_t words = model_num_words(model);
+  uint64_t edges = model_num_edges(model);
+  printf("%u words, %llu edges\n", words, (unsigned long long)edges);
+  printf("%-8s %12s %10s\n", "form", "image bytes", "bytes/edge");
+  printf("%-8s %12llu %10.2f\n", "model",
+         (unsigned long long)model->header->image_size,
+         (double)model->header->image_size / edges);
+
+  packed_model_t *packed[2];
+  static const packed_encoding_t encodings[] = {PACKED_VARINT, PACKED_BITS};
+  for (int k = 0; k < 2; ++k) {
+    packed[k] = packed_model_build(model, encodings[k]);
+    printf("%-8s %12llu %10.2f (rows: %.2f)\n",
+           packed_encoding_name(encodings[k]),
+           (unsigned long long)packed[k]->header->image_size,
+           (double)packed[k]->header->image_size / edges,
+           (double)packed[k]->header->data_len / edges);
+  }
+
+  /* walks restart from a random word at every dead end */
+  uint32_t ids[WALK];
+  uint64_t state = 1, sink = 0;
+  bench_counters_t counters;
+  bench_counters_start(&counters);
+  uint64_t start = bench_now_ns();
+  for (size_t done = 0; done < steps;) {
+    uint32_t from = (uint32_t)(generate_rand(&state) % words);
+    size_t n = generate_walk(model, from, ids, WALK, &state);
+    sink += n ? ids[n - 1] : 0;
+    done += n + 1;
+  }
+  uint64_t elapsed = bench_now_ns() - start;
+  bench_counters_stop(&counters);
+  bench_report("packed", "walk, model", elapsed, steps, "word", &counters);
+  for (int k = 0; k < 2; ++k) {
+    char label[64];
+    state = 1;
+    bench_counters_start(&counters);
+    start = bench_now_ns();
+    for (size_t done = 0; done < steps;) {
+      uint32_t from = (uint32_t)(generate_rand(&state) % words);
+      size_t n = packed_model_walk(packed[k], from, ids, WALK, &state);
+      sink += n ? ids[n - 1] : 0;
+      done += n + 1;
+    }
+    snprintf(label, sizeof label, "walk, %s",
+             packed_encoding_name(encodings[k]));
+    elapsed = bench_now_ns() - start;
+    bench_counters_stop(&counters);
+    bench_report("packed", label, elapsed, steps, "word", &counters);
+  }
+
+  bench_counters_start(&counters);
+  start = bench_now_ns();
+  for (uint32_t id = 0; id < words; ++id) {
+    uint32_t n;
+    const model_edge_t *row = model_followers(model, id, &n);
+    for (uint32_t e = 0; e < n; ++e)
+      sink += row[e].next + row[e].count;
+  }
+  elapsed = bench_now_ns() - start;
+  bench_counters_stop(&counters);
+  bench_report("packed", "read every row, model", elapsed, edges, "edge",
+               &counters);
+  for (int k = 0; k < 2; ++k) {
+    char label[64];
+    model_edge_t *row =
+        dmalloc(sizeof(model_edge_t) * (packed[k]->header->widest + 1));
+    bench_counters_start(&counters);
+    start = bench_now_ns();
+    for (uint32_t id = 0; id < words; ++id) {
+      uint32_t n = packed_model_followers(packed[k], id, row);
+      for (uint32_t e = 0; e < n; ++e)
+        sink += row[e].next + row[e].count;
+    }
+    snprintf(label, sizeof label, "decode every row, %s",
+             packed_encoding_name(encodings[k]));
+    elapsed = bench_now_ns() - start;
+    bench_counters_stop(&counters);
+    bench_report("packed", label, elapsed, edges, "edge", &counters);
+    dfree(row);
+    free_packed_model(packed[k]);
+  }
+  printf("(checksum %llu)\n", (unsigned long long)sink);
+
+  free_model(model);
+  bench_corpus_free(corpus);
+}
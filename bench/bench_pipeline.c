@@ -0,0 +1,71 @@
+/*
+ * Training input in-process (read, decode, tokenize and count on one
+ * thread) against the three process pipeline, for a few batch sizes.
+ * The stage lines show where the time goes: a stage that stalls a lot is
+ * held back by the one after it, one that starves waits for the one
+ * before.
+ */
+#include "bench.h"
+#include "../include/pipeline.h"
+#include "../include/tokenizer.h"
+#include "../include/train.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+
+static const char *corpus_path = "/tmp/markov_bench_pipeline.txt";
+
+static void in_process(size_t bytes) {
+  train_config_t config = {TRAIN_BACKEND_RADIX, 1, {0, NULL}, NULL};
+  trainer_t *trainer = create_trainer(&config);
+  tokenizer_t *tok = create_tokenizer(tokenizer_train_sink, trainer);
+  bench_counters_t counters;
+  bench_counters_start(&counters);
+  uint64_t start = bench_now_ns();
+  int fd = open(corpus_path, O_RDONLY);
+  tokenizer_feed_fd(tok, fd);
+  close(fd);
+  tokenizer_finish(tok);
+  uint64_t elapsed = bench_now_ns() - start;
+  bench_counters_stop(&counters);
+  bench_report_bytes("pipeline", "in-process", elapsed, bytes, &counters);
+  free_tokenizer(tok);
+  free_model(trainer_finish(trainer));
+  free_trainer(trainer);
+}
+
+static void piped(size_t bytes, size_t slot_bytes) {
+  train_config_t config = {TRAIN_BACKEND_RADIX, 1, {0, NULL}, NULL};
+  trainer_t *trainer = create_trainer(&config);
+  pipeline_config_t pipe = {16, slot_bytes};
+  pipeline_stats_t stats;
+  const char *paths[] = {corpus_path};
+  bench_counters_t counters;
+  bench_counters_start(&counters);
+  uint64_t start = bench_now_ns();
+  int rc = pipeline_train(trainer, paths, 1, &pipe, &stats);
+  uint64_t elapsed = bench_now_ns() - start;
+  bench_counters_stop(&counters);
+  char label[64];
+  snprintf(label, sizeof label, "3 processes, %zu KiB batches%s",
+           slot_bytes >> 10, rc == 0 ? "" : " (FAILED)");
+  bench_report_bytes("pipeline", label, elapsed, bytes, &counters);
+  pipeline_print_stats(&stats, stdout);
+  free_model(trainer_finish(trainer));
+  free_trainer(trainer);
+}
+
+void bench_pipeline(void) {
+  size_t tokens = bench_size(4000000);
+  bench_corpus_t *corpus =
+      bench_corpus_create(tokens, (uint32_t)(tokens / 20 + 100), 6);
+  size_t bytes = bench_corpus_write(corpus, corpus_path);
+  bench_corpus_free(corpus);
+  if (bytes == 0)
+    return;
+  in_process(bytes);
+  piped(bytes, 16 << 10);
+  piped(bytes, 64 << 10);
+  piped(bytes, 256 << 10);
+  unlink(corpus_path);
+}
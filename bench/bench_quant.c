@@ -0,0 +1,95 @@
+/*
+ * Quantized follower distributions: image bytes per edge, followers
+ * dropped and the largest probability error of 8 and 16 bit cumulative
+ * and alias tables, then random walks (ns per generated word) against the
+ * raw model, whose draws scan the counts of the row.
+ */
+#include "bench.h"
+#include "../include/generate.h"
+#include "../include/quant_model.h"
+#include "../include/train.h"
+#include <stdio.h>
+
+#define WALK 256
+
+static model_t *train_corpus(const bench_corpus_t *corpus) {
+  train_config_t config = {TRAIN_BACKEND_RADIX, 1, {0, NULL}, NULL};
+  trainer_t *trainer = create_trainer(&config);
+  for (size_t i = 0; i < corpus->num_tokens; ++i)
+    trainer_add_word(trainer, corpus->words[corpus->tokens[i]]);
+  model_t *model = trainer_finish(trainer);
+  free_trainer(trainer);
+  return model;
+}
+
+void bench_quant(void) {
+  size_t tokens = bench_size(2000000);
+  size_t steps = bench_size(500000);
+  bench_corpus_t *corpus =
+      bench_corpus_create(tokens, (uint32_t)(tokens / 20 + 100), 41);
+  model_t *model = train_corpus(corpus);
+  uint32_t words = model_num_words(model);
+  uint64_t edges = model_num_edges(model);
+  printf("%u words, %llu edges\n", words, (unsigned long long)edges);
+  printf("%-9s %12s %10s %10s %10s\n", "form", "image bytes", "bytes/edge",
+         "dropped", "max error");
+  printf("%-9s %12llu %10.2f %10d %10d\n", "model",
+         (unsigned long long)model->header->image_size,
+         (double)model->header->image_size / edges, 0, 0);
+
+  static const struct {
+    const char *name;
+    unsigned bits;
+    quant_table_t table;
+  } forms[] = {{"cdf8", 8, QUANT_CDF},
+               {"cdf16", 16, QUANT_CDF},
+               {"alias8", 8, QUANT_ALIAS},
+               {"alias16", 16, QUANT_ALIAS}};
+  enum { FORMS = sizeof(forms) / sizeof(forms[0]) };
+  quant_model_t *quant[FORMS];
+  for (int k = 0; k < FORMS; ++k) {
+    quant[k] = quant_model_build(model, forms[k].bits, forms[k].table);
+    printf("%-9s %12llu %10.2f %10llu %10.3g\n", forms[k].name,
+           (unsigned long long)quant[k]->header->image_size,
+           (double)quant[k]->header->image_size / edges,
+           (unsigned long long)quant[k]->header->dropped,
+           quant[k]->header->max_error);
+  }
+
+  /* walks restart from a random word at every dead end */
+  uint32_t ids[WALK];
+  uint64_t state = 1, sink = 0;
+  bench_counters_t counters;
+  bench_counters_start(&counters);
+  uint64_t start = bench_now_ns();
+  for (size_t done = 0; done < steps;) {
+    uint32_t from = (uint32_t)(generate_rand(&state) % words);
+    size_t n = generate_walk(model, from, ids, WALK, &state);
+    sink += n ? ids[n - 1] : 0;
+    done += n + 1;
+  }
+  uint64_t elapsed = bench_now_ns() - start;
+  bench_counters_stop(&counters);
+  bench_report("quant", "walk, model", elapsed, steps, "word", &counters);
+  for (int k = 0; k < FORMS; ++k) {
+    char label[64];
+    state = 1;
+    bench_counters_start(&counters);
+    start = bench_now_ns();
+    for (size_t done = 0; done < steps;) {
+      uint32_t from = (uint32_t)(generate_rand(&state) % words);
+      size_t n = quant_model_walk(quant[k], from, ids, WALK, &state);
+      sink += n ? ids[n - 1] : 0;
+      done += n + 1;
+    }
+    snprintf(label, sizeof label, "walk, %s", forms[k].name);
+    elapsed = bench_now_ns() - start;
+    bench_counters_stop(&counters);
+    bench_report("quant", label, elapsed, steps, "word", &counters);
+    free_quant_model(quant[k]);
+  }
+  printf("(checksum %llu)\n", (unsigned long long)sink);
+
+  free_model(model);
+  bench_corpus_free(corpus);
+}
@@ -0,0 +1,145 @@
+/*
+ * Startup of a generator: private copy of the model (read into memory),
+ * file mapping (model_load) and shared memory attach (model_attach_shm)
+ * followed by a first walk,
+ * then several generator processes attached at once: their proportional
+ * share of the model (Pss_Shmem) shows a single physical copy.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include "bench.h"
+#include "../include/generate.h"
+#include "../include/model.h"
+#include "../include/train.h"
+#include "../include/utils.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define SHM_MODEL_PATH "bench_shm_model.bin"
+#define SHM_GENERATORS 4
+
+/* Pss_Shmem of this process in KiB, 0 if unknown. */
+static long pss_shmem_kb(void) {
+  FILE *f = fopen("/proc/self/smaps_rollup", "r");
+  if (f == NULL)
+    return 0;
+  char line[128];
+  long kb = 0;
+  while (fgets(line, sizeof line, f))
+    if (sscanf(line, "Pss_Shmem: %ld", &kb) == 1)
+      break;
+  fclose(f);
+  return kb;
+}
+
+/* Generate words from a freshly obtained model; returns a checksum so
+ * the walk is not optimised away. */
+static uint64_t first_words(const model_t *model) {
+  uint32_t ids[256];
+  uint64_t state = 5, sum = 0;
+  size_t n = generate_walk(model, 0, ids, 256, &state);
+  for (size_t i = 0; i < n; ++i)
+    sum += ids[i];
+  return sum;
+}
+
+static void startup(const char *label, model_t *(*open_model)(const char *),
+                    const char *source, size_t image_size) {
+  bench_counters_t counters;
+  bench_counters_start(&counters);
+  uint64_t start = bench_now_ns();
+  model_t *model = open_model(source);
+  uint64_t opened = bench_now_ns();
+  uint64_t sum = model ? first_words(model) : 0;
+  uint64_t elapsed = bench_now_ns() - start;
+  bench_counters_stop(&counters);
+  char text[80];
+  snprintf(text, sizeof text, "%s open %.3f ms (sum %llu)", label,
+           (opened - start) / 1e6, (unsigned long long)(sum % 1000));
+  bench_report_bytes("shm", text, elapsed, image_size, &counters);
+  free_model(model);
+}
+
+/* The least a private copy costs: reading the image into the heap. */
+static void private_read(const char *path, size_t image_size) {
+  char *copy = dmalloc(image_size);
+  bench_counters_t counters;
+  bench_counters_start(&counters);
+  uint64_t start = bench_now_ns();
+  int fd = open(path, O_RDONLY);
+  ssize_t got = fd < 0 ? -1 : read_full(fd, copy, image_size);
+  if (fd >= 0)
+    close(fd);
+  uint64_t elapsed = bench_now_ns() - start;
+  bench_counters_stop(&counters);
+  bench_report_bytes("shm", got == (ssize_t)image_size ? "private read"
+                                                        : "private read FAILED",
+                     elapsed, image_size, &counters);
+  dfree(copy);
+}
+
+void bench_shm(void) {
+  size_t tokens = bench_size(2000000);
+  bench_corpus_t *corpus =
+      bench_corpus_create(tokens, (uint32_t)(tokens / 20 + 100), 8);
+  train_config_t config = {TRAIN_BACKEND_RADIX, 1, {0, NULL}, NULL};
+  trainer_t *trainer = create_trainer(&config);
+  for (size_t i = 0; i < corpus->num_tokens; ++i)
+    trainer_add_word(trainer, corpus->words[corpus->tokens[i]]);
+  model_t *model = trainer_finish(trainer);
+  free_trainer(trainer);
+  bench_corpus_free(corpus);
+  size_t size = model->image_size;
+  model_save(model, SHM_MODEL_PATH);
+  char name[64];
+  snprintf(name, sizeof name, "/markov_first_bench-%ld", (long)getpid());
+  if (model_publish_shm(model, name) != 0) {
+    free_model(model);
+    unlink(SHM_MODEL_PATH);
+    return;
+  }
+  free_model(model);
+
+  private_read(SHM_MODEL_PATH, size);
+  startup("file mmap", model_load, SHM_MODEL_PATH, size);
+  startup("shm attach", model_attach_shm, name, size);
+
+  /* generators touching the whole model at the same time: each reports
+   * once all of them have mapped it */
+  int ready[2], go[2];
+  if (pipe(ready) != 0 || pipe(go) != 0)
+    return;
+  fflush(NULL);
+  for (int g = 0; g < SHM_GENERATORS; ++g) {
+    if (fork() == 0) {
+      close(go[1]);
+      model_t *m = model_attach_shm(name);
+      volatile uint64_t total = 0;
+      for (uint64_t e = 0; m && e < model_num_edges(m); ++e)
+        total += m->edges[e].count;
+      char c = 'x';
+      if (write(ready[1], &c, 1) != 1 || read(go[0], &c, 1) < 0)
+        _exit(1);
+      printf("shm          generator %d: Pss_Shmem %ld KiB of a %zu KiB "
+             "model\n",
+             g, pss_shmem_kb(), size >> 10);
+      fflush(stdout);
+      free_model(m);
+      _exit(0);
+    }
+  }
+  char c;
+  for (int g = 0; g < SHM_GENERATORS; ++g)
+    if (read(ready[0], &c, 1) != 1)
+      break;
+  close(go[1]); /* end of file: every generator goes */
+  for (int g = 0; g < SHM_GENERATORS; ++g)
+    wait(NULL);
+  close(go[0]);
+  close(ready[0]);
+  close(ready[1]);
+  model_unpublish_shm(name);
+  unlink(SHM_MODEL_PATH);
+}
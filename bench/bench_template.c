@@ -0,0 +1,114 @@
+/*
+ * Generic hash_table_t (void * keys, hash and compare through function
+ * pointers) against tables specialized by ht_template.h: uint32 ID ->
+ * count, and word -> ID as used by the vocabulary.
+ */
+#include "bench.h"
+#include "../include/hash_table.h"
+#include "../include/ht_template.h"
+#include "../include/word.h"
+#include <stdio.h>
+
+HT_GENERATE(bench_counts, uint32_t, uint32_t, ht_hash_u32, HT_EQ_SCALAR)
+HT_GENERATE(bench_words, const int *, uint32_t, ht_hash_codepoints,
+            ht_eq_codepoints)
+
+static unsigned int u32_hash(const void *key, int size) {
+  return ht_hash_u32(*(const uint32_t *)key) % (unsigned int)size;
+}
+
+static int u32_cmp(const void *a, const void *b) {
+  uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+  return (x > y) - (x < y);
+}
+
+static void count_ids(size_t ops, uint32_t distinct) {
+  uint32_t *stream = dmalloc(sizeof(uint32_t) * ops);
+  uint64_t state = 3;
+  for (size_t i = 0; i < ops; ++i)
+    stream[i] = (uint32_t)(bench_rand(&state) % distinct);
+  char label[64];
+
+  /* generic: search, then insert or bump the count kept in the value */
+  hash_table_t *generic = create_hash_table(1024, u32_hash, u32_cmp);
+  bench_counters_t counters;
+  bench_counters_start(&counters);
+  uint64_t start = bench_now_ns();
+  for (size_t i = 0; i < ops; ++i) {
+    ht_item *item = ht_search(generic, &stream[i]);
+    if (item)
+      item->value = (void *)((uintptr_t)item->value + 1);
+    else
+      ht_insert(generic, default_create_ht_item(&stream[i], (void *)1));
+  }
+  uint64_t elapsed = bench_now_ns() - start;
+  bench_counters_stop(&counters);
+  snprintf(label, sizeof label, "u32 count generic (%d keys)",
+           ht_get_count(generic));
+  bench_report("template", label, elapsed, ops, "op", &counters);
+  free_hash_table(generic);
+
+  bench_counts_t counts;
+  bench_counts_init(&counts, 1024);
+  bench_counters_start(&counters);
+  start = bench_now_ns();
+  for (size_t i = 0; i < ops; ++i)
+    (*bench_counts_upsert(&counts, stream[i], NULL))++;
+  elapsed = bench_now_ns() - start;
+  bench_counters_stop(&counters);
+  snprintf(label, sizeof label, "u32 count specialized (%zu keys)",
+           counts.count);
+  bench_report("template", label, elapsed, ops, "op", &counters);
+  bench_counts_destroy(&counts);
+  dfree(stream);
+}
+
+static void lookup_words(const bench_corpus_t *corpus) {
+  char label[64];
+  hash_table_t *generic =
+      create_hash_table(1024, word_hash, word_hashtable_keycmp);
+  word_t *keys = dmalloc(sizeof(word_t) * corpus->num_words);
+  for (uint32_t i = 0; i < corpus->num_words; ++i) {
+    keys[i].word = corpus->words[i];
+    ht_insert(generic, default_create_ht_item(&keys[i], (void *)(uintptr_t)i));
+  }
+  uint64_t sum = 0;
+  bench_counters_t counters;
+  bench_counters_start(&counters);
+  uint64_t start = bench_now_ns();
+  for (size_t t = 0; t < corpus->num_tokens; ++t) {
+    word_t probe = {(int *)corpus->words[corpus->tokens[t]], 0};
+    sum += (uintptr_t)ht_search(generic, &probe)->value;
+  }
+  uint64_t elapsed = bench_now_ns() - start;
+  bench_counters_stop(&counters);
+  bench_report("template", "word lookup generic", elapsed, corpus->num_tokens,
+               "op", &counters);
+  free_hash_table(generic);
+  dfree(keys);
+
+  bench_words_t words;
+  bench_words_init(&words, 1024);
+  for (uint32_t i = 0; i < corpus->num_words; ++i)
+    *bench_words_upsert(&words, corpus->words[i], NULL) = i;
+  uint64_t check = 0;
+  bench_counters_start(&counters);
+  start = bench_now_ns();
+  for (size_t t = 0; t < corpus->num_tokens; ++t)
+    check += *bench_words_find(&words, corpus->words[corpus->tokens[t]]);
+  elapsed = bench_now_ns() - start;
+  bench_counters_stop(&counters);
+  snprintf(label, sizeof label, "word lookup specialized%s",
+           check == sum ? "" : " (MISMATCH)");
+  bench_report("template", label, elapsed, corpus->num_tokens, "op", &counters);
+  bench_words_destroy(&words);
+}
+
+void bench_template(void) {
+  size_t ops = bench_size(4000000);
+  count_ids(ops, (uint32_t)(ops / 8 + 1));
+  bench_corpus_t *corpus =
+      bench_corpus_create(ops, (uint32_t)(ops / 20 + 100), 5);
+  lookup_words(corpus);
+  bench_corpus_free(corpus);
+}
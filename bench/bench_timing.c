@@ -0,0 +1,66 @@
+/*
+ * Cost of the hot path timers: reading the clock, recording a sample
+ * into the calling thread's histogram, and a whole TIMER_START /
+ * TIMER_STOP pair, against clock_gettime; then merging and percentiles.
+ * The functions are called directly, so this runs without TIMERS=1.
+ */
+#include "bench.h"
+#include "../include/timing.h"
+#include <stdio.h>
+
+void bench_timing(void) {
+  size_t n = bench_size(10000000);
+  uint64_t sum = 0;
+  bench_counters_t counters;
+  bench_counters_start(&counters);
+  uint64_t start = bench_now_ns();
+  for (size_t i = 0; i < n; ++i)
+    sum += timing_now();
+  uint64_t elapsed = bench_now_ns() - start;
+  bench_counters_stop(&counters);
+  bench_report("timing", "timing_now", elapsed, n, "call", &counters);
+
+  bench_counters_start(&counters);
+  start = bench_now_ns();
+  for (size_t i = 0; i < n; ++i)
+    sum += monotonic_ns();
+  elapsed = bench_now_ns() - start;
+  bench_counters_stop(&counters);
+  bench_report("timing", "clock_gettime", elapsed, n, "call", &counters);
+
+  timing_reset();
+  uint64_t state = 5;
+  bench_counters_start(&counters);
+  start = bench_now_ns();
+  for (size_t i = 0; i < n; ++i)
+    timing_record(TIMING_DECODE, bench_rand(&state) >> (i & 63));
+  elapsed = bench_now_ns() - start;
+  bench_counters_stop(&counters);
+  bench_report("timing", "timing_record", elapsed, n, "sample", &counters);
+
+  bench_counters_start(&counters);
+  start = bench_now_ns();
+  for (size_t i = 0; i < n; ++i) {
+    uint64_t t = timing_now();
+    timing_record(TIMING_TOKENIZE, timing_now() - t);
+  }
+  elapsed = bench_now_ns() - start;
+  bench_counters_stop(&counters);
+  bench_report("timing", "start/stop pair", elapsed, n, "pair", &counters);
+
+  timing_summary_t s;
+  bench_counters_start(&counters);
+  start = bench_now_ns();
+  for (int r = 0; r < 100; ++r)
+    sum += timing_summary(TIMING_TOKENIZE, &s);
+  elapsed = bench_now_ns() - start;
+  bench_counters_stop(&counters);
+  bench_report("timing", "merge and percentiles", elapsed, 100, "summary",
+               &counters);
+  printf("empty pair: p50 %.1f ns, p99 %.1f ns (%.3f ns/tick)\n",
+         (double)s.p50 * timing_ns_per_tick(),
+         (double)s.p99 * timing_ns_per_tick(), timing_ns_per_tick());
+  timing_reset();
+  if (sum == 42)
+    printf("\n");
+}
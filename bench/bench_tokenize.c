@@ -0,0 +1,86 @@
+/*
+ * Tokenizer throughput on Italian-looking text (accents, apostrophes,
+ * punctuation): tokens/s for the state machine alone and with the tokens
+ * fed to the radix trainer.
+ */
+#include "bench.h"
+#include "../include/tokenizer.h"
+#include "../include/train.h"
+#include "../include/utils.h"
+#include <stdio.h>
+#include <string.h>
+
+static void count_token(void *ctx, const int *token, size_t length) {
+  (void)token;
+  *(uint64_t *)ctx += length;
+}
+
+/* Corpus words with elisions, accented endings and punctuation. */
+static char *make_text(const bench_corpus_t *corpus, size_t *len) {
+  size_t cap = corpus->num_tokens * 24 + 16, used = 0;
+  char *text = dmalloc(cap);
+  uint64_t state = 11;
+  for (size_t t = 0; t < corpus->num_tokens; ++t) {
+    uint64_t r = bench_rand(&state) % 32;
+    if (r == 0)
+      used += (size_t)sprintf(text + used, "l'");
+    else if (r == 1)
+      text[used++] = 'E';
+    const int *w = corpus->words[corpus->tokens[t]];
+    for (int i = 0; w[i] != '\0'; ++i)
+      text[used++] = (char)w[i];
+    if (r == 2)
+      used += (size_t)sprintf(text + used, "\xc3\xa0"); /* à */
+    if (r == 3)
+      text[used++] = ',';
+    else if (r == 4)
+      text[used++] = '.';
+    text[used++] = t % 16 == 15 ? '\n' : ' ';
+  }
+  *len = used;
+  return text;
+}
+
+void bench_tokenize(void) {
+  size_t tokens = bench_size(2000000);
+  bench_corpus_t *corpus =
+      bench_corpus_create(tokens, (uint32_t)(tokens / 20 + 100), 4);
+  size_t len;
+  char *text = make_text(corpus, &len);
+  bench_corpus_free(corpus);
+
+  uint64_t chars = 0;
+  tokenizer_t *tok = create_tokenizer(count_token, &chars);
+  bench_counters_t counters;
+  bench_counters_start(&counters);
+  uint64_t start = bench_now_ns();
+  for (size_t off = 0; off < len; off += 1 << 16)
+    tokenizer_feed_utf8(tok, text + off, len - off < (1 << 16) ? len - off : 1 << 16);
+  tokenizer_finish(tok);
+  uint64_t elapsed = bench_now_ns() - start;
+  bench_counters_stop(&counters);
+  const tokenizer_stats_t *stats = tokenizer_get_stats(tok);
+  uint64_t emitted = stats->words + stats->punct;
+  bench_report("tokenize", "state machine", elapsed, emitted, "tok", &counters);
+  bench_report_bytes("tokenize", "state machine", elapsed, len, &counters);
+  free_tokenizer(tok);
+
+  train_config_t config = {TRAIN_BACKEND_RADIX, 1, {0, NULL}, NULL};
+  trainer_t *trainer = create_trainer(&config);
+  tok = create_tokenizer(tokenizer_train_sink, trainer);
+  bench_counters_start(&counters);
+  start = bench_now_ns();
+  tokenizer_feed_utf8(tok, text, len);
+  tokenizer_finish(tok);
+  model_t *model = trainer_finish(trainer);
+  elapsed = bench_now_ns() - start;
+  bench_counters_stop(&counters);
+  char label[64];
+  snprintf(label, sizeof label, "+ radix training (%llu edges)",
+           (unsigned long long)model_num_edges(model));
+  bench_report("tokenize", label, elapsed, emitted, "tok", &counters);
+  free_model(model);
+  free_tokenizer(tok);
+  free_trainer(trainer);
+  dfree(text);
+}
@@ -0,0 +1,124 @@
+/*
+ * Top-k followers: copying and sorting the row on every query (what a
+ * caller had to do before the rank section) against model_top_followers,
+ * one query at a time and in batches. The queried words follow the token
+ * stream, so the long rows of frequent words dominate as in real use.
+ */
+#include "bench.h"
+#include "../include/train.h"
+#include "../include/utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int cmp_count_desc(const void *a, const void *b) {
+  const model_edge_t *x = a, *y = b;
+  if (x->count != y->count)
+    return (x->count < y->count) - (x->count > y->count);
+  return (x->next > y->next) - (x->next < y->next);
+}
+
+/* The old way: copy, sort by count, take k. */
+static uint32_t sort_top(const model_t *model, uint32_t id, uint32_t k,
+                         model_edge_t *scratch, model_follower_t *out) {
+  uint32_t n;
+  const model_edge_t *row = model_followers(model, id, &n);
+  for (uint32_t i = 0; i < n; ++i)
+    scratch[i] = row[i];
+  qsort(scratch, n, sizeof(model_edge_t), cmp_count_desc);
+  uint64_t total = model_row_total(model, id);
+  if (k > n)
+    k = n;
+  for (uint32_t i = 0; i < k; ++i) {
+    out[i].next = scratch[i].next;
+    out[i].count = scratch[i].count;
+    out[i].probability = (double)scratch[i].count / (double)total;
+  }
+  return k;
+}
+
+void bench_topk(void) {
+  size_t tokens = bench_size(2000000);
+  bench_corpus_t *corpus =
+      bench_corpus_create(tokens, (uint32_t)(tokens / 20 + 100), 9);
+  train_config_t config = {TRAIN_BACKEND_RADIX, 1, {0, NULL}, NULL};
+  trainer_t *trainer = create_trainer(&config);
+  for (size_t i = 0; i < corpus->num_tokens; ++i)
+    trainer_add_word(trainer, corpus->words[corpus->tokens[i]]);
+  bench_counters_t counters;
+  bench_counters_start(&counters);
+  uint64_t start = bench_now_ns();
+  model_t *model = trainer_finish(trainer);
+  uint64_t elapsed = bench_now_ns() - start;
+  bench_counters_stop(&counters);
+  bench_report("topk", "freeze, ranks included", elapsed,
+               model_num_edges(model), "edge", &counters);
+  free_trainer(trainer);
+
+  const model_header_t *h = model->header;
+  uint64_t widest = 0;
+  for (uint32_t id = 0; id < model_num_words(model); ++id) {
+    uint32_t n;
+    model_followers(model, id, &n);
+    if (n > widest)
+      widest = n;
+  }
+  printf("%u words, %llu edges, widest row %llu; ranks and totals: "
+         "%.1f MB of %.1f MB\n",
+         model_num_words(model), (unsigned long long)model_num_edges(model),
+         (unsigned long long)widest,
+         (double)(h->image_size - h->row_totals_off) / 1e6,
+         (double)h->image_size / 1e6);
+
+  size_t queries = bench_size(200000);
+  uint32_t *ids = dmalloc(sizeof(uint32_t) * queries);
+  for (size_t q = 0; q < queries; ++q)
+    ids[q] = model_find(model, corpus->words[corpus->tokens[q * 7 %
+                                                           tokens]]);
+  model_edge_t *scratch = dmalloc(sizeof(model_edge_t) * (widest + 1));
+  static const uint32_t ks[] = {1, 5, 20};
+  model_follower_t *out = dmalloc(sizeof(model_follower_t) * 20 * queries);
+  uint32_t *found = dmalloc(sizeof(uint32_t) * queries);
+  memset(out, 0, sizeof(model_follower_t) * 20 * queries); /* no faults */
+  memset(found, 0, sizeof(uint32_t) * queries);
+  size_t sorted_queries = queries / 100 + 1; /* slow: fewer of them */
+  uint64_t sum = 0;
+  char label[64];
+  for (size_t s = 0; s < sizeof(ks) / sizeof(ks[0]); ++s) {
+    uint32_t k = ks[s];
+    bench_counters_start(&counters);
+    start = bench_now_ns();
+    for (size_t q = 0; q < sorted_queries; ++q)
+      sum += sort_top(model, ids[q], k, scratch, out);
+    snprintf(label, sizeof label, "k=%u sort the row", k);
+    elapsed = bench_now_ns() - start;
+    bench_counters_stop(&counters);
+    bench_report("topk", label, elapsed, sorted_queries, "query", &counters);
+
+    bench_counters_start(&counters);
+    start = bench_now_ns();
+    for (size_t q = 0; q < queries; ++q)
+      sum += model_top_followers(model, ids[q], k, out);
+    snprintf(label, sizeof label, "k=%u ranked", k);
+    elapsed = bench_now_ns() - start;
+    bench_counters_stop(&counters);
+    bench_report("topk", label, elapsed, queries, "query", &counters);
+
+    bench_counters_start(&counters);
+    start = bench_now_ns();
+    model_top_followers_batch(model, ids, queries, k, out, found);
+    snprintf(label, sizeof label, "k=%u ranked, one batch", k);
+    elapsed = bench_now_ns() - start;
+    bench_counters_stop(&counters);
+    bench_report("topk", label, elapsed, queries, "query", &counters);
+    sum += found[queries - 1];
+  }
+  if (sum == 42)
+    printf("\n");
+  dfree(found);
+  dfree(out);
+  dfree(scratch);
+  dfree(ids);
+  free_model(model);
+  bench_corpus_free(corpus);
+}
@@ -0,0 +1,42 @@
+/*
+ * Training backends compared as the corpus grows: the hash_table_t path
+ * (one ht_insert per pair) against the packed-pair radix sort engine.
+ */
+#include "bench.h"
+#include "../include/train.h"
+#include <stdio.h>
+
+static void run_backend(const bench_corpus_t *corpus, train_backend_t backend,
+                        int threads) {
+  train_config_t config = {backend, threads, {0, NULL}, NULL};
+  bench_counters_t counters;
+  bench_counters_start(&counters);
+  uint64_t start = bench_now_ns();
+  trainer_t *trainer = create_trainer(&config);
+  for (size_t i = 0; i < corpus->num_tokens; ++i)
+    trainer_add_word(trainer, corpus->words[corpus->tokens[i]]);
+  model_t *model = trainer_finish(trainer);
+  uint64_t elapsed = bench_now_ns() - start;
+  bench_counters_stop(&counters);
+
+  char label[64];
+  snprintf(label, sizeof label, "%s/%dt %zu tokens (%llu edges)",
+           train_backend_name(backend), threads, corpus->num_tokens,
+           (unsigned long long)model_num_edges(model));
+  bench_report("train", label, elapsed, corpus->num_tokens, "tok", &counters);
+  free_model(model);
+  free_trainer(trainer);
+}
+
+void bench_train(void) {
+  static const size_t sizes[] = {10000, 100000, 300000};
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+    size_t tokens = bench_size(sizes[s]);
+    bench_corpus_t *corpus =
+        bench_corpus_create(tokens, (uint32_t)(tokens / 10 + 100), 1);
+    run_backend(corpus, TRAIN_BACKEND_HASH_TABLE, 1);
+    run_backend(corpus, TRAIN_BACKEND_RADIX, 1);
+    run_backend(corpus, TRAIN_BACKEND_RADIX, 4);
+    bench_corpus_free(corpus);
+  }
+}
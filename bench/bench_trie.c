@@ -0,0 +1,231 @@
+/*
+ * Word dictionaries side by side: the generic hash_table_t keyed by
+ * word_t (word_hash), the specialized vocab_t, binary search over the
+ * sorted IDs of a model, and the radix tree of word_trie.h. Memory is
+ * what malloc hands out while building each one (mallinfo2), plus the
+ * code points of the keys for the hash table, which only points to
+ * them; lookups run over the token stream (hits) and over words with
+ * one letter changed (mostly misses). Ordered iteration is a full
+ * enumeration of the trie against sorting the vocabulary.
+ */
+#define _DEFAULT_SOURCE
+#include "bench.h"
+#include "../include/hash_table.h"
+#include "../include/vocab.h"
+#include "../include/word.h"
+#include "../include/word_trie.h"
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static size_t heap_used(void) {
+  struct mallinfo2 info = mallinfo2();
+  return info.uordblks + info.hblkhd; /* large blocks are mmapped */
+}
+
+static void report_memory(const char *label, size_t bytes, uint32_t words) {
+  printf("%-12s %-40s %10.1f KiB %12.1f B/word\n", "trie", label,
+         (double)bytes / 1024.0, (double)bytes / (words ? words : 1));
+}
+
+static int count_word(void *ctx, const int *word, size_t length,
+                      uint32_t id) {
+  (void)word;
+  *(uint64_t *)ctx += length + id;
+  return 0;
+}
+
+void bench_trie(void) {
+  size_t tokens = bench_size(2000000);
+  bench_corpus_t *corpus =
+      bench_corpus_create(tokens, (uint32_t)(tokens / 10 + 100), 8);
+  uint32_t n = corpus->num_words;
+  const int **words = dmalloc(sizeof(int *) * n);
+  size_t key_bytes = 0;
+  for (uint32_t i = 0; i < n; ++i) {
+    words[i] = corpus->words[i];
+    size_t len = 0;
+    while (words[i][len])
+      len++;
+    key_bytes += sizeof(int) * (len + 1);
+  }
+  /* probes: every word with its first letter changed */
+  int **misses = dmalloc(sizeof(int *) * n);
+  for (uint32_t i = 0; i < n; ++i) {
+    size_t len = 0;
+    while (words[i][len])
+      len++;
+    misses[i] = dmalloc(sizeof(int) * (len + 1));
+    memcpy(misses[i], words[i], sizeof(int) * (len + 1));
+    misses[i][0] = misses[i][0] == 'z' ? 'y' : 'z';
+  }
+  printf("%u distinct words, %zu lookups\n", n, corpus->num_tokens);
+
+  /* build */
+  size_t before = heap_used();
+  bench_counters_t counters;
+  bench_counters_start(&counters);
+  uint64_t start = bench_now_ns();
+  hash_table_t *table =
+      create_hash_table(1024, word_hash, word_hashtable_keycmp);
+  word_t *keys = dmalloc(sizeof(word_t) * n);
+  for (uint32_t i = 0; i < n; ++i) {
+    keys[i].word = (int *)words[i];
+    ht_insert(table, default_create_ht_item(&keys[i], (void *)(uintptr_t)i));
+  }
+  uint64_t elapsed = bench_now_ns() - start;
+  bench_counters_stop(&counters);
+  bench_report("trie", "build word_hash table", elapsed, n, "word", &counters);
+  size_t table_bytes = heap_used() - before + key_bytes;
+
+  before = heap_used();
+  bench_counters_start(&counters);
+  start = bench_now_ns();
+  vocab_t *vocab = create_vocab(1024);
+  for (uint32_t i = 0; i < n; ++i)
+    vocab_intern(vocab, words[i]);
+  elapsed = bench_now_ns() - start;
+  bench_counters_stop(&counters);
+  bench_report("trie", "build vocab", elapsed, n, "word", &counters);
+  size_t vocab_heap = heap_used() - before;
+
+  before = heap_used();
+  bench_counters_start(&counters);
+  start = bench_now_ns();
+  word_trie_t *trie = create_word_trie(words, NULL, n);
+  elapsed = bench_now_ns() - start;
+  bench_counters_stop(&counters);
+  bench_report("trie", "build radix tree", elapsed, n, "word", &counters);
+  size_t trie_heap = heap_used() - before;
+
+  uint64_t *rows = dmalloc(sizeof(uint64_t) * ((size_t)n + 1));
+  model_edge_t no_edges[1];
+  model_t *model = model_build(vocab, rows, no_edges);
+  dfree(rows);
+  size_t model_bytes = model->header->edges_off - model->header->pool_off;
+
+  report_memory("word_hash table (+ keys)", table_bytes, n);
+  report_memory("vocab", vocab_heap, n);
+  report_memory("model pool + offsets + sorted IDs", model_bytes, n);
+  report_memory("radix tree", trie_heap, n);
+  printf("%-12s %-40s %10.1f KiB (word_trie_bytes)\n", "trie",
+         "radix tree, counted", word_trie_bytes(trie) / 1024.0);
+
+  /* lookups */
+  uint64_t sum = 0;
+  bench_counters_start(&counters);
+  start = bench_now_ns();
+  for (size_t t = 0; t < corpus->num_tokens; ++t) {
+    word_t probe = {corpus->words[corpus->tokens[t]], 0};
+    sum += (uintptr_t)ht_search(table, &probe)->value;
+  }
+  elapsed = bench_now_ns() - start;
+  bench_counters_stop(&counters);
+  bench_report("trie", "hit: word_hash table", elapsed, corpus->num_tokens,
+               "op", &counters);
+  bench_counters_start(&counters);
+  start = bench_now_ns();
+  for (size_t t = 0; t < corpus->num_tokens; ++t)
+    sum += vocab_find(vocab, corpus->words[corpus->tokens[t]]);
+  elapsed = bench_now_ns() - start;
+  bench_counters_stop(&counters);
+  bench_report("trie", "hit: vocab", elapsed, corpus->num_tokens, "op",
+               &counters);
+  bench_counters_start(&counters);
+  start = bench_now_ns();
+  for (size_t t = 0; t < corpus->num_tokens; ++t)
+    sum += model_find(model, corpus->words[corpus->tokens[t]]);
+  elapsed = bench_now_ns() - start;
+  bench_counters_stop(&counters);
+  bench_report("trie", "hit: model binary search", elapsed, corpus->num_tokens,
+               "op", &counters);
+  bench_counters_start(&counters);
+  start = bench_now_ns();
+  for (size_t t = 0; t < corpus->num_tokens; ++t)
+    sum += word_trie_find(trie, corpus->words[corpus->tokens[t]]);
+  elapsed = bench_now_ns() - start;
+  bench_counters_stop(&counters);
+  bench_report("trie", "hit: radix tree", elapsed, corpus->num_tokens, "op",
+               &counters);
+
+  size_t rounds = corpus->num_tokens / n + 1;
+  bench_counters_start(&counters);
+  start = bench_now_ns();
+  for (size_t r = 0; r < rounds; ++r)
+    for (uint32_t i = 0; i < n; ++i) {
+      word_t probe = {misses[i], 0};
+      sum += ht_search(table, &probe) != NULL;
+    }
+  elapsed = bench_now_ns() - start;
+  bench_counters_stop(&counters);
+  bench_report("trie", "miss: word_hash table", elapsed, rounds * n, "op",
+               &counters);
+  bench_counters_start(&counters);
+  start = bench_now_ns();
+  for (size_t r = 0; r < rounds; ++r)
+    for (uint32_t i = 0; i < n; ++i)
+      sum += vocab_find(vocab, misses[i]);
+  elapsed = bench_now_ns() - start;
+  bench_counters_stop(&counters);
+  bench_report("trie", "miss: vocab", elapsed, rounds * n, "op", &counters);
+  bench_counters_start(&counters);
+  start = bench_now_ns();
+  for (size_t r = 0; r < rounds; ++r)
+    for (uint32_t i = 0; i < n; ++i)
+      sum += model_find(model, misses[i]);
+  elapsed = bench_now_ns() - start;
+  bench_counters_stop(&counters);
+  bench_report("trie", "miss: model binary search", elapsed, rounds * n, "op",
+               &counters);
+  bench_counters_start(&counters);
+  start = bench_now_ns();
+  for (size_t r = 0; r < rounds; ++r)
+    for (uint32_t i = 0; i < n; ++i)
+      sum += word_trie_find(trie, misses[i]);
+  elapsed = bench_now_ns() - start;
+  bench_counters_stop(&counters);
+  bench_report("trie", "miss: radix tree", elapsed, rounds * n, "op",
+               &counters);
+
+  /* ordered iteration */
+  bench_counters_start(&counters);
+  start = bench_now_ns();
+  uint32_t *sorted = vocab_sorted_ids(vocab);
+  elapsed = bench_now_ns() - start;
+  bench_counters_stop(&counters);
+  bench_report("trie", "in order: sort the vocab", elapsed, n, "word",
+               &counters);
+  dfree(sorted);
+  bench_counters_start(&counters);
+  start = bench_now_ns();
+  word_trie_prefix(trie, NULL, count_word, &sum);
+  elapsed = bench_now_ns() - start;
+  bench_counters_stop(&counters);
+  bench_report("trie", "in order: walk the radix tree", elapsed, n, "word",
+               &counters);
+  int prefix[3] = {words[0][0], words[0][1], '\0'};
+  bench_counters_start(&counters);
+  start = bench_now_ns();
+  size_t found = 0;
+  for (int r = 0; r < 100; ++r)
+    found += word_trie_prefix(trie, prefix, count_word, &sum);
+  char label[64];
+  snprintf(label, sizeof label, "prefix of 2 (%zu words)", found / 100);
+  elapsed = bench_now_ns() - start;
+  bench_counters_stop(&counters);
+  bench_report("trie", label, elapsed, found, "word", &counters);
+  if (sum == 42)
+    printf("\n"); /* keep the lookups */
+
+  free_model(model);
+  free_word_trie(trie);
+  free_vocab(vocab);
+  free_hash_table(table);
+  dfree(keys);
+  for (uint32_t i = 0; i < n; ++i)
+    dfree(misses[i]);
+  dfree(misses);
+  dfree(words);
+  bench_corpus_free(corpus);
+}
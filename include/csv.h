@@ -0,0 +1,63 @@
+#ifndef CSV_H
+#define CSV_H
+
+#include "model.h"
+#include <stdint.h>
+
+/*
+ * Text export of the transition table: one line per (word, follower) edge,
+ *
+ *   word,follower,count        or        word,follower,probability
+ *
+ * with fields quoted as in RFC 4180 when they contain the separator, a
+ * double quote or a line break (punctuation tokens such as "," do).
+ * Probabilities are count / row total with six decimals, computed in
+ * integer arithmetic.
+ *
+ * Words are UTF-8 encoded once up front; the rows are then split into
+ * shards of about the same number of edges. Each shard is sized exactly,
+ * so every thread knows its file offset and formats into its own large
+ * buffer, written with pwrite: the output is identical whatever the number
+ * of threads.
+ */
+
+typedef enum { CSV_VALUE_COUNT, CSV_VALUE_PROBABILITY } csv_value_t;
+
+typedef struct {
+  char separator;    /* ',' for CSV, '\t' for TSV */
+  csv_value_t value; /* third column */
+  int header;        /* write a "word,follower,count" line first */
+  int threads;       /* formatting threads (<= 1: calling thread only) */
+} csv_export_config_t;
+
+/* config may be NULL: CSV with counts and a header, one thread.
+ * Returns the number of bytes written, or -1 on error. */
+int64_t model_export_csv(const model_t *model, const char *path,
+                         const csv_export_config_t *config);
+
+/*
+ * Import of a "word,follower,count" file (as written above with counts)
+ * back into a frozen model, without retokenizing the corpus.
+ *
+ * The file is mapped and cut into line-aligned chunks parsed in parallel;
+ * each worker interns the words of its chunk into a private span table
+ * and emits (local word, local follower, count) records. The private
+ * dictionaries are then merged in file order, so word IDs follow the
+ * first appearance in the file whatever the number of threads, and the
+ * follower rows are built in bulk with a counting sort on the word.
+ * Repeated (word, follower) lines are summed.
+ *
+ * Errors are reported on stderr as "path:line: message" (the first one in
+ * file order) and make the import return NULL. Quoted fields may contain
+ * the separator and doubled quotes but not line breaks.
+ */
+
+typedef struct {
+  char separator; /* ',' or '\t'; 0 detects it from the first line */
+  int threads;    /* parsing threads (<= 1: calling thread only) */
+} csv_import_config_t;
+
+/* config may be NULL: detect the separator, one thread. */
+model_t *model_import_csv(const char *path, const csv_import_config_t *config);
+
+#endif /* CSV_H */
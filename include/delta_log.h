@@ -0,0 +1,92 @@
+#ifndef DELTA_LOG_H
+#define DELTA_LOG_H
+
+#include "model.h"
+#include <stdint.h>
+
+/*
+ * Incremental updates of a saved model: instead of training again on the
+ * whole corpus, (word, follower, count delta) updates are appended to a
+ * log next to the base model (model.delta by convention), so an update
+ * costs in proportion to the new data, whatever the size of the model.
+ *
+ *   header  | batch | batch | ...
+ *   header: u32 magic "MKD1", u32 version, u32 base fingerprint, u32 0
+ *   batch:  u32 magic "MKDB", u32 CRC-32C of everything after it,
+ *           u32 words, u32 records, u64 payload bytes,
+ *           payload: the words (NUL terminated code points, back to back)
+ *           then the records {u32 word, u32 next, i64 delta}, word and
+ *           next indexing the words of the batch
+ *
+ * Updates collect in memory, summed by pair, until delta_log_commit
+ * writes them as one batch with a single write and fdatasync. A batch cut
+ * short by a crash fails its checksum: opening the log for appending
+ * truncates it, loading ignores it (with a warning).
+ *
+ * The fingerprint (CRC-32C of the base header and row totals) ties the
+ * log to the base it was written against; a log that does not match is
+ * refused rather than applied to the wrong counts.
+ *
+ * Loading maps the base and, if the log holds anything, builds a new
+ * model with the deltas summed in: new words get the IDs after the base
+ * ones, edges whose count drops to 0 or below are removed, counts above
+ * UINT32_MAX are clamped.
+ *
+ * Compaction folds the log into a new base. It runs on a thread of its
+ * own while updates go on: the batches committed when it starts are
+ * merged with the base into model.compact; then, with updates held for
+ * a moment, the batches committed since are copied to a new log bound to
+ * the new base and both files are renamed over the old ones. One process
+ * at a time may append to a log.
+ */
+
+#define DELTA_LOG_MAGIC 0x31444B4Du       /* "MKD1" little endian */
+#define DELTA_LOG_BATCH_MAGIC 0x42444B4Du /* "MKDB" */
+#define DELTA_LOG_VERSION 1u
+
+typedef struct {
+  uint64_t batches; /* valid batches applied */
+  uint64_t records; /* (word, follower) deltas applied */
+  uint64_t bytes;   /* log bytes applied, header included */
+  uint64_t ignored; /* bytes of a torn or corrupted tail */
+} delta_log_stats_t;
+
+typedef struct delta_log delta_log_t;
+
+/* Open the log at path for appending, creating it if missing. base is the
+ * model the log belongs to. Returns NULL on error. */
+delta_log_t *delta_log_open(const char *path, const model_t *base);
+
+/* Add delta to the count of word -> next (code points, taken as they are)
+ * in the pending batch. Returns 0 or -1. */
+int delta_log_add(delta_log_t *log, const int *word, const int *next,
+                  int64_t delta);
+
+/* Add every edge of model (e.g. one trained on the new text only). */
+int delta_log_add_model(delta_log_t *log, const model_t *model);
+
+/* Write the pending updates as one batch and sync it. Nothing pending is
+ * not an error. Returns 0 or -1. */
+int delta_log_commit(delta_log_t *log);
+
+/* Commit, wait for a compaction in progress and free log. Returns 0 or
+ * -1 if either failed. */
+int delta_log_close(delta_log_t *log);
+
+/* Start folding the log into model_path (the base it was opened with) on
+ * a background thread. Returns 0, or -1 if one is already running. */
+int delta_log_compact_start(delta_log_t *log, const char *model_path);
+
+/* Wait for the compaction started last. Returns its result, 0 or -1. */
+int delta_log_compact_wait(delta_log_t *log);
+
+/* The base at model_path with the log at log_path applied. Without a log
+ * (or an empty one) it is the mapped base itself. stats may be NULL.
+ * Returns NULL on error. */
+model_t *delta_log_load(const char *model_path, const char *log_path,
+                        delta_log_stats_t *stats);
+
+/* Identifies a base model for its logs. */
+uint32_t delta_log_fingerprint(const model_t *base);
+
+#endif /* DELTA_LOG_H */
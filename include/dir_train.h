@@ -0,0 +1,52 @@
+#ifndef DIR_TRAIN_H
+#define DIR_TRAIN_H
+
+#include "model.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Training on whole directory trees with several threads.
+ *
+ * The roots are walked recursively (entries in strcmp order, symbolic
+ * links skipped) and every regular file is a corpus of its own, as with
+ * "train model file ...". The work is cut into units of about chunk_bytes:
+ * a large file is split into several chunks, small files are grouped
+ * into one unit. A chunk boundary is moved forward to just after an
+ * ASCII white space byte, where the tokenizer is always between tokens
+ * and no UTF-8 sequence can be cut, so every chunk tokenizes exactly like
+ * that part of the whole file.
+ *
+ * Every worker starts with a contiguous share of the units (by bytes);
+ * one that runs out steals half of what is left to the most loaded one,
+ * so a few huge files cannot leave the other threads idle. Each worker
+ * counts into its own RADIX trainer. The pairs that straddle two chunks
+ * of a file are added from the first and last token of every chunk, then
+ * the trainers are merged with trainer_merge: the model is the one of
+ * training the files one by one, with words numbered in code point
+ * order, identical whatever the number of threads and the scheduling.
+ */
+
+typedef struct {
+  int threads;        /* workers, also used for the merge (0: 1) */
+  size_t chunk_bytes; /* bytes per unit of work (0: 1 MiB) */
+} dir_train_config_t;
+
+typedef struct {
+  uint64_t files;
+  uint64_t bytes;
+  uint64_t chunks;  /* pieces of files tokenized separately */
+  uint64_t units;   /* units of work: one chunk or a group of small files */
+  uint64_t steals;  /* successful steals, all workers */
+  uint64_t tokens;
+  uint64_t invalid; /* malformed UTF-8 sequences */
+  uint64_t elapsed_ns;
+} dir_train_stats_t;
+
+/* Train on every regular file under the roots (files or directories).
+ * config and stats may be NULL. Returns the model or NULL on error. */
+model_t *dir_train(const char *const *roots, int n,
+                   const dir_train_config_t *config,
+                   dir_train_stats_t *stats);
+
+#endif /* DIR_TRAIN_H */
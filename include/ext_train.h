@@ -0,0 +1,58 @@
+#ifndef EXT_TRAIN_H
+#define EXT_TRAIN_H
+
+#include "vocab.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * External-memory training for corpora whose follower table does not fit in
+ * RAM. Only the vocabulary is kept in memory: every (word ID, follower ID)
+ * pair is packed into a uint64_t and buffered; when the buffer reaches the
+ * memory budget it is sorted, collapsed into (pair, count) records and
+ * spilled to a temporary run file. ext_trainer_finish k-way merges the runs
+ * (in several passes if there are too many to merge at once) and streams the
+ * counted edges straight into a model file (see model.h).
+ *
+ * All run and model I/O is sequential, through large buffers.
+ */
+
+#define EXT_TRAIN_DEFAULT_BUDGET ((size_t)256 << 20) /* 256 MiB */
+
+typedef struct {
+  size_t mem_budget;   /* cap for pair buffer + vocabulary + merge buffers */
+  const char *tmp_dir; /* where runs are spilled; NULL means "/tmp" */
+} ext_train_config_t;
+
+typedef struct {
+  uint64_t tokens;        /* words received */
+  uint64_t pairs;         /* (word, follower) pairs counted */
+  uint32_t runs;          /* run files spilled while reading */
+  uint32_t merge_passes;  /* intermediate passes needed before the last */
+  uint64_t bytes_spilled; /* bytes written to run files, all passes */
+  uint64_t edges;         /* distinct pairs in the final model */
+  long peak_rss_kb;       /* ru_maxrss when the model was written */
+  int over_budget;        /* the vocabulary alone exceeded mem_budget */
+} ext_train_stats_t;
+
+typedef struct ext_trainer ext_trainer_t;
+
+/* config may be NULL for the defaults. */
+ext_trainer_t *create_ext_trainer(const ext_train_config_t *config);
+
+/* Feed the next word of the corpus (already normalised by the caller). */
+void ext_trainer_add_word(ext_trainer_t *trainer, const int *word);
+
+/* End of a chain (document boundary): the next word gets no predecessor. */
+void ext_trainer_break(ext_trainer_t *trainer);
+
+/* Merge the runs and write the model to model_path. Returns 0 on success,
+ * -1 on error. The trainer must still be released with free_ext_trainer. */
+int ext_trainer_finish(ext_trainer_t *trainer, const char *model_path);
+
+const ext_train_stats_t *ext_trainer_get_stats(const ext_trainer_t *trainer);
+const vocab_t *ext_trainer_get_vocab(const ext_trainer_t *trainer);
+
+void free_ext_trainer(ext_trainer_t *trainer);
+
+#endif /* EXT_TRAIN_H */
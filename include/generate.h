@@ -0,0 +1,60 @@
+#ifndef GENERATE_H
+#define GENERATE_H
+
+#include "model.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Text generation from a frozen model. The model is only read, so any
+ * number of generators (threads or processes attached to one shared
+ * memory copy, see model_attach_shm) can use it at the same time; each
+ * one keeps its own random state.
+ *
+ * The follower of a word is drawn with probability count / row total.
+ *
+ * Beam search instead looks for the most probable continuation: at every
+ * step only the width best partial sequences (hypotheses) are kept. They
+ * live in an arena owned by a generate_beam_t, one level of width slots
+ * per step with a link to the parent, and the candidates of a step go
+ * through a bounded heap of width entries, so a search allocates nothing
+ * per expansion. The followers of a hypothesis are taken from the most
+ * frequent down (the model's ranks) and the scan stops as soon as one
+ * cannot enter the heap, so a step costs far less than width times the
+ * row length. Results are deterministic: equal scores are ordered by word
+ * ID, then by parent.
+ */
+
+/* xorshift64* step; a zero state is replaced by a fixed seed. */
+uint64_t generate_rand(uint64_t *state);
+
+/* A random follower of id, or VOCAB_NO_ID if id has none. */
+uint32_t generate_next(const model_t *model, uint32_t id, uint64_t *state);
+
+/* Random walk from start: the IDs of up to max following words go to out
+ * (start itself is not included). Stops early at a word without
+ * followers. Returns the number of IDs written. */
+size_t generate_walk(const model_t *model, uint32_t start, uint32_t *out,
+                     size_t max, uint64_t *state);
+
+typedef struct generate_beam generate_beam_t;
+
+/* Scratch for beam searches of the given width; the arena is sized for
+ * length words and grows if a search asks for more. A beam serves one
+ * search at a time. */
+generate_beam_t *create_generate_beam(uint32_t width, size_t length);
+void free_generate_beam(generate_beam_t *beam);
+
+/* Most probable continuation of start found with the beam: up to max IDs
+ * go to out (start not included). The search stops early when no
+ * hypothesis can be extended; hypotheses that reach a word without
+ * followers are dropped. log_prob (may be NULL) receives the natural log
+ * of the probability of the sequence. Returns the number of IDs written. */
+size_t generate_beam_search(generate_beam_t *beam, const model_t *model,
+                            uint32_t start, uint32_t *out, size_t max,
+                            double *log_prob);
+
+/* Candidates considered by the last search (heap pushes and attempts). */
+uint64_t generate_beam_expansions(const generate_beam_t *beam);
+
+#endif /* GENERATE_H */
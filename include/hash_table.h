@@ -12,27 +12,78 @@ typedef struct {
   int count;               /* number of stored items  */
   unsigned int (*hash_func)(const void *key, int size); /* key -> hash */
   int (*key_cmp)(const void *key1, const void *key2);   /* key compare */
+  ll_pool_t *pool; /* chain nodes of every bucket */
+  const ht_item_ops_t *ops; /* update / free of every item */
 } hash_table_t;
 
-/* Allocate a new table; initial_size is rounded up to the next prime. */
+/* Allocate a new table; initial_size is rounded up to the next prime. The
+ * items get ht_default_item_ops. */
 hash_table_t *create_hash_table(int initial_size,
                                 unsigned int (*hash_func)(const void *, int),
                                 int (*key_cmp)(const void *, const void *));
 
-/* Insert a new item. If the key already exists, the stored
- * ht_item->update_value function is invoked and the *item* passed to ht_insert
- * is freed. */
+/* Same, with the item operations of the table (which must outlive it). */
+hash_table_t *create_hash_table_ops(int initial_size,
+                                    unsigned int (*hash_func)(const void *,
+                                                              int),
+                                    int (*key_cmp)(const void *, const void *),
+                                    const ht_item_ops_t *ops);
+
+/* Insert a new item, caching the hash of its key in item->hash. If the key
+ * already exists, ops->update_value is invoked on the stored item and the
+ * *item* passed to ht_insert is freed with ops->free_item. */
 void ht_insert(hash_table_t *table, ht_item *item);
 
 /* Search an item by key; returns NULL if not found. */
 ht_item *ht_search(const hash_table_t *table, const void *key);
 
-/* Remove an item and optionally free it (set free_item to NULL to skip). */
+/* Remove an item and free it with ops->free_item (if not NULL). */
 int ht_remove(hash_table_t *table, const void *key);
 
-/* Destroy the entire table; free_item is applied to every stored item. */
+/* Destroy the entire table; ops->free_item is applied to every stored item. */
 void free_hash_table(hash_table_t *table);
 
+/*
+ * Batched versions of ht_insert / ht_search. Keys are processed in groups
+ * of HT_BATCH_GROUP: all the hashes of a group are computed first and the
+ * bucket slots, bucket lists and first chain nodes are prefetched in
+ * successive passes, so the cache misses of the group overlap instead of
+ * being paid one key at a time. The results are the same as calling the
+ * scalar function on each element in order (duplicate keys inside a batch
+ * included).
+ */
+#define HT_BATCH_GROUP 16
+
+void ht_insert_batch(hash_table_t *table, ht_item **items, int n);
+
+/* out[i] receives the item for keys[i], or NULL. */
+void ht_search_batch(const hash_table_t *table, const void *const *keys,
+                     int n, ht_item **out);
+
+/*
+ * Cursor over the items of a table, or of the buckets [begin, end) only:
+ * disjoint ranges visit disjoint items, so a pass can be split between
+ * threads (ht_partition computes the ranges). The iterator lives on the
+ * caller's stack and never allocates. Inserting (which may resize) or
+ * removing items invalidates it.
+ */
+typedef struct {
+  const hash_table_t *table;
+  int bucket; /* next bucket to enter */
+  int end;    /* one past the last bucket */
+  ll_item_t *node;
+} ht_iter_t;
+
+void ht_iter_init(ht_iter_t *it, const hash_table_t *table);
+void ht_iter_init_range(ht_iter_t *it, const hash_table_t *table, int begin,
+                        int end);
+/* Next item, or NULL when the range is exhausted. */
+ht_item *ht_iter_next(ht_iter_t *it);
+
+/* Bucket range [*begin, *end) of part number part out of parts. */
+void ht_partition(const hash_table_t *table, int part, int parts, int *begin,
+                  int *end);
+
 int ht_get_count(const hash_table_t *table);
 int ht_get_size(const hash_table_t *table);
 
@@ -1,19 +1,41 @@
-#ifndef HT_ITEM_H
-#define HT_ITEM_H
-
-typedef struct ht_item ht_item;
-typedef void (*update_value_func_t)(const void *item, const void *new_value);
-typedef void (*free_item_func_t)(ht_item *item);
-struct ht_item {
-  void *key;                        // Pointer to the key
-  void *value;                      // Pointer to the value
-  update_value_func_t update_value; // Function to update the value
-  free_item_func_t free_item;       // Function to free the item
-};
-
-ht_item *default_create_ht_item(void *key, void *value);
-void *get_ht_item_key(const ht_item *item);
-void *get_ht_item_value(const ht_item *item);
-void free_ht_item(ht_item *item);
-void default_free_ht_item(ht_item *item); 
-#endif
+#ifndef HT_ITEM_H
+#define HT_ITEM_H
+
+#include <limits.h>
+
+typedef struct ht_item ht_item;
+typedef void (*update_value_func_t)(const void *item, const void *new_value);
+typedef void (*free_item_func_t)(ht_item *item);
+struct ht_item {
+  void *key;         // Pointer to the key
+  void *value;       // Pointer to the value
+  unsigned int hash; // hash_func(key, HT_HASH_RANGE), set by the table
+};
+
+/*
+ * What a table does with its items, shared by every item of the table
+ * instead of being stored in each of them:
+ *   update_value: ht_insert of an existing key hands it the value of the
+ *                 redundant item, which is then freed with free_item;
+ *   free_item:    releases an item (key and value included if the item
+ *                 owns them); NULL: the table never frees items.
+ */
+typedef struct {
+  update_value_func_t update_value;
+  free_item_func_t free_item;
+} ht_item_ops_t;
+
+/* Range passed to the hash function for the cached hash: 2^31 - 1 is prime,
+ * so hash functions ending in "% size" keep their spread. Bucket indexes are
+ * derived from the cached hash, which resizing never recomputes. */
+#define HT_HASH_RANGE INT_MAX
+
+/* Replace the value pointer, free the item only. */
+extern const ht_item_ops_t ht_default_item_ops;
+
+ht_item *default_create_ht_item(void *key, void *value);
+void *get_ht_item_key(const ht_item *item);
+void *get_ht_item_value(const ht_item *item);
+void default_update_value(const void *item, const void *new_value);
+void default_free_ht_item(ht_item *item);
+#endif
@@ -0,0 +1,218 @@
+#ifndef HT_TEMPLATE_H
+#define HT_TEMPLATE_H
+
+#include "timing.h"
+#include "utils.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Type specialized hash tables stamped out by a macro, for the hot paths
+ * where hash_table_t's void * keys and hash_func / key_cmp pointers get in
+ * the way: with the key type and the hash / equality known at compile
+ * time both are inlined. hash_table_t stays the general purpose table.
+ *
+ *   HT_GENERATE(count_table, uint32_t, uint32_t, ht_hash_u32, HT_EQ_SCALAR)
+ *
+ * defines count_table_t and static inline functions:
+ *
+ *   void        count_table_init(count_table_t *t, size_t initial);
+ *   void        count_table_destroy(count_table_t *t);
+ *   uint32_t   *count_table_find(const count_table_t *t, uint32_t key);
+ *   uint32_t   *count_table_upsert(count_table_t *t, uint32_t key, int *added);
+ *   count_table_entry_t *count_table_upsert_entry(count_table_t *t,
+ *                                                 uint32_t key, int *added);
+ *   int         count_table_remove(count_table_t *t, uint32_t key); (1/0)
+ *   int         count_table_next(const count_table_t *t, size_t *pos,
+ *                                uint32_t *key, uint32_t **value);
+ *
+ * upsert returns the value slot of key, adding it (value zeroed, *added
+ * set to 1 if added is not NULL) when missing; the key is stored by value,
+ * so pointer keys must outlive the table. upsert_entry does the same and
+ * returns the whole entry, whose key the caller may replace by an equal
+ * one (same hash, eq_fn true), say a copy the table should keep instead
+ * of a caller's buffer. Pointers into the table are valid until the next
+ * upsert or remove. next iterates: start with *pos = 0, it returns 0 at
+ * the end.
+ *
+ * Layout: open addressing with linear probing over a power of two number
+ * of slots, at most 3/4 full, removal by backward shift (no tombstones).
+ * A parallel array keeps the 32 bit hash of every slot (0 = empty), so
+ * probes compare hashes before keys and growing never rehashes keys.
+ */
+
+static inline uint32_t ht_hash_u32(uint32_t x) {
+  x ^= x >> 16;
+  x *= 0x7FEB352Du;
+  x ^= x >> 15;
+  x *= 0x846CA68Bu;
+  x ^= x >> 16;
+  return x;
+}
+
+static inline uint32_t ht_hash_u64(uint64_t x) {
+  x ^= x >> 33;
+  x *= 0xFF51AFD7ED558CCDULL;
+  x ^= x >> 33;
+  return (uint32_t)x;
+}
+
+/* FNV-1a over the code points of a NUL terminated word. */
+static inline uint32_t ht_hash_codepoints(const int *word) {
+  uint32_t h = 2166136261u;
+  for (; *word != '\0'; ++word)
+    h = (h ^ (uint32_t)*word) * 16777619u;
+  return h;
+}
+
+static inline int ht_eq_codepoints(const int *a, const int *b) {
+  while (*a != '\0' && *a == *b) {
+    a++;
+    b++;
+  }
+  return *a == *b;
+}
+
+#define HT_EQ_SCALAR(a, b) ((a) == (b))
+
+#define HT_GENERATE(name, key_type, value_type, hash_fn, eq_fn)                \
+  typedef struct {                                                             \
+    key_type key;                                                              \
+    value_type value;                                                          \
+  } name##_entry_t;                                                            \
+                                                                               \
+  typedef struct {                                                             \
+    name##_entry_t *entries;                                                   \
+    uint32_t *hashes; /* 0: empty slot */                                      \
+    size_t mask;      /* slots - 1 */                                          \
+    size_t count;                                                              \
+  } name##_t;                                                                  \
+                                                                               \
+  static inline uint32_t name##_hash(key_type key) {                           \
+    uint32_t h = (uint32_t)(hash_fn(key));                                     \
+    return h ? h : 1;                                                          \
+  }                                                                            \
+                                                                               \
+  static inline void name##_init(name##_t *t, size_t initial) {                \
+    size_t slots = 16;                                                         \
+    while (slots * 3 < initial * 4)                                            \
+      slots *= 2;                                                              \
+    t->entries = dmalloc_tag(sizeof(name##_entry_t) * slots, MEM_BUCKETS);     \
+    t->hashes = dmalloc_tag(sizeof(uint32_t) * slots, MEM_BUCKETS);            \
+    t->mask = slots - 1;                                                       \
+    t->count = 0;                                                              \
+  }                                                                            \
+                                                                               \
+  static inline void name##_destroy(name##_t *t) {                             \
+    dfree(t->entries);                                                         \
+    dfree(t->hashes);                                                          \
+    t->entries = NULL;                                                         \
+    t->hashes = NULL;                                                          \
+    t->count = 0;                                                              \
+  }                                                                            \
+                                                                               \
+  static inline value_type *name##_find(const name##_t *t, key_type key) {     \
+    uint32_t h = name##_hash(key);                                             \
+    for (size_t i = h & t->mask;; i = (i + 1) & t->mask) {                     \
+      if (t->hashes[i] == 0)                                                   \
+        return NULL;                                                           \
+      if (t->hashes[i] == h && eq_fn(t->entries[i].key, key))                  \
+        return &t->entries[i].value;                                           \
+    }                                                                          \
+  }                                                                            \
+                                                                               \
+  static inline void name##_grow(name##_t *t) {                                \
+    TIMER_START(grow_start);                                                   \
+    size_t old_slots = t->mask + 1, slots = old_slots * 2;                     \
+    name##_entry_t *entries = t->entries;                                      \
+    uint32_t *hashes = t->hashes;                                              \
+    t->entries = dmalloc_tag(sizeof(name##_entry_t) * slots, MEM_BUCKETS);     \
+    t->hashes = dmalloc_tag(sizeof(uint32_t) * slots, MEM_BUCKETS);            \
+    t->mask = slots - 1;                                                       \
+    for (size_t j = 0; j < old_slots; ++j) {                                   \
+      if (hashes[j] == 0)                                                      \
+        continue;                                                              \
+      size_t i = hashes[j] & t->mask;                                          \
+      while (t->hashes[i] != 0)                                                \
+        i = (i + 1) & t->mask;                                                 \
+      t->hashes[i] = hashes[j];                                                \
+      t->entries[i] = entries[j];                                              \
+    }                                                                          \
+    dfree(entries);                                                            \
+    dfree(hashes);                                                             \
+    TIMER_STOP(TIMING_RESIZE, grow_start);                                     \
+  }                                                                            \
+                                                                               \
+  static inline name##_entry_t *name##_upsert_entry(                           \
+      name##_t *t, key_type key, int *added) {                                 \
+    uint32_t h = name##_hash(key);                                             \
+    size_t i = h & t->mask;                                                    \
+    for (; t->hashes[i] != 0; i = (i + 1) & t->mask) {                         \
+      if (t->hashes[i] == h && eq_fn(t->entries[i].key, key)) {                \
+        if (added)                                                             \
+          *added = 0;                                                          \
+        return &t->entries[i];                                                 \
+      }                                                                        \
+    }                                                                          \
+    if ((t->count + 1) * 4 > (t->mask + 1) * 3) {                              \
+      name##_grow(t);                                                          \
+      for (i = h & t->mask; t->hashes[i] != 0; i = (i + 1) & t->mask)          \
+        ;                                                                      \
+    }                                                                          \
+    t->hashes[i] = h;                                                          \
+    t->entries[i].key = key;                                                   \
+    memset(&t->entries[i].value, 0, sizeof(value_type));                       \
+    t->count++;                                                                \
+    if (added)                                                                 \
+      *added = 1;                                                              \
+    return &t->entries[i];                                                     \
+  }                                                                            \
+                                                                               \
+  static inline value_type *name##_upsert(name##_t *t, key_type key,           \
+                                          int *added) {                        \
+    return &name##_upsert_entry(t, key, added)->value;                         \
+  }                                                                            \
+                                                                               \
+  static inline int name##_remove(name##_t *t, key_type key) {                 \
+    uint32_t h = name##_hash(key);                                             \
+    size_t i = h & t->mask;                                                    \
+    for (;; i = (i + 1) & t->mask) {                                           \
+      if (t->hashes[i] == 0)                                                   \
+        return 0;                                                              \
+      if (t->hashes[i] == h && eq_fn(t->entries[i].key, key))                  \
+        break;                                                                 \
+    }                                                                          \
+    /* shift back the following entries that probed past slot i */            \
+    size_t j = i;                                                              \
+    for (;;) {                                                                 \
+      j = (j + 1) & t->mask;                                                   \
+      if (t->hashes[j] == 0)                                                   \
+        break;                                                                 \
+      size_t home = t->hashes[j] & t->mask;                                    \
+      if (((j - home) & t->mask) >= ((j - i) & t->mask)) {                     \
+        t->hashes[i] = t->hashes[j];                                           \
+        t->entries[i] = t->entries[j];                                         \
+        i = j;                                                                 \
+      }                                                                        \
+    }                                                                          \
+    t->hashes[i] = 0;                                                          \
+    t->count--;                                                                \
+    return 1;                                                                  \
+  }                                                                            \
+                                                                               \
+  static inline int name##_next(const name##_t *t, size_t *pos,               \
+                                key_type *key, value_type **value) {           \
+    for (; *pos <= t->mask; ++*pos) {                                          \
+      if (t->hashes[*pos] != 0) {                                              \
+        *key = t->entries[*pos].key;                                           \
+        *value = &t->entries[*pos].value;                                      \
+        ++*pos;                                                                \
+        return 1;                                                              \
+      }                                                                        \
+    }                                                                          \
+    return 0;                                                                  \
+  }
+
+#endif /* HT_TEMPLATE_H */
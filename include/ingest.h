@@ -0,0 +1,61 @@
+#ifndef INGEST_H
+#define INGEST_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Reading many corpus files with a fixed number of reads in flight, so the
+ * disk stays busy while the caller decodes and tokenizes what has already
+ * arrived, and there is no idle gap between one file and the next.
+ *
+ * The files are cut into blocks of block_size bytes; blocks are read ahead
+ * across file boundaries (queue_depth of them at a time, so many small
+ * files are read concurrently) and handed to the sink in order: the sink
+ * sees every file from start to end, one after the other, then a call
+ * with len 0 for its end (also for an empty file).
+ *
+ * Backends:
+ * - INGEST_IO_URING: reads are submitted to an io_uring (Linux >= 5.6),
+ *   set up with the raw system calls, no library needed;
+ * - INGEST_PREAD: worker threads doing blocking pread;
+ * - INGEST_AUTO: io_uring if the kernel allows it and has IORING_OP_READ
+ *   (IORING_FEAT_RW_CUR_POS, 5.6), pread otherwise.
+ *
+ * Only regular files can be ingested (their size is taken at open).
+ */
+
+typedef enum { INGEST_AUTO, INGEST_IO_URING, INGEST_PREAD } ingest_backend_t;
+
+typedef struct {
+  ingest_backend_t backend;
+  unsigned queue_depth; /* blocks in flight (0: 32) */
+  size_t block_size;    /* bytes per read (0: 128 KiB) */
+  int threads;          /* INGEST_PREAD workers (0: 4) */
+} ingest_config_t;
+
+typedef struct {
+  ingest_backend_t backend; /* the one actually used */
+  uint64_t files;
+  uint64_t bytes;
+  uint64_t reads;      /* read requests, resubmitted short reads included */
+  uint64_t elapsed_ns; /* whole ingestion */
+  uint64_t wait_ns;    /* time the caller waited for data */
+} ingest_stats_t;
+
+/* data: the next len bytes of file number file (len 0: its end). Return 0
+ * to go on, anything else to stop the ingestion. */
+typedef int (*ingest_sink_t)(void *ctx, int file, const char *data,
+                             size_t len);
+
+/* config and stats may be NULL. Returns 0, or -1 on an I/O error (reported
+ * on stderr) or when the sink stopped. */
+int ingest_files(const char *const *paths, int n,
+                 const ingest_config_t *config, ingest_sink_t sink, void *ctx,
+                 ingest_stats_t *stats);
+
+/* "auto", "uring" or "pread". Returns 0 on success, -1 if unknown. */
+int ingest_backend_from_name(const char *name, ingest_backend_t *backend);
+const char *ingest_backend_name(ingest_backend_t backend);
+
+#endif /* INGEST_H */
@@ -1,24 +1,104 @@
-#ifndef LINKED_LIST_H
-#define LINKED_LIST_H
-
-typedef struct ll_item {
-  void *data;
-  struct ll_item *next;
-} ll_item_t;
-
-typedef struct {
-  ll_item_t *head;
-  ll_item_t *tail;
-} linked_list_t;
-
-typedef struct {
-  ll_item_t *current;
-} linked_list_iterator_t;
-
-linked_list_t *create_linked_list();
-void add_to_list(linked_list_t *list, void *data);
-void remove_from_list(linked_list_t *list, void *data);
-void free_linked_list(linked_list_t *list);
-int get_list_size(const linked_list_t *list);
-void **linked_list_to_array(const linked_list_t *list);
-#endif
+#ifndef LINKED_LIST_H
+#define LINKED_LIST_H
+
+#include <stddef.h>
+
+typedef struct ll_item {
+  void *data;
+  struct ll_item *next;
+} ll_item_t;
+
+/*
+ * Node pool: nodes are carved out of slabs and recycled through a free
+ * list, so adding to a list costs no malloc once the pool is warm. A pool
+ * can be shared by many lists (e.g. all the chains of a hash table); it is
+ * not thread safe and must outlive the lists using it.
+ */
+typedef struct ll_pool_slab ll_pool_slab_t;
+typedef struct {
+  ll_item_t *free_nodes;  /* recycled nodes */
+  ll_pool_slab_t *slabs;  /* every slab, for free_ll_pool */
+  size_t slab_nodes;      /* nodes per slab */
+  size_t used;            /* nodes handed out from the current slab */
+  size_t live;            /* nodes currently in some list */
+} ll_pool_t;
+
+typedef struct {
+  ll_item_t *head;
+  ll_item_t *tail;
+  int size;        /* number of elements, kept up to date */
+  ll_pool_t *pool; /* where nodes come from, NULL: dmalloc/dfree */
+} linked_list_t;
+
+/* Cursor over a list, on the stack: iterating never allocates.
+ *   linked_list_iterator_t it;
+ *   void *data;
+ *   ll_iter_init(&it, list);
+ *   while (ll_iter_next(&it, &data)) ...
+ * Removing the element just returned is not allowed while iterating. */
+typedef struct {
+  ll_item_t *current;
+} linked_list_iterator_t;
+
+linked_list_t *create_linked_list();
+/* A list whose nodes come from pool. */
+linked_list_t *create_linked_list_pool(ll_pool_t *pool);
+/* 0 on success, -1 if list is NULL. */
+int add_to_list(linked_list_t *list, void *data);
+/* Unlink the first node holding data. 0 on success, -1 if not found. */
+int remove_from_list(linked_list_t *list, void *data);
+/* Free the list, its nodes and every payload with dfree(). */
+void free_linked_list(linked_list_t *list);
+/* Free the list and its nodes; free_data (if not NULL) is applied to every
+ * payload. Use NULL for payloads on the stack or in an arena. */
+void free_linked_list_with(linked_list_t *list, void (*free_data)(void *));
+/* O(1). */
+int get_list_size(const linked_list_t *list);
+void **linked_list_to_array(const linked_list_t *list);
+
+/* Moving nodes between lists that share a pool (or both have none), with
+ * no allocation: append an unlinked node / unlink the node after previous
+ * (NULL: the head) / give an unlinked node back to the list's pool. */
+void ll_push_node(linked_list_t *list, ll_item_t *node);
+void ll_unlink_node(linked_list_t *list, ll_item_t *previous, ll_item_t *node);
+void ll_release_node(linked_list_t *list, ll_item_t *node);
+
+void ll_iter_init(linked_list_iterator_t *it, const linked_list_t *list);
+/* Store the next element in *data and return 1, or return 0 at the end. */
+int ll_iter_next(linked_list_iterator_t *it, void **data);
+
+/* slab_nodes: nodes allocated at a time (0: a default). */
+ll_pool_t *create_ll_pool(size_t slab_nodes);
+void free_ll_pool(ll_pool_t *pool);
+
+/*
+ * Intrusive list: the payload embeds an ll_link_t and the list only chains
+ * the links, so nothing is ever allocated and payloads may live anywhere
+ * (stack, arena, inside another structure). LL_CONTAINER_OF gets back from
+ * a link to the structure holding it:
+ *
+ *   struct entry { int value; ll_link_t link; };
+ *   for (ll_link_t *l = list.head; l; l = l->next)
+ *     LL_CONTAINER_OF(l, struct entry, link)->value++;
+ */
+typedef struct ll_link {
+  struct ll_link *next;
+} ll_link_t;
+
+typedef struct {
+  ll_link_t *head;
+  ll_link_t *tail;
+  size_t size;
+} ll_intrusive_t;
+
+#define LL_CONTAINER_OF(link, type, member)                                    \
+  ((type *)((char *)(link) - offsetof(type, member)))
+
+void ll_intrusive_init(ll_intrusive_t *list);
+void ll_intrusive_push_back(ll_intrusive_t *list, ll_link_t *link);
+void ll_intrusive_push_front(ll_intrusive_t *list, ll_link_t *link);
+/* Unlink and return the head, NULL if the list is empty. */
+ll_link_t *ll_intrusive_pop_front(ll_intrusive_t *list);
+/* 0 if the link was found and unlinked, -1 otherwise. O(n). */
+int ll_intrusive_remove(ll_intrusive_t *list, ll_link_t *link);
+#endif
@@ -0,0 +1,162 @@
+#ifndef MODEL_H
+#define MODEL_H
+
+#include "vocab.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Frozen word -> followers model in a compact, pointer-free layout.
+ *
+ * The whole model lives in one contiguous image that is identical in memory
+ * and on disk, so a saved model is loaded with a single mmap:
+ *
+ *   header | pool | word_offsets | sorted_ids | edges | row_offsets |
+ *   row_totals | ranks
+ *
+ * - pool:         NUL terminated code point strings, back to back (int)
+ * - word_offsets: num_words entries, start of each word inside pool
+ * - sorted_ids:   word IDs in lexicographic order (for model_find)
+ * - edges:        (follower ID, count) pairs, grouped by word, each group
+ *                 sorted by follower ID
+ * - row_offsets:  num_words + 1 entries; the followers of word w are
+ *                 edges[row_offsets[w] .. row_offsets[w + 1])
+ * - row_totals:   num_words entries, sum of the counts of every row
+ * - ranks:        one entry per edge, by row: the positions inside the row
+ *                 from the most frequent follower down (equal counts by
+ *                 follower ID), so the top k of a row are read in O(k)
+ *
+ * Every section starts on an 8 byte boundary and is addressed by its byte
+ * offset from the start of the image.
+ */
+
+#define MODEL_MAGIC 0x314D4B4Du /* "MKM1" little endian */
+#define MODEL_VERSION 2u
+
+typedef struct {
+  uint32_t next;  /* follower word ID */
+  uint32_t count; /* how many times next followed the word */
+} model_edge_t;
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t num_words;
+  uint32_t flags;
+  uint64_t num_edges;
+  uint64_t pool_len; /* code points, terminators included */
+  uint64_t pool_off;
+  uint64_t word_offsets_off;
+  uint64_t sorted_ids_off;
+  uint64_t edges_off;
+  uint64_t row_offsets_off;
+  uint64_t row_totals_off;
+  uint64_t ranks_off;
+  uint64_t image_size;
+} model_header_t;
+
+typedef struct {
+  const model_header_t *header;
+  const int *pool;
+  const uint64_t *word_offsets;
+  const uint32_t *sorted_ids;
+  const model_edge_t *edges;
+  const uint64_t *row_offsets;
+  const uint64_t *row_totals;
+  const uint32_t *ranks;
+
+  void *image;       /* start of the image */
+  size_t image_size; /* bytes */
+  int mapped;        /* 1 if image is an mmap, 0 if dmalloc'd */
+} model_t;
+
+/*
+ * Build an in-memory model from a vocabulary and edges already grouped by
+ * word: the followers of word w are edges[row_offsets[w] .. row_offsets[w+1])
+ * and must be sorted by follower ID. row_offsets has vocab_size + 1 entries.
+ */
+model_t *model_build(const vocab_t *vocab, const uint64_t *row_offsets,
+                     const model_edge_t *edges);
+
+/* Write the image to path. Returns 0 on success, -1 on error. */
+int model_save(const model_t *model, const char *path);
+
+/* Map a saved model read-only. Returns NULL on error. */
+model_t *model_load(const char *path);
+
+void free_model(model_t *model);
+
+/*
+ * Shared memory publication, for several generator processes on one
+ * machine: the image is pointer free, so one copy in a POSIX shared
+ * memory object (name as for shm_open, e.g. "/markov") can be mapped
+ * read-only by every process, at any address, with a single physical copy
+ * and no parsing at startup.
+ *
+ * model_publish_shm copies the image into a new object (it fails if name
+ * exists) and sets the magic number last, so an attach that races with it
+ * sees "not a model image" rather than a partial one. The object stays
+ * until model_unpublish_shm; processes attached at that point keep their
+ * mapping, so a model is replaced by unpublishing and publishing again.
+ * Attached models are released with free_model.
+ */
+int model_publish_shm(const model_t *model, const char *name);
+model_t *model_attach_shm(const char *name);
+int model_unpublish_shm(const char *name);
+
+uint32_t model_num_words(const model_t *model);
+uint64_t model_num_edges(const model_t *model);
+
+/* Code points of the word with the given ID (NUL terminated). */
+const int *model_word(const model_t *model, uint32_t id);
+
+/* ID of word (exact match), or VOCAB_NO_ID. Binary search on sorted_ids. */
+uint32_t model_find(const model_t *model, const int *word);
+
+/* Followers of id; *count receives their number. */
+const model_edge_t *model_followers(const model_t *model, uint32_t id,
+                                    uint32_t *count);
+
+/* Sum of the follower counts of id. */
+uint64_t model_row_total(const model_t *model, uint32_t id);
+
+typedef struct {
+  uint32_t next;
+  uint32_t count;
+  double probability; /* count / row total */
+} model_follower_t;
+
+/* The k most frequent followers of id, most frequent first (equal counts
+ * by follower ID), in O(k). Returns how many were written to out: k, or
+ * fewer if id has fewer followers. */
+uint32_t model_top_followers(const model_t *model, uint32_t id, uint32_t k,
+                             model_follower_t *out);
+
+/* model_top_followers for n words at once: the followers of ids[i] go to
+ * out[i * k ...] and their number to found[i]. The rows are prefetched a
+ * few words ahead, which hides their cache misses when k is small. */
+void model_top_followers_batch(const model_t *model, const uint32_t *ids,
+                               size_t n, uint32_t k, model_follower_t *out,
+                               uint32_t *found);
+
+/* ------------------------------------------------------------------
+ * Streaming writer: produces the same file as model_save without holding
+ * the edges in memory. Edges must arrive ordered by (word, follower).
+ * ------------------------------------------------------------------ */
+typedef struct model_writer model_writer_t;
+
+model_writer_t *model_writer_open(const char *path, const vocab_t *vocab);
+int model_writer_add_edge(model_writer_t *writer, uint32_t word,
+                          uint32_t next, uint32_t count);
+/* Flush everything, write the row offsets and the header. Frees writer.
+ * Returns 0 on success, -1 on error. */
+int model_writer_close(model_writer_t *writer);
+
+/* Shared helpers for code that lays out model images. */
+int model_word_cmp(const int *a, const int *b);
+void model_sort_ids(uint32_t *ids, uint32_t n, const int *pool,
+                    const uint64_t *word_offsets);
+/* IDs of vocab in code point order of their words (dmalloc'd). */
+uint32_t *vocab_sorted_ids(const vocab_t *vocab);
+
+#endif /* MODEL_H */
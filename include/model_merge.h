@@ -0,0 +1,52 @@
+#ifndef MODEL_MERGE_H
+#define MODEL_MERGE_H
+
+#include "model.h"
+#include <stdint.h>
+
+/*
+ * Merging two frozen models, e.g. trained on different sources, without
+ * going back through a hash table.
+ *
+ * The dictionaries are matched by a sorted merge of their sorted_ids
+ * sections: the words of a keep their IDs, the words only b has come
+ * after them, in b's order. The rows of a are therefore already sorted by
+ * follower; a row of b is remapped and, unless the remapping kept it in
+ * order, sorted again. Each row of the result is then a sorted merge of
+ * the two, the counts of a follower in both added after weighting:
+ *
+ *   count = round(weight_a * count_a + weight_b * count_b)
+ *
+ * clamped to UINT32_MAX; followers whose count rounds to 0 are dropped.
+ *
+ * The merged words are cut into chunks of about the same number of input
+ * edges (at most MODEL_MERGE_CHUNK_EDGES), merged threads at a time, each
+ * chunk by a worker of its own, and streamed to the output through
+ * model_writer in order, so memory stays bounded by threads chunks
+ * whatever the size of the models.
+ */
+
+#define MODEL_MERGE_CHUNK_EDGES (1u << 20)
+
+typedef struct {
+  double weight_a; /* multiplier of the counts of a (>= 0) */
+  double weight_b; /* multiplier of the counts of b (>= 0) */
+  int threads;     /* workers (0: 1) */
+} model_merge_config_t;
+
+typedef struct {
+  uint32_t words;    /* of the merged model */
+  uint32_t shared;   /* words found in both */
+  uint64_t edges;    /* of the merged model */
+  uint64_t dropped;  /* edges whose weighted count rounded to 0 */
+  uint64_t resorted; /* rows of b that needed sorting after remapping */
+  uint64_t chunks;
+} model_merge_stats_t;
+
+/* Merge a and b into a model file at path. config may be NULL (weights
+ * 1, one thread), so may stats. Returns 0 or -1. */
+int model_merge(const model_t *a, const model_t *b, const char *path,
+                const model_merge_config_t *config,
+                model_merge_stats_t *stats);
+
+#endif /* MODEL_MERGE_H */
@@ -0,0 +1,109 @@
+#ifndef PACKED_MODEL_H
+#define PACKED_MODEL_H
+
+#include "model.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Compressed copy of a frozen model, for when the 8 bytes of every edge
+ * (and 4 of its rank) dominate: the followers of each word are kept as a
+ * byte stream and decoded on demand, row by row.
+ *
+ *   header | pool | word_offsets | sorted_ids | row_offsets | row_totals |
+ *   data
+ *
+ * pool, word_offsets and sorted_ids are those of the model; row_offsets
+ * has num_words + 1 byte offsets into data, row_totals the sum of the
+ * counts of every row. A row starts with its number of followers n
+ * (varint) and, in follower ID order, stores the first ID as is and the
+ * others as the gap to the previous one minus 1, with one of two codes:
+ *
+ * - PACKED_VARINT: (gap, count) pairs, each a LEB128 varint (7 bits per
+ *   byte), so the common small gaps and counts of 1 take one byte each.
+ * - PACKED_BITS:   two bytes with the widths g and c of the widest gap and
+ *   count of the row, the first ID as a varint, then the n - 1 gaps in g
+ *   bits and the n counts in c bits, bit packed. Decoding reads each
+ *   field with one unaligned 64 bit load, shift and mask, without the
+ *   per byte branches of varints (data is followed by 8 bytes of slack).
+ *
+ * There are no ranks: generation draws a follower by decoding the row
+ * until the drawn count is reached, with the same random numbers as
+ * generate_next, so a walk is the same on both forms of a model. Like a
+ * model, the image is pointer free and loaded with a single mmap.
+ */
+
+#define PACKED_MODEL_MAGIC 0x314B504Du /* "MPK1" little endian */
+#define PACKED_MODEL_VERSION 1u
+
+typedef enum { PACKED_VARINT, PACKED_BITS } packed_encoding_t;
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t num_words;
+  uint32_t encoding; /* packed_encoding_t */
+  uint64_t num_edges;
+  uint64_t pool_len; /* code points, terminators included */
+  uint64_t pool_off;
+  uint64_t word_offsets_off;
+  uint64_t sorted_ids_off;
+  uint64_t row_offsets_off;
+  uint64_t row_totals_off;
+  uint64_t data_off;
+  uint64_t data_len; /* slack included */
+  uint64_t image_size;
+  uint32_t widest; /* followers of the longest row */
+  uint32_t reserved;
+} packed_model_header_t;
+
+typedef struct {
+  const packed_model_header_t *header;
+  const int *pool;
+  const uint64_t *word_offsets;
+  const uint32_t *sorted_ids;
+  const uint64_t *row_offsets;
+  const uint64_t *row_totals;
+  const uint8_t *data;
+
+  void *image;
+  size_t image_size;
+  int mapped; /* 1 if image is an mmap, 0 if dmalloc'd */
+} packed_model_t;
+
+/* Encode model. Returns NULL on error. */
+packed_model_t *packed_model_build(const model_t *model,
+                                   packed_encoding_t encoding);
+
+/* Write the image to path. Returns 0 or -1. */
+int packed_model_save(const packed_model_t *packed, const char *path);
+/* Map a saved packed model read-only. Returns NULL on error. */
+packed_model_t *packed_model_load(const char *path);
+/* 1 if path holds a packed model, 0 if not (or cannot be read). */
+int packed_model_probe(const char *path);
+
+void free_packed_model(packed_model_t *packed);
+
+uint32_t packed_model_num_words(const packed_model_t *packed);
+uint64_t packed_model_num_edges(const packed_model_t *packed);
+const int *packed_model_word(const packed_model_t *packed, uint32_t id);
+/* ID of word (exact match), or VOCAB_NO_ID. */
+uint32_t packed_model_find(const packed_model_t *packed, const int *word);
+uint64_t packed_model_row_total(const packed_model_t *packed, uint32_t id);
+
+/* Decode the followers of id, in follower ID order, into out, which has
+ * room for header->widest edges. Returns their number. */
+uint32_t packed_model_followers(const packed_model_t *packed, uint32_t id,
+                                model_edge_t *out);
+
+/* generate_next and generate_walk (generate.h) on a packed model. */
+uint32_t packed_model_next(const packed_model_t *packed, uint32_t id,
+                           uint64_t *state);
+size_t packed_model_walk(const packed_model_t *packed, uint32_t start,
+                         uint32_t *out, size_t max, uint64_t *state);
+
+/* "varint" or "bits". Returns 0 on success, -1 if unknown. */
+int packed_encoding_from_name(const char *name, packed_encoding_t *encoding);
+const char *packed_encoding_name(packed_encoding_t encoding);
+
+#endif /* PACKED_MODEL_H */
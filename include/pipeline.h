@@ -0,0 +1,56 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "shm_ring.h"
+#include "train.h"
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Training input as a three process pipeline, one stage per process so
+ * that each can run on its own core:
+ *
+ *   reader     reads the corpora and decodes UTF-8 into code points
+ *      |       ring: batches of code points, an empty batch ends a corpus
+ *   tokenizer  runs the tokenizer (tokenizer.h) on them
+ *      |       ring: batches of NUL terminated tokens, a lone NUL is a
+ *      |       corpus boundary
+ *   builder    the calling process: feeds the tokens to the trainer
+ *
+ * The rings are shm_ring_t (single producer / single consumer, POSIX
+ * shared memory). The reader is forked by the tokenizer and the tokenizer
+ * by the caller, so every consumer can tell when its producer has died.
+ * Malformed UTF-8 separates tokens, as in tokenizer_feed_utf8: the trainer
+ * receives exactly the words of the in-process path.
+ */
+
+typedef struct {
+  size_t ring_slots; /* batches in flight per ring (0: 16) */
+  size_t slot_bytes; /* bytes per batch (0: 64 KiB) */
+} pipeline_config_t;
+
+typedef struct {
+  uint64_t items;      /* reader: bytes read; tokenizer, builder: tokens */
+  uint64_t batches;    /* batches sent (builder: received) */
+  uint64_t elapsed_ns; /* wall time of the stage */
+  uint64_t starved;    /* waits on an empty input ring */
+  uint64_t starved_ns;
+  uint64_t stalled;    /* waits on a full output ring: backpressure */
+  uint64_t stalled_ns;
+} pipeline_stage_stats_t;
+
+typedef struct {
+  pipeline_stage_stats_t reader, tokenizer, builder;
+  uint64_t invalid; /* malformed UTF-8 sequences */
+} pipeline_stats_t;
+
+/* Feed every path ("-": standard input; none: standard input) to trainer
+ * through the pipeline, each one a separate chain. config and stats may
+ * be NULL. Returns 0, or -1 if a stage failed. */
+int pipeline_train(trainer_t *trainer, const char *const *paths, int n,
+                   const pipeline_config_t *config, pipeline_stats_t *stats);
+
+/* One line per stage: throughput, starvation and backpressure. */
+void pipeline_print_stats(const pipeline_stats_t *stats, FILE *out);
+
+#endif /* PIPELINE_H */
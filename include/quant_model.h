@@ -0,0 +1,111 @@
+#ifndef QUANT_MODEL_H
+#define QUANT_MODEL_H
+
+#include "model.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Sampling-only copy of a frozen model whose follower distributions are
+ * quantized to 8 or 16 bit probabilities, for when the 32 bit count of
+ * every edge, its rank and the row totals cost more than generation needs.
+ *
+ *   header | pool | word_offsets | sorted_ids | row_offsets | nexts |
+ *   probs | aliases
+ *
+ * pool, word_offsets and sorted_ids are those of the model. Each row is
+ * quantized to S = 2^bits quanta by largest remainder rounding: follower i
+ * of a row of total T gets floor(c_i * S / T) quanta, and the followers
+ * with the largest remainders one more each until the row sums to S.
+ * Followers left with no quantum are dropped; nexts keeps the others in
+ * follower ID order. Two table forms:
+ *
+ * - QUANT_CDF:   probs holds the cumulative quanta minus 1 of each
+ *   follower; a draw r in [0, S) takes the first follower whose value is
+ *   >= r (binary search).
+ * - QUANT_ALIAS: Vose's alias table over the m followers of the row,
+ *   built exactly in integers; a draw picks a slot j in [0, m), keeps
+ *   follower j when r < probs[j] and takes follower aliases[j] (an index
+ *   in the row) otherwise. One draw, O(1) per word, 4 more bytes an edge.
+ *
+ * Error bound: the probability of every follower is off by less than
+ * 1 / S (1/256 with 8 bits, 1/65536 with 16), so the total variation
+ * distance of a row of n followers is below min(1, n / (2 S)). Followers
+ * of probability below 1 / S may be dropped, and an 8 bit row keeps at most
+ * 256 of them. Both tables sample exactly the quantized distribution
+ * (header->max_error is the largest error of the model, measured at
+ * build). Walks use their own draws: they do not repeat generate_walk.
+ */
+
+#define QUANT_MODEL_MAGIC 0x3154514Du /* "MQT1" little endian */
+#define QUANT_MODEL_VERSION 1u
+
+typedef enum { QUANT_CDF, QUANT_ALIAS } quant_table_t;
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t num_words;
+  uint32_t bits;  /* 8 or 16 */
+  uint32_t table; /* quant_table_t */
+  uint32_t reserved;
+  uint64_t num_edges; /* followers kept */
+  uint64_t dropped;   /* followers whose probability rounded to 0 */
+  double max_error;   /* largest |quantized - exact| probability */
+  uint64_t pool_len;  /* code points, terminators included */
+  uint64_t pool_off;
+  uint64_t word_offsets_off;
+  uint64_t sorted_ids_off;
+  uint64_t row_offsets_off;
+  uint64_t nexts_off;
+  uint64_t probs_off;
+  uint64_t aliases_off; /* no section for QUANT_CDF */
+  uint64_t image_size;
+} quant_model_header_t;
+
+typedef struct {
+  const quant_model_header_t *header;
+  const int *pool;
+  const uint64_t *word_offsets;
+  const uint32_t *sorted_ids;
+  const uint64_t *row_offsets; /* num_words + 1 indices into nexts */
+  const uint32_t *nexts;
+  const void *probs; /* uint8_t or uint16_t, by header->bits */
+  const uint32_t *aliases;
+
+  void *image;
+  size_t image_size;
+  int mapped; /* 1 if image is an mmap, 0 if dmalloc'd */
+} quant_model_t;
+
+/* Quantize model to bits (8 or 16) per probability. NULL on error. */
+quant_model_t *quant_model_build(const model_t *model, unsigned bits,
+                                 quant_table_t table);
+
+/* Write the image to path. Returns 0 or -1. */
+int quant_model_save(const quant_model_t *quant, const char *path);
+/* Map a saved quantized model read-only. Returns NULL on error. */
+quant_model_t *quant_model_load(const char *path);
+/* 1 if path holds a quantized model, 0 if not (or cannot be read). */
+int quant_model_probe(const char *path);
+
+void free_quant_model(quant_model_t *quant);
+
+uint32_t quant_model_num_words(const quant_model_t *quant);
+uint64_t quant_model_num_edges(const quant_model_t *quant);
+const int *quant_model_word(const quant_model_t *quant, uint32_t id);
+/* ID of word (exact match), or VOCAB_NO_ID. */
+uint32_t quant_model_find(const quant_model_t *quant, const int *word);
+
+/* The kept followers of id with their quanta (out of 2^bits) as counts,
+ * in follower ID order, into out (room for the row). Returns their number. */
+uint32_t quant_model_followers(const quant_model_t *quant, uint32_t id,
+                               model_edge_t *out);
+
+/* generate_next and generate_walk (generate.h) on a quantized model. */
+uint32_t quant_model_next(const quant_model_t *quant, uint32_t id,
+                          uint64_t *state);
+size_t quant_model_walk(const quant_model_t *quant, uint32_t start,
+                        uint32_t *out, size_t max, uint64_t *state);
+
+#endif /* QUANT_MODEL_H */
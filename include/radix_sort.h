@@ -0,0 +1,18 @@
+#ifndef RADIX_SORT_H
+#define RADIX_SORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * LSD radix sort of 64 bit keys, one byte per pass. Passes whose byte is the
+ * same in every key are skipped, so packed (prev ID, next ID) pairs over a
+ * small vocabulary only pay for the bytes actually in use.
+ *
+ * keys:    array to sort (sorted in place)
+ * scratch: n more keys of workspace
+ * threads: number of worker threads (<= 1 sorts on the calling thread)
+ */
+void radix_sort_u64(uint64_t *keys, uint64_t *scratch, size_t n, int threads);
+
+#endif /* RADIX_SORT_H */
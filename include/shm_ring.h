@@ -0,0 +1,75 @@
+#ifndef SHM_RING_H
+#define SHM_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Single producer / single consumer ring of fixed size slots in POSIX
+ * shared memory, to connect the stages of a pipeline running as separate
+ * processes. Each slot carries one batch (up to slot_bytes), so the
+ * synchronisation cost is paid per batch, not per item.
+ *
+ * The segment is created with shm_open and unlinked right away: it lives
+ * as long as a process maps it, and processes forked after
+ * create_shm_ring share it. head (written by the producer only) and tail
+ * (consumer only) are 64 bit counters on separate cache lines, published
+ * with release stores and read with acquire loads: no locks and no system
+ * calls while the ring is neither full nor empty.
+ *
+ * A side that has to wait spins briefly, then yields, then sleeps, and
+ * counts the wait: producer waits on a full ring are backpressure from the
+ * consumer, consumer waits on an empty ring are starvation. While sleeping
+ * it polls the peer hook (shm_ring_set_peer) so that a peer that died
+ * without closing the ring does not hang it.
+ */
+
+typedef struct {
+  uint64_t batches;  /* published (producer) / released (consumer) */
+  uint64_t bytes;    /* payload of those batches */
+  uint64_t waits;    /* producer: ring full, consumer: ring empty */
+  uint64_t wait_ns;  /* time spent in those waits */
+} shm_ring_stats_t;
+
+typedef struct shm_ring shm_ring_t;
+
+/* slots >= 2. Returns NULL (and reports on stderr) on error. */
+shm_ring_t *create_shm_ring(size_t slots, size_t slot_bytes);
+
+/* Unmap the ring in this process. */
+void free_shm_ring(shm_ring_t *ring);
+
+size_t shm_ring_slot_bytes(const shm_ring_t *ring);
+
+/* alive(ctx) is called from time to time while this process waits on the
+ * ring; returning 0 means the other side is gone. Process local. */
+void shm_ring_set_peer(shm_ring_t *ring, int (*alive)(void *ctx), void *ctx);
+
+/* Producer: the next free slot (slot_bytes bytes), waiting while the ring
+ * is full. NULL if the ring failed (consumer gone or shm_ring_fail). */
+void *shm_ring_reserve(shm_ring_t *ring);
+
+/* Producer: hand the reserved slot, holding bytes bytes, to the consumer. */
+void shm_ring_publish(shm_ring_t *ring, size_t bytes);
+
+/* Producer: no more batches. */
+void shm_ring_close(shm_ring_t *ring);
+
+/* Either side: give up; the other side sees the failure. */
+void shm_ring_fail(shm_ring_t *ring);
+
+/* Consumer: the oldest published batch and its size, waiting while the
+ * ring is empty. NULL at the end: closed and drained, or failed
+ * (shm_ring_failed tells which). */
+const void *shm_ring_peek(shm_ring_t *ring, size_t *bytes);
+
+/* Consumer: done with the batch returned by shm_ring_peek. */
+void shm_ring_release(shm_ring_t *ring);
+
+int shm_ring_failed(const shm_ring_t *ring);
+
+/* Counters of either side, readable from any process. */
+void shm_ring_get_stats(const shm_ring_t *ring, shm_ring_stats_t *producer,
+                        shm_ring_stats_t *consumer);
+
+#endif /* SHM_RING_H */
@@ -0,0 +1,83 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+/*
+ * Hot path timers. Built with -DTIMING_ENABLED (make TIMERS=1), the
+ * TIMER_START / TIMER_STOP pairs placed around decoding, tokenizing,
+ * ht_insert, follower updates, table resizes and generation steps read
+ * the time stamp counter (clock_gettime where there is none) and add the
+ * elapsed ticks to a histogram of the calling thread; without the flag
+ * they compile to nothing.
+ *
+ * Histograms are HDR style: values below 64 ticks have a bucket each,
+ * larger ones go to one of 32 linear buckets per power of two, so every
+ * recorded value is known to within about 3% whatever its magnitude, in
+ * a fixed 15 KiB per point and thread. A thread's histograms are
+ * allocated on its first record and outlive it; timing_summary merges
+ * those of every thread and timing_report prints the percentiles, once
+ * the measured work is over (recording threads are not stopped).
+ */
+
+#include "utils.h"
+#include <stdint.h>
+#include <stdio.h>
+
+typedef enum {
+  TIMING_DECODE,          /* utf8_decode of a buffer */
+  TIMING_TOKENIZE,        /* tokenizer_feed_utf8 of a buffer, sink included */
+  TIMING_HT_INSERT,       /* one item, alone or batched, update included */
+  TIMING_FOLLOWER_UPDATE, /* merging followers into a word's list */
+  TIMING_RESIZE,          /* growing a hash table */
+  TIMING_GENERATE_STEP,   /* one word of a walk, one level of a beam */
+  TIMING_POINTS
+} timing_point_t;
+
+#ifdef TIMING_ENABLED
+#define TIMER_START(var) uint64_t var = timing_now()
+#define TIMER_STOP(point, var) timing_record((point), timing_now() - (var))
+#else
+#define TIMER_START(var)
+#define TIMER_STOP(point, var) ((void)0)
+#endif
+
+/* 1 when the timers are compiled in. */
+int timing_enabled(void);
+
+/* Current time in ticks of the timer clock. */
+static inline uint64_t timing_now(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  return __builtin_ia32_rdtsc();
+#else
+  return monotonic_ns();
+#endif
+}
+
+/* Add one duration, in ticks, to the calling thread's histogram.
+ * Durations of 2^63 ticks or more (a clock read backwards) are dropped. */
+void timing_record(timing_point_t point, uint64_t ticks);
+
+/* Nanoseconds per tick, measured between the first record (or the first
+ * call) and now. */
+double timing_ns_per_tick(void);
+
+typedef struct {
+  uint64_t count;
+  uint64_t min, max; /* ticks, exact */
+  double mean;       /* ticks */
+  uint64_t p50, p90, p99, p999; /* ticks, within the bucket width */
+} timing_summary_t;
+
+/* Merge the histograms of every thread for one point. Returns count. */
+uint64_t timing_summary(timing_point_t point, timing_summary_t *out);
+/* Value at quantile q (0..1) of the merged histogram, in ticks. */
+uint64_t timing_percentile(timing_point_t point, double q);
+
+const char *timing_point_name(timing_point_t point);
+
+/* One line per point with samples: count, mean and percentiles in ns. */
+void timing_report(FILE *out);
+
+/* Zero every histogram (no thread may be recording). */
+void timing_reset(void);
+
+#endif /* TIMING_H */
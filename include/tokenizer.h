@@ -0,0 +1,74 @@
+#ifndef TOKENIZER_H
+#define TOKENIZER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Single pass tokenizer. Every code point is looked up in a generated
+ * class table (tokenizer_class_table.h) and drives a two-state machine
+ * (between tokens / inside a word) whose transitions are a small table
+ * of actions, so there is no per-character branching on the text itself.
+ *
+ * - letters (and digits, combining marks) build up words; words longer
+ *   than MAX_WORD_LENGTH - 1 code points are cut, the rest is skipped
+ * - an apostrophe after a letter ends the word and stays in it, so
+ *   "l'acqua" gives "l'" "acqua" and "po'" stays "po'"; typographic
+ *   apostrophes are stored as '\''; elsewhere an apostrophe is a quote
+ *   and separates
+ * - sentence punctuation (. , ; : ! ? ... ¡ ¿) ends the word and is a
+ *   token of its own
+ * - anything else separates
+ *
+ * Tokens are handed to a sink as they are found, NUL terminated, with the
+ * case of the input (the trainer lowercases). tokenizer_train_sink feeds
+ * them straight into a trainer_t, which counts (previous, current) pairs.
+ * UTF-8 may be fed in arbitrary pieces, sequences split between two calls
+ * are joined; malformed bytes are counted and act as separators.
+ */
+
+typedef enum {
+  TOKEN_CLASS_SEPARATOR,
+  TOKEN_CLASS_LETTER,
+  TOKEN_CLASS_APOSTROPHE,
+  TOKEN_CLASS_PUNCT
+} token_class_t;
+
+/* token: the code points, NUL terminated; valid during the call only */
+typedef void (*token_sink_t)(void *ctx, const int *token, size_t length);
+
+typedef struct {
+  uint64_t bytes;   /* UTF-8 input */
+  uint64_t words;   /* word tokens emitted */
+  uint64_t punct;   /* punctuation tokens emitted */
+  uint64_t invalid; /* malformed UTF-8 sequences */
+  uint64_t cut;     /* words longer than the limit */
+} tokenizer_stats_t;
+
+typedef struct tokenizer tokenizer_t;
+
+tokenizer_t *create_tokenizer(token_sink_t sink, void *ctx);
+
+/* Feed decoded code points. */
+void tokenizer_feed(tokenizer_t *tok, const int *codepoints, size_t n);
+
+/* Feed UTF-8 text, decoded on the fly. */
+void tokenizer_feed_utf8(tokenizer_t *tok, const char *bytes, size_t len);
+
+/* Read fd to the end through tokenizer_feed_utf8. Returns 0 or -1. */
+int tokenizer_feed_fd(tokenizer_t *tok, int fd);
+
+/* End of input: emit the word in progress. The tokenizer can be fed
+ * again afterwards (e.g. the next document). */
+void tokenizer_finish(tokenizer_t *tok);
+
+const tokenizer_stats_t *tokenizer_get_stats(const tokenizer_t *tok);
+
+void free_tokenizer(tokenizer_t *tok);
+
+token_class_t token_class(int codepoint);
+
+/* Sink for create_tokenizer: ctx is a trainer_t. */
+void tokenizer_train_sink(void *trainer, const int *token, size_t length);
+
+#endif /* TOKENIZER_H */
@@ -0,0 +1,76 @@
+#ifndef TRAIN_H
+#define TRAIN_H
+
+#include "ext_train.h"
+#include "hash_table.h"
+#include "model.h"
+#include <stdint.h>
+
+/*
+ * Training front end with selectable counting backends. Every backend gets
+ * the same word stream and produces the same frozen model (up to the
+ * numbering of the words):
+ *
+ * - TRAIN_BACKEND_HASH_TABLE: the original path. Every (previous, current)
+ *   pair goes through ht_insert_batch (in groups) on a hash_table_t keyed by
+ *   word_t whose values are linked lists of follower word_t; finish freezes
+ *   the table.
+ * - TRAIN_BACKEND_RADIX: words are interned once, each pair is appended as a
+ *   packed uint64_t (prev ID << 32 | next ID); finish radix sorts the array
+ *   (in parallel if threads > 1) and counts adjacent runs in one pass.
+ * - TRAIN_BACKEND_EXTERNAL: like RADIX but spilled to disk under a memory
+ *   budget (ext_train.h); finish writes model_path and maps it.
+ *
+ * Words are folded to lowercase and cut to MAX_WORD_LENGTH - 1 code points
+ * before counting.
+ */
+
+typedef enum {
+  TRAIN_BACKEND_HASH_TABLE,
+  TRAIN_BACKEND_RADIX,
+  TRAIN_BACKEND_EXTERNAL
+} train_backend_t;
+
+typedef struct {
+  train_backend_t backend;
+  int threads;                 /* radix sort / freeze workers */
+  ext_train_config_t external; /* EXTERNAL only */
+  const char *model_path;      /* EXTERNAL only: where the model is written */
+} train_config_t;
+
+typedef struct trainer trainer_t;
+
+/* config may be NULL: hash table backend, one thread. */
+trainer_t *create_trainer(const train_config_t *config);
+
+/* Feed the next word of the corpus (NUL terminated code points). */
+void trainer_add_word(trainer_t *trainer, const int *word);
+
+/* End of a chain (document boundary): the next word gets no predecessor. */
+void trainer_break(trainer_t *trainer);
+
+/* Count everything fed so far and return the frozen model, or NULL on
+ * error. The trainer can only be freed afterwards. */
+model_t *trainer_finish(trainer_t *trainer);
+
+/* Count what several RADIX trainers were fed as one corpus: the pairs are
+ * summed and the words numbered in code point order (model_word_cmp), so
+ * the model does not depend on how the input was shared out between the
+ * trainers. Their pairs are released; they can only be freed afterwards.
+ * Returns NULL on error. */
+model_t *trainer_merge(trainer_t *const *trainers, int n, int threads);
+
+uint64_t trainer_get_tokens(const trainer_t *trainer);
+
+void free_trainer(trainer_t *trainer);
+
+/* "hash", "radix" or "external". Returns 0 on success, -1 if unknown. */
+int train_backend_from_name(const char *name, train_backend_t *backend);
+const char *train_backend_name(train_backend_t backend);
+
+/* Freeze a word follower table (word_t keys, lists of word_t followers,
+ * as built by word_ht_item_create) into a model. The rows are filled by
+ * threads workers, each on its own range of buckets. */
+model_t *model_from_word_table(const hash_table_t *table, int threads);
+
+#endif /* TRAIN_H */
@@ -5,6 +5,7 @@
  * characters. functions like strcopy,strcmp can be used to manipulate UTF-8
  * strings, because they read and compare bytes.
  */
+#include <stddef.h>
 #include <stdint.h>
 
 // error codes for UTF-8 reading bad formats
@@ -33,6 +34,8 @@ void utf8_putchar(int codepoint, int fd);
  * The function reads a UTF-8 codepoint and returns the lowercase equivalent
  * If the codepoint does not have a lowercase equivalent, it returns the
  * original codepoint.
+ * The full Unicode simple case mapping is covered (see utf8_case_table.h,
+ * generated by tools/gen_case_table.py).
  */
 int utf8_char_to_lower(int codepoint);
 
@@ -65,4 +68,52 @@ void utf8_print_word(const int *word, int fd);
 
 int *utf8_word_to_lower(const int *word, int word_length);
 
+/*
+ * Lowercase n codepoints from src into dst (which may be src).
+ * Runs of ASCII are converted four at a time where SSE2 is available.
+ * NOTE: no terminator is read or written
+ */
+void utf8_codepoints_to_lower(int *dst, const int *src, size_t n);
+
+/*
+ * Encode a codepoint as UTF-8 into out (room for 4 bytes).
+ * Returns the number of bytes written.
+ */
+size_t utf8_encode(int codepoint, char *out);
+
+/*
+ * Decode len bytes of UTF-8 into codepoints.
+ * out: room for max_out codepoints (no terminator is added)
+ * returns the number of codepoints, UTF8_ERROR for a malformed sequence
+ * or -1 if out is too small.
+ */
+int utf8_decode(const char *bytes, size_t len, int *out, size_t max_out);
+
+/*
+ * Incremental decoder for UTF-8 read in pieces: a sequence may be split
+ * between two calls. It follows the rules of utf8_decode (no overlong
+ * forms, surrogates or values past U+10FFFF), but a malformed sequence
+ * becomes one replacement code point and decoding goes on.
+ */
+typedef struct {
+  unsigned char pending[4]; /* sequence split between two calls */
+  unsigned pending_len, pending_need;
+  uint64_t invalid; /* malformed sequences so far */
+} utf8_stream_t;
+
+#define UTF8_STREAM_INIT {{0}, 0, 0, 0}
+
+/*
+ * Decode len more bytes into out, which has room for len + 1 codepoints.
+ * Returns the number of codepoints written.
+ */
+size_t utf8_stream_decode(utf8_stream_t *s, const char *bytes, size_t len,
+                          int *out, int replacement);
+
+/*
+ * End of the input: a sequence still pending is malformed. Writes its
+ * replacement to out (room for 1) and returns 1, or returns 0.
+ */
+size_t utf8_stream_finish(utf8_stream_t *s, int *out, int replacement);
+
 #endif
@@ -2,11 +2,72 @@
 #define UTILS_H
 
 #include <math.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <sys/types.h>
 
 unsigned int is_prime(int n);
 unsigned int next_prime(int n);
 unsigned int hash_function(int *key, int table_size);
 void *dmalloc(size_t size);
+/* Grow or shrink a dmalloc'd block; like dmalloc it never returns NULL for a
+ * non-zero size. Memory past the old size is NOT zeroed. */
+void *drealloc(void *ptr, size_t size);
+/* Release a dmalloc'd or drealloc'd block (NULL is fine). Blocks from the
+ * d* allocators must go back through dfree, never through free. */
+void dfree(void *ptr);
+
+/*
+ * Memory accounting. Built with -DDMALLOC_ACCOUNTING (make MEMSTAT=1),
+ * every block carries a 16 byte header with its size and the subsystem
+ * it was charged to, and live bytes, peak live bytes and allocation
+ * counts are kept per subsystem with relaxed atomic adds, one cache line
+ * per subsystem. Without the flag the allocators are plain malloc and
+ * free and the statistics read zero. dmalloc charges MEM_OTHER;
+ * drealloc keeps the subsystem of the block (MEM_OTHER for NULL).
+ */
+typedef enum {
+  MEM_OTHER,
+  MEM_WORDS,      /* word_t and code point arrays */
+  MEM_LIST_NODES, /* linked lists, their nodes and node slabs */
+  MEM_BUCKETS,    /* hash table bucket and slot arrays */
+  MEM_ITEMS,      /* hash table items */
+  MEM_MODEL,      /* frozen model images */
+  MEM_TRAIN,      /* training pairs, runs and scratch */
+  MEM_TAGS
+} mem_tag_t;
+
+typedef struct {
+  uint64_t live;   /* bytes requested and not yet freed */
+  uint64_t peak;   /* highest live */
+  uint64_t allocs; /* blocks handed out, reallocations excluded */
+  uint64_t frees;
+} mem_stats_t;
+
+void *dmalloc_tag(size_t size, mem_tag_t tag);
+/* 1 when accounting is compiled in. */
+int dmalloc_accounting(void);
+/* Counters of one subsystem, or of all of them for MEM_TAGS (the peak is
+ * then the peak of the total, not the sum of the peaks). */
+void dmalloc_stats(mem_tag_t tag, mem_stats_t *out);
+const char *mem_tag_name(mem_tag_t tag);
+/* One line per subsystem and a total, written with write(2) only, so a
+ * signal handler may call it. Returns 0 or -1. */
+int dmalloc_report(int fd);
+
+/* Write exactly len bytes (retrying short writes). Returns 0 or -1. */
+int write_all(int fd, const void *buf, size_t len);
+/* Read up to len bytes, stopping early only at end of file.
+ * Returns the number of bytes read or -1 on error. */
+ssize_t read_full(int fd, void *buf, size_t len);
+
+/* Write the decimal digits of value to out (no terminator, at most 20
+ * chars, two digits per step through a lookup table). Returns the length. */
+int format_u64(uint64_t value, char *out);
+/* Number of decimal digits format_u64 would write. */
+int u64_digits(uint64_t value);
+
+/* CLOCK_MONOTONIC in nanoseconds. */
+uint64_t monotonic_ns(void);
 
 #endif
@@ -0,0 +1,48 @@
+#ifndef VOCAB_H
+#define VOCAB_H
+
+#include "ht_template.h"
+#include "word.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Word dictionary: interns code point strings and hands out dense IDs
+ * (0, 1, 2, ... in order of first appearance). The lookup index is a
+ * table specialized by ht_template.h for code point string keys (pointing
+ * into the interned words) and ID values, so hashing and comparing the
+ * words is inlined.
+ */
+
+#define VOCAB_NO_ID UINT32_MAX
+
+HT_GENERATE(vocab_index, const int *, uint32_t, ht_hash_codepoints,
+            ht_eq_codepoints)
+
+typedef struct {
+  vocab_index_t index; /* code points -> ID */
+  word_t **words;      /* ID -> interned word */
+  uint32_t count;      /* number of distinct words */
+  uint32_t capacity;   /* allocated slots in words */
+  size_t pool_len;     /* code points of all words, terminators included */
+  size_t bytes;        /* approximate heap footprint of the dictionary */
+} vocab_t;
+
+vocab_t *create_vocab(int initial_size);
+
+/* Return the ID of word, adding it to the dictionary if it is new. The word
+ * is copied as is (no case folding). */
+uint32_t vocab_intern(vocab_t *vocab, const int *word);
+
+/* Return the ID of word or VOCAB_NO_ID if it was never interned. */
+uint32_t vocab_find(const vocab_t *vocab, const int *word);
+
+/* Code points of the word with the given ID (NUL terminated). */
+const int *vocab_word(const vocab_t *vocab, uint32_t id);
+
+uint32_t vocab_size(const vocab_t *vocab);
+size_t vocab_bytes(const vocab_t *vocab);
+
+void free_vocab(vocab_t *vocab);
+
+#endif /* VOCAB_H */
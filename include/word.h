@@ -22,14 +22,20 @@ int get_word_occurrences(const word_t *word);
 int wordcmp(const word_t *word1, const word_t *word2);
 int word_str_cmp(const int *word, const int *str);
 void update_ht_item_value(const void *item, const void *new_value);
+/* Item operations of a word -> followers table (create_hash_table_ops):
+ * followers are merged by update_ht_item_value, items freed by
+ * ht_item_free_word. */
+extern const ht_item_ops_t word_ht_item_ops;
 ht_item *word_ht_item_create(word_t *key, word_t *value);
+/* Same, with the follower list nodes taken from pool (which must outlive
+ * the item); lists merged into it by update_ht_item_value use it too. */
+ht_item *word_ht_item_create_pooled(word_t *key, word_t *value,
+                                    ll_pool_t *pool);
 unsigned int word_hash(const void *key, int size);
 void print_utf8_word(const word_t *word, int fd);
 void word_print(const word_t *word, int fd, int *between_char);
 void free_word(word_t *word);
 void ht_item_free_word(ht_item *item);
-static void word_followers_free_list(linked_list_t *list);
 int word_hashtable_keycmp(const void *key1, const void *key2);
-static word_t *word_deep_copy(const word_t *original);
 
 #endif
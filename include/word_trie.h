@@ -0,0 +1,52 @@
+#ifndef WORD_TRIE_H
+#define WORD_TRIE_H
+
+#include "model.h"
+#include "vocab.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Read-only word dictionary as a radix tree (a trie whose chains of
+ * single children are merged into one edge label). Inflected forms share
+ * their stem ("parlare", "parlava", "parlavano" store "parla" once), and
+ * the words come out of it in code point order (as model_word_cmp)
+ * without any sorting, so it also answers prefix queries.
+ *
+ * The tree is built in one go from a list of words and laid out in flat
+ * arrays: the children of a node are contiguous and ordered by the first
+ * code point of their label, which sits in its own array so that picking
+ * a child is a binary search over a few packed ints. A node is 16 bytes
+ * plus 4 for that code point; labels are code points in one pool.
+ */
+
+typedef struct word_trie word_trie_t;
+
+/* words[i] (NUL terminated code points) gets ids[i] (ids NULL: i). The
+ * words may come in any order; a duplicate keeps the last ID. */
+word_trie_t *create_word_trie(const int *const *words, const uint32_t *ids,
+                              uint32_t n);
+/* Every word of a dictionary or a model, with its ID. */
+word_trie_t *word_trie_from_vocab(const vocab_t *vocab);
+word_trie_t *word_trie_from_model(const model_t *model);
+
+/* ID of word (exact match), or VOCAB_NO_ID. */
+uint32_t word_trie_find(const word_trie_t *trie, const int *word);
+
+/* Called for every word found, in order; word is valid during the call
+ * only. Return 0 to go on, anything else to stop. */
+typedef int (*word_trie_visit_t)(void *ctx, const int *word, size_t length,
+                                 uint32_t id);
+
+/* Visit every word starting with prefix ("" or NULL: all of them), in
+ * code point order. Returns the number of words visited. */
+size_t word_trie_prefix(const word_trie_t *trie, const int *prefix,
+                        word_trie_visit_t visit, void *ctx);
+
+uint32_t word_trie_size(const word_trie_t *trie);
+/* Heap footprint: nodes, first code points, labels. */
+size_t word_trie_bytes(const word_trie_t *trie);
+
+void free_word_trie(word_trie_t *trie);
+
+#endif /* WORD_TRIE_H */
@@ -0,0 +1,714 @@
+#define _POSIX_C_SOURCE 200809L
+#include "../include/csv.h"
+#include "../include/utf8_tools.h"
+#include "../include/utils.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define CSV_BUFFER_SIZE (1 << 20)
+#define PROBABILITY_SCALE 1000000u /* six decimals */
+#define PROBABILITY_LEN 8          /* "0.123456" */
+
+/* Every word already encoded as a ready to copy CSV field. */
+typedef struct {
+  char *pool;
+  uint64_t *offsets; /* num_words + 1 */
+} csv_fields_t;
+
+typedef struct {
+  const model_t *model;
+  const csv_fields_t *fields;
+  const csv_export_config_t *config;
+  int fd;
+  uint32_t row_lo, row_hi; /* rows [row_lo, row_hi) */
+  uint64_t offset;         /* first byte of the shard in the file */
+  uint64_t size;           /* bytes of the shard */
+  int failed;
+} csv_shard_t;
+
+static void encode_fields(const model_t *model, char separator,
+                          csv_fields_t *fields) {
+  uint32_t n = model_num_words(model);
+  fields->offsets = dmalloc(sizeof(uint64_t) * ((size_t)n + 1));
+  /* Worst case: 4 bytes per code point, doubled quotes, two enclosing. */
+  size_t cap = 1024, used = 0;
+  fields->pool = dmalloc(cap);
+  for (uint32_t id = 0; id < n; ++id) {
+    const int *w = model_word(model, id);
+    size_t len = 0;
+    while (w[len] != '\0')
+      len++;
+    if (used + 8 * len + 2 > cap) {
+      while (used + 8 * len + 2 > cap)
+        cap *= 2;
+      fields->pool = drealloc(fields->pool, cap);
+    }
+    int quote = 0;
+    for (size_t i = 0; i < len; ++i) {
+      if (w[i] == separator || w[i] == '"' || w[i] == '\n' || w[i] == '\r')
+        quote = 1;
+    }
+    fields->offsets[id] = used;
+    char *out = fields->pool + used;
+    size_t k = 0;
+    if (quote)
+      out[k++] = '"';
+    for (size_t i = 0; i < len; ++i) {
+      if (w[i] == '"')
+        out[k++] = '"';
+      k += utf8_encode(w[i], out + k);
+    }
+    if (quote)
+      out[k++] = '"';
+    used += k;
+  }
+  fields->offsets[n] = used;
+}
+
+static uint64_t field_len(const csv_fields_t *fields, uint32_t id) {
+  return fields->offsets[id + 1] - fields->offsets[id];
+}
+
+static void *size_shard(void *arg) {
+  csv_shard_t *s = arg;
+  uint64_t size = 0;
+  for (uint32_t row = s->row_lo; row < s->row_hi; ++row) {
+    uint32_t n;
+    const model_edge_t *edges = model_followers(s->model, row, &n);
+    uint64_t prefix = field_len(s->fields, row) + 1; /* word + separator */
+    for (uint32_t i = 0; i < n; ++i) {
+      size += prefix + field_len(s->fields, edges[i].next) + 2;
+      if (s->config->value == CSV_VALUE_COUNT)
+        size += (uint64_t)u64_digits(edges[i].count);
+      else
+        size += PROBABILITY_LEN;
+    }
+  }
+  s->size = size;
+  return NULL;
+}
+
+/* "d.dddddd" for count / total rounded to six decimals. */
+static int format_probability(uint64_t count, uint64_t total, char *out) {
+  uint64_t scaled = (count * PROBABILITY_SCALE + total / 2) / total;
+  out[0] = (char)('0' + scaled / PROBABILITY_SCALE);
+  out[1] = '.';
+  uint64_t frac = scaled % PROBABILITY_SCALE;
+  for (int i = 7; i > 1; --i) {
+    out[i] = (char)('0' + frac % 10);
+    frac /= 10;
+  }
+  return PROBABILITY_LEN;
+}
+
+static void *format_shard(void *arg) {
+  csv_shard_t *s = arg;
+  char *buffer = dmalloc(CSV_BUFFER_SIZE);
+  size_t used = 0;
+  uint64_t pos = s->offset;
+  const char *pool = s->fields->pool;
+  char sep = s->config->separator;
+
+  for (uint32_t row = s->row_lo; row < s->row_hi && !s->failed; ++row) {
+    uint32_t n;
+    const model_edge_t *edges = model_followers(s->model, row, &n);
+    if (n == 0)
+      continue;
+    uint64_t total = 0;
+    if (s->config->value == CSV_VALUE_PROBABILITY)
+      total = model_row_total(s->model, row);
+    const char *word = pool + s->fields->offsets[row];
+    size_t word_len = (size_t)field_len(s->fields, row);
+
+    for (uint32_t i = 0; i < n; ++i) {
+      size_t next_len = (size_t)field_len(s->fields, edges[i].next);
+      if (used + word_len + next_len + 24 > CSV_BUFFER_SIZE) {
+        if (pwrite(s->fd, buffer, used, (off_t)pos) != (ssize_t)used) {
+          s->failed = 1;
+          break;
+        }
+        pos += used;
+        used = 0;
+      }
+      memcpy(buffer + used, word, word_len);
+      used += word_len;
+      buffer[used++] = sep;
+      memcpy(buffer + used, pool + s->fields->offsets[edges[i].next],
+             next_len);
+      used += next_len;
+      buffer[used++] = sep;
+      if (s->config->value == CSV_VALUE_COUNT)
+        used += (size_t)format_u64(edges[i].count, buffer + used);
+      else
+        used += (size_t)format_probability(edges[i].count, total,
+                                           buffer + used);
+      buffer[used++] = '\n';
+    }
+  }
+  if (!s->failed && used > 0 &&
+      pwrite(s->fd, buffer, used, (off_t)pos) != (ssize_t)used)
+    s->failed = 1;
+  dfree(buffer);
+  return NULL;
+}
+
+/* Run fn over every shard, on threads when there is more than one. */
+static void run_shards(csv_shard_t *shards, int count, void *(*fn)(void *)) {
+  if (count == 1) {
+    fn(&shards[0]);
+    return;
+  }
+  pthread_t *tids = dmalloc(sizeof(pthread_t) * count);
+  int started = 1;
+  for (; started < count; ++started) {
+    int rc = pthread_create(&tids[started], NULL, fn, &shards[started]);
+    if (rc != 0) {
+      fprintf(stderr, "model_export_csv: cannot start thread: %s\n",
+              strerror(rc));
+      break; /* the shards left are written here */
+    }
+  }
+  fn(&shards[0]);
+  for (int i = started; i < count; ++i)
+    fn(&shards[i]);
+  for (int i = 1; i < started; ++i)
+    pthread_join(tids[i], NULL);
+  dfree(tids);
+}
+
+int64_t model_export_csv(const model_t *model, const char *path,
+                         const csv_export_config_t *config) {
+  csv_export_config_t defaults = {',', CSV_VALUE_COUNT, 1, 1};
+  if (config == NULL)
+    config = &defaults;
+  if (model == NULL || path == NULL)
+    return -1;
+
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    perror(path);
+    return -1;
+  }
+
+  csv_fields_t fields;
+  encode_fields(model, config->separator, &fields);
+
+  char header[64];
+  int header_len = 0;
+  if (config->header)
+    header_len = snprintf(header, sizeof header, "word%cfollower%c%s\n",
+                          config->separator, config->separator,
+                          config->value == CSV_VALUE_COUNT ? "count"
+                                                           : "probability");
+
+  /* Shards of about the same number of edges. */
+  uint32_t words = model_num_words(model);
+  uint64_t edges = model_num_edges(model);
+  int threads = config->threads > 1 ? config->threads : 1;
+  if ((uint32_t)threads > words)
+    threads = words ? (int)words : 1;
+  csv_shard_t *shards = dmalloc(sizeof(csv_shard_t) * threads);
+  uint32_t row = 0;
+  for (int i = 0; i < threads; ++i) {
+    uint64_t target = edges * (uint64_t)(i + 1) / (uint64_t)threads;
+    shards[i].model = model;
+    shards[i].fields = &fields;
+    shards[i].config = config;
+    shards[i].fd = fd;
+    shards[i].row_lo = row;
+    while (row < words && (i == threads - 1 || model->row_offsets[row] < target))
+      row++;
+    shards[i].row_hi = row;
+  }
+
+  run_shards(shards, threads, size_shard);
+  uint64_t offset = (uint64_t)header_len;
+  for (int i = 0; i < threads; ++i) {
+    shards[i].offset = offset;
+    offset += shards[i].size;
+  }
+
+  int failed = 0;
+  if (header_len > 0 && write_all(fd, header, (size_t)header_len) != 0)
+    failed = 1;
+  if (!failed && ftruncate(fd, (off_t)offset) != 0)
+    failed = 1;
+  if (!failed) {
+    run_shards(shards, threads, format_shard);
+    for (int i = 0; i < threads; ++i)
+      failed |= shards[i].failed;
+  }
+  if (close(fd) != 0)
+    failed = 1;
+  if (failed)
+    perror(path);
+
+  dfree(shards);
+  dfree(fields.pool);
+  dfree(fields.offsets);
+  return failed ? -1 : (int64_t)offset;
+}
+
+/* ------------------------------------------------------------------
+ * Import
+ * ------------------------------------------------------------------ */
+#define IMPORT_MIN_CHUNK (1 << 20)
+#define IMPORT_MAX_WORD 256 /* code points */
+
+typedef struct {
+  uint32_t word, next; /* chunk local IDs */
+  uint32_t count;
+} csv_record_t;
+
+typedef struct {
+  const char *ptr;
+  uint32_t len;
+  uint32_t hash;
+} csv_span_t;
+
+typedef struct {
+  const char *begin, *end; /* whole lines */
+  char separator;
+
+  /* private dictionary: spans by local ID, open addressing on top */
+  csv_span_t *spans;
+  uint32_t num_spans, spans_cap;
+  uint32_t *slots; /* local ID + 1, 0 when empty */
+  uint32_t slots_cap;
+  int *codepoints;          /* decoded words, back to back */
+  size_t cp_len, cp_cap;
+  uint64_t *cp_offsets;     /* by local ID */
+  char **owned;             /* unescaped copies of quoted fields */
+  uint32_t num_owned, owned_cap;
+
+  csv_record_t *records;
+  size_t num_records, records_cap;
+
+  uint64_t lines;      /* lines parsed */
+  uint64_t error_line; /* chunk relative, 0 if none */
+  const char *error;
+} csv_chunk_t;
+
+typedef struct {
+  csv_chunk_t *chunks;
+  uint32_t num_chunks;
+  uint32_t next_chunk; /* shared work counter */
+} csv_import_job_t;
+
+static uint32_t span_hash(const char *p, uint32_t len) {
+  uint32_t h = 2166136261u; /* FNV-1a */
+  for (uint32_t i = 0; i < len; ++i)
+    h = (h ^ (unsigned char)p[i]) * 16777619u;
+  return h;
+}
+
+static void chunk_grow_slots(csv_chunk_t *c) {
+  uint32_t cap = c->slots_cap ? c->slots_cap * 2 : 1024;
+  uint32_t *slots = dmalloc(sizeof(uint32_t) * cap);
+  for (uint32_t id = 0; id < c->num_spans; ++id) {
+    uint32_t i = c->spans[id].hash & (cap - 1);
+    while (slots[i] != 0)
+      i = (i + 1) & (cap - 1);
+    slots[i] = id + 1;
+  }
+  dfree(c->slots);
+  c->slots = slots;
+  c->slots_cap = cap;
+}
+
+/* Local ID of a field, interning (and decoding) it on first sight.
+ * Returns UINT32_MAX and sets c->error on a bad word. */
+static uint32_t chunk_intern(csv_chunk_t *c, const char *p, uint32_t len) {
+  if ((c->num_spans + 1) * 2 > c->slots_cap)
+    chunk_grow_slots(c);
+  uint32_t h = span_hash(p, len);
+  uint32_t i = h & (c->slots_cap - 1);
+  while (c->slots[i] != 0) {
+    const csv_span_t *s = &c->spans[c->slots[i] - 1];
+    if (s->hash == h && s->len == len && memcmp(s->ptr, p, len) == 0)
+      return c->slots[i] - 1;
+    i = (i + 1) & (c->slots_cap - 1);
+  }
+
+  if (c->cp_len + IMPORT_MAX_WORD + 1 > c->cp_cap) {
+    c->cp_cap = c->cp_cap ? c->cp_cap * 2 : 4096;
+    c->codepoints = drealloc(c->codepoints, sizeof(int) * c->cp_cap);
+  }
+  int n = utf8_decode(p, len, c->codepoints + c->cp_len, IMPORT_MAX_WORD);
+  if (n == UTF8_ERROR) {
+    c->error = "invalid UTF-8 in word";
+    return UINT32_MAX;
+  }
+  if (n < 0) {
+    c->error = "word too long";
+    return UINT32_MAX;
+  }
+
+  if (c->num_spans == c->spans_cap) {
+    c->spans_cap = c->spans_cap ? c->spans_cap * 2 : 256;
+    c->spans = drealloc(c->spans, sizeof(csv_span_t) * c->spans_cap);
+    c->cp_offsets =
+        drealloc(c->cp_offsets, sizeof(uint64_t) * c->spans_cap);
+  }
+  uint32_t id = c->num_spans++;
+  c->spans[id].ptr = p;
+  c->spans[id].len = len;
+  c->spans[id].hash = h;
+  c->cp_offsets[id] = c->cp_len;
+  c->cp_len += (size_t)n;
+  c->codepoints[c->cp_len++] = '\0';
+  c->slots[i] = id + 1;
+  return id;
+}
+
+/* Parse one field starting at *pos; leaves *pos on the byte after it. */
+static uint32_t parse_field(csv_chunk_t *c, const char **pos) {
+  const char *p = *pos, *end = c->end;
+  if (p < end && *p == '"') {
+    const char *start = ++p;
+    int escaped = 0;
+    for (;;) {
+      if (p >= end || *p == '\n') {
+        c->error = "unterminated quoted field";
+        return UINT32_MAX;
+      }
+      if (*p == '"') {
+        if (p + 1 < end && p[1] == '"') {
+          escaped = 1;
+          p += 2;
+          continue;
+        }
+        break;
+      }
+      p++;
+    }
+    *pos = p + 1;
+    uint32_t len = (uint32_t)(p - start);
+    if (!escaped)
+      return len ? chunk_intern(c, start, len)
+                 : (c->error = "empty word", UINT32_MAX);
+    /* Unescape "" into a private copy that lives as long as the chunk. */
+    char *copy = dmalloc(len);
+    uint32_t k = 0;
+    for (uint32_t i = 0; i < len; ++i) {
+      copy[k++] = start[i];
+      if (start[i] == '"')
+        i++;
+    }
+    if (c->num_owned == c->owned_cap) {
+      c->owned_cap = c->owned_cap ? c->owned_cap * 2 : 16;
+      c->owned = drealloc(c->owned, sizeof(char *) * c->owned_cap);
+    }
+    c->owned[c->num_owned++] = copy;
+    return chunk_intern(c, copy, k);
+  }
+
+  const char *start = p;
+  while (p < end && *p != c->separator && *p != '\n' && *p != '\r')
+    p++;
+  *pos = p;
+  if (p == start) {
+    c->error = "empty word";
+    return UINT32_MAX;
+  }
+  return chunk_intern(c, start, (uint32_t)(p - start));
+}
+
+static int parse_count(csv_chunk_t *c, const char **pos, uint32_t *count) {
+  const char *p = *pos;
+  uint64_t value = 0;
+  int digits = 0;
+  while (p < c->end && *p >= '0' && *p <= '9') {
+    value = value * 10 + (uint64_t)(*p - '0');
+    if (value > UINT32_MAX) {
+      c->error = "count out of range";
+      return -1;
+    }
+    p++;
+    digits++;
+  }
+  if (p < c->end && *p == '.') {
+    c->error = "count is not an integer (probability export?)";
+    return -1;
+  }
+  if (digits == 0) {
+    c->error = "missing count";
+    return -1;
+  }
+  if (value == 0) {
+    c->error = "count must be positive";
+    return -1;
+  }
+  if (p < c->end && *p == '\r')
+    p++;
+  if (p < c->end && *p != '\n') {
+    c->error = "trailing characters after count";
+    return -1;
+  }
+  *pos = p < c->end ? p + 1 : p;
+  *count = (uint32_t)value;
+  return 0;
+}
+
+static void parse_chunk(csv_chunk_t *c) {
+  const char *p = c->begin;
+  while (p < c->end) {
+    c->lines++;
+    if (*p == '\n' || (*p == '\r' && p + 1 < c->end && p[1] == '\n')) {
+      p += *p == '\n' ? 1 : 2; /* blank line */
+      continue;
+    }
+    csv_record_t rec;
+    rec.word = parse_field(c, &p);
+    if (rec.word == UINT32_MAX)
+      goto fail;
+    if (p >= c->end || *p != c->separator) {
+      c->error = "expected 3 fields";
+      goto fail;
+    }
+    p++;
+    rec.next = parse_field(c, &p);
+    if (rec.next == UINT32_MAX)
+      goto fail;
+    if (p >= c->end || *p != c->separator) {
+      c->error = "expected 3 fields";
+      goto fail;
+    }
+    p++;
+    if (parse_count(c, &p, &rec.count) != 0)
+      goto fail;
+
+    if (c->num_records == c->records_cap) {
+      c->records_cap = c->records_cap ? c->records_cap * 2 : 4096;
+      c->records =
+          drealloc(c->records, sizeof(csv_record_t) * c->records_cap);
+    }
+    c->records[c->num_records++] = rec;
+  }
+  return;
+fail:
+  c->error_line = c->lines;
+}
+
+static void *import_worker(void *arg) {
+  csv_import_job_t *job = arg;
+  for (;;) {
+    uint32_t i = __atomic_fetch_add(&job->next_chunk, 1, __ATOMIC_RELAXED);
+    if (i >= job->num_chunks)
+      return NULL;
+    parse_chunk(&job->chunks[i]);
+  }
+}
+
+static void free_chunk(csv_chunk_t *c) {
+  for (uint32_t i = 0; i < c->num_owned; ++i)
+    dfree(c->owned[i]);
+  dfree(c->owned);
+  dfree(c->spans);
+  dfree(c->slots);
+  dfree(c->codepoints);
+  dfree(c->cp_offsets);
+  dfree(c->records);
+}
+
+/* Merge the chunk results into a vocabulary and CSR rows. */
+static model_t *build_imported(csv_chunk_t *chunks, uint32_t num_chunks) {
+  vocab_t *vocab = create_vocab(1024);
+  uint32_t **remap = dmalloc(sizeof(uint32_t *) * num_chunks);
+  size_t total = 0;
+  for (uint32_t k = 0; k < num_chunks; ++k) {
+    csv_chunk_t *c = &chunks[k];
+    remap[k] = dmalloc(sizeof(uint32_t) * (c->num_spans + 1));
+    for (uint32_t id = 0; id < c->num_spans; ++id)
+      remap[k][id] = vocab_intern(vocab, c->codepoints + c->cp_offsets[id]);
+    total += c->num_records;
+  }
+
+  /* Two stable counting sorts, on the follower then on the word, leave
+   * every row ordered by follower without a comparison sort. */
+  uint32_t words = vocab_size(vocab);
+  uint64_t *rows = dmalloc(sizeof(uint64_t) * ((size_t)words + 1));
+  uint64_t *cursor = dmalloc(sizeof(uint64_t) * ((size_t)words + 1));
+  csv_record_t *by_next = dmalloc(sizeof(csv_record_t) * (total + 1));
+  for (uint32_t k = 0; k < num_chunks; ++k) {
+    for (size_t i = 0; i < chunks[k].num_records; ++i)
+      cursor[remap[k][chunks[k].records[i].next] + 1]++;
+  }
+  for (uint32_t w = 0; w < words; ++w)
+    cursor[w + 1] += cursor[w];
+  for (uint32_t k = 0; k < num_chunks; ++k) {
+    for (size_t i = 0; i < chunks[k].num_records; ++i) {
+      const csv_record_t *r = &chunks[k].records[i];
+      csv_record_t *e = &by_next[cursor[remap[k][r->next]]++];
+      e->word = remap[k][r->word];
+      e->next = remap[k][r->next];
+      e->count = r->count;
+      rows[e->word + 1]++;
+    }
+    dfree(remap[k]);
+  }
+  dfree(remap);
+
+  for (uint32_t w = 0; w < words; ++w)
+    rows[w + 1] += rows[w];
+  memcpy(cursor, rows, sizeof(uint64_t) * ((size_t)words + 1));
+  model_edge_t *edges = dmalloc(sizeof(model_edge_t) * (total + 1));
+  for (size_t i = 0; i < total; ++i) {
+    model_edge_t *e = &edges[cursor[by_next[i].word]++];
+    e->next = by_next[i].next;
+    e->count = by_next[i].count;
+  }
+  dfree(by_next);
+
+  /* Fold repeated lines together. */
+  uint64_t out = 0;
+  for (uint32_t w = 0; w < words; ++w) {
+    uint64_t begin = rows[w], end = rows[w + 1];
+    rows[w] = out;
+    for (uint64_t i = begin; i < end; ++i) {
+      if (out > rows[w] && edges[out - 1].next == edges[i].next) {
+        uint64_t sum = (uint64_t)edges[out - 1].count + edges[i].count;
+        edges[out - 1].count = sum > UINT32_MAX ? UINT32_MAX : (uint32_t)sum;
+      } else {
+        edges[out++] = edges[i];
+      }
+    }
+  }
+  rows[words] = out;
+
+  model_t *model = model_build(vocab, rows, edges);
+  dfree(cursor);
+  dfree(edges);
+  dfree(rows);
+  free_vocab(vocab);
+  return model;
+}
+
+model_t *model_import_csv(const char *path, const csv_import_config_t *config) {
+  csv_import_config_t defaults = {0, 1};
+  if (config == NULL)
+    config = &defaults;
+  if (path == NULL)
+    return NULL;
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    perror(path);
+    return NULL;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    perror(path);
+    close(fd);
+    return NULL;
+  }
+  size_t size = (size_t)st.st_size;
+  const char *data = NULL;
+  if (size > 0) {
+    data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      perror(path);
+      close(fd);
+      return NULL;
+    }
+  }
+  close(fd);
+
+  const char *begin = data, *end = data + size;
+  const char *eol = size ? memchr(begin, '\n', size) : NULL;
+  const char *first_end = eol ? eol : end;
+  char separator = config->separator;
+  if (separator == 0)
+    separator = memchr(begin, '\t', (size_t)(first_end - begin)) ? '\t' : ',';
+
+  /* Optional header line. */
+  uint64_t line_base = 0;
+  char header[32];
+  int header_len = snprintf(header, sizeof header, "word%cfollower%c",
+                            separator, separator);
+  if (first_end - begin >= header_len &&
+      memcmp(begin, header, (size_t)header_len) == 0) {
+    const char *value = begin + header_len;
+    if ((size_t)(first_end - value) >= 11 &&
+        memcmp(value, "probability", 11) == 0) {
+      fprintf(stderr, "%s:1: probabilities cannot be imported, export counts\n",
+              path);
+      munmap((void *)data, size);
+      return NULL;
+    }
+    begin = eol ? eol + 1 : end;
+    line_base = 1;
+  }
+
+  /* Line-aligned chunks, several per thread so fast workers take more. */
+  int threads = config->threads > 1 ? config->threads : 1;
+  size_t chunk_size = (size_t)(end - begin) / ((size_t)threads * 4);
+  if (chunk_size < IMPORT_MIN_CHUNK)
+    chunk_size = IMPORT_MIN_CHUNK;
+  uint32_t cap = (uint32_t)((size_t)(end - begin) / chunk_size + 2);
+  csv_chunk_t *chunks = dmalloc(sizeof(csv_chunk_t) * cap);
+  uint32_t num_chunks = 0;
+  const char *p = begin;
+  while (p < end) {
+    const char *stop = p + chunk_size < end ? p + chunk_size : end;
+    if (stop < end) {
+      const char *nl = memchr(stop, '\n', (size_t)(end - stop));
+      stop = nl ? nl + 1 : end;
+    }
+    chunks[num_chunks].begin = p;
+    chunks[num_chunks].end = stop;
+    chunks[num_chunks].separator = separator;
+    num_chunks++;
+    p = stop;
+  }
+
+  csv_import_job_t job = {chunks, num_chunks, 0};
+  if (threads > (int)num_chunks)
+    threads = num_chunks ? (int)num_chunks : 1;
+  if (threads == 1) {
+    import_worker(&job);
+  } else {
+    pthread_t *tids = dmalloc(sizeof(pthread_t) * threads);
+    int started = 1;
+    for (; started < threads; ++started) {
+      int rc = pthread_create(&tids[started], NULL, import_worker, &job);
+      if (rc != 0) {
+        fprintf(stderr, "model_import_csv: cannot start thread: %s\n",
+                strerror(rc));
+        break; /* the others take its chunks */
+      }
+    }
+    import_worker(&job);
+    for (int t = 1; t < started; ++t)
+      pthread_join(tids[t], NULL);
+    dfree(tids);
+  }
+
+  model_t *model = NULL;
+  uint64_t line = line_base;
+  uint32_t bad = num_chunks;
+  for (uint32_t k = 0; k < num_chunks; ++k) {
+    if (chunks[k].error) {
+      fprintf(stderr, "%s:%llu: %s\n", path,
+              (unsigned long long)(line + chunks[k].error_line),
+              chunks[k].error);
+      bad = k;
+      break;
+    }
+    line += chunks[k].lines;
+  }
+  if (bad == num_chunks)
+    model = build_imported(chunks, num_chunks);
+
+  for (uint32_t k = 0; k < num_chunks; ++k)
+    free_chunk(&chunks[k]);
+  dfree(chunks);
+  if (data)
+    munmap((void *)data, size);
+  return model;
+}
@@ -0,0 +1,696 @@
+#define _POSIX_C_SOURCE 200809L
+#include "../include/delta_log.h"
+#include "../include/ht_template.h"
+#include "../include/radix_sort.h"
+#include "../include/utils.h"
+#include "../include/vocab.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define RECORD_SIZE 16 /* u32 word, u32 next, i64 delta */
+#define COPY_BUFFER_SIZE (1 << 20)
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t fingerprint;
+  uint32_t reserved;
+} log_header_t;
+
+typedef struct {
+  uint32_t magic;
+  uint32_t crc; /* of the fields below and the payload */
+  uint32_t words;
+  uint32_t records;
+  uint64_t payload;
+} batch_header_t;
+
+/* (word << 32 | next) -> summed delta */
+HT_GENERATE(delta_map, uint64_t, int64_t, ht_hash_u64, HT_EQ_SCALAR)
+
+struct delta_log {
+  pthread_mutex_t lock; /* fd, end and fingerprint, swapped by compaction */
+  int fd;
+  uint64_t end; /* bytes committed */
+  uint32_t fingerprint;
+  char *path;
+
+  vocab_t *words;      /* pending batch: its words */
+  delta_map_t pending; /* and its deltas, by pair of those words */
+
+  pthread_t compactor;
+  int compacting;
+  int compact_rc;
+  char *model_path;
+};
+
+/* CRC-32C (Castagnoli), a byte at a time from a table. */
+static uint32_t crc_table[256];
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+static void crc_init(void) {
+  for (uint32_t i = 0; i < 256; ++i) {
+    uint32_t c = i;
+    for (int k = 0; k < 8; ++k)
+      c = c & 1 ? (c >> 1) ^ 0x82F63B78u : c >> 1;
+    crc_table[i] = c;
+  }
+}
+
+static uint32_t crc32c(uint32_t crc, const void *data, size_t len) {
+  pthread_once(&crc_once, crc_init);
+  const unsigned char *p = data;
+  crc = ~crc;
+  while (len--)
+    crc = crc_table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+  return ~crc;
+}
+
+uint32_t delta_log_fingerprint(const model_t *base) {
+  if (base == NULL)
+    return 0;
+  uint32_t crc = crc32c(0, base->header, sizeof(model_header_t));
+  return crc32c(crc, base->row_totals,
+                sizeof(uint64_t) * base->header->num_words);
+}
+
+static char *with_suffix(const char *path, const char *suffix) {
+  size_t len = strlen(path), extra = strlen(suffix);
+  char *out = dmalloc(len + extra + 1);
+  memcpy(out, path, len);
+  memcpy(out + len, suffix, extra + 1);
+  return out;
+}
+
+static size_t word_length(const int *word) {
+  size_t len = 0;
+  while (word[len] != '\0')
+    len++;
+  return len;
+}
+
+/* pread until len bytes or the end of the file. Returns 0 if all came. */
+static int pread_all(int fd, void *buf, size_t len, uint64_t offset) {
+  char *p = buf;
+  while (len > 0) {
+    ssize_t got = pread(fd, p, len, (off_t)offset);
+    if (got < 0 && errno == EINTR)
+      continue;
+    if (got <= 0)
+      return -1;
+    p += got;
+    len -= (size_t)got;
+    offset += (uint64_t)got;
+  }
+  return 0;
+}
+
+static int check_header(int fd, const char *path, uint32_t fingerprint) {
+  log_header_t h;
+  if (pread_all(fd, &h, sizeof(h), 0) != 0 || h.magic != DELTA_LOG_MAGIC) {
+    fprintf(stderr, "%s: not a delta log\n", path);
+    return -1;
+  }
+  if (h.version != DELTA_LOG_VERSION) {
+    fprintf(stderr, "%s: delta log version %u, expected %u\n", path,
+            h.version, DELTA_LOG_VERSION);
+    return -1;
+  }
+  if (h.fingerprint != fingerprint) {
+    fprintf(stderr, "%s: delta log of another base model\n", path);
+    return -1;
+  }
+  return 0;
+}
+
+static int write_header(int fd, uint32_t fingerprint) {
+  log_header_t h = {DELTA_LOG_MAGIC, DELTA_LOG_VERSION, fingerprint, 0};
+  if (lseek(fd, 0, SEEK_SET) != 0 || write_all(fd, &h, sizeof(h)) != 0)
+    return -1;
+  return fdatasync(fd);
+}
+
+/* Read the batch at pos into *buf (grown as needed) and check it.
+ * Returns its size, header included, or 0 if it is torn or corrupted. */
+static uint64_t read_batch(int fd, uint64_t pos, uint64_t end,
+                           batch_header_t *h, char **buf, size_t *cap) {
+  if (end - pos < sizeof(*h) || pread_all(fd, h, sizeof(*h), pos) != 0)
+    return 0;
+  uint64_t room = end - pos - sizeof(*h);
+  if (h->magic != DELTA_LOG_BATCH_MAGIC || h->payload > room ||
+      h->payload < (uint64_t)h->records * RECORD_SIZE +
+                       (uint64_t)h->words * 2 * sizeof(int) ||
+      (h->payload - (uint64_t)h->records * RECORD_SIZE) % sizeof(int) != 0)
+    return 0;
+  if (h->payload > *cap) {
+    dfree(*buf);
+    *cap = (size_t)h->payload;
+    *buf = dmalloc(*cap);
+  }
+  if (pread_all(fd, *buf, (size_t)h->payload, pos + sizeof(*h)) != 0)
+    return 0;
+  uint32_t crc = crc32c(0, &h->words, sizeof(*h) - 2 * sizeof(uint32_t));
+  if (crc32c(crc, *buf, (size_t)h->payload) != h->crc)
+    return 0;
+  return sizeof(*h) + h->payload;
+}
+
+/* Sum the records of a checked batch into deltas, with its words
+ * interned into vocab. Returns 0, or -1 if the batch does not parse. */
+static int apply_batch(const batch_header_t *h, const char *payload,
+                       vocab_t *vocab, delta_map_t *deltas) {
+  uint64_t word_ints =
+      (h->payload - (uint64_t)h->records * RECORD_SIZE) / sizeof(int);
+  const int *pool = (const int *)payload;
+  uint32_t *ids = dmalloc(sizeof(uint32_t) * ((size_t)h->words + 1));
+  uint64_t pos = 0;
+  int rc = 0;
+  for (uint32_t i = 0; i < h->words && rc == 0; ++i) {
+    uint64_t len = 0;
+    while (pos + len < word_ints && pool[pos + len] != '\0')
+      len++;
+    if (len == 0 || len >= MAX_WORD_LENGTH || pos + len == word_ints)
+      rc = -1;
+    else
+      ids[i] = vocab_intern(vocab, pool + pos);
+    pos += len + 1;
+  }
+  if (pos != word_ints)
+    rc = -1;
+  const char *records = payload + word_ints * sizeof(int);
+  for (uint32_t r = 0; r < h->records && rc == 0; ++r) {
+    uint32_t pair[2];
+    memcpy(pair, records + (size_t)r * RECORD_SIZE, sizeof(pair));
+    if (pair[0] >= h->words || pair[1] >= h->words)
+      rc = -1;
+  }
+  /* all or nothing: checked before the first record is summed */
+  for (uint32_t r = 0; r < h->records && rc == 0; ++r) {
+    const char *record = records + (size_t)r * RECORD_SIZE;
+    uint32_t pair[2];
+    int64_t delta;
+    memcpy(pair, record, sizeof(pair));
+    memcpy(&delta, record + sizeof(pair), sizeof(delta));
+    uint64_t key = (uint64_t)ids[pair[0]] << 32 | ids[pair[1]];
+    *delta_map_upsert(deltas, key, NULL) += delta;
+  }
+  dfree(ids);
+  return rc;
+}
+
+/* Apply every valid batch in [pos, end). Returns where the valid batches
+ * stop (end if all of them are). */
+static uint64_t read_deltas(int fd, uint64_t pos, uint64_t end,
+                            vocab_t *vocab, delta_map_t *deltas,
+                            delta_log_stats_t *stats) {
+  char *buf = NULL;
+  size_t cap = 0;
+  batch_header_t h;
+  while (pos < end) {
+    uint64_t size = read_batch(fd, pos, end, &h, &buf, &cap);
+    if (size == 0 || apply_batch(&h, buf, vocab, deltas) != 0)
+      break;
+    pos += size;
+    if (stats) {
+      stats->batches++;
+      stats->records += h.records;
+    }
+  }
+  dfree(buf);
+  return pos;
+}
+
+/* Valid batches from pos on, without applying them. */
+static uint64_t scan_batches(int fd, uint64_t pos, uint64_t end) {
+  char *buf = NULL;
+  size_t cap = 0;
+  batch_header_t h;
+  while (pos < end) {
+    uint64_t size = read_batch(fd, pos, end, &h, &buf, &cap);
+    if (size == 0)
+      break;
+    pos += size;
+  }
+  dfree(buf);
+  return pos;
+}
+
+/* The words of base, with their IDs, ready for new ones after them. */
+static vocab_t *base_vocab(const model_t *base) {
+  uint32_t n = model_num_words(base);
+  vocab_t *vocab = create_vocab((int)n + 16);
+  for (uint32_t i = 0; i < n; ++i)
+    vocab_intern(vocab, model_word(base, i));
+  return vocab;
+}
+
+/* Build base + deltas: every row of base merged, by follower, with the
+ * deltas of its word, sorted once by (word, follower). */
+static model_t *merge_deltas(const model_t *base, const vocab_t *vocab,
+                             const delta_map_t *deltas) {
+  size_t m = deltas->count;
+  uint64_t *keys = dmalloc_tag(sizeof(uint64_t) * (m + 1), MEM_TRAIN);
+  int64_t *values = dmalloc_tag(sizeof(int64_t) * (m + 1), MEM_TRAIN);
+  size_t pos = 0, k = 0;
+  uint64_t key;
+  int64_t *value;
+  while (delta_map_next(deltas, &pos, &key, &value))
+    keys[k++] = key;
+  radix_sort_u64(keys, (uint64_t *)values, m, 1); /* values as scratch */
+  for (k = 0; k < m; ++k)
+    values[k] = *delta_map_find(deltas, keys[k]);
+
+  uint32_t n = model_num_words(base), words = vocab_size(vocab);
+  uint64_t *rows = dmalloc_tag(sizeof(uint64_t) * ((size_t)words + 1),
+                               MEM_TRAIN);
+  model_edge_t *edges = dmalloc_tag(
+      sizeof(model_edge_t) * (model_num_edges(base) + m + 1), MEM_TRAIN);
+  uint64_t e = 0;
+  k = 0;
+  for (uint32_t w = 0; w < words; ++w) {
+    rows[w] = e;
+    uint32_t len = 0;
+    const model_edge_t *row = w < n ? model_followers(base, w, &len) : NULL;
+    uint32_t i = 0;
+    for (;;) {
+      int has_delta = k < m && (uint32_t)(keys[k] >> 32) == w;
+      if (i == len && !has_delta)
+        break;
+      uint32_t next;
+      int64_t count = 0;
+      if (i < len && (!has_delta || row[i].next <= (uint32_t)keys[k])) {
+        next = row[i].next;
+        count = row[i++].count;
+        if (has_delta && (uint32_t)keys[k] == next)
+          count += values[k++];
+      } else {
+        next = (uint32_t)keys[k];
+        count = values[k++];
+      }
+      if (count <= 0)
+        continue;
+      edges[e].next = next;
+      edges[e].count = count > UINT32_MAX ? UINT32_MAX : (uint32_t)count;
+      e++;
+    }
+  }
+  rows[words] = e;
+  model_t *model = model_build(vocab, rows, edges);
+  dfree(edges);
+  dfree(rows);
+  dfree(values);
+  dfree(keys);
+  return model;
+}
+
+model_t *delta_log_load(const char *model_path, const char *log_path,
+                        delta_log_stats_t *stats) {
+  delta_log_stats_t local;
+  if (stats == NULL)
+    stats = &local;
+  memset(stats, 0, sizeof(*stats));
+  model_t *base = model_load(model_path);
+  if (base == NULL || log_path == NULL)
+    return base;
+  int fd = open(log_path, O_RDONLY);
+  if (fd < 0) {
+    if (errno == ENOENT)
+      return base;
+    perror(log_path);
+    free_model(base);
+    return NULL;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    return base;
+  }
+  if (check_header(fd, log_path, delta_log_fingerprint(base)) != 0) {
+    close(fd);
+    free_model(base);
+    return NULL;
+  }
+  uint64_t end = (uint64_t)st.st_size;
+  vocab_t *vocab = base_vocab(base);
+  delta_map_t deltas;
+  delta_map_init(&deltas, 1024);
+  stats->bytes = read_deltas(fd, sizeof(log_header_t), end, vocab, &deltas,
+                             stats);
+  stats->ignored = end - stats->bytes;
+  close(fd);
+  if (stats->ignored)
+    fprintf(stderr, "%s: ignoring %llu bytes of a torn or corrupted batch\n",
+            log_path, (unsigned long long)stats->ignored);
+
+  model_t *model = base;
+  if (stats->records > 0) {
+    model = merge_deltas(base, vocab, &deltas);
+    free_model(base);
+  }
+  delta_map_destroy(&deltas);
+  free_vocab(vocab);
+  return model;
+}
+
+/* ------------------------------------------------------------------
+ * Appending
+ * ------------------------------------------------------------------ */
+static void reset_pending(delta_log_t *log) {
+  free_vocab(log->words);
+  delta_map_destroy(&log->pending);
+  log->words = create_vocab(64);
+  delta_map_init(&log->pending, 64);
+}
+
+delta_log_t *delta_log_open(const char *path, const model_t *base) {
+  if (path == NULL || base == NULL)
+    return NULL;
+  int fd = open(path, O_RDWR | O_CREAT, 0644);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    perror(path);
+    if (fd >= 0)
+      close(fd);
+    return NULL;
+  }
+  uint32_t fingerprint = delta_log_fingerprint(base);
+  uint64_t size = (uint64_t)st.st_size, end = sizeof(log_header_t);
+  if (size == 0) {
+    if (write_header(fd, fingerprint) != 0) {
+      perror(path);
+      close(fd);
+      return NULL;
+    }
+  } else {
+    if (check_header(fd, path, fingerprint) != 0) {
+      close(fd);
+      return NULL;
+    }
+    end = scan_batches(fd, end, size);
+    if (end < size) {
+      fprintf(stderr, "%s: truncating %llu bytes of a torn batch\n", path,
+              (unsigned long long)(size - end));
+      if (ftruncate(fd, (off_t)end) != 0) {
+        perror(path);
+        close(fd);
+        return NULL;
+      }
+    }
+  }
+
+  delta_log_t *log = dmalloc(sizeof(delta_log_t));
+  pthread_mutex_init(&log->lock, NULL);
+  log->fd = fd;
+  log->end = end;
+  log->fingerprint = fingerprint;
+  log->path = with_suffix(path, "");
+  log->words = create_vocab(64);
+  delta_map_init(&log->pending, 64);
+  return log;
+}
+
+int delta_log_add(delta_log_t *log, const int *word, const int *next,
+                  int64_t delta) {
+  if (log == NULL || word == NULL || next == NULL || word[0] == '\0' ||
+      next[0] == '\0') {
+    fprintf(stderr, "delta_log_add: missing word\n");
+    return -1;
+  }
+  if (word_length(word) >= MAX_WORD_LENGTH ||
+      word_length(next) >= MAX_WORD_LENGTH) {
+    fprintf(stderr, "delta_log_add: word longer than %d code points\n",
+            MAX_WORD_LENGTH - 1);
+    return -1;
+  }
+  if (delta == 0)
+    return 0;
+  uint64_t key = (uint64_t)vocab_intern(log->words, word) << 32 |
+                 vocab_intern(log->words, next);
+  *delta_map_upsert(&log->pending, key, NULL) += delta;
+  return 0;
+}
+
+int delta_log_add_model(delta_log_t *log, const model_t *model) {
+  if (log == NULL || model == NULL)
+    return -1;
+  uint32_t n = model_num_words(model);
+  uint32_t *ids = dmalloc(sizeof(uint32_t) * ((size_t)n + 1));
+  for (uint32_t w = 0; w < n; ++w)
+    ids[w] = VOCAB_NO_ID;
+  for (uint32_t w = 0; w < n; ++w) {
+    uint32_t len;
+    const model_edge_t *row = model_followers(model, w, &len);
+    if (len == 0)
+      continue;
+    if (ids[w] == VOCAB_NO_ID)
+      ids[w] = vocab_intern(log->words, model_word(model, w));
+    for (uint32_t i = 0; i < len; ++i) {
+      uint32_t next = row[i].next;
+      if (ids[next] == VOCAB_NO_ID)
+        ids[next] = vocab_intern(log->words, model_word(model, next));
+      *delta_map_upsert(&log->pending, (uint64_t)ids[w] << 32 | ids[next],
+                        NULL) += row[i].count;
+    }
+  }
+  dfree(ids);
+  return 0;
+}
+
+int delta_log_commit(delta_log_t *log) {
+  if (log == NULL)
+    return -1;
+  if (log->pending.count == 0)
+    return 0;
+  batch_header_t h = {DELTA_LOG_BATCH_MAGIC, 0, vocab_size(log->words),
+                      (uint32_t)log->pending.count, 0};
+  h.payload = sizeof(int) * (uint64_t)log->words->pool_len +
+              (uint64_t)h.records * RECORD_SIZE;
+  size_t size = sizeof(h) + (size_t)h.payload;
+  char *batch = dmalloc(size);
+  char *p = batch + sizeof(h);
+  for (uint32_t i = 0; i < h.words; ++i) {
+    const int *word = vocab_word(log->words, i);
+    size_t bytes = (word_length(word) + 1) * sizeof(int);
+    memcpy(p, word, bytes);
+    p += bytes;
+  }
+  size_t pos = 0;
+  uint64_t key;
+  int64_t *delta;
+  while (delta_map_next(&log->pending, &pos, &key, &delta)) {
+    uint32_t pair[2] = {(uint32_t)(key >> 32), (uint32_t)key};
+    memcpy(p, pair, sizeof(pair));
+    memcpy(p + sizeof(pair), delta, sizeof(*delta));
+    p += RECORD_SIZE;
+  }
+  h.crc = crc32c(0, &h.words, sizeof(h) - 2 * sizeof(uint32_t));
+  h.crc = crc32c(h.crc, batch + sizeof(h), (size_t)h.payload);
+  memcpy(batch, &h, sizeof(h));
+
+  /* One write and one sync per batch; a failed one is cut off again so
+   * the next commit does not land after garbage. */
+  pthread_mutex_lock(&log->lock);
+  int rc = -1;
+  if (lseek(log->fd, (off_t)log->end, SEEK_SET) == (off_t)log->end &&
+      write_all(log->fd, batch, size) == 0 && fdatasync(log->fd) == 0)
+    rc = 0;
+  if (rc == 0) {
+    log->end += size;
+  } else {
+    perror(log->path);
+    if (ftruncate(log->fd, (off_t)log->end) != 0)
+      perror(log->path);
+  }
+  pthread_mutex_unlock(&log->lock);
+  dfree(batch);
+  if (rc == 0)
+    reset_pending(log);
+  return rc;
+}
+
+/* ------------------------------------------------------------------
+ * Compaction
+ * ------------------------------------------------------------------ */
+static int save_synced(const model_t *model, const char *path) {
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    perror(path);
+    return -1;
+  }
+  int rc = write_all(fd, model->image, model->header->image_size);
+  if (rc == 0)
+    rc = fsync(fd);
+  if (close(fd) != 0)
+    rc = -1;
+  if (rc != 0)
+    perror(path);
+  return rc;
+}
+
+/* fsync the directory holding path, so renames into it survive a crash. */
+static int sync_parent(const char *path) {
+  char *dir = with_suffix(path, "");
+  char *slash = strrchr(dir, '/');
+  if (slash == dir)
+    slash[1] = '\0';
+  else if (slash != NULL)
+    *slash = '\0';
+  int fd = open(slash != NULL ? dir : ".", O_RDONLY | O_DIRECTORY);
+  int rc = fd < 0 ? -1 : fsync(fd);
+  if (fd >= 0)
+    close(fd);
+  if (rc != 0)
+    perror(slash != NULL ? dir : ".");
+  dfree(dir);
+  return rc;
+}
+
+/* With log->lock held: a new log for the new base with the batches
+ * committed after from, then both files renamed into place. */
+static int switch_log(delta_log_t *log, uint64_t from, uint32_t fingerprint,
+                      const char *model_tmp) {
+  char *log_tmp = with_suffix(log->path, ".compact");
+  int fd = open(log_tmp, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  int rc = fd < 0 ? -1 : 0;
+  log_header_t h = {DELTA_LOG_MAGIC, DELTA_LOG_VERSION, fingerprint, 0};
+  if (rc == 0)
+    rc = write_all(fd, &h, sizeof(h));
+  char *buf = dmalloc(COPY_BUFFER_SIZE);
+  for (uint64_t pos = from; rc == 0 && pos < log->end;) {
+    size_t len = log->end - pos < COPY_BUFFER_SIZE ? (size_t)(log->end - pos)
+                                                   : COPY_BUFFER_SIZE;
+    rc = pread_all(log->fd, buf, len, pos);
+    if (rc == 0)
+      rc = write_all(fd, buf, len);
+    pos += len;
+  }
+  dfree(buf);
+  if (rc == 0)
+    rc = fdatasync(fd);
+  /* The base first: a crash between the renames leaves the old log with
+   * the new base, which the fingerprint refuses, not a log applied twice
+   * without notice. */
+  if (rc == 0)
+    rc = rename(model_tmp, log->model_path);
+  if (rc == 0)
+    rc = rename(log_tmp, log->path);
+  if (rc != 0) {
+    perror(log_tmp);
+    if (fd >= 0)
+      close(fd);
+    unlink(log_tmp);
+    dfree(log_tmp);
+    return -1;
+  }
+  close(log->fd);
+  log->fd = fd;
+  log->end = sizeof(h) + (log->end - from);
+  log->fingerprint = fingerprint;
+  dfree(log_tmp);
+  /* The switch is done either way; -1 only says it may not be durable. */
+  rc = sync_parent(log->model_path);
+  if (sync_parent(log->path) != 0)
+    rc = -1;
+  return rc;
+}
+
+static int compact(delta_log_t *log) {
+  pthread_mutex_lock(&log->lock);
+  uint64_t end = log->end;
+  uint32_t fingerprint = log->fingerprint;
+  int fd = log->fd; /* only compaction replaces it */
+  pthread_mutex_unlock(&log->lock);
+
+  model_t *base = model_load(log->model_path);
+  if (base == NULL)
+    return -1;
+  if (delta_log_fingerprint(base) != fingerprint) {
+    fprintf(stderr, "%s: not the base model of %s\n", log->model_path,
+            log->path);
+    free_model(base);
+    return -1;
+  }
+  vocab_t *vocab = base_vocab(base);
+  delta_map_t deltas;
+  delta_map_init(&deltas, 1024);
+  model_t *merged = NULL;
+  if (read_deltas(fd, sizeof(log_header_t), end, vocab, &deltas, NULL) == end)
+    merged = merge_deltas(base, vocab, &deltas);
+  else
+    fprintf(stderr, "%s: cannot read back committed batches, not compacting\n",
+            log->path);
+  delta_map_destroy(&deltas);
+  free_vocab(vocab);
+  free_model(base);
+  if (merged == NULL)
+    return -1;
+
+  char *model_tmp = with_suffix(log->model_path, ".compact");
+  int rc = save_synced(merged, model_tmp);
+  uint32_t new_fingerprint = delta_log_fingerprint(merged);
+  free_model(merged);
+  if (rc == 0) {
+    pthread_mutex_lock(&log->lock);
+    rc = switch_log(log, end, new_fingerprint, model_tmp);
+    pthread_mutex_unlock(&log->lock);
+  }
+  if (rc != 0)
+    unlink(model_tmp);
+  dfree(model_tmp);
+  return rc;
+}
+
+static void *compact_main(void *arg) {
+  delta_log_t *log = arg;
+  log->compact_rc = compact(log);
+  return NULL;
+}
+
+int delta_log_compact_start(delta_log_t *log, const char *model_path) {
+  if (log == NULL || model_path == NULL)
+    return -1;
+  if (log->compacting) {
+    fprintf(stderr, "%s: a compaction is already running\n", log->path);
+    return -1;
+  }
+  dfree(log->model_path);
+  log->model_path = with_suffix(model_path, "");
+  log->compact_rc = -1;
+  if (pthread_create(&log->compactor, NULL, compact_main, log) != 0) {
+    perror("delta_log_compact_start");
+    return -1;
+  }
+  log->compacting = 1;
+  return 0;
+}
+
+int delta_log_compact_wait(delta_log_t *log) {
+  if (log == NULL)
+    return -1;
+  if (log->compacting) {
+    pthread_join(log->compactor, NULL);
+    log->compacting = 0;
+  }
+  return log->compact_rc;
+}
+
+int delta_log_close(delta_log_t *log) {
+  if (log == NULL)
+    return -1;
+  int rc = delta_log_commit(log);
+  if (log->compacting && delta_log_compact_wait(log) != 0)
+    rc = -1;
+  close(log->fd);
+  pthread_mutex_destroy(&log->lock);
+  free_vocab(log->words);
+  delta_map_destroy(&log->pending);
+  dfree(log->model_path);
+  dfree(log->path);
+  dfree(log);
+  return rc;
+}
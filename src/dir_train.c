@@ -0,0 +1,434 @@
+#define _DEFAULT_SOURCE
+#include "../include/dir_train.h"
+#include "../include/tokenizer.h"
+#include "../include/train.h"
+#include "../include/utils.h"
+#include "../include/word.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define DEFAULT_CHUNK_BYTES (1 << 20)
+
+typedef struct {
+  char *path;
+  uint64_t size; /* when walked */
+} dt_file_t;
+
+/* Nominal byte range [begin, end) of a file; see chunk_bound. */
+typedef struct {
+  int file;
+  uint64_t begin, end;
+  int split;                   /* the file has several chunks */
+  int has_tokens;
+  int first[MAX_WORD_LENGTH];  /* split files: first and last token */
+  int last[MAX_WORD_LENGTH];
+} chunk_t;
+
+/* Chunks [chunk, chunk_end) are one unit of work. */
+typedef struct {
+  size_t chunk, chunk_end;
+  uint64_t bytes;
+} unit_t;
+
+typedef struct dir_train dir_train_t;
+
+typedef struct {
+  dir_train_t *dt;
+  pthread_mutex_t lock; /* next and end */
+  size_t next, end;     /* units still owned: [next, end) */
+  trainer_t *trainer;
+  tokenizer_t *tok;
+  chunk_t *chunk; /* being tokenized */
+  uint64_t steals;
+  int failed;
+} worker_t;
+
+struct dir_train {
+  dt_file_t *files;
+  int num_files, files_cap;
+  chunk_t *chunks;
+  size_t num_chunks;
+  unit_t *units;
+  size_t num_units;
+  worker_t *workers;
+  int threads;
+};
+
+/* ---------------------------------------------------------------------
+ * Walking the roots
+ * ------------------------------------------------------------------- */
+
+/* strdup, but from dmalloc so dfree releases it. */
+static char *dup_string(const char *text) {
+  size_t len = strlen(text) + 1;
+  return memcpy(dmalloc(len), text, len);
+}
+
+static int cmp_names(const void *a, const void *b) {
+  return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static void add_file(dir_train_t *dt, const char *path, uint64_t size) {
+  if (dt->num_files == dt->files_cap) {
+    dt->files_cap = dt->files_cap ? dt->files_cap * 2 : 64;
+    dt->files = drealloc(dt->files, sizeof(dt_file_t) * dt->files_cap);
+  }
+  dt->files[dt->num_files].path = dup_string(path);
+  dt->files[dt->num_files].size = size;
+  dt->num_files++;
+}
+
+static int walk(dir_train_t *dt, const char *path, int root) {
+  struct stat st;
+  if ((root ? stat(path, &st) : lstat(path, &st)) != 0) {
+    perror(path);
+    return -1;
+  }
+  if (S_ISREG(st.st_mode)) {
+    add_file(dt, path, (uint64_t)st.st_size);
+    return 0;
+  }
+  if (!S_ISDIR(st.st_mode))
+    return 0; /* links, devices, sockets */
+
+  DIR *dir = opendir(path);
+  if (dir == NULL) {
+    perror(path);
+    return -1;
+  }
+  char **names = NULL;
+  size_t n = 0, cap = 0;
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL) {
+    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+      continue;
+    if (n == cap) {
+      cap = cap ? cap * 2 : 16;
+      names = drealloc(names, sizeof(char *) * cap);
+    }
+    names[n++] = dup_string(entry->d_name);
+  }
+  closedir(dir);
+  qsort(names, n, sizeof(char *), cmp_names);
+
+  int rc = 0;
+  size_t len = strlen(path);
+  for (size_t i = 0; i < n; ++i) {
+    if (rc == 0) {
+      char *child = dmalloc(len + strlen(names[i]) + 2);
+      sprintf(child, "%s%s%s", path,
+              len && path[len - 1] == '/' ? "" : "/", names[i]);
+      rc = walk(dt, child, 0);
+      dfree(child);
+    }
+    dfree(names[i]);
+  }
+  dfree(names);
+  return rc;
+}
+
+/* ---------------------------------------------------------------------
+ * Units of work
+ * ------------------------------------------------------------------- */
+
+static void plan_units(dir_train_t *dt, size_t chunk_bytes) {
+  size_t cap = (size_t)dt->num_files + 1;
+  for (int f = 0; f < dt->num_files; ++f)
+    cap += dt->files[f].size / chunk_bytes;
+  dt->chunks = dmalloc(sizeof(chunk_t) * cap);
+  dt->units = dmalloc(sizeof(unit_t) * cap);
+
+  unit_t *open_unit = NULL; /* group of small files being filled */
+  for (int f = 0; f < dt->num_files; ++f) {
+    uint64_t size = dt->files[f].size;
+    if (size > chunk_bytes) {
+      open_unit = NULL;
+      uint64_t pieces = (size + chunk_bytes - 1) / chunk_bytes;
+      for (uint64_t p = 0; p < pieces; ++p) {
+        chunk_t *c = &dt->chunks[dt->num_chunks];
+        c->file = f;
+        c->begin = size * p / pieces;
+        c->end = size * (p + 1) / pieces;
+        c->split = 1;
+        unit_t *u = &dt->units[dt->num_units++];
+        u->chunk = dt->num_chunks++;
+        u->chunk_end = dt->num_chunks;
+        u->bytes = c->end - c->begin;
+      }
+      continue;
+    }
+    if (open_unit == NULL || open_unit->bytes + size > chunk_bytes) {
+      open_unit = &dt->units[dt->num_units++];
+      open_unit->chunk = dt->num_chunks;
+      open_unit->bytes = 0;
+    }
+    chunk_t *c = &dt->chunks[dt->num_chunks++];
+    c->file = f;
+    c->begin = 0;
+    c->end = size;
+    open_unit->chunk_end = dt->num_chunks;
+    open_unit->bytes += size;
+  }
+}
+
+/* Give every worker a contiguous share of the units, by bytes. */
+static void share_units(dir_train_t *dt) {
+  uint64_t total = 0;
+  for (size_t u = 0; u < dt->num_units; ++u)
+    total += dt->units[u].bytes;
+  size_t u = 0;
+  uint64_t done = 0;
+  for (int w = 0; w < dt->threads; ++w) {
+    uint64_t target = total * (uint64_t)(w + 1) / (uint64_t)dt->threads;
+    dt->workers[w].next = u;
+    while (u < dt->num_units &&
+           (w == dt->threads - 1 || done + dt->units[u].bytes / 2 < target))
+      done += dt->units[u++].bytes;
+    dt->workers[w].end = u;
+  }
+}
+
+/* Next unit for w: its own, else half of the largest share left. Returns
+ * 0 when there is no work anywhere. */
+static int take_unit(worker_t *w, size_t *unit) {
+  dir_train_t *dt = w->dt;
+  pthread_mutex_lock(&w->lock);
+  if (w->next < w->end) {
+    *unit = w->next++;
+    pthread_mutex_unlock(&w->lock);
+    return 1;
+  }
+  pthread_mutex_unlock(&w->lock);
+
+  for (;;) {
+    worker_t *victim = NULL;
+    size_t most = 0;
+    for (int i = 0; i < dt->threads; ++i) {
+      worker_t *v = &dt->workers[i];
+      pthread_mutex_lock(&v->lock);
+      size_t left = v->end - v->next;
+      pthread_mutex_unlock(&v->lock);
+      if (v != w && left > most) {
+        most = left;
+        victim = v;
+      }
+    }
+    if (victim == NULL)
+      return 0; /* units are never added: this is final */
+
+    pthread_mutex_lock(&victim->lock);
+    size_t left = victim->end - victim->next;
+    size_t begin = victim->end - (left + 1) / 2;
+    size_t end = victim->end;
+    if (left > 0)
+      victim->end = begin;
+    pthread_mutex_unlock(&victim->lock);
+    if (left == 0)
+      continue; /* it finished them meanwhile */
+
+    pthread_mutex_lock(&w->lock);
+    w->next = begin + 1;
+    w->end = end;
+    w->steals++;
+    pthread_mutex_unlock(&w->lock);
+    *unit = begin;
+    return 1;
+  }
+}
+
+/* ---------------------------------------------------------------------
+ * Tokenizing
+ * ------------------------------------------------------------------- */
+
+static int is_space(unsigned char c) {
+  return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\f' ||
+         c == '\v';
+}
+
+/* Real position of the nominal boundary at: the first position from at on
+ * that follows a white space byte (the file start and end stay). */
+static uint64_t chunk_bound(const unsigned char *data, uint64_t size,
+                            uint64_t at) {
+  if (at == 0 || at >= size)
+    return at < size ? at : size;
+  while (at < size && !is_space(data[at - 1]))
+    at++;
+  return at;
+}
+
+static void copy_token(int *out, const int *token, size_t length) {
+  if (length > MAX_WORD_LENGTH - 1)
+    length = MAX_WORD_LENGTH - 1;
+  memcpy(out, token, sizeof(int) * length);
+  out[length] = '\0';
+}
+
+static void chunk_sink(void *ctx, const int *token, size_t length) {
+  worker_t *w = ctx;
+  chunk_t *c = w->chunk;
+  tokenizer_train_sink(w->trainer, token, length);
+  if (c->split) {
+    if (!c->has_tokens)
+      copy_token(c->first, token, length);
+    copy_token(c->last, token, length);
+  }
+  c->has_tokens = 1;
+}
+
+static int run_chunk(worker_t *w, chunk_t *c) {
+  const char *path = w->dt->files[c->file].path;
+  int fd = open(path, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    perror(path);
+    if (fd >= 0)
+      close(fd);
+    return -1;
+  }
+  uint64_t size = (uint64_t)st.st_size;
+  if (size > w->dt->files[c->file].size)
+    size = w->dt->files[c->file].size; /* grew since the walk */
+  if (size > 0) {
+    unsigned char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      perror(path);
+      close(fd);
+      return -1;
+    }
+    uint64_t begin = chunk_bound(data, size, c->begin);
+    uint64_t end = chunk_bound(data, size, c->end);
+    if (begin < end) {
+      w->chunk = c;
+      tokenizer_feed_utf8(w->tok, (const char *)data + begin,
+                          (size_t)(end - begin));
+      tokenizer_finish(w->tok);
+    }
+    munmap(data, size);
+  }
+  close(fd);
+  trainer_break(w->trainer);
+  return 0;
+}
+
+static void *work(void *arg) {
+  worker_t *w = arg;
+  size_t unit;
+  while (!w->failed && take_unit(w, &unit)) {
+    const unit_t *u = &w->dt->units[unit];
+    for (size_t c = u->chunk; c < u->chunk_end && !w->failed; ++c)
+      if (run_chunk(w, &w->dt->chunks[c]) != 0)
+        w->failed = 1;
+  }
+  return NULL;
+}
+
+/* The pairs across chunk boundaries of split files, in a trainer of
+ * their own. */
+static trainer_t *boundary_pairs(const dir_train_t *dt) {
+  train_config_t config = {TRAIN_BACKEND_RADIX, 1, {0, NULL}, NULL};
+  trainer_t *trainer = create_trainer(&config);
+  const chunk_t *prev = NULL;
+  for (size_t i = 0; i < dt->num_chunks; ++i) {
+    const chunk_t *c = &dt->chunks[i];
+    if (!c->split || !c->has_tokens)
+      continue;
+    if (prev && prev->file == c->file) {
+      trainer_add_word(trainer, prev->last);
+      trainer_add_word(trainer, c->first);
+      trainer_break(trainer);
+    }
+    prev = c;
+  }
+  return trainer;
+}
+
+model_t *dir_train(const char *const *roots, int n,
+                   const dir_train_config_t *config,
+                   dir_train_stats_t *stats) {
+  uint64_t start = monotonic_ns();
+  dir_train_t dt;
+  memset(&dt, 0, sizeof dt);
+  dt.threads = config && config->threads > 0 ? config->threads : 1;
+  size_t chunk_bytes = config && config->chunk_bytes ? config->chunk_bytes
+                                                     : DEFAULT_CHUNK_BYTES;
+  int rc = 0;
+  for (int i = 0; i < n && rc == 0; ++i)
+    rc = walk(&dt, roots[i], 1);
+  model_t *model = NULL;
+  dir_train_stats_t st;
+  memset(&st, 0, sizeof st);
+  if (rc != 0)
+    goto done;
+
+  plan_units(&dt, chunk_bytes);
+  dt.workers = dmalloc(sizeof(worker_t) * (size_t)dt.threads);
+  train_config_t train = {TRAIN_BACKEND_RADIX, 1, {0, NULL}, NULL};
+  for (int w = 0; w < dt.threads; ++w) {
+    worker_t *worker = &dt.workers[w];
+    worker->dt = &dt;
+    pthread_mutex_init(&worker->lock, NULL);
+    worker->trainer = create_trainer(&train);
+    worker->tok = create_tokenizer(chunk_sink, worker);
+  }
+  share_units(&dt);
+
+  pthread_t *tids = dmalloc(sizeof(pthread_t) * (size_t)dt.threads);
+  int started = 1;
+  for (; started < dt.threads; ++started) {
+    if (pthread_create(&tids[started], NULL, work, &dt.workers[started]) !=
+        0) {
+      perror("pthread_create");
+      break; /* the others steal its share */
+    }
+  }
+  work(&dt.workers[0]);
+  for (int w = 1; w < started; ++w)
+    pthread_join(tids[w], NULL);
+  dfree(tids);
+
+  trainer_t **trainers =
+      dmalloc(sizeof(trainer_t *) * (size_t)(dt.threads + 1));
+  for (int w = 0; w < dt.threads; ++w) {
+    worker_t *worker = &dt.workers[w];
+    if (worker->failed)
+      rc = -1;
+    trainers[w] = worker->trainer;
+    st.steals += worker->steals;
+    st.tokens += trainer_get_tokens(worker->trainer);
+    st.invalid += tokenizer_get_stats(worker->tok)->invalid;
+  }
+  trainers[dt.threads] = boundary_pairs(&dt);
+  if (rc == 0)
+    model = trainer_merge(trainers, dt.threads + 1, dt.threads);
+  free_trainer(trainers[dt.threads]);
+  dfree(trainers);
+  for (int w = 0; w < dt.threads; ++w) {
+    free_tokenizer(dt.workers[w].tok);
+    free_trainer(dt.workers[w].trainer);
+    pthread_mutex_destroy(&dt.workers[w].lock);
+  }
+  dfree(dt.workers);
+
+done:
+  st.files = (uint64_t)dt.num_files;
+  for (int f = 0; f < dt.num_files; ++f) {
+    st.bytes += dt.files[f].size;
+    dfree(dt.files[f].path);
+  }
+  st.chunks = dt.num_chunks;
+  st.units = dt.num_units;
+  st.elapsed_ns = monotonic_ns() - start;
+  if (stats)
+    *stats = st;
+  dfree(dt.files);
+  dfree(dt.chunks);
+  dfree(dt.units);
+  return model;
+}
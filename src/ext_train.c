@@ -0,0 +1,425 @@
+#define _DEFAULT_SOURCE
+#include "../include/ext_train.h"
+#include "../include/model.h"
+#include "../include/utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#define RUN_IO_BUFFER (256 * 1024)   /* spill buffer */
+#define MIN_READ_BUFFER (64 * 1024)  /* per-run buffer while merging */
+#define MIN_RUN_PAIRS 4096           /* never spill smaller runs */
+#define MAX_FAN_IN 128               /* upper bound of runs merged at once */
+#define MODEL_WRITER_BUFFER (1 << 20) /* see model.c */
+
+/* One counted pair as stored in a run file; runs are sorted by key. */
+typedef struct {
+  uint64_t key; /* prev << 32 | next */
+  uint64_t count;
+} run_record_t;
+
+struct ext_trainer {
+  ext_train_config_t config;
+  vocab_t *vocab;
+  uint32_t prev;
+
+  uint64_t *pairs;     /* anonymous mapping of mem_budget bytes */
+  size_t pairs_cap;    /* capacity of the mapping in pairs */
+  size_t pairs_len;    /* pairs buffered */
+  size_t high_water;   /* pairs ever touched since the last release */
+  char *io_buffer;     /* RUN_IO_BUFFER bytes for spilling */
+
+  int *runs; /* fds of unlinked run files, oldest first */
+  uint32_t num_runs;
+  uint32_t runs_cap;
+
+  int failed; /* a spill failed; finish reports it */
+  ext_train_stats_t stats;
+};
+
+static int cmp_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+/* Memory left for pairs and merge buffers once the vocabulary is counted. */
+static size_t budget_left(ext_trainer_t *t) {
+  size_t used = vocab_bytes(t->vocab) + RUN_IO_BUFFER;
+  if (used >= t->config.mem_budget) {
+    if (!t->stats.over_budget) {
+      fprintf(stderr, "Warning: vocabulary exceeds the training memory "
+                      "budget, spilling minimal runs\n");
+      t->stats.over_budget = 1;
+    }
+    return 0;
+  }
+  return t->config.mem_budget - used;
+}
+
+static size_t pair_limit(ext_trainer_t *t) {
+  size_t limit = budget_left(t) / sizeof(uint64_t);
+  if (limit < MIN_RUN_PAIRS)
+    limit = MIN_RUN_PAIRS;
+  if (limit > t->pairs_cap)
+    limit = t->pairs_cap;
+  return limit;
+}
+
+static int create_run_file(ext_trainer_t *t) {
+  const char *dir = t->config.tmp_dir ? t->config.tmp_dir : "/tmp";
+  size_t len = strlen(dir) + sizeof("/markov-run-XXXXXX");
+  char *path = dmalloc(len);
+  snprintf(path, len, "%s/markov-run-XXXXXX", dir);
+  int fd = mkstemp(path);
+  if (fd < 0)
+    perror(path);
+  else
+    unlink(path); /* the file vanishes with its last descriptor */
+  dfree(path);
+  return fd;
+}
+
+static void push_run(ext_trainer_t *t, int fd) {
+  if (t->num_runs == t->runs_cap) {
+    t->runs_cap = t->runs_cap ? t->runs_cap * 2 : 16;
+    t->runs = t->runs ? drealloc(t->runs, sizeof(int) * t->runs_cap)
+                      : dmalloc_tag(sizeof(int) * t->runs_cap, MEM_TRAIN);
+  }
+  t->runs[t->num_runs++] = fd;
+}
+
+/* ------------------------------------------------------------------
+ * Buffered run writer
+ * ------------------------------------------------------------------ */
+typedef struct {
+  int fd;
+  char *buffer;
+  size_t size;
+  size_t used;
+  int failed;
+  uint64_t written;
+} run_writer_t;
+
+static void run_writer_put(run_writer_t *w, const run_record_t *rec) {
+  if (w->used + sizeof(*rec) > w->size) {
+    if (write_all(w->fd, w->buffer, w->used) != 0)
+      w->failed = 1;
+    w->written += w->used;
+    w->used = 0;
+  }
+  memcpy(w->buffer + w->used, rec, sizeof(*rec));
+  w->used += sizeof(*rec);
+}
+
+static int run_writer_flush(run_writer_t *w) {
+  if (w->used > 0 && write_all(w->fd, w->buffer, w->used) != 0)
+    w->failed = 1;
+  w->written += w->used;
+  w->used = 0;
+  if (!w->failed && lseek(w->fd, 0, SEEK_SET) != 0)
+    w->failed = 1;
+  return w->failed ? -1 : 0;
+}
+
+/* Sort the buffered pairs, collapse equal ones and write them as a run. */
+static int spill_run(ext_trainer_t *t) {
+  if (t->pairs_len == 0)
+    return 0;
+  int fd = create_run_file(t);
+  if (fd < 0)
+    return -1;
+
+  qsort(t->pairs, t->pairs_len, sizeof(uint64_t), cmp_u64);
+  run_writer_t w = {fd, t->io_buffer, RUN_IO_BUFFER, 0, 0, 0};
+  run_record_t rec = {t->pairs[0], 0};
+  for (size_t i = 0; i < t->pairs_len; ++i) {
+    if (t->pairs[i] != rec.key) {
+      run_writer_put(&w, &rec);
+      rec.key = t->pairs[i];
+      rec.count = 0;
+    }
+    rec.count++;
+  }
+  run_writer_put(&w, &rec);
+  if (run_writer_flush(&w) != 0) {
+    perror("spill_run");
+    close(fd);
+    return -1;
+  }
+
+  push_run(t, fd);
+  t->stats.runs++;
+  t->stats.bytes_spilled += w.written;
+  if (t->pairs_len > t->high_water)
+    t->high_water = t->pairs_len;
+  t->pairs_len = 0;
+  return 0;
+}
+
+ext_trainer_t *create_ext_trainer(const ext_train_config_t *config) {
+  ext_trainer_t *t = dmalloc_tag(sizeof(ext_trainer_t), MEM_TRAIN);
+  if (config)
+    t->config = *config;
+  if (t->config.mem_budget == 0)
+    t->config.mem_budget = EXT_TRAIN_DEFAULT_BUDGET;
+  t->vocab = create_vocab(1024);
+  t->prev = VOCAB_NO_ID;
+
+  /* Reserve address space only; pages become resident as pairs arrive. */
+  size_t cap = t->config.mem_budget / sizeof(uint64_t);
+  if (cap < MIN_RUN_PAIRS)
+    cap = MIN_RUN_PAIRS;
+  t->pairs = mmap(NULL, cap * sizeof(uint64_t), PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (t->pairs == MAP_FAILED) {
+    perror("create_ext_trainer");
+    free_vocab(t->vocab);
+    dfree(t);
+    return NULL;
+  }
+  t->pairs_cap = cap;
+  t->io_buffer = dmalloc_tag(RUN_IO_BUFFER, MEM_TRAIN);
+  return t;
+}
+
+void ext_trainer_add_word(ext_trainer_t *t, const int *word) {
+  if (t == NULL || word == NULL || t->pairs == NULL)
+    return;
+  uint32_t id = vocab_intern(t->vocab, word);
+  t->stats.tokens++;
+  if (t->prev != VOCAB_NO_ID) {
+    t->pairs[t->pairs_len++] = (uint64_t)t->prev << 32 | id;
+    t->stats.pairs++;
+    size_t limit = pair_limit(t);
+    if (t->pairs_len >= limit) {
+      if (spill_run(t) != 0) {
+        /* Drop the pairs and keep reading; finish reports the error. */
+        t->pairs_len = 0;
+        t->failed = 1;
+      }
+      /* The vocabulary grew since those pages were touched: give back the
+       * part of the buffer that no longer fits in the budget. */
+      if (t->high_water > limit) {
+        size_t page = (size_t)sysconf(_SC_PAGESIZE);
+        size_t from = (limit * sizeof(uint64_t) + page - 1) / page * page;
+        size_t to = t->high_water * sizeof(uint64_t);
+        if (to > from)
+          madvise((char *)t->pairs + from, to - from, MADV_DONTNEED);
+        t->high_water = limit;
+      }
+    }
+  }
+  t->prev = id;
+}
+
+void ext_trainer_break(ext_trainer_t *t) {
+  if (t)
+    t->prev = VOCAB_NO_ID;
+}
+
+/* ------------------------------------------------------------------
+ * K-way merge
+ * ------------------------------------------------------------------ */
+typedef struct {
+  int fd;
+  char *buffer;
+  size_t size;
+  size_t len;
+  size_t pos;
+  run_record_t current;
+} run_reader_t;
+
+/* Advance to the next record; returns 1, 0 at the end of the run, or -1
+ * if the run cannot be read or ends in a partial record. */
+static int run_reader_next(run_reader_t *r) {
+  if (r->pos + sizeof(run_record_t) > r->len) {
+    ssize_t n = read_full(r->fd, r->buffer, r->size);
+    if (n == 0)
+      return 0;
+    if (n < 0 || n % (ssize_t)sizeof(run_record_t) != 0) {
+      fprintf(stderr, "External training: %s run file\n",
+              n < 0 ? "cannot read a" : "truncated");
+      return -1;
+    }
+    r->len = (size_t)n;
+    r->pos = 0;
+  }
+  memcpy(&r->current, r->buffer + r->pos, sizeof(run_record_t));
+  r->pos += sizeof(run_record_t);
+  return 1;
+}
+
+static void heap_sift_down(run_reader_t **heap, uint32_t n, uint32_t i) {
+  for (;;) {
+    uint32_t l = 2 * i + 1, r = l + 1, m = i;
+    if (l < n && heap[l]->current.key < heap[m]->current.key)
+      m = l;
+    if (r < n && heap[r]->current.key < heap[m]->current.key)
+      m = r;
+    if (m == i)
+      return;
+    run_reader_t *tmp = heap[i];
+    heap[i] = heap[m];
+    heap[m] = tmp;
+    i = m;
+  }
+}
+
+typedef int (*record_sink_t)(void *ctx, const run_record_t *rec);
+
+/* Merge fds[0..n) into sink, summing the counts of equal keys. Closes the
+ * input runs. */
+static int merge_runs(const int *fds, uint32_t n, size_t buffer_size,
+                      record_sink_t sink, void *ctx) {
+  run_reader_t *readers = dmalloc(sizeof(run_reader_t) * n);
+  run_reader_t **heap = dmalloc(sizeof(run_reader_t *) * n);
+  char *buffers = dmalloc_tag(buffer_size * n, MEM_TRAIN);
+  uint32_t live = 0;
+  int rc = 0;
+  for (uint32_t i = 0; i < n; ++i) {
+    readers[i].fd = fds[i];
+    readers[i].buffer = buffers + buffer_size * i;
+    readers[i].size = buffer_size - buffer_size % sizeof(run_record_t);
+    int more = run_reader_next(&readers[i]);
+    if (more > 0)
+      heap[live++] = &readers[i];
+    else if (more < 0)
+      rc = -1;
+  }
+  for (uint32_t i = live / 2; i-- > 0;)
+    heap_sift_down(heap, live, i);
+
+  while (live > 0 && rc == 0) {
+    run_record_t acc = heap[0]->current;
+    int more = run_reader_next(heap[0]);
+    if (more <= 0)
+      heap[0] = heap[--live];
+    heap_sift_down(heap, live, 0);
+    while (live > 0 && heap[0]->current.key == acc.key && more >= 0) {
+      acc.count += heap[0]->current.count;
+      if ((more = run_reader_next(heap[0])) <= 0)
+        heap[0] = heap[--live];
+      heap_sift_down(heap, live, 0);
+    }
+    rc = more < 0 ? -1 : sink(ctx, &acc);
+  }
+
+  for (uint32_t i = 0; i < n; ++i)
+    close(fds[i]);
+  dfree(buffers);
+  dfree(heap);
+  dfree(readers);
+  return rc;
+}
+
+static int sink_to_run(void *ctx, const run_record_t *rec) {
+  run_writer_t *w = ctx;
+  run_writer_put(w, rec);
+  return w->failed ? -1 : 0;
+}
+
+typedef struct {
+  model_writer_t *writer;
+  uint64_t edges;
+} model_sink_t;
+
+static int sink_to_model(void *ctx, const run_record_t *rec) {
+  model_sink_t *s = ctx;
+  uint32_t count = rec->count > UINT32_MAX ? UINT32_MAX : (uint32_t)rec->count;
+  s->edges++;
+  return model_writer_add_edge(s->writer, (uint32_t)(rec->key >> 32),
+                               (uint32_t)rec->key, count);
+}
+
+int ext_trainer_finish(ext_trainer_t *t, const char *model_path) {
+  if (t == NULL || model_path == NULL)
+    return -1;
+  if (t->failed || spill_run(t) != 0) {
+    fprintf(stderr, "External training failed while spilling runs\n");
+    return -1;
+  }
+  /* Reading is over: the pair buffer is no longer needed. */
+  munmap(t->pairs, t->pairs_cap * sizeof(uint64_t));
+  t->pairs = NULL;
+  t->pairs_len = 0;
+
+  /* Split what the budget leaves between run readers. The final pass also
+   * holds the model writer and its row offsets. */
+  size_t fixed = vocab_bytes(t->vocab) + RUN_IO_BUFFER + MODEL_WRITER_BUFFER +
+                 sizeof(uint64_t) * ((size_t)vocab_size(t->vocab) + 1);
+  size_t avail = t->config.mem_budget > fixed ? t->config.mem_budget - fixed
+                                              : 0;
+  uint32_t fan_in = (uint32_t)(avail / MIN_READ_BUFFER);
+  if (fan_in > MAX_FAN_IN)
+    fan_in = MAX_FAN_IN;
+  if (fan_in < 2)
+    fan_in = 2;
+
+  /* Intermediate passes: merge the oldest runs until one pass suffices. */
+  while (t->num_runs > fan_in) {
+    int fd = create_run_file(t);
+    if (fd < 0)
+      return -1;
+    run_writer_t w = {fd, t->io_buffer, RUN_IO_BUFFER, 0, 0, 0};
+    size_t buffer_size = avail / (fan_in + 1);
+    if (buffer_size < MIN_READ_BUFFER)
+      buffer_size = MIN_READ_BUFFER;
+    int rc = merge_runs(t->runs, fan_in, buffer_size, sink_to_run, &w);
+    if (rc == 0)
+      rc = run_writer_flush(&w);
+    memmove(t->runs, t->runs + fan_in,
+            sizeof(int) * (t->num_runs - fan_in));
+    t->num_runs -= fan_in;
+    if (rc != 0) {
+      close(fd);
+      return -1;
+    }
+    push_run(t, fd);
+    t->stats.merge_passes++;
+    t->stats.bytes_spilled += w.written;
+  }
+
+  model_sink_t sink = {model_writer_open(model_path, t->vocab), 0};
+  if (sink.writer == NULL)
+    return -1;
+  int rc = 0;
+  if (t->num_runs > 0) {
+    size_t buffer_size = avail / t->num_runs;
+    if (buffer_size < MIN_READ_BUFFER)
+      buffer_size = MIN_READ_BUFFER;
+    rc = merge_runs(t->runs, t->num_runs, buffer_size, sink_to_model, &sink);
+    t->num_runs = 0;
+  }
+  if (model_writer_close(sink.writer) != 0)
+    rc = -1;
+  t->stats.edges = sink.edges;
+
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) == 0)
+    t->stats.peak_rss_kb = usage.ru_maxrss;
+  return rc;
+}
+
+const ext_train_stats_t *ext_trainer_get_stats(const ext_trainer_t *t) {
+  return t ? &t->stats : NULL;
+}
+
+const vocab_t *ext_trainer_get_vocab(const ext_trainer_t *t) {
+  return t ? t->vocab : NULL;
+}
+
+void free_ext_trainer(ext_trainer_t *t) {
+  if (t == NULL)
+    return;
+  for (uint32_t i = 0; i < t->num_runs; ++i)
+    close(t->runs[i]);
+  if (t->pairs)
+    munmap(t->pairs, t->pairs_cap * sizeof(uint64_t));
+  dfree(t->runs);
+  dfree(t->io_buffer);
+  free_vocab(t->vocab);
+  dfree(t);
+}
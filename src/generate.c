@@ -0,0 +1,204 @@
+#include "../include/generate.h"
+#include "../include/timing.h"
+#include "../include/utils.h"
+#include <math.h>
+#include <stdio.h>
+
+uint64_t generate_rand(uint64_t *state) {
+  uint64_t x = *state ? *state : 0x9E3779B97F4A7C15ULL;
+  x ^= x >> 12;
+  x ^= x << 25;
+  x ^= x >> 27;
+  *state = x;
+  return x * 0x2545F4914F6CDD1DULL;
+}
+
+static uint32_t next_word(const model_t *model, uint32_t id,
+                          uint64_t *state) {
+  uint32_t n;
+  const model_edge_t *edges = model_followers(model, id, &n);
+  if (n == 0)
+    return VOCAB_NO_ID;
+  uint64_t r = generate_rand(state) % model_row_total(model, id);
+  for (uint32_t i = 0; i < n; ++i) {
+    if (r < edges[i].count)
+      return edges[i].next;
+    r -= edges[i].count;
+  }
+  return edges[n - 1].next; /* not reached */
+}
+
+uint32_t generate_next(const model_t *model, uint32_t id, uint64_t *state) {
+  TIMER_START(start);
+  uint32_t next = next_word(model, id, state);
+  TIMER_STOP(TIMING_GENERATE_STEP, start);
+  return next;
+}
+
+size_t generate_walk(const model_t *model, uint32_t start, uint32_t *out,
+                     size_t max, uint64_t *state) {
+  size_t n = 0;
+  uint32_t id = start;
+  while (n < max && (id = generate_next(model, id, state)) != VOCAB_NO_ID)
+    out[n++] = id;
+  return n;
+}
+
+/* ------------------------------------------------------------------
+ * Beam search
+ * ------------------------------------------------------------------ */
+typedef struct {
+  double score;    /* log probability of the path */
+  uint32_t word;
+  uint32_t parent; /* index of the previous hypothesis in the arena */
+} beam_hyp_t;
+
+struct generate_beam {
+  uint32_t width;
+  beam_hyp_t *arena; /* level t: arena[t * width ...], best first */
+  size_t levels;     /* levels the arena holds */
+  beam_hyp_t *heap;  /* candidates of the step, the worst at the root */
+  uint64_t expansions;
+};
+
+generate_beam_t *create_generate_beam(uint32_t width, size_t length) {
+  if (width == 0) {
+    fprintf(stderr, "create_generate_beam: width must be at least 1\n");
+    return NULL;
+  }
+  generate_beam_t *beam = dmalloc(sizeof(generate_beam_t));
+  beam->width = width;
+  beam->levels = length + 1;
+  beam->arena = dmalloc(sizeof(beam_hyp_t) * width * beam->levels);
+  beam->heap = dmalloc(sizeof(beam_hyp_t) * width);
+  return beam;
+}
+
+void free_generate_beam(generate_beam_t *beam) {
+  if (beam == NULL)
+    return;
+  dfree(beam->arena);
+  dfree(beam->heap);
+  dfree(beam);
+}
+
+uint64_t generate_beam_expansions(const generate_beam_t *beam) {
+  return beam ? beam->expansions : 0;
+}
+
+/* Total order on hypotheses: higher score, then lower word, then lower
+ * parent. */
+static int beam_better(const beam_hyp_t *a, const beam_hyp_t *b) {
+  if (a->score != b->score)
+    return a->score > b->score;
+  if (a->word != b->word)
+    return a->word < b->word;
+  return a->parent < b->parent;
+}
+
+static void heap_sift_down(beam_hyp_t *heap, uint32_t len, uint32_t i) {
+  beam_hyp_t item = heap[i];
+  for (;;) {
+    uint32_t child = 2 * i + 1;
+    if (child >= len)
+      break;
+    if (child + 1 < len && beam_better(&heap[child], &heap[child + 1]))
+      child++; /* the worse of the two */
+    if (!beam_better(&item, &heap[child]))
+      break;
+    heap[i] = heap[child];
+    i = child;
+  }
+  heap[i] = item;
+}
+
+static void heap_push(beam_hyp_t *heap, uint32_t len, beam_hyp_t item) {
+  uint32_t i = len;
+  while (i > 0) {
+    uint32_t parent = (i - 1) / 2;
+    if (!beam_better(&heap[parent], &item))
+      break;
+    heap[i] = heap[parent];
+    i = parent;
+  }
+  heap[i] = item;
+}
+
+size_t generate_beam_search(generate_beam_t *beam, const model_t *model,
+                            uint32_t start, uint32_t *out, size_t max,
+                            double *log_prob) {
+  if (log_prob)
+    *log_prob = 0.0;
+  beam->expansions = 0;
+  if (model == NULL || start >= model_num_words(model))
+    return 0;
+  if (max + 1 > beam->levels) {
+    beam->levels = max + 1;
+    beam->arena = drealloc(beam->arena,
+                           sizeof(beam_hyp_t) * beam->width * beam->levels);
+  }
+  uint32_t width = beam->width;
+  beam_hyp_t *heap = beam->heap;
+  beam->arena[0].score = 0.0;
+  beam->arena[0].word = start;
+  beam->arena[0].parent = 0;
+  uint32_t level_len = 1;
+  size_t steps = 0;
+
+  while (steps < max) {
+    TIMER_START(step_start);
+    const beam_hyp_t *level = beam->arena + steps * width;
+    uint32_t len = 0;
+    for (uint32_t h = 0; h < level_len; ++h) {
+      const beam_hyp_t *hyp = &level[h];
+      /* best first: no later hypothesis can beat a full heap either */
+      if (len == width && hyp->score < heap[0].score)
+        break;
+      uint32_t n;
+      const model_edge_t *row = model_followers(model, hyp->word, &n);
+      if (n == 0)
+        continue;
+      const uint32_t *ranks = model->ranks + model->row_offsets[hyp->word];
+      double log_total = log((double)model_row_total(model, hyp->word));
+      uint32_t parent = (uint32_t)(steps * width + h);
+      for (uint32_t r = 0; r < n && r < width; ++r) {
+        const model_edge_t *e = &row[ranks[r]];
+        beam_hyp_t cand = {hyp->score + log((double)e->count) - log_total,
+                           e->next, parent};
+        beam->expansions++;
+        if (len < width) {
+          heap_push(heap, len++, cand);
+        } else if (beam_better(&cand, &heap[0])) {
+          heap[0] = cand;
+          heap_sift_down(heap, len, 0);
+        } else {
+          break; /* the followers left are no more frequent */
+        }
+      }
+    }
+    if (len == 0)
+      break; /* every hypothesis is at a dead end */
+
+    /* Heap sort into the next level: popping the worst to the back
+     * leaves it best first. */
+    beam_hyp_t *next = beam->arena + (steps + 1) * width;
+    for (uint32_t i = len; i > 0; --i) {
+      next[i - 1] = heap[0];
+      heap[0] = heap[i - 1];
+      heap_sift_down(heap, i - 1, 0);
+    }
+    level_len = len;
+    steps++;
+    TIMER_STOP(TIMING_GENERATE_STEP, step_start);
+  }
+
+  /* Follow the parents of the best final hypothesis back to start. */
+  const beam_hyp_t *best = beam->arena + steps * width;
+  if (log_prob)
+    *log_prob = best->score;
+  for (size_t t = steps; t > 0; --t) {
+    out[t - 1] = best->word;
+    best = &beam->arena[best->parent];
+  }
+  return steps;
+}
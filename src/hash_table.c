@@ -1,4 +1,5 @@
 #include "../include/hash_table.h"
+#include "../include/timing.h"
 #include "../include/utils.h"
 #include <stdio.h>
 #include <stdlib.h>
@@ -8,24 +9,41 @@
 /* Ensure the bucket at index exists, creating a linked list if necessary. */
 static linked_list_t *ensure_bucket(hash_table_t *table, int index) {
   if (table->buckets[index] == NULL) {
-    table->buckets[index] = create_linked_list();
+    table->buckets[index] = create_linked_list_pool(table->pool);
   }
   return table->buckets[index];
 }
 
+/* Hash of key as cached in ht_item->hash, and the bucket it goes to. */
+static unsigned int key_hash(const hash_table_t *table, const void *key) {
+  return table->hash_func(key, HT_HASH_RANGE);
+}
+
+static int bucket_of(const hash_table_t *table, unsigned int hash) {
+  return (int)(hash % (unsigned int)table->size);
+}
+
+/* Release a redundant or removed item. */
+static void release_item(const hash_table_t *table, ht_item *item) {
+  if (table->ops->free_item)
+    table->ops->free_item(item);
+}
+
 /* Resize the table when the load factor exceeds the threshold. */
 static void ht_resize(hash_table_t *table) {
+  TIMER_START(start);
   int new_size = next_prime(table->size * 2);
   linked_list_t **old_buckets = table->buckets;
   int old_size = table->size;
 
-  table->buckets = dmalloc(sizeof(linked_list_t *) * new_size);
+  table->buckets = dmalloc_tag(sizeof(linked_list_t *) * new_size, MEM_BUCKETS);
   table->size = new_size;
   for (int i = 0; i < new_size; ++i) {
     table->buckets[i] = NULL;
   }
 
-  /* Re‑hash every element into the new bucket array. */
+  /* Move every element into the new bucket array by its cached hash,
+   * moving the nodes themselves: they all belong to the table's pool. */
   for (int i = 0; i < old_size; ++i) {
     linked_list_t *bucket = old_buckets[i];
     if (bucket == NULL)
@@ -33,23 +51,32 @@ static void ht_resize(hash_table_t *table) {
 
     ll_item_t *current = bucket->head;
     while (current) {
+      ll_item_t *next = current->next;
       ht_item *it = (ht_item *)current->data;
-      int index = table->hash_func(get_ht_item_key(it), table->size);
-      linked_list_t *dest = ensure_bucket(table, index);
-      add_to_list(dest, it);
-      current = current->next;
+      ll_push_node(ensure_bucket(table, bucket_of(table, it->hash)), current);
+      current = next;
     }
     /* Free the wrapper list; items are now in the new table. */
-    free(bucket);
+    dfree(bucket);
   }
-  free(old_buckets);
+  dfree(old_buckets);
+  TIMER_STOP(TIMING_RESIZE, start);
 }
 
 hash_table_t *create_hash_table(int initial_size,
                                 unsigned int (*hash_func)(const void *, int),
                                 int (*key_cmp)(const void *, const void *)) {
-  if (!hash_func || !key_cmp) {
-    fprintf(stderr, "Hash function and key compare cannot be NULL\n");
+  return create_hash_table_ops(initial_size, hash_func, key_cmp,
+                               &ht_default_item_ops);
+}
+
+hash_table_t *create_hash_table_ops(int initial_size,
+                                    unsigned int (*hash_func)(const void *,
+                                                              int),
+                                    int (*key_cmp)(const void *, const void *),
+                                    const ht_item_ops_t *ops) {
+  if (!hash_func || !key_cmp || !ops) {
+    fprintf(stderr, "Hash function, key compare and ops cannot be NULL\n");
     return NULL;
   }
   hash_table_t *table = dmalloc(sizeof(hash_table_t));
@@ -57,8 +84,11 @@ hash_table_t *create_hash_table(int initial_size,
   table->count = 0;
   table->hash_func = hash_func;
   table->key_cmp = key_cmp;
+  table->pool = create_ll_pool(0);
+  table->ops = ops;
 
-  table->buckets = dmalloc(sizeof(linked_list_t *) * table->size);
+  table->buckets =
+      dmalloc_tag(sizeof(linked_list_t *) * table->size, MEM_BUCKETS);
   for (int i = 0; i < table->size; ++i) {
     table->buckets[i] = NULL;
   }
@@ -69,20 +99,18 @@ static double load_factor(const hash_table_t *table) {
   return (double)table->count / (double)table->size;
 }
 
-void ht_insert(hash_table_t *table, ht_item *item) {
-  if (!table || !item)
-    return;
-
-  int index = table->hash_func(get_ht_item_key(item), table->size);
-  linked_list_t *bucket = ensure_bucket(table, index);
+static void insert_one(hash_table_t *table, ht_item *item) {
+  item->hash = key_hash(table, item->key);
+  linked_list_t *bucket = ensure_bucket(table, bucket_of(table, item->hash));
 
   ll_item_t *current = bucket->head;
   while (current) {
     ht_item *existing = (ht_item *)current->data;
-    if (table->key_cmp(get_ht_item_key(existing), get_ht_item_key(item)) == 0) {
+    if (existing->hash == item->hash &&
+        table->key_cmp(existing->key, item->key) == 0) {
       /* Key already present – update value using item's value. */
-      existing->update_value(existing, get_ht_item_value(item));
-      item->free_item(item); /* Item is redundant now. */
+      table->ops->update_value(existing, item->value);
+      release_item(table, item); /* Item is redundant now. */
       return;
     }
     current = current->next;
@@ -97,19 +125,27 @@ void ht_insert(hash_table_t *table, ht_item *item) {
   }
 }
 
+void ht_insert(hash_table_t *table, ht_item *item) {
+  if (!table || !item)
+    return;
+  TIMER_START(start);
+  insert_one(table, item);
+  TIMER_STOP(TIMING_HT_INSERT, start);
+}
+
 ht_item *ht_search(const hash_table_t *table, const void *key) {
   if (!table || !key)
     return NULL;
 
-  int index = table->hash_func(key, table->size);
-  linked_list_t *bucket = table->buckets[index];
+  unsigned int hash = key_hash(table, key);
+  linked_list_t *bucket = table->buckets[bucket_of(table, hash)];
   if (bucket == NULL)
     return NULL;
 
   ll_item_t *current = bucket->head;
   while (current) {
     ht_item *it = (ht_item *)current->data;
-    if (table->key_cmp(get_ht_item_key(it), key) == 0) {
+    if (it->hash == hash && table->key_cmp(it->key, key) == 0) {
       return it;
     }
     current = current->next;
@@ -121,8 +157,8 @@ int ht_remove(hash_table_t *table, const void *key) {
   if (!table || !key)
     return 0;
 
-  int index = table->hash_func(key, table->size);
-  linked_list_t *bucket = table->buckets[index];
+  unsigned int hash = key_hash(table, key);
+  linked_list_t *bucket = table->buckets[bucket_of(table, hash)];
   if (bucket == NULL)
     return 0;
 
@@ -130,27 +166,109 @@ int ht_remove(hash_table_t *table, const void *key) {
   ll_item_t *previous = NULL;
   while (current) {
     ht_item *it = (ht_item *)current->data;
-    if (table->key_cmp(get_ht_item_key(it), key) == 0) {
-      /* Unlink current. */
-      if (previous == NULL) {
-        bucket->head = current->next;
-        if (bucket->head == NULL)
-          bucket->tail = NULL;
-      } else {
-        previous->next = current->next;
-        if (current->next == NULL)
-          bucket->tail = previous;
+    if (it->hash == hash && table->key_cmp(it->key, key) == 0) {
+      ll_unlink_node(bucket, previous, current);
+      release_item(table, it);
+      ll_release_node(bucket, current);
+      table->count--;
+      return 1; /* Removed. */
+    }
+    previous = current;
+    current = current->next;
+  }
+  return 0; /* Not found. */
+}
+
+/* Hash a group of keys and walk the prefetches down to the first chain
+ * node: every pass only touches lines requested by the previous one. */
+static void prefetch_group(const hash_table_t *table, const void *const *keys,
+                           int n, unsigned int *hash, int *index) {
+  for (int i = 0; i < n; ++i) {
+    hash[i] = key_hash(table, keys[i]);
+    index[i] = bucket_of(table, hash[i]);
+    __builtin_prefetch(&table->buckets[index[i]]);
+  }
+  for (int i = 0; i < n; ++i) {
+    linked_list_t *bucket = table->buckets[index[i]];
+    if (bucket)
+      __builtin_prefetch(bucket);
+  }
+  for (int i = 0; i < n; ++i) {
+    linked_list_t *bucket = table->buckets[index[i]];
+    if (bucket && bucket->head)
+      __builtin_prefetch(bucket->head);
+  }
+}
+
+void ht_insert_batch(hash_table_t *table, ht_item **items, int n) {
+  if (!table || !items)
+    return;
+
+  const void *keys[HT_BATCH_GROUP];
+  unsigned int hash[HT_BATCH_GROUP];
+  int index[HT_BATCH_GROUP];
+  for (int base = 0; base < n; base += HT_BATCH_GROUP) {
+    int group = n - base < HT_BATCH_GROUP ? n - base : HT_BATCH_GROUP;
+    for (int i = 0; i < group; ++i)
+      keys[i] = items[base + i]->key;
+    prefetch_group(table, keys, group, hash, index);
+
+    int size = table->size;
+    for (int i = 0; i < group; ++i) {
+      TIMER_START(start);
+      ht_item *item = items[base + i];
+      item->hash = hash[i];
+      /* an insert earlier in the group may have resized the table */
+      int idx = size == table->size ? index[i] : bucket_of(table, hash[i]);
+      linked_list_t *bucket = ensure_bucket(table, idx);
+      ll_item_t *current = bucket->head;
+      while (current) {
+        ht_item *existing = (ht_item *)current->data;
+        if (existing->hash == hash[i] &&
+            table->key_cmp(existing->key, keys[i]) == 0)
+          break;
+        current = current->next;
+      }
+      if (current) {
+        ht_item *existing = (ht_item *)current->data;
+        table->ops->update_value(existing, item->value);
+        release_item(table, item);
+        TIMER_STOP(TIMING_HT_INSERT, start);
+        continue;
       }
-      if (it->free_item) {
-        it->free_item(it);
-        free(current);
-        table->count--;
-        return 1; /* Removed. */
+      add_to_list(bucket, item);
+      table->count++;
+      if (load_factor(table) > LOAD_FACTOR_THRESHOLD)
+        ht_resize(table);
+      TIMER_STOP(TIMING_HT_INSERT, start);
+    }
+  }
+}
+
+void ht_search_batch(const hash_table_t *table, const void *const *keys,
+                     int n, ht_item **out) {
+  if (!table || !keys || !out)
+    return;
+
+  unsigned int hash[HT_BATCH_GROUP];
+  int index[HT_BATCH_GROUP];
+  for (int base = 0; base < n; base += HT_BATCH_GROUP) {
+    int group = n - base < HT_BATCH_GROUP ? n - base : HT_BATCH_GROUP;
+    prefetch_group(table, keys + base, group, hash, index);
+    for (int i = 0; i < group; ++i) {
+      out[base + i] = NULL;
+      linked_list_t *bucket = table->buckets[index[i]];
+      if (bucket == NULL)
+        continue;
+      for (ll_item_t *current = bucket->head; current; current = current->next) {
+        ht_item *it = (ht_item *)current->data;
+        if (it->hash == hash[i] &&
+            table->key_cmp(it->key, keys[base + i]) == 0) {
+          out[base + i] = it;
+          break;
+        }
       }
-      previous = current;
-      current = current->next;
     }
-    return 0; /* Not found. */
   }
 }
 
@@ -163,19 +281,46 @@ void free_hash_table(hash_table_t *table) {
     if (bucket == NULL)
       continue;
 
-    ll_item_t *current = bucket->head;
-    while (current) {
-      ll_item_t *next = current->next;
-      ht_item *item = (ht_item *)current->data;
-      if (item->free_item)
-        item->free_item((ht_item *)current->data);
-      free(current);
-      current = next;
-    }
-    free(bucket);
+    for (ll_item_t *current = bucket->head; current; current = current->next)
+      release_item(table, (ht_item *)current->data);
+    dfree(bucket); /* the nodes go away with the pool */
   }
-  free(table->buckets);
-  free(table);
+  free_ll_pool(table->pool);
+  dfree(table->buckets);
+  dfree(table);
+}
+
+void ht_iter_init(ht_iter_t *it, const hash_table_t *table) {
+  ht_iter_init_range(it, table, 0, table ? table->size : 0);
+}
+
+void ht_iter_init_range(ht_iter_t *it, const hash_table_t *table, int begin,
+                        int end) {
+  it->table = table;
+  it->bucket = begin < 0 ? 0 : begin;
+  it->end = table && end > table->size ? table->size : end;
+  it->node = NULL;
 }
+
+ht_item *ht_iter_next(ht_iter_t *it) {
+  while (it->node == NULL) {
+    if (it->bucket >= it->end)
+      return NULL;
+    linked_list_t *bucket = it->table->buckets[it->bucket++];
+    if (bucket)
+      it->node = bucket->head;
+  }
+  ht_item *item = it->node->data;
+  it->node = it->node->next;
+  return item;
+}
+
+void ht_partition(const hash_table_t *table, int part, int parts, int *begin,
+                  int *end) {
+  long long size = table ? table->size : 0;
+  *begin = (int)(size * part / parts);
+  *end = (int)(size * (part + 1) / parts);
+}
+
 int ht_get_count(const hash_table_t *table) { return table ? table->count : 0; }
 int ht_get_size(const hash_table_t *table) { return table ? table->size : 0; }
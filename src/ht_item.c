@@ -9,15 +9,16 @@ void default_update_value(const void *item, const void *new_value) {
     return;
   }
   ht_item *htItem = (ht_item *)item;
-  htItem->value = new_value; // Update the value directly
+  htItem->value = (void *)new_value; // Update the value directly
 }
 
+const ht_item_ops_t ht_default_item_ops = {default_update_value,
+                                           default_free_ht_item};
+
 ht_item *default_create_ht_item(void *key, void *value) {
-  ht_item *new_item = dmalloc(sizeof(ht_item));
+  ht_item *new_item = dmalloc_tag(sizeof(ht_item), MEM_ITEMS);
   new_item->key = key;
-  new_item->value = value; // Initialize value to NULL}
-  new_item->update_value = default_update_value;
-  new_item->free_item = default_free_ht_item; // No free function by default
+  new_item->value = value;
   return new_item;
 }
 
@@ -42,5 +43,5 @@ void default_free_ht_item(ht_item *item) {
     fprintf(stderr, "ht_item is NULL\n");
     return;
   }
-  free(item);
+  dfree(item);
 }
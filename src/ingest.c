@@ -0,0 +1,493 @@
+#define _DEFAULT_SOURCE
+#include "../include/ingest.h"
+#include "../include/utils.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define DEFAULT_QUEUE_DEPTH 32
+#define DEFAULT_BLOCK_SIZE (128 * 1024)
+#define DEFAULT_THREADS 4
+
+enum { SLOT_FREE, SLOT_PENDING, SLOT_READING, SLOT_DONE };
+
+typedef struct {
+  int fd;
+  int opened;
+  uint64_t size; /* at open */
+} file_t;
+
+/* One block in flight; block number seq lives in slots[seq % depth]. */
+typedef struct {
+  int file;
+  uint64_t offset;
+  size_t len; /* 0: end of an empty file, nothing to read */
+  size_t got; /* bytes read so far */
+  int state;
+  int error; /* errno of a failed read, -1: unexpected end of file */
+  char *buffer;
+} slot_t;
+
+/* io_uring set up with the raw system calls. */
+typedef struct {
+  int fd;
+  unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+  unsigned *cq_head, *cq_tail, *cq_mask;
+  struct io_uring_sqe *sqes;
+  struct io_uring_cqe *cqes;
+  void *sq_map, *cq_map;
+  size_t sq_map_len, cq_map_len, sqes_len;
+  unsigned to_submit; /* queued, not yet passed to the kernel */
+  unsigned in_flight; /* passed to the kernel, not yet completed */
+} uring_t;
+
+typedef struct {
+  const char *const *paths;
+  int n;
+  file_t *files;
+  int next_file;        /* next block to issue: file and offset */
+  uint64_t next_offset;
+  slot_t *slots;
+  unsigned depth;
+  size_t block_size;
+  uint64_t issued;      /* blocks issued / delivered so far */
+  uint64_t delivered;
+  int stopping;         /* no more resubmission of short reads */
+  ingest_stats_t stats;
+
+  uring_t ring;
+
+  /* INGEST_PREAD */
+  pthread_t *workers;
+  int threads;
+  pthread_mutex_t lock;
+  pthread_cond_t work; /* a slot became PENDING or stop was set */
+  pthread_cond_t done; /* a slot became DONE */
+  uint64_t claimed;    /* blocks taken by the workers */
+  int stop;
+} ingest_t;
+
+/* ---------------------------------------------------------------------
+ * io_uring
+ * ------------------------------------------------------------------- */
+
+static int uring_setup(uring_t *r, unsigned entries) {
+  struct io_uring_params p;
+  memset(&p, 0, sizeof p);
+  memset(r, 0, sizeof *r);
+  r->fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+  if (r->fd < 0)
+    return -1;
+  /* 5.1-5.5 set up a ring but have no IORING_OP_READ: every read would
+   * fail with EINVAL. RW_CUR_POS came with it in 5.6. */
+  if (!(p.features & IORING_FEAT_RW_CUR_POS)) {
+    close(r->fd);
+    r->fd = -1;
+    errno = EOPNOTSUPP;
+    return -1;
+  }
+  r->sq_map_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  r->cq_map_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  int single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+  if (single && r->cq_map_len > r->sq_map_len)
+    r->sq_map_len = r->cq_map_len;
+  r->sq_map = mmap(NULL, r->sq_map_len, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+  r->cq_map = single ? r->sq_map
+                     : mmap(NULL, r->cq_map_len, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, r->fd,
+                            IORING_OFF_CQ_RING);
+  r->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+  r->sqes = mmap(NULL, r->sqes_len, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+  if (r->sq_map == MAP_FAILED || r->cq_map == MAP_FAILED ||
+      r->sqes == MAP_FAILED) {
+    if (r->sq_map != MAP_FAILED)
+      munmap(r->sq_map, r->sq_map_len);
+    if (!single && r->cq_map != MAP_FAILED)
+      munmap(r->cq_map, r->cq_map_len);
+    if (r->sqes != MAP_FAILED)
+      munmap(r->sqes, r->sqes_len);
+    close(r->fd);
+    r->fd = -1;
+    return -1;
+  }
+  char *sq = r->sq_map, *cq = r->cq_map;
+  r->sq_head = (unsigned *)(sq + p.sq_off.head);
+  r->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+  r->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+  r->sq_array = (unsigned *)(sq + p.sq_off.array);
+  r->cq_head = (unsigned *)(cq + p.cq_off.head);
+  r->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+  r->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+  r->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+  return 0;
+}
+
+static void uring_free(uring_t *r) {
+  if (r->fd < 0)
+    return;
+  munmap(r->sqes, r->sqes_len);
+  if (r->cq_map != r->sq_map)
+    munmap(r->cq_map, r->cq_map_len);
+  munmap(r->sq_map, r->sq_map_len);
+  close(r->fd);
+  r->fd = -1;
+}
+
+/* Queue a read of the rest of slot (index in user_data). */
+static void uring_queue_read(ingest_t *in, slot_t *slot) {
+  uring_t *r = &in->ring;
+  unsigned tail = *r->sq_tail;
+  unsigned index = tail & *r->sq_mask;
+  struct io_uring_sqe *sqe = &r->sqes[index];
+  memset(sqe, 0, sizeof *sqe);
+  sqe->opcode = IORING_OP_READ;
+  sqe->fd = in->files[slot->file].fd;
+  sqe->off = slot->offset + slot->got;
+  sqe->addr = (uint64_t)(uintptr_t)(slot->buffer + slot->got);
+  sqe->len = (uint32_t)(slot->len - slot->got);
+  sqe->user_data = (uint64_t)(slot - in->slots);
+  r->sq_array[index] = index;
+  __atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+  r->to_submit++;
+  in->stats.reads++;
+}
+
+/* Submit what is queued and, if wait, block until a completion arrives.
+ * Returns 0 or -1. */
+static int uring_enter(uring_t *r, int wait) {
+  unsigned flags = wait ? IORING_ENTER_GETEVENTS : 0;
+  for (;;) {
+    int ret = (int)syscall(__NR_io_uring_enter, r->fd, r->to_submit,
+                           wait ? 1u : 0u, flags, NULL, 0);
+    if (ret >= 0) {
+      r->to_submit -= (unsigned)ret;
+      r->in_flight += (unsigned)ret;
+      return 0;
+    }
+    if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+      perror("io_uring_enter");
+      return -1;
+    }
+  }
+}
+
+static void uring_reap(ingest_t *in) {
+  uring_t *r = &in->ring;
+  unsigned head = *r->cq_head;
+  while (head != __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)) {
+    const struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+    slot_t *slot = &in->slots[cqe->user_data];
+    r->in_flight--;
+    if (cqe->res < 0) {
+      slot->error = -cqe->res;
+    } else if (cqe->res == 0) {
+      slot->error = -1; /* the file shrank */
+    } else {
+      slot->got += (size_t)cqe->res;
+    }
+    if (slot->error == 0 && slot->got < slot->len && !in->stopping)
+      uring_queue_read(in, slot); /* short read: ask for the rest */
+    else
+      slot->state = SLOT_DONE;
+    head++;
+  }
+  __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+}
+
+static int uring_wait(ingest_t *in, slot_t *slot) {
+  while (slot->state != SLOT_DONE) {
+    if (uring_enter(&in->ring, 1) != 0)
+      return -1;
+    uring_reap(in);
+  }
+  return 0;
+}
+
+/* Wait for every read still in the kernel: their buffers are about to be
+ * freed. */
+static void uring_drain(ingest_t *in) {
+  in->stopping = 1;
+  if (in->ring.to_submit && uring_enter(&in->ring, 0) != 0)
+    return;
+  while (in->ring.in_flight > 0) {
+    if (uring_enter(&in->ring, 1) != 0)
+      return;
+    uring_reap(in);
+  }
+}
+
+/* ---------------------------------------------------------------------
+ * pread workers
+ * ------------------------------------------------------------------- */
+
+static void *pread_worker(void *arg) {
+  ingest_t *in = arg;
+  pthread_mutex_lock(&in->lock);
+  for (;;) {
+    slot_t *slot = NULL;
+    while (in->claimed < in->issued) {
+      slot_t *s = &in->slots[in->claimed++ % in->depth];
+      if (s->state == SLOT_PENDING) {
+        slot = s;
+        break;
+      }
+    }
+    if (slot == NULL) {
+      if (in->stop)
+        break;
+      pthread_cond_wait(&in->work, &in->lock);
+      continue;
+    }
+    slot->state = SLOT_READING;
+    int fd = in->files[slot->file].fd;
+    pthread_mutex_unlock(&in->lock);
+
+    int error = 0;
+    uint64_t reads = 0;
+    while (slot->got < slot->len) {
+      ssize_t got = pread(fd, slot->buffer + slot->got, slot->len - slot->got,
+                          (off_t)(slot->offset + slot->got));
+      reads++;
+      if (got < 0 && errno == EINTR)
+        continue;
+      if (got <= 0) {
+        error = got < 0 ? errno : -1;
+        break;
+      }
+      slot->got += (size_t)got;
+    }
+
+    pthread_mutex_lock(&in->lock);
+    slot->error = error;
+    slot->state = SLOT_DONE;
+    in->stats.reads += reads;
+    pthread_cond_broadcast(&in->done);
+  }
+  pthread_mutex_unlock(&in->lock);
+  return NULL;
+}
+
+static int pread_start(ingest_t *in, int threads) {
+  pthread_mutex_init(&in->lock, NULL);
+  pthread_cond_init(&in->work, NULL);
+  pthread_cond_init(&in->done, NULL);
+  in->workers = dmalloc(sizeof(pthread_t) * (size_t)threads);
+  for (in->threads = 0; in->threads < threads; ++in->threads) {
+    if (pthread_create(&in->workers[in->threads], NULL, pread_worker, in) !=
+        0) {
+      perror("pthread_create");
+      return in->threads > 0 ? 0 : -1;
+    }
+  }
+  return 0;
+}
+
+static void pread_stop(ingest_t *in) {
+  pthread_mutex_lock(&in->lock);
+  in->stop = 1;
+  pthread_cond_broadcast(&in->work);
+  pthread_mutex_unlock(&in->lock);
+  for (int t = 0; t < in->threads; ++t)
+    pthread_join(in->workers[t], NULL);
+  dfree(in->workers);
+  pthread_mutex_destroy(&in->lock);
+  pthread_cond_destroy(&in->work);
+  pthread_cond_destroy(&in->done);
+}
+
+/* ---------------------------------------------------------------------
+ * Common part: issuing blocks in file order, delivering them in order
+ * ------------------------------------------------------------------- */
+
+/* Issue the next block, if any. Returns 1 if one was issued, 0 when every
+ * file is issued, -1 on error. */
+static int issue_next(ingest_t *in) {
+  if (in->next_file >= in->n)
+    return 0;
+  file_t *f = &in->files[in->next_file];
+  if (!f->opened) {
+    const char *path = in->paths[in->next_file];
+    struct stat st;
+    f->fd = open(path, O_RDONLY);
+    if (f->fd < 0 || fstat(f->fd, &st) != 0) {
+      perror(path);
+      return -1;
+    }
+    f->opened = 1;
+    if (!S_ISREG(st.st_mode)) {
+      fprintf(stderr, "%s: not a regular file\n", path);
+      return -1;
+    }
+    f->size = (uint64_t)st.st_size;
+    in->stats.files++;
+  }
+
+  int pread_backend = in->stats.backend == INGEST_PREAD;
+  if (pread_backend)
+    pthread_mutex_lock(&in->lock);
+  slot_t *slot = &in->slots[in->issued % in->depth];
+  slot->file = in->next_file;
+  slot->offset = in->next_offset;
+  uint64_t left = f->size - in->next_offset;
+  slot->len = left < in->block_size ? (size_t)left : in->block_size;
+  slot->got = 0;
+  slot->error = 0;
+  slot->state = slot->len ? SLOT_PENDING : SLOT_DONE;
+  in->next_offset += slot->len;
+  if (in->next_offset >= f->size) {
+    in->next_file++;
+    in->next_offset = 0;
+  }
+  in->issued++;
+  if (pread_backend) {
+    pthread_cond_signal(&in->work);
+    pthread_mutex_unlock(&in->lock);
+  } else if (slot->len) {
+    uring_queue_read(in, slot);
+  }
+  return 1;
+}
+
+static int wait_slot(ingest_t *in, slot_t *slot) {
+  if (in->stats.backend == INGEST_IO_URING)
+    return uring_wait(in, slot);
+  pthread_mutex_lock(&in->lock);
+  while (slot->state != SLOT_DONE)
+    pthread_cond_wait(&in->done, &in->lock);
+  pthread_mutex_unlock(&in->lock);
+  return 0;
+}
+
+static int deliver(ingest_t *in, ingest_sink_t sink, void *ctx) {
+  slot_t *slot = &in->slots[in->delivered % in->depth];
+  uint64_t start = monotonic_ns();
+  if (wait_slot(in, slot) != 0)
+    return -1;
+  in->stats.wait_ns += monotonic_ns() - start;
+  const char *path = in->paths[slot->file];
+  if (slot->error) {
+    if (slot->error > 0)
+      fprintf(stderr, "%s: %s\n", path, strerror(slot->error));
+    else
+      fprintf(stderr, "%s: unexpected end of file\n", path);
+    return -1;
+  }
+  file_t *f = &in->files[slot->file];
+  if (slot->len > 0 && sink(ctx, slot->file, slot->buffer, slot->len) != 0)
+    return -1;
+  in->stats.bytes += slot->len;
+  if (slot->offset + slot->len >= f->size) {
+    if (sink(ctx, slot->file, slot->buffer, 0) != 0)
+      return -1;
+    close(f->fd);
+    f->fd = -1;
+  }
+  slot->state = SLOT_FREE;
+  in->delivered++;
+  return 0;
+}
+
+int ingest_files(const char *const *paths, int n,
+                 const ingest_config_t *config, ingest_sink_t sink, void *ctx,
+                 ingest_stats_t *stats) {
+  if (sink == NULL || (n > 0 && paths == NULL)) {
+    fprintf(stderr, "ingest_files: no sink or no paths\n");
+    return -1;
+  }
+  uint64_t start = monotonic_ns();
+  ingest_backend_t backend = config ? config->backend : INGEST_AUTO;
+  ingest_t in;
+  memset(&in, 0, sizeof in);
+  in.paths = paths;
+  in.n = n;
+  in.depth = config && config->queue_depth ? config->queue_depth
+                                           : DEFAULT_QUEUE_DEPTH;
+  in.block_size = config && config->block_size ? config->block_size
+                                               : DEFAULT_BLOCK_SIZE;
+  int threads = config && config->threads > 0 ? config->threads
+                                              : DEFAULT_THREADS;
+  in.ring.fd = -1;
+
+  if (backend != INGEST_PREAD) {
+    if (uring_setup(&in.ring, in.depth) == 0) {
+      backend = INGEST_IO_URING;
+    } else if (backend == INGEST_IO_URING) {
+      perror("io_uring_setup");
+      return -1;
+    } else {
+      backend = INGEST_PREAD;
+    }
+  }
+  in.stats.backend = backend;
+  if (backend == INGEST_PREAD && pread_start(&in, threads) != 0)
+    return -1;
+
+  in.files = dmalloc(sizeof(file_t) * (size_t)(n > 0 ? n : 1));
+  for (int i = 0; i < n; ++i)
+    in.files[i].fd = -1;
+  in.slots = dmalloc(sizeof(slot_t) * in.depth);
+  for (unsigned i = 0; i < in.depth; ++i)
+    in.slots[i].buffer = dmalloc(in.block_size);
+
+  int rc = 0;
+  while (rc == 0 && in.issued < in.depth && (rc = issue_next(&in)) == 1)
+    rc = 0;
+  while (rc == 0 && in.delivered < in.issued) {
+    rc = deliver(&in, sink, ctx);
+    if (rc == 0 && issue_next(&in) < 0)
+      rc = -1;
+  }
+
+  if (backend == INGEST_IO_URING) {
+    uring_drain(&in);
+    uring_free(&in.ring);
+  } else {
+    pread_stop(&in);
+  }
+  for (int i = 0; i < n; ++i)
+    if (in.files[i].fd >= 0)
+      close(in.files[i].fd);
+  for (unsigned i = 0; i < in.depth; ++i)
+    dfree(in.slots[i].buffer);
+  dfree(in.slots);
+  dfree(in.files);
+  in.stats.elapsed_ns = monotonic_ns() - start;
+  if (stats)
+    *stats = in.stats;
+  return rc;
+}
+
+int ingest_backend_from_name(const char *name, ingest_backend_t *backend) {
+  if (name == NULL || backend == NULL)
+    return -1;
+  if (strcmp(name, "auto") == 0)
+    *backend = INGEST_AUTO;
+  else if (strcmp(name, "uring") == 0)
+    *backend = INGEST_IO_URING;
+  else if (strcmp(name, "pread") == 0)
+    *backend = INGEST_PREAD;
+  else
+    return -1;
+  return 0;
+}
+
+const char *ingest_backend_name(ingest_backend_t backend) {
+  switch (backend) {
+  case INGEST_AUTO:
+    return "auto";
+  case INGEST_IO_URING:
+    return "uring";
+  case INGEST_PREAD:
+    return "pread";
+  }
+  return "?";
+}
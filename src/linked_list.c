@@ -1,120 +1,243 @@
-#include "../include/linked_list.h"
-#include "../include/utils.h"
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-
-// constructor for the linked list
-linked_list_t *create_linked_list() {
-  linked_list_t *list = dmalloc(sizeof(linked_list_t));
-  list->head = NULL;
-  list->tail = NULL;
-  return list;
-}
-
-void add_to_list(linked_list_t *list, void *data) {
-  if (list == NULL) {
-    fprintf(stderr, "List is NULL\n");
-    return;
-  }
-  ll_item_t *new_item = dmalloc(sizeof(ll_item_t));
-  new_item->data = data;
-  new_item->next = NULL;
-
-  if (list->head == NULL) {
-    list->head = new_item;
-    list->tail = new_item;
-
-  } else {
-    list->tail->next = new_item;
-    list->tail = new_item;
-  }
-  list->tail->next = NULL;
-
-  return;
-}
-
-void remove_from_list(linked_list_t *list, void *data) {
-  if (list == NULL || list->head == NULL) {
-    fprintf(stderr, "List is empty or NULL\n");
-    return;
-  }
-
-  ll_item_t *current = list->head;
-  ll_item_t *previous = NULL;
-
-  while (current != NULL) {
-    if (current->data == data) {
-      if (previous == NULL) {
-        // Removing the head
-        list->head = current->next;
-        if (list->head == NULL) {
-          list->tail = NULL; // List is now empty
-        }
-      } else {
-        previous->next = current->next;
-        if (current->next == NULL) {
-          list->tail = previous; // Update tail if we removed the last item
-        }
-      }
-      free(current);
-      return;
-    }
-    previous = current;
-    current = current->next;
-  }
-  fprintf(stderr, "Data not found in the list\n");
-}
-
-void free_linked_list(linked_list_t *list) {
-  if (list == NULL) {
-    fprintf(stderr, "list is null\n");
-    return;
-  }
-
-  ll_item_t *current = list->head;
-  while (current != NULL) {
-    ll_item_t *next = current->next;
-    free(current->data);
-    free(current);
-    current = next;
-  }
-  free(list);
-  return;
-}
-
-int get_list_size(const linked_list_t *list) {
-  if (list == NULL) {
-    fprintf(stderr, "List is NULL\n");
-    return 0;
-  }
-
-  int size = 0;
-  ll_item_t *current = list->head;
-  while (current != NULL) {
-    size++;
-    current = current->next;
-  }
-  return size;
-}
-
-void **linked_list_to_array(const linked_list_t *list) {
-  if (list == NULL || list->head == NULL) {
-    fprintf(stderr, "List is empty or NULL\n");
-    return NULL;
-  }
-  int size = get_list_size(list);
-  void **array = dmalloc(size * sizeof(void *));
-
-  ll_item_t *current = list->head;
-  for (int i = 0; i < size; i++) {
-    if (current == NULL) {
-      fprintf(stderr, "Unexpected end of list\n");
-      free(array);
-      return NULL;
-    }
-    array[i] = current->data;
-    current = current->next;
-  }
-  return array;
-}
+#include "../include/linked_list.h"
+#include "../include/utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LL_POOL_DEFAULT_SLAB 1024
+
+struct ll_pool_slab {
+  struct ll_pool_slab *next;
+  ll_item_t nodes[]; /* slab_nodes of them */
+};
+
+ll_pool_t *create_ll_pool(size_t slab_nodes) {
+  ll_pool_t *pool = dmalloc(sizeof(ll_pool_t));
+  pool->slab_nodes = slab_nodes ? slab_nodes : LL_POOL_DEFAULT_SLAB;
+  pool->used = pool->slab_nodes; /* no slab yet */
+  return pool;
+}
+
+void free_ll_pool(ll_pool_t *pool) {
+  if (pool == NULL)
+    return;
+  ll_pool_slab_t *slab = pool->slabs;
+  while (slab) {
+    ll_pool_slab_t *next = slab->next;
+    dfree(slab);
+    slab = next;
+  }
+  dfree(pool);
+}
+
+static ll_item_t *node_alloc(ll_pool_t *pool) {
+  if (pool == NULL)
+    return dmalloc_tag(sizeof(ll_item_t), MEM_LIST_NODES);
+  ll_item_t *node = pool->free_nodes;
+  if (node) {
+    pool->free_nodes = node->next;
+  } else {
+    if (pool->used == pool->slab_nodes) {
+      ll_pool_slab_t *slab =
+          dmalloc_tag(sizeof(ll_pool_slab_t) +
+                          sizeof(ll_item_t) * pool->slab_nodes,
+                      MEM_LIST_NODES);
+      slab->next = pool->slabs;
+      pool->slabs = slab;
+      pool->used = 0;
+    }
+    node = &pool->slabs->nodes[pool->used++];
+  }
+  pool->live++;
+  return node;
+}
+
+static void node_free(ll_pool_t *pool, ll_item_t *node) {
+  if (pool == NULL) {
+    dfree(node);
+    return;
+  }
+  node->next = pool->free_nodes;
+  pool->free_nodes = node;
+  pool->live--;
+}
+
+// constructor for the linked list
+linked_list_t *create_linked_list() { return create_linked_list_pool(NULL); }
+
+linked_list_t *create_linked_list_pool(ll_pool_t *pool) {
+  linked_list_t *list = dmalloc_tag(sizeof(linked_list_t), MEM_LIST_NODES);
+  list->head = NULL;
+  list->tail = NULL;
+  list->size = 0;
+  list->pool = pool;
+  return list;
+}
+
+void ll_push_node(linked_list_t *list, ll_item_t *node) {
+  node->next = NULL;
+  if (list->head == NULL) {
+    list->head = node;
+  } else {
+    list->tail->next = node;
+  }
+  list->tail = node;
+  list->size++;
+}
+
+void ll_unlink_node(linked_list_t *list, ll_item_t *previous, ll_item_t *node) {
+  if (previous == NULL) {
+    // Removing the head
+    list->head = node->next;
+  } else {
+    previous->next = node->next;
+  }
+  if (list->tail == node) {
+    list->tail = previous; // Update tail if we removed the last item
+  }
+  list->size--;
+}
+
+void ll_release_node(linked_list_t *list, ll_item_t *node) {
+  node_free(list->pool, node);
+}
+
+int add_to_list(linked_list_t *list, void *data) {
+  if (list == NULL)
+    return -1;
+  ll_item_t *new_item = node_alloc(list->pool);
+  new_item->data = data;
+  ll_push_node(list, new_item);
+  return 0;
+}
+
+int remove_from_list(linked_list_t *list, void *data) {
+  if (list == NULL)
+    return -1;
+
+  ll_item_t *current = list->head;
+  ll_item_t *previous = NULL;
+  while (current != NULL) {
+    if (current->data == data) {
+      ll_unlink_node(list, previous, current);
+      node_free(list->pool, current);
+      return 0;
+    }
+    previous = current;
+    current = current->next;
+  }
+  return -1; // Data not found in the list
+}
+
+static void free_data_default(void *data) { dfree(data); }
+
+void free_linked_list(linked_list_t *list) {
+  if (list == NULL) {
+    fprintf(stderr, "list is null\n");
+    return;
+  }
+  free_linked_list_with(list, free_data_default);
+}
+
+void free_linked_list_with(linked_list_t *list, void (*free_data)(void *)) {
+  if (list == NULL)
+    return;
+
+  ll_item_t *current = list->head;
+  while (current != NULL) {
+    ll_item_t *next = current->next;
+    if (free_data)
+      free_data(current->data);
+    node_free(list->pool, current);
+    current = next;
+  }
+  dfree(list);
+}
+
+int get_list_size(const linked_list_t *list) {
+  if (list == NULL) {
+    fprintf(stderr, "List is NULL\n");
+    return 0;
+  }
+  return list->size;
+}
+
+void **linked_list_to_array(const linked_list_t *list) {
+  if (list == NULL || list->head == NULL) {
+    fprintf(stderr, "List is empty or NULL\n");
+    return NULL;
+  }
+  void **array = dmalloc(list->size * sizeof(void *));
+
+  int i = 0;
+  for (ll_item_t *current = list->head; current; current = current->next)
+    array[i++] = current->data;
+  return array;
+}
+
+void ll_iter_init(linked_list_iterator_t *it, const linked_list_t *list) {
+  it->current = list ? list->head : NULL;
+}
+
+int ll_iter_next(linked_list_iterator_t *it, void **data) {
+  if (it->current == NULL)
+    return 0;
+  *data = it->current->data;
+  it->current = it->current->next;
+  return 1;
+}
+
+void ll_intrusive_init(ll_intrusive_t *list) {
+  list->head = NULL;
+  list->tail = NULL;
+  list->size = 0;
+}
+
+void ll_intrusive_push_back(ll_intrusive_t *list, ll_link_t *link) {
+  link->next = NULL;
+  if (list->head == NULL)
+    list->head = link;
+  else
+    list->tail->next = link;
+  list->tail = link;
+  list->size++;
+}
+
+void ll_intrusive_push_front(ll_intrusive_t *list, ll_link_t *link) {
+  link->next = list->head;
+  list->head = link;
+  if (list->tail == NULL)
+    list->tail = link;
+  list->size++;
+}
+
+ll_link_t *ll_intrusive_pop_front(ll_intrusive_t *list) {
+  ll_link_t *link = list->head;
+  if (link == NULL)
+    return NULL;
+  list->head = link->next;
+  if (list->head == NULL)
+    list->tail = NULL;
+  list->size--;
+  link->next = NULL;
+  return link;
+}
+
+int ll_intrusive_remove(ll_intrusive_t *list, ll_link_t *link) {
+  ll_link_t *previous = NULL;
+  for (ll_link_t *current = list->head; current; current = current->next) {
+    if (current == link) {
+      if (previous == NULL)
+        list->head = current->next;
+      else
+        previous->next = current->next;
+      if (list->tail == current)
+        list->tail = previous;
+      list->size--;
+      link->next = NULL;
+      return 0;
+    }
+    previous = current;
+  }
+  return -1;
+}
@@ -1,95 +1,778 @@
-
+/*
+ * Command line front end.
+ *
+ *   Markov_First train [-b hash|radix|external] [-t threads] [-m MB]
+ *                      [-T tmp_dir] [-P | -I auto|uring|pread | -R] model
+ *                      [corpus ...]
+ *   Markov_First export [-p] [-d tab] [-t threads] model table.csv
+ *   Markov_First import [-t threads] table.csv model
+ *   Markov_First update [-c] model [corpus ...]
+ *   Markov_First compact model
+ *   Markov_First merge [-t threads] [-w weight_a,weight_b] a b merged
+ *   Markov_First pack [-e varint|bits] model packed
+ *   Markov_First quantize [-b 8|16] [-a] model quantized
+ *   Markov_First tokens [corpus ...]
+ *   Markov_First publish model /name
+ *   Markov_First unpublish /name
+ *   Markov_First generate [-S] [-n words] [-s seed | -B width] model [start]
+ *
+ * Corpora are UTF-8 text files ("-" or none: standard input), each one a
+ * separate chain. With -P, training reads and tokenizes in separate
+ * processes (pipeline.h) and reports per stage statistics. With -I, the
+ * corpus files are read ahead with a queue of asynchronous reads
+ * (ingest.h), io_uring or a pool of pread threads. With -R, the corpora
+ * may be directories: every file below them is trained on by -t threads
+ * that share the work out by stealing (dir_train.h).
+ *
+ * publish copies a model into POSIX shared memory; generate -S attaches to
+ * such a copy instead of mapping a file, so any number of generators share
+ * one model in RAM. A start word ending in '*' is a prefix: generation
+ * starts from a random word beginning with it (word_trie.h). With -B,
+ * generation is deterministic: a beam search of that width for the most
+ * probable continuation of the start word.
+ *
+ * update trains on the new corpora only and appends their counts as one
+ * batch to model.delta (delta_log.h), at a cost that does not depend on
+ * the size of the model; export, publish and generate see the model with
+ * its log applied. compact (or update -c) folds the log into the model.
+ *
+ * merge combines two models, e.g. trained on different sources, scaling
+ * the counts of each by its weight (model_merge.h).
+ *
+ * pack writes a compressed copy of a model (packed_model.h) that generate
+ * reads like a model, walking it row by row; beam search, shared memory
+ * and prefix starts need the model itself. Likewise quantize writes a
+ * copy for sampling only, with 8 or 16 bit probabilities in cumulative or
+ * (-a) alias tables (quant_model.h).
+ *
+ * With MARKOV_MEMSTAT set in the environment, the dmalloc accounting of a
+ * MEMSTAT=1 build (utils.h) is written to standard error at exit and on
+ * SIGUSR1. A TIMERS=1 build prints the latency percentiles of its hot
+ * paths (timing.h) to standard error at exit.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include "../include/csv.h"
+#include "../include/delta_log.h"
+#include "../include/dir_train.h"
+#include "../include/generate.h"
+#include "../include/ingest.h"
+#include "../include/model_merge.h"
+#include "../include/packed_model.h"
+#include "../include/pipeline.h"
+#include "../include/quant_model.h"
+#include "../include/timing.h"
+#include "../include/tokenizer.h"
+#include "../include/train.h"
+#include "../include/utf8_tools.h"
+#include "../include/word_trie.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static void usage(void) {
+  fprintf(stderr,
+          "Usage:\n"
+          "  Markov_First train [-b hash|radix|external] [-t threads] "
+          "[-m MB] [-T tmp_dir]\n"
+          "                     [-P | -I auto|uring|pread | -R] model "
+          "[corpus ...]\n"
+          "  Markov_First export [-p] [-d tab] [-t threads] model table.csv\n"
+          "  Markov_First import [-t threads] table.csv model\n"
+          "  Markov_First update [-c] model [corpus ...]\n"
+          "  Markov_First compact model\n"
+          "  Markov_First merge [-t threads] [-w weight_a,weight_b] a b "
+          "merged\n"
+          "  Markov_First pack [-e varint|bits] model packed\n"
+          "  Markov_First quantize [-b 8|16] [-a] model quantized\n"
+          "  Markov_First tokens [corpus ...]\n"
+          "  Markov_First publish model /name\n"
+          "  Markov_First unpublish /name\n"
+          "  Markov_First generate [-S] [-n words] [-s seed | -B width] model "
+          "[start]\n");
+}
+
+/* Path of the delta log of a model (dmalloc'd). */
+static char *delta_path(const char *model_path) {
+  size_t len = strlen(model_path);
+  char *path = dmalloc(len + sizeof(".delta"));
+  memcpy(path, model_path, len);
+  memcpy(path + len, ".delta", sizeof(".delta"));
+  return path;
+}
+
+/* A saved model with its delta log, if it has one, applied. */
+static model_t *load_model(const char *model_path) {
+  char *log_path = delta_path(model_path);
+  model_t *model = delta_log_load(model_path, log_path, NULL);
+  dfree(log_path);
+  return model;
+}
+
+/* Feed every corpus (stdin if there are none) to the tokenizer. */
+static int tokenize_inputs(tokenizer_t *tok, int argc, char **argv,
+                           trainer_t *trainer) {
+  for (int i = 0; i < argc || (i == 0 && argc == 0); ++i) {
+    const char *path = argc ? argv[i] : "-";
+    int fd = strcmp(path, "-") == 0 ? STDIN_FILENO : open(path, O_RDONLY);
+    if (fd < 0) {
+      perror(path);
+      return -1;
+    }
+    int rc = tokenizer_feed_fd(tok, fd);
+    if (fd != STDIN_FILENO)
+      close(fd);
+    if (rc != 0)
+      return -1;
+    tokenizer_finish(tok);
+    if (trainer)
+      trainer_break(trainer);
+  }
+  return 0;
+}
+
+typedef struct {
+  tokenizer_t *tok;
+  trainer_t *trainer;
+} ingest_train_ctx_t;
 
-#define MAX_WORD_LENGTH                                                        \
-  31 // Maximum length of a word in code points with null terminato
-
-int main(void) {
-  char *str = "oggi e un bel giorno, domani e un giorno soleggiato";
-
-  char current_word[MAX_WORD_LENGTH] = {0}; // buffer for the current word
-  char next_word[MAX_WORD_LENGTH] = {0};    // buffer for the next word
-  char reading_next = 0;
-  size_t c_idx = 0; // current index in the string
-  size_t n_idx = 0; // next index in the string
-  for (int i = 0; str[i] != '\0'; i++) {
-    printf("char: %c\n", str[i]);
-    if (reading_next != 0) {
-      if (str[i] == ' ') {
-        reading_next = 1;
-        current_word[c_idx] = '\0'; // terminate the current word
-        c_idx = 0;
-      } else {
-        current_word[c_idx] = str[i];
-        c_idx++;
+static int ingest_train_sink(void *ctx, int file, const char *data,
+                             size_t len) {
+  ingest_train_ctx_t *c = ctx;
+  (void)file;
+  if (len > 0) {
+    tokenizer_feed_utf8(c->tok, data, len);
+  } else {
+    tokenizer_finish(c->tok);
+    trainer_break(c->trainer);
+  }
+  return 0;
+}
 
+static int train_recursive(const char *model_path, int argc, char **argv,
+                           int threads) {
+  dir_train_config_t config = {threads, 0};
+  dir_train_stats_t stats;
+  model_t *model =
+      dir_train((const char *const *)argv, argc, &config, &stats);
+  if (model && model_save(model, model_path) != 0) {
+    free_model(model);
+    model = NULL;
+  }
+  if (stats.invalid)
+    fprintf(stderr, "%llu malformed UTF-8 sequences skipped\n",
+            (unsigned long long)stats.invalid);
+  if (model)
+    fprintf(stderr, "%llu files, %.1f MB in %llu units, %llu steals; "
+                    "%llu tokens, %u words, %llu edges\n",
+            (unsigned long long)stats.files, stats.bytes / 1e6,
+            (unsigned long long)stats.units, (unsigned long long)stats.steals,
+            (unsigned long long)stats.tokens, model_num_words(model),
+            (unsigned long long)model_num_edges(model));
+  int rc = model ? 0 : 1;
+  free_model(model);
+  return rc;
+}
+
+static int cmd_train(int argc, char **argv) {
+  train_config_t config = {TRAIN_BACKEND_RADIX, 1, {0, NULL}, NULL};
+  int pipeline = 0;
+  int ingest = 0;
+  int recursive = 0;
+  ingest_config_t ingest_config = {INGEST_AUTO, 0, 0, 0};
+  int i = 0;
+  for (; i + 1 < argc && argv[i][0] == '-' && argv[i][1] != '\0'; i += 2) {
+    if (strcmp(argv[i], "-P") == 0) {
+      pipeline = 1;
+      i--; /* no value */
+    } else if (strcmp(argv[i], "-R") == 0) {
+      recursive = 1;
+      i--;
+    } else if (strcmp(argv[i], "-I") == 0) {
+      if (ingest_backend_from_name(argv[i + 1], &ingest_config.backend) !=
+          0) {
+        fprintf(stderr, "Unknown ingestion backend %s\n", argv[i + 1]);
+        return 1;
       }
-    } else {
-      if (str[i] == ' ') {
-        reading_next = 0;
-        printf("la parola corrente e: %s\n la prossima parola e: %s\n",
-               current_word, next_word);
-        // free(current_word);
-        // free(next_word);
-        next_word[n_idx] = '\0'; // terminate the next word
-        n_idx = 0; // reset next index
-        strcpy(current_word, next_word); // copy next to current
-        // reset next word buffer
-        memset(next_word, 0, sizeof(next_word));
-      } else {
-        next_word[n_idx] = str[i];
-        n_idx++;
+      ingest = 1;
+    } else if (strcmp(argv[i], "-b") == 0) {
+      if (train_backend_from_name(argv[i + 1], &config.backend) != 0) {
+        fprintf(stderr, "Unknown backend %s\n", argv[i + 1]);
+        return 1;
       }
+    } else if (strcmp(argv[i], "-t") == 0) {
+      config.threads = atoi(argv[i + 1]);
+    } else if (strcmp(argv[i], "-m") == 0) {
+      config.external.mem_budget = (size_t)atol(argv[i + 1]) << 20;
+    } else if (strcmp(argv[i], "-T") == 0) {
+      config.external.tmp_dir = argv[i + 1];
+    } else {
+      usage();
+      return 1;
     }
   }
+  if (i >= argc || pipeline + ingest + recursive > 1 ||
+      ((ingest || recursive) && i + 1 >= argc)) {
+    usage();
+    return 1;
+  }
+  const char *model_path = argv[i++];
+  config.model_path = model_path;
+  if (recursive)
+    return train_recursive(model_path, argc - i, argv + i, config.threads);
+
+  trainer_t *trainer = create_trainer(&config);
+  if (trainer == NULL)
+    return 1;
+  int rc;
+  uint64_t invalid;
+  if (pipeline) {
+    pipeline_stats_t stats;
+    rc = pipeline_train(trainer, (const char *const *)argv + i, argc - i,
+                        NULL, &stats);
+    if (rc == 0)
+      pipeline_print_stats(&stats, stderr);
+    invalid = stats.invalid;
+  } else if (ingest) {
+    ingest_train_ctx_t ctx = {create_tokenizer(tokenizer_train_sink, trainer),
+                              trainer};
+    ingest_stats_t stats;
+    rc = ingest_files((const char *const *)argv + i, argc - i, &ingest_config,
+                      ingest_train_sink, &ctx, &stats);
+    if (rc == 0)
+      fprintf(stderr, "ingest (%s): %llu files, %.1f MB in %.3f s, "
+                      "%.3f s waiting for reads\n",
+              ingest_backend_name(stats.backend),
+              (unsigned long long)stats.files, stats.bytes / 1e6,
+              stats.elapsed_ns / 1e9, stats.wait_ns / 1e9);
+    invalid = tokenizer_get_stats(ctx.tok)->invalid;
+    free_tokenizer(ctx.tok);
+  } else {
+    tokenizer_t *tok = create_tokenizer(tokenizer_train_sink, trainer);
+    rc = tokenize_inputs(tok, argc - i, argv + i, trainer);
+    invalid = tokenizer_get_stats(tok)->invalid;
+    free_tokenizer(tok);
+  }
+  if (invalid)
+    fprintf(stderr, "%llu malformed UTF-8 sequences skipped\n",
+            (unsigned long long)invalid);
+
+  model_t *model = rc == 0 ? trainer_finish(trainer) : NULL;
+  if (model && config.backend != TRAIN_BACKEND_EXTERNAL &&
+      model_save(model, model_path) != 0) {
+    free_model(model);
+    model = NULL;
+  }
+  if (model)
+    fprintf(stderr, "%llu tokens, %u words, %llu edges\n",
+            (unsigned long long)trainer_get_tokens(trainer),
+            model_num_words(model),
+            (unsigned long long)model_num_edges(model));
+  free_trainer(trainer);
+  rc = model ? 0 : 1;
+  free_model(model);
+  return rc;
 }
-/*
-int main() {
-  char stringa[] = "oggi e un bel giorno,domani e un giorno soleggiato";
-  int i = 0, start1, start2;
 
-  while (stringa[i] != '\0') {
+static int cmd_update(int argc, char **argv) {
+  int compact = argc > 0 && strcmp(argv[0], "-c") == 0;
+  if (argc - compact < 1) {
+    usage();
+    return 1;
+  }
+  const char *model_path = argv[compact];
+  argc -= compact + 1;
+  argv += compact + 1;
+  model_t *base = model_load(model_path);
+  if (base == NULL)
+    return 1;
+  char *log_path = delta_path(model_path);
+  delta_log_t *log = delta_log_open(log_path, base);
+  free_model(base); /* the log only needed its fingerprint */
+  dfree(log_path);
+  if (log == NULL)
+    return 1;
 
-    while (stringa[i] == ' ' || stringa[i] == ',')
-      i++;
-    if (stringa[i] == '\0')
-      break;
-    start1 = i;
+  train_config_t config = {TRAIN_BACKEND_RADIX, 1, {0, NULL}, NULL};
+  trainer_t *trainer = create_trainer(&config);
+  tokenizer_t *tok = create_tokenizer(tokenizer_train_sink, trainer);
+  int rc = tokenize_inputs(tok, argc, argv, trainer);
+  free_tokenizer(tok);
+  model_t *fresh = rc == 0 ? trainer_finish(trainer) : NULL;
+  rc = fresh ? delta_log_add_model(log, fresh) : -1;
+  if (rc == 0)
+    rc = delta_log_commit(log);
+  if (rc == 0)
+    fprintf(stderr, "%llu tokens, %llu edges appended\n",
+            (unsigned long long)trainer_get_tokens(trainer),
+            (unsigned long long)model_num_edges(fresh));
+  free_model(fresh);
+  free_trainer(trainer);
+  if (rc == 0 && compact)
+    rc = delta_log_compact_start(log, model_path);
+  if (delta_log_close(log) != 0)
+    rc = -1;
+  return rc != 0;
+}
 
-    // vai alla fine della prima parola
-    while (stringa[i] != '\0' && stringa[i] != ' ' && stringa[i] != ',')
-      i++;
+static int cmd_compact(int argc, char **argv) {
+  if (argc != 1) {
+    usage();
+    return 1;
+  }
+  model_t *base = model_load(argv[0]);
+  if (base == NULL)
+    return 1;
+  char *log_path = delta_path(argv[0]);
+  delta_log_t *log = delta_log_open(log_path, base);
+  free_model(base);
+  dfree(log_path);
+  int rc = log ? delta_log_compact_start(log, argv[0]) : -1;
+  if (log && delta_log_close(log) != 0)
+    rc = -1;
+  return rc != 0;
+}
+
+static int cmd_merge(int argc, char **argv) {
+  model_merge_config_t config = {1.0, 1.0, 1};
+  int i = 0;
+  for (; i + 1 < argc && argv[i][0] == '-'; i += 2) {
+    if (strcmp(argv[i], "-t") == 0) {
+      config.threads = atoi(argv[i + 1]);
+    } else if (strcmp(argv[i], "-w") == 0) {
+      char *end;
+      config.weight_a = strtod(argv[i + 1], &end);
+      if (*end != ',') {
+        usage();
+        return 1;
+      }
+      config.weight_b = strtod(end + 1, &end);
+      if (*end != '\0') {
+        usage();
+        return 1;
+      }
+    } else {
+      usage();
+      return 1;
+    }
+  }
+  if (argc - i != 3) {
+    usage();
+    return 1;
+  }
+  model_t *a = load_model(argv[i]);
+  model_t *b = a ? load_model(argv[i + 1]) : NULL;
+  model_merge_stats_t stats;
+  int rc = b ? model_merge(a, b, argv[i + 2], &config, &stats) : -1;
+  if (rc == 0)
+    fprintf(stderr, "%u words (%u shared), %llu edges (%llu dropped), "
+                    "%llu chunks\n",
+            stats.words, stats.shared, (unsigned long long)stats.edges,
+            (unsigned long long)stats.dropped,
+            (unsigned long long)stats.chunks);
+  free_model(a);
+  free_model(b);
+  return rc != 0;
+}
 
-    // trova inizio seconda parola
-    while (stringa[i] == ' ' || stringa[i] == ',')
+static int cmd_pack(int argc, char **argv) {
+  packed_encoding_t encoding = PACKED_BITS;
+  int i = 0;
+  if (argc > 1 && strcmp(argv[0], "-e") == 0) {
+    if (packed_encoding_from_name(argv[1], &encoding) != 0) {
+      usage();
+      return 1;
+    }
+    i = 2;
+  }
+  if (argc - i != 2) {
+    usage();
+    return 1;
+  }
+  model_t *model = load_model(argv[i]);
+  if (model == NULL)
+    return 1;
+  packed_model_t *packed = packed_model_build(model, encoding);
+  int rc = packed ? packed_model_save(packed, argv[i + 1]) : -1;
+  if (rc == 0)
+    fprintf(stderr, "%s: %llu bytes -> %llu bytes (%s), %.2f bytes/edge\n",
+            argv[i], (unsigned long long)model->header->image_size,
+            (unsigned long long)packed->header->image_size,
+            packed_encoding_name(encoding),
+            model_num_edges(model)
+                ? (double)packed->header->data_len / model_num_edges(model)
+                : 0.0);
+  free_packed_model(packed);
+  free_model(model);
+  return rc != 0;
+}
+
+static int cmd_quantize(int argc, char **argv) {
+  unsigned bits = 16;
+  quant_table_t table = QUANT_CDF;
+  int i = 0;
+  for (; i < argc && argv[i][0] == '-'; ++i) {
+    if (strcmp(argv[i], "-a") == 0) {
+      table = QUANT_ALIAS;
+    } else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+      bits = (unsigned)atoi(argv[++i]);
+    } else {
+      usage();
+      return 1;
+    }
+  }
+  if (argc - i != 2) {
+    usage();
+    return 1;
+  }
+  model_t *model = load_model(argv[i]);
+  if (model == NULL)
+    return 1;
+  quant_model_t *quant = quant_model_build(model, bits, table);
+  int rc = quant ? quant_model_save(quant, argv[i + 1]) : -1;
+  if (rc == 0)
+    fprintf(stderr, "%s: %llu bytes -> %llu bytes (%u bit %s), %llu of "
+                    "%llu followers dropped, max error %.3g\n",
+            argv[i], (unsigned long long)model->header->image_size,
+            (unsigned long long)quant->header->image_size, bits,
+            table == QUANT_ALIAS ? "alias" : "cdf",
+            (unsigned long long)quant->header->dropped,
+            (unsigned long long)model_num_edges(model),
+            quant->header->max_error);
+  free_quant_model(quant);
+  free_model(model);
+  return rc != 0;
+}
+
+static int cmd_export(int argc, char **argv) {
+  csv_export_config_t config = {',', CSV_VALUE_COUNT, 1, 1};
+  int i = 0;
+  for (; i < argc && argv[i][0] == '-'; ++i) {
+    if (strcmp(argv[i], "-p") == 0) {
+      config.value = CSV_VALUE_PROBABILITY;
+    } else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc &&
+               strcmp(argv[i + 1], "tab") == 0) {
+      config.separator = '\t';
       i++;
-    if (stringa[i] == '\0')
-      break;
-    start2 = i;
-
-    // stampa prima parola
-    int j = start1;
-    while (stringa[j] != '\0' && stringa[j] != ' ' && stringa[j] != ',') {
-      putchar(stringa[j]);
-      j++;
+    } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+      config.threads = atoi(argv[++i]);
+    } else {
+      usage();
+      return 1;
     }
+  }
+  if (argc - i != 2) {
+    usage();
+    return 1;
+  }
+  model_t *model = load_model(argv[i]);
+  if (model == NULL)
+    return 1;
+  int64_t bytes = model_export_csv(model, argv[i + 1], &config);
+  free_model(model);
+  return bytes < 0;
+}
+
+static int cmd_import(int argc, char **argv) {
+  csv_import_config_t config = {0, 1};
+  int i = 0;
+  if (argc > 1 && strcmp(argv[0], "-t") == 0) {
+    config.threads = atoi(argv[1]);
+    i = 2;
+  }
+  if (argc - i != 2) {
+    usage();
+    return 1;
+  }
+  model_t *model = model_import_csv(argv[i], &config);
+  if (model == NULL)
+    return 1;
+  int rc = model_save(model, argv[i + 1]);
+  free_model(model);
+  return rc != 0;
+}
+
+static void print_token(void *ctx, const int *token, size_t length) {
+  (void)ctx;
+  (void)length;
+  utf8_print_word(token, STDOUT_FILENO);
+  utf8_putchar('\n', STDOUT_FILENO);
+}
 
-    putchar(' '); // separatore
+static int cmd_tokens(int argc, char **argv) {
+  tokenizer_t *tok = create_tokenizer(print_token, NULL);
+  int rc = tokenize_inputs(tok, argc, argv, NULL);
+  free_tokenizer(tok);
+  return rc != 0;
+}
 
-    // stampa seconda parola
-    j = start2;
-    while (stringa[j] != '\0' && stringa[j] != ' ' && stringa[j] != ',') {
-      putchar(stringa[j]);
-      j++;
+static int cmd_publish(int argc, char **argv) {
+  if (argc != 2) {
+    usage();
+    return 1;
+  }
+  model_t *model = load_model(argv[0]);
+  if (model == NULL)
+    return 1;
+  int rc = model_publish_shm(model, argv[1]);
+  free_model(model);
+  return rc != 0;
+}
+
+static int cmd_unpublish(int argc, char **argv) {
+  if (argc != 1) {
+    usage();
+    return 1;
+  }
+  return model_unpublish_shm(argv[0]) != 0;
+}
+
+typedef struct {
+  uint64_t *state;
+  uint64_t seen;
+  uint32_t pick;
+} seed_pick_t;
+
+/* Reservoir of one: every word of the prefix is equally likely. */
+static int pick_seed(void *ctx, const int *word, size_t length, uint32_t id) {
+  seed_pick_t *p = ctx;
+  (void)word;
+  (void)length;
+  if (generate_rand(p->state) % ++p->seen == 0)
+    p->pick = id;
+  return 0;
+}
+
+/* Decode a start word into word (MAX_WORD_LENGTH), lower case. Returns
+ * its length, 0 or less if there is none. */
+static int decode_word(const char *text, size_t len, int *word) {
+  int n = utf8_decode(text, len, word, MAX_WORD_LENGTH - 1);
+  if (n > 0)
+    utf8_codepoints_to_lower(word, word, (size_t)n);
+  word[n > 0 ? n : 0] = '\0';
+  return n;
+}
+
+/* Random walk on a packed model, from start (a word) or a random word. */
+static int generate_packed(const char *path, const char *start_word,
+                           size_t words, uint64_t state) {
+  packed_model_t *packed = packed_model_load(path);
+  if (packed == NULL)
+    return 1;
+  if (packed_model_num_words(packed) == 0) {
+    free_packed_model(packed);
+    return 0;
+  }
+  uint32_t start;
+  if (start_word) {
+    int word[MAX_WORD_LENGTH];
+    int n = decode_word(start_word, strlen(start_word), word);
+    start = n > 0 ? packed_model_find(packed, word) : VOCAB_NO_ID;
+    if (start == VOCAB_NO_ID) {
+      fprintf(stderr, "%s: not in the model\n", start_word);
+      free_packed_model(packed);
+      return 1;
     }
+  } else {
+    start = (uint32_t)(generate_rand(&state) % packed_model_num_words(packed));
+  }
+  uint32_t *ids = dmalloc(sizeof(uint32_t) * (words ? words : 1));
+  size_t n = packed_model_walk(packed, start, ids, words, &state);
+  utf8_print_word(packed_model_word(packed, start), STDOUT_FILENO);
+  for (size_t k = 0; k < n; ++k) {
+    utf8_putchar(' ', STDOUT_FILENO);
+    utf8_print_word(packed_model_word(packed, ids[k]), STDOUT_FILENO);
+  }
+  utf8_putchar('\n', STDOUT_FILENO);
+  dfree(ids);
+  free_packed_model(packed);
+  return 0;
+}
 
-    putchar('\n');
+/* Random walk on a quantized model, as generate_packed. */
+static int generate_quant(const char *path, const char *start_word,
+                          size_t words, uint64_t state) {
+  quant_model_t *quant = quant_model_load(path);
+  if (quant == NULL)
+    return 1;
+  if (quant_model_num_words(quant) == 0) {
+    free_quant_model(quant);
+    return 0;
+  }
+  uint32_t start;
+  if (start_word) {
+    int word[MAX_WORD_LENGTH];
+    int n = decode_word(start_word, strlen(start_word), word);
+    start = n > 0 ? quant_model_find(quant, word) : VOCAB_NO_ID;
+    if (start == VOCAB_NO_ID) {
+      fprintf(stderr, "%s: not in the model\n", start_word);
+      free_quant_model(quant);
+      return 1;
+    }
+  } else {
+    start = (uint32_t)(generate_rand(&state) % quant_model_num_words(quant));
+  }
+  uint32_t *ids = dmalloc(sizeof(uint32_t) * (words ? words : 1));
+  size_t n = quant_model_walk(quant, start, ids, words, &state);
+  utf8_print_word(quant_model_word(quant, start), STDOUT_FILENO);
+  for (size_t k = 0; k < n; ++k) {
+    utf8_putchar(' ', STDOUT_FILENO);
+    utf8_print_word(quant_model_word(quant, ids[k]), STDOUT_FILENO);
+  }
+  utf8_putchar('\n', STDOUT_FILENO);
+  dfree(ids);
+  free_quant_model(quant);
+  return 0;
+}
 
-    // riposiziona i alla seconda parola per continuare
-    i = start2;
+static int cmd_generate(int argc, char **argv) {
+  int shared = 0;
+  size_t words = 50;
+  uint64_t seed = 0;
+  long width = 0;
+  int i = 0;
+  for (; i < argc && argv[i][0] == '-'; ++i) {
+    if (strcmp(argv[i], "-S") == 0) {
+      shared = 1;
+    } else if (strcmp(argv[i], "-B") == 0 && i + 1 < argc) {
+      width = atol(argv[++i]);
+      if (width < 1 || width > UINT32_MAX) {
+        fprintf(stderr, "generate: beam width must be positive\n");
+        return 1;
+      }
+    } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+      words = (size_t)atol(argv[++i]);
+    } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+      seed = (uint64_t)atoll(argv[++i]);
+    } else {
+      usage();
+      return 1;
+    }
+  }
+  if (argc - i < 1 || argc - i > 2) {
+    usage();
+    return 1;
+  }
+  uint64_t state =
+      seed ? seed : (uint64_t)getpid() << 32 ^ (uint64_t)time(NULL);
+  int packed = !shared && packed_model_probe(argv[i]);
+  int quantized = !shared && !packed && quant_model_probe(argv[i]);
+  if (packed || quantized) {
+    const char *text = argc - i == 2 ? argv[i + 1] : NULL;
+    if (width > 0 || (text && text[0] && text[strlen(text) - 1] == '*')) {
+      fprintf(stderr, "generate: %s is %s: no beam search or prefix "
+                      "start\n", argv[i], packed ? "packed" : "quantized");
+      return 1;
+    }
+    return packed ? generate_packed(argv[i], text, words, state)
+                  : generate_quant(argv[i], text, words, state);
+  }
+  model_t *model = shared ? model_attach_shm(argv[i]) : load_model(argv[i]);
+  if (model == NULL)
+    return 1;
+  if (model_num_words(model) == 0) {
+    free_model(model);
+    return 0;
+  }
+  uint32_t start;
+  if (argc - i == 2) {
+    int word[MAX_WORD_LENGTH];
+    const char *text = argv[i + 1];
+    size_t len = strlen(text);
+    int prefix = len > 0 && text[len - 1] == '*';
+    int n = decode_word(text, len - (size_t)prefix, word);
+    if (prefix) {
+      seed_pick_t pick = {&state, 0, VOCAB_NO_ID};
+      word_trie_t *trie = word_trie_from_model(model);
+      word_trie_prefix(trie, word, pick_seed, &pick);
+      free_word_trie(trie);
+      start = pick.pick;
+    } else {
+      start = n > 0 ? model_find(model, word) : VOCAB_NO_ID;
+    }
+    if (start == VOCAB_NO_ID) {
+      fprintf(stderr, "%s: not in the model\n", text);
+      free_model(model);
+      return 1;
+    }
+  } else {
+    start = (uint32_t)(generate_rand(&state) % model_num_words(model));
   }
 
+  uint32_t *ids = dmalloc(sizeof(uint32_t) * (words ? words : 1));
+  size_t n;
+  if (width > 0) {
+    generate_beam_t *beam = create_generate_beam((uint32_t)width, words);
+    n = generate_beam_search(beam, model, start, ids, words, NULL);
+    free_generate_beam(beam);
+  } else {
+    n = generate_walk(model, start, ids, words, &state);
+  }
+  utf8_print_word(model_word(model, start), STDOUT_FILENO);
+  for (size_t k = 0; k < n; ++k) {
+    utf8_putchar(' ', STDOUT_FILENO);
+    utf8_print_word(model_word(model, ids[k]), STDOUT_FILENO);
+  }
+  utf8_putchar('\n', STDOUT_FILENO);
+  dfree(ids);
+  free_model(model);
   return 0;
-}*/
+}
+
+static void report_memory(void) { dmalloc_report(STDERR_FILENO); }
+
+static void report_timing(void) { timing_report(stderr); }
+
+static void report_memory_signal(int sig) {
+  (void)sig;
+  int saved_errno = errno; /* the interrupted code may be about to read it */
+  dmalloc_report(STDERR_FILENO); /* write(2) only */
+  errno = saved_errno;
+}
+
+int main(int argc, char **argv) {
+  if (getenv("MARKOV_MEMSTAT") != NULL) {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof sa);
+    sa.sa_handler = report_memory_signal;
+    sa.sa_flags = SA_RESTART;
+    sigaction(SIGUSR1, &sa, NULL);
+    atexit(report_memory);
+  }
+  if (timing_enabled())
+    atexit(report_timing);
+  if (argc < 2) {
+    usage();
+    return 1;
+  }
+  if (strcmp(argv[1], "train") == 0)
+    return cmd_train(argc - 2, argv + 2);
+  if (strcmp(argv[1], "export") == 0)
+    return cmd_export(argc - 2, argv + 2);
+  if (strcmp(argv[1], "import") == 0)
+    return cmd_import(argc - 2, argv + 2);
+  if (strcmp(argv[1], "update") == 0)
+    return cmd_update(argc - 2, argv + 2);
+  if (strcmp(argv[1], "compact") == 0)
+    return cmd_compact(argc - 2, argv + 2);
+  if (strcmp(argv[1], "merge") == 0)
+    return cmd_merge(argc - 2, argv + 2);
+  if (strcmp(argv[1], "pack") == 0)
+    return cmd_pack(argc - 2, argv + 2);
+  if (strcmp(argv[1], "quantize") == 0)
+    return cmd_quantize(argc - 2, argv + 2);
+  if (strcmp(argv[1], "tokens") == 0)
+    return cmd_tokens(argc - 2, argv + 2);
+  if (strcmp(argv[1], "publish") == 0)
+    return cmd_publish(argc - 2, argv + 2);
+  if (strcmp(argv[1], "unpublish") == 0)
+    return cmd_unpublish(argc - 2, argv + 2);
+  if (strcmp(argv[1], "generate") == 0)
+    return cmd_generate(argc - 2, argv + 2);
+  usage();
+  return 1;
+}
@@ -0,0 +1,619 @@
+#define _POSIX_C_SOURCE 200809L
+#include "../include/model.h"
+#include "../include/utils.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define WRITER_BUFFER_SIZE (1 << 20)
+
+static uint64_t align8(uint64_t n) { return (n + 7) & ~(uint64_t)7; }
+
+/* Compute every section offset for the given dimensions. */
+static void model_layout(model_header_t *h, uint32_t num_words,
+                         uint64_t pool_len, uint64_t num_edges) {
+  memset(h, 0, sizeof(*h));
+  h->magic = MODEL_MAGIC;
+  h->version = MODEL_VERSION;
+  h->num_words = num_words;
+  h->num_edges = num_edges;
+  h->pool_len = pool_len;
+
+  uint64_t off = align8(sizeof(model_header_t));
+  h->pool_off = off;
+  off += align8(pool_len * sizeof(int));
+  h->word_offsets_off = off;
+  off += (uint64_t)num_words * sizeof(uint64_t);
+  h->sorted_ids_off = off;
+  off += align8((uint64_t)num_words * sizeof(uint32_t));
+  h->edges_off = off;
+  off += num_edges * sizeof(model_edge_t);
+  h->row_offsets_off = off;
+  off += ((uint64_t)num_words + 1) * sizeof(uint64_t);
+  h->row_totals_off = off;
+  off += (uint64_t)num_words * sizeof(uint64_t);
+  h->ranks_off = off;
+  off += align8(num_edges * sizeof(uint32_t));
+  h->image_size = off;
+}
+
+/* Point the section views of model into image; validates the header. */
+static model_t *model_from_image(void *image, size_t size, int mapped) {
+  const model_header_t *h = image;
+  if (size < 2 * sizeof(uint32_t) || h->magic != MODEL_MAGIC) {
+    fprintf(stderr, "Not a model image\n");
+    return NULL;
+  }
+  if (h->version != MODEL_VERSION || size < sizeof(model_header_t)) {
+    fprintf(stderr, "Model image version %u, expected %u: train again\n",
+            h->version, MODEL_VERSION);
+    return NULL;
+  }
+  model_header_t expected;
+  model_layout(&expected, h->num_words, h->pool_len, h->num_edges);
+  if (expected.image_size != h->image_size || h->image_size > size ||
+      expected.pool_off != h->pool_off ||
+      expected.word_offsets_off != h->word_offsets_off ||
+      expected.sorted_ids_off != h->sorted_ids_off ||
+      expected.edges_off != h->edges_off ||
+      expected.row_offsets_off != h->row_offsets_off ||
+      expected.row_totals_off != h->row_totals_off ||
+      expected.ranks_off != h->ranks_off) {
+    fprintf(stderr, "Corrupted model image\n");
+    return NULL;
+  }
+
+  /* rows in order, covering the edges; words inside a terminated pool;
+   * every ID and rank inside what it indexes */
+  char *base = image;
+  const int *pool = (const int *)(base + h->pool_off);
+  const uint64_t *rows = (const uint64_t *)(base + h->row_offsets_off);
+  const uint64_t *words = (const uint64_t *)(base + h->word_offsets_off);
+  const uint32_t *sorted = (const uint32_t *)(base + h->sorted_ids_off);
+  const model_edge_t *edges = (const model_edge_t *)(base + h->edges_off);
+  const uint32_t *ranks = (const uint32_t *)(base + h->ranks_off);
+  int valid = rows[0] == 0 && rows[h->num_words] == h->num_edges &&
+              (h->pool_len ? pool[h->pool_len - 1] == '\0'
+                           : h->num_words == 0);
+  for (uint32_t i = 0; i < h->num_words && valid; ++i)
+    valid = rows[i] <= rows[i + 1] && words[i] < h->pool_len &&
+            sorted[i] < h->num_words;
+  for (uint32_t i = 0; i < h->num_words && valid; ++i)
+    for (uint64_t k = rows[i]; k < rows[i + 1] && valid; ++k)
+      valid = edges[k].next < h->num_words && ranks[k] < rows[i + 1] - rows[i];
+  if (!valid) {
+    fprintf(stderr, "Corrupted model image\n");
+    return NULL;
+  }
+
+  model_t *model = dmalloc_tag(sizeof(model_t), MEM_MODEL);
+  model->header = h;
+  model->pool = (const int *)(base + h->pool_off);
+  model->word_offsets = (const uint64_t *)(base + h->word_offsets_off);
+  model->sorted_ids = (const uint32_t *)(base + h->sorted_ids_off);
+  model->edges = (const model_edge_t *)(base + h->edges_off);
+  model->row_offsets = (const uint64_t *)(base + h->row_offsets_off);
+  model->row_totals = (const uint64_t *)(base + h->row_totals_off);
+  model->ranks = (const uint32_t *)(base + h->ranks_off);
+  model->image = image;
+  model->image_size = size;
+  model->mapped = mapped;
+  return model;
+}
+
+int model_word_cmp(const int *a, const int *b) {
+  int i = 0;
+  while (a[i] != '\0' && a[i] == b[i])
+    i++;
+  return (a[i] > b[i]) - (a[i] < b[i]);
+}
+
+/* Bottom-up merge sort of ids by the words they refer to. */
+static void sort_ids_by_words(uint32_t *ids, uint32_t n,
+                              const int *const *words) {
+  uint32_t *tmp = dmalloc(sizeof(uint32_t) * (n ? n : 1));
+  uint32_t *src = ids, *dst = tmp;
+  for (uint32_t width = 1; width < n; width *= 2) {
+    for (uint32_t lo = 0; lo < n; lo += 2 * width) {
+      uint32_t mid = lo + width < n ? lo + width : n;
+      uint32_t hi = lo + 2 * width < n ? lo + 2 * width : n;
+      uint32_t i = lo, j = mid, k = lo;
+      while (i < mid && j < hi) {
+        if (model_word_cmp(words[src[j]], words[src[i]]) < 0)
+          dst[k++] = src[j++];
+        else
+          dst[k++] = src[i++];
+      }
+      while (i < mid)
+        dst[k++] = src[i++];
+      while (j < hi)
+        dst[k++] = src[j++];
+    }
+    uint32_t *swap = src;
+    src = dst;
+    dst = swap;
+  }
+  if (src != ids)
+    memcpy(ids, src, sizeof(uint32_t) * n);
+  dfree(tmp);
+}
+
+void model_sort_ids(uint32_t *ids, uint32_t n, const int *pool,
+                    const uint64_t *word_offsets) {
+  const int **words = dmalloc(sizeof(int *) * (n ? n : 1));
+  for (uint32_t i = 0; i < n; ++i) {
+    ids[i] = i;
+    words[i] = pool + word_offsets[i];
+  }
+  sort_ids_by_words(ids, n, words);
+  dfree(words);
+}
+
+uint32_t *vocab_sorted_ids(const vocab_t *vocab) {
+  uint32_t n = vocab_size(vocab);
+  uint32_t *ids = dmalloc(sizeof(uint32_t) * (n ? n : 1));
+  const int **words = dmalloc(sizeof(int *) * (n ? n : 1));
+  for (uint32_t i = 0; i < n; ++i) {
+    ids[i] = i;
+    words[i] = vocab_word(vocab, i);
+  }
+  sort_ids_by_words(ids, n, words);
+  dfree(words);
+  return ids;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+/* Ranks of one row (see the layout in model.h); keys is scratch for n
+ * entries. Returns the row total. */
+static uint64_t rank_row(const model_edge_t *row, uint32_t n,
+                         uint32_t *ranks, uint64_t *keys) {
+  uint64_t total = 0;
+  for (uint32_t i = 0; i < n; ++i) {
+    keys[i] = (uint64_t)(UINT32_MAX - row[i].count) << 32 | i;
+    total += row[i].count;
+  }
+  qsort(keys, n, sizeof(uint64_t), cmp_u64);
+  for (uint32_t i = 0; i < n; ++i)
+    ranks[i] = (uint32_t)keys[i];
+  return total;
+}
+
+model_t *model_build(const vocab_t *vocab, const uint64_t *row_offsets,
+                     const model_edge_t *edges) {
+  if (vocab == NULL || row_offsets == NULL) {
+    fprintf(stderr, "Vocabulary or row offsets are NULL\n");
+    return NULL;
+  }
+  uint32_t n = vocab_size(vocab);
+  model_header_t h;
+  model_layout(&h, n, vocab->pool_len, row_offsets[n]);
+
+  char *image = dmalloc_tag(h.image_size, MEM_MODEL);
+  memcpy(image, &h, sizeof(h));
+
+  int *pool = (int *)(image + h.pool_off);
+  uint64_t *word_offsets = (uint64_t *)(image + h.word_offsets_off);
+  uint64_t pos = 0;
+  for (uint32_t i = 0; i < n; ++i) {
+    const int *w = vocab_word(vocab, i);
+    word_offsets[i] = pos;
+    size_t len = 0;
+    while (w[len] != '\0')
+      len++;
+    memcpy(pool + pos, w, (len + 1) * sizeof(int));
+    pos += len + 1;
+  }
+
+  uint32_t *sorted = vocab_sorted_ids(vocab);
+  memcpy(image + h.sorted_ids_off, sorted, sizeof(uint32_t) * n);
+  dfree(sorted);
+
+  if (h.num_edges)
+    memcpy(image + h.edges_off, edges, sizeof(model_edge_t) * h.num_edges);
+  memcpy(image + h.row_offsets_off, row_offsets,
+         sizeof(uint64_t) * ((size_t)n + 1));
+
+  uint64_t *totals = (uint64_t *)(image + h.row_totals_off);
+  uint32_t *ranks = (uint32_t *)(image + h.ranks_off);
+  uint64_t widest = 0;
+  for (uint32_t i = 0; i < n; ++i)
+    if (row_offsets[i + 1] - row_offsets[i] > widest)
+      widest = row_offsets[i + 1] - row_offsets[i];
+  uint64_t *keys = dmalloc(sizeof(uint64_t) * (widest + 1));
+  for (uint32_t i = 0; i < n; ++i)
+    totals[i] = rank_row(edges + row_offsets[i],
+                         (uint32_t)(row_offsets[i + 1] - row_offsets[i]),
+                         ranks + row_offsets[i], keys);
+  dfree(keys);
+
+  return model_from_image(image, h.image_size, 0);
+}
+
+int model_save(const model_t *model, const char *path) {
+  if (model == NULL || path == NULL)
+    return -1;
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    perror(path);
+    return -1;
+  }
+  int rc = write_all(fd, model->image, model->header->image_size);
+  if (close(fd) != 0)
+    rc = -1;
+  if (rc != 0)
+    perror(path);
+  return rc;
+}
+
+model_t *model_load(const char *path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    perror(path);
+    return NULL;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(model_header_t)) {
+    fprintf(stderr, "%s: not a model file\n", path);
+    close(fd);
+    return NULL;
+  }
+  void *image = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (image == MAP_FAILED) {
+    perror(path);
+    return NULL;
+  }
+  model_t *model = model_from_image(image, (size_t)st.st_size, 1);
+  if (model == NULL)
+    munmap(image, (size_t)st.st_size);
+  return model;
+}
+
+int model_publish_shm(const model_t *model, const char *name) {
+  if (model == NULL || name == NULL)
+    return -1;
+  size_t size = model->header->image_size;
+  int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+  if (fd < 0) {
+    perror(name);
+    return -1;
+  }
+  void *image = MAP_FAILED;
+  if (ftruncate(fd, (off_t)size) == 0)
+    image = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (image == MAP_FAILED) {
+    perror(name);
+    shm_unlink(name);
+    return -1;
+  }
+  /* everything but the magic number (still 0 from ftruncate), which tells
+   * attachers it is ready */
+  size_t skip = sizeof(((model_header_t *)0)->magic);
+  memcpy((char *)image + skip, (const char *)model->image + skip,
+         size - skip);
+  model_header_t *h = image;
+  __atomic_store_n(&h->magic, MODEL_MAGIC, __ATOMIC_RELEASE);
+  munmap(image, size);
+  return 0;
+}
+
+model_t *model_attach_shm(const char *name) {
+  int fd = shm_open(name, O_RDONLY, 0);
+  if (fd < 0) {
+    perror(name);
+    return NULL;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(model_header_t)) {
+    fprintf(stderr, "%s: not a model image\n", name);
+    close(fd);
+    return NULL;
+  }
+  void *image = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (image == MAP_FAILED) {
+    perror(name);
+    return NULL;
+  }
+  if (__atomic_load_n(&((const model_header_t *)image)->magic,
+                      __ATOMIC_ACQUIRE) != MODEL_MAGIC) {
+    fprintf(stderr, "%s: not a model image (yet)\n", name);
+    munmap(image, (size_t)st.st_size);
+    return NULL;
+  }
+  model_t *model = model_from_image(image, (size_t)st.st_size, 1);
+  if (model == NULL)
+    munmap(image, (size_t)st.st_size);
+  return model;
+}
+
+int model_unpublish_shm(const char *name) {
+  if (shm_unlink(name) != 0) {
+    perror(name);
+    return -1;
+  }
+  return 0;
+}
+
+void free_model(model_t *model) {
+  if (model == NULL)
+    return;
+  if (model->mapped)
+    munmap(model->image, model->image_size);
+  else
+    dfree(model->image);
+  dfree(model);
+}
+
+uint32_t model_num_words(const model_t *model) {
+  return model ? model->header->num_words : 0;
+}
+
+uint64_t model_num_edges(const model_t *model) {
+  return model ? model->header->num_edges : 0;
+}
+
+const int *model_word(const model_t *model, uint32_t id) {
+  if (model == NULL || id >= model->header->num_words)
+    return NULL;
+  return model->pool + model->word_offsets[id];
+}
+
+uint32_t model_find(const model_t *model, const int *word) {
+  if (model == NULL || word == NULL)
+    return VOCAB_NO_ID;
+  uint32_t lo = 0, hi = model->header->num_words;
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    uint32_t id = model->sorted_ids[mid];
+    int cmp = model_word_cmp(model_word(model, id), word);
+    if (cmp == 0)
+      return id;
+    if (cmp < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return VOCAB_NO_ID;
+}
+
+const model_edge_t *model_followers(const model_t *model, uint32_t id,
+                                    uint32_t *count) {
+  if (model == NULL || id >= model->header->num_words) {
+    if (count)
+      *count = 0;
+    return NULL;
+  }
+  uint64_t begin = model->row_offsets[id];
+  if (count)
+    *count = (uint32_t)(model->row_offsets[id + 1] - begin);
+  return model->edges + begin;
+}
+
+uint64_t model_row_total(const model_t *model, uint32_t id) {
+  if (model == NULL || id >= model->header->num_words)
+    return 0;
+  return model->row_totals[id];
+}
+
+uint32_t model_top_followers(const model_t *model, uint32_t id, uint32_t k,
+                             model_follower_t *out) {
+  uint32_t n;
+  const model_edge_t *row = model_followers(model, id, &n);
+  if (k > n)
+    k = n;
+  if (k == 0)
+    return 0;
+  const uint32_t *ranks = model->ranks + model->row_offsets[id];
+  double total = (double)model->row_totals[id];
+  for (uint32_t i = 0; i < k; ++i) {
+    const model_edge_t *e = &row[ranks[i]];
+    out[i].next = e->next;
+    out[i].count = e->count;
+    out[i].probability = (double)e->count / total;
+  }
+  return k;
+}
+
+#define TOP_PREFETCH 8 /* rows ahead in a batch */
+
+void model_top_followers_batch(const model_t *model, const uint32_t *ids,
+                               size_t n, uint32_t k, model_follower_t *out,
+                               uint32_t *found) {
+  uint32_t words = model_num_words(model);
+  for (size_t i = 0; i < n && i < TOP_PREFETCH; ++i)
+    if (ids[i] < words)
+      __builtin_prefetch(&model->row_offsets[ids[i]]);
+  for (size_t i = 0; i < n; ++i) {
+    /* the offsets of a row further on, and the ranks and first edges of
+     * the next one, whose offsets were fetched earlier */
+    if (i + TOP_PREFETCH < n && ids[i + TOP_PREFETCH] < words)
+      __builtin_prefetch(&model->row_offsets[ids[i + TOP_PREFETCH]]);
+    if (i + 1 < n && ids[i + 1] < words) {
+      uint64_t next = model->row_offsets[ids[i + 1]];
+      __builtin_prefetch(&model->ranks[next]);
+      __builtin_prefetch(&model->edges[next]);
+      __builtin_prefetch(&model->row_totals[ids[i + 1]]);
+    }
+    found[i] = model_top_followers(model, ids[i], k, out + i * (size_t)k);
+  }
+}
+
+/* ------------------------------------------------------------------
+ * Streaming writer
+ * ------------------------------------------------------------------ */
+struct model_writer {
+  int fd;
+  char *buffer;
+  size_t used;
+  int failed;
+  model_header_t header;
+  uint64_t *row_offsets; /* num_words + 1 */
+  uint64_t *row_totals;  /* num_words */
+  uint32_t current;      /* word whose followers are being written */
+  uint64_t edges;        /* edges written so far */
+  uint64_t file_pos;     /* bytes handed to the buffer so far */
+};
+
+static void writer_put(model_writer_t *w, const void *data, size_t len) {
+  const char *p = data;
+  while (len > 0 && !w->failed) {
+    size_t room = WRITER_BUFFER_SIZE - w->used;
+    size_t n = len < room ? len : room;
+    memcpy(w->buffer + w->used, p, n);
+    w->used += n;
+    p += n;
+    len -= n;
+    if (w->used == WRITER_BUFFER_SIZE) {
+      if (write_all(w->fd, w->buffer, w->used) != 0)
+        w->failed = 1;
+      w->used = 0;
+    }
+  }
+  w->file_pos += (uint64_t)(p - (const char *)data);
+}
+
+static void writer_pad_to(model_writer_t *w, uint64_t offset) {
+  static const char zeros[8] = {0};
+  while (w->file_pos < offset && !w->failed) {
+    uint64_t gap = offset - w->file_pos;
+    writer_put(w, zeros, gap < sizeof(zeros) ? (size_t)gap : sizeof(zeros));
+  }
+}
+
+model_writer_t *model_writer_open(const char *path, const vocab_t *vocab) {
+  if (path == NULL || vocab == NULL)
+    return NULL;
+  int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    perror(path);
+    return NULL;
+  }
+  model_writer_t *w = dmalloc(sizeof(model_writer_t));
+  w->fd = fd;
+  w->buffer = dmalloc(WRITER_BUFFER_SIZE);
+  uint32_t n = vocab_size(vocab);
+  /* The edge count is unknown yet: only the sections before edges_off are
+   * final, the header is rewritten by model_writer_close. */
+  model_layout(&w->header, n, vocab->pool_len, 0);
+  w->row_offsets = dmalloc(sizeof(uint64_t) * ((size_t)n + 1));
+  w->row_totals = dmalloc(sizeof(uint64_t) * ((size_t)n + 1));
+
+  writer_put(w, &w->header, sizeof(w->header));
+  writer_pad_to(w, w->header.pool_off);
+  for (uint32_t i = 0; i < n; ++i) {
+    const int *word = vocab_word(vocab, i);
+    size_t len = 0;
+    while (word[len] != '\0')
+      len++;
+    writer_put(w, word, (len + 1) * sizeof(int));
+  }
+  writer_pad_to(w, w->header.word_offsets_off);
+  uint64_t pos = 0;
+  for (uint32_t i = 0; i < n; ++i) {
+    writer_put(w, &pos, sizeof(pos));
+    const int *word = vocab_word(vocab, i);
+    size_t len = 0;
+    while (word[len] != '\0')
+      len++;
+    pos += len + 1;
+  }
+  uint32_t *sorted = vocab_sorted_ids(vocab);
+  writer_pad_to(w, w->header.sorted_ids_off);
+  writer_put(w, sorted, sizeof(uint32_t) * n);
+  dfree(sorted);
+  writer_pad_to(w, w->header.edges_off);
+  return w;
+}
+
+int model_writer_add_edge(model_writer_t *w, uint32_t word, uint32_t next,
+                          uint32_t count) {
+  if (w == NULL || word >= w->header.num_words || word < w->current) {
+    fprintf(stderr, "Edges must be added in word order\n");
+    return -1;
+  }
+  /* Close the rows of every word skipped since the last edge. */
+  while (w->current < word)
+    w->row_offsets[++w->current] = w->edges;
+  model_edge_t edge = {next, count};
+  writer_put(w, &edge, sizeof(edge));
+  w->row_totals[word] += count;
+  w->edges++;
+  return w->failed ? -1 : 0;
+}
+
+/* The ranks section: the edges are not in memory, so every row is read
+ * back from the file (where the buffer flushed it) and ranked. */
+static void writer_put_ranks(model_writer_t *w, const model_header_t *h) {
+  uint32_t n = h->num_words;
+  if (w->used > 0 && !w->failed) {
+    if (write_all(w->fd, w->buffer, w->used) != 0)
+      w->failed = 1;
+    w->used = 0;
+  }
+  uint64_t widest = 0;
+  for (uint32_t i = 0; i < n; ++i)
+    if (w->row_offsets[i + 1] - w->row_offsets[i] > widest)
+      widest = w->row_offsets[i + 1] - w->row_offsets[i];
+  model_edge_t *row = dmalloc(sizeof(model_edge_t) * (widest + 1));
+  uint32_t *ranks = dmalloc(sizeof(uint32_t) * (widest + 1));
+  uint64_t *keys = dmalloc(sizeof(uint64_t) * (widest + 1));
+  for (uint32_t i = 0; i < n && !w->failed; ++i) {
+    uint32_t len = (uint32_t)(w->row_offsets[i + 1] - w->row_offsets[i]);
+    if (len == 0)
+      continue;
+    size_t bytes = sizeof(model_edge_t) * len;
+    off_t at = (off_t)(h->edges_off + sizeof(model_edge_t) * w->row_offsets[i]);
+    if (pread(w->fd, row, bytes, at) != (ssize_t)bytes) {
+      w->failed = 1;
+      break;
+    }
+    rank_row(row, len, ranks, keys);
+    writer_put(w, ranks, sizeof(uint32_t) * len);
+  }
+  dfree(keys);
+  dfree(ranks);
+  dfree(row);
+  writer_pad_to(w, h->image_size);
+}
+
+int model_writer_close(model_writer_t *w) {
+  if (w == NULL)
+    return -1;
+  uint32_t n = w->header.num_words;
+  while (w->current < n)
+    w->row_offsets[++w->current] = w->edges;
+  w->row_offsets[0] = 0;
+
+  model_header_t final;
+  model_layout(&final, n, w->header.pool_len, w->edges);
+  writer_pad_to(w, final.row_offsets_off);
+  writer_put(w, w->row_offsets, sizeof(uint64_t) * ((size_t)n + 1));
+  writer_put(w, w->row_totals, sizeof(uint64_t) * n);
+  writer_put_ranks(w, &final);
+
+  int rc = w->failed ? -1 : 0;
+  if (rc == 0 && w->used > 0 && write_all(w->fd, w->buffer, w->used) != 0)
+    rc = -1;
+  /* The only non sequential write: the final header at offset 0. */
+  if (rc == 0 && pwrite(w->fd, &final, sizeof(final), 0) != sizeof(final))
+    rc = -1;
+  if (close(w->fd) != 0)
+    rc = -1;
+  if (rc != 0)
+    perror("model_writer_close");
+  dfree(w->row_offsets);
+  dfree(w->row_totals);
+  dfree(w->buffer);
+  dfree(w);
+  return rc;
+}
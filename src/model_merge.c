@@ -0,0 +1,259 @@
+#include "../include/model_merge.h"
+#include "../include/utils.h"
+#include "../include/vocab.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MIN_CHUNK_EDGES 1024
+
+typedef struct {
+  const model_t *a, *b;
+  const uint32_t *from_b; /* merged ID -> b ID, or VOCAB_NO_ID */
+  const uint32_t *b_ids;  /* b ID -> merged ID */
+  double weight_a, weight_b;
+  uint64_t widest_b;
+
+  uint32_t begin, end; /* merged words of the chunk */
+  uint64_t capacity;   /* input edges of the chunk */
+  model_edge_t *out;   /* merged rows, back to back */
+  uint32_t *lengths;   /* row length of every word of the chunk */
+  uint64_t edges;
+  uint64_t dropped;
+  uint64_t resorted;
+} merge_job_t;
+
+static int cmp_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+static uint32_t row_length(const model_t *model, uint32_t id) {
+  uint32_t n;
+  model_followers(model, id, &n);
+  return n;
+}
+
+/* Row of b remapped to merged IDs, as (next << 32 | count), sorted. */
+static uint32_t remap_row(merge_job_t *job, uint32_t id, uint64_t *row) {
+  uint32_t n;
+  const model_edge_t *edges = model_followers(job->b, id, &n);
+  int sorted = 1;
+  for (uint32_t i = 0; i < n; ++i) {
+    row[i] = (uint64_t)job->b_ids[edges[i].next] << 32 | edges[i].count;
+    if (i > 0 && row[i] < row[i - 1])
+      sorted = 0;
+  }
+  if (!sorted) {
+    qsort(row, n, sizeof(uint64_t), cmp_u64);
+    job->resorted++;
+  }
+  return n;
+}
+
+static void put_edge(merge_job_t *job, uint32_t next, double count) {
+  double rounded = floor(count + 0.5);
+  if (rounded < 1) {
+    job->dropped++;
+    return;
+  }
+  job->out[job->edges].next = next;
+  job->out[job->edges].count =
+      rounded > UINT32_MAX ? UINT32_MAX : (uint32_t)rounded;
+  job->edges++;
+}
+
+static void *merge_rows(void *arg) {
+  merge_job_t *job = arg;
+  uint64_t *row_b = dmalloc(sizeof(uint64_t) * (job->widest_b + 1));
+  uint32_t words_a = model_num_words(job->a);
+  for (uint32_t w = job->begin; w < job->end; ++w) {
+    uint64_t first = job->edges;
+    uint32_t na = 0, nb = 0;
+    const model_edge_t *row_a =
+        w < words_a ? model_followers(job->a, w, &na) : NULL;
+    if (job->from_b[w] != VOCAB_NO_ID)
+      nb = remap_row(job, job->from_b[w], row_b);
+    uint32_t i = 0, j = 0;
+    while (i < na || j < nb) {
+      uint32_t next_b = j < nb ? (uint32_t)(row_b[j] >> 32) : UINT32_MAX;
+      if (j == nb || (i < na && row_a[i].next < next_b)) {
+        put_edge(job, row_a[i].next, job->weight_a * row_a[i].count);
+        i++;
+      } else if (i == na || next_b < row_a[i].next) {
+        put_edge(job, next_b, job->weight_b * (uint32_t)row_b[j]);
+        j++;
+      } else {
+        put_edge(job, next_b,
+                 job->weight_a * row_a[i].count +
+                     job->weight_b * (uint32_t)row_b[j]);
+        i++;
+        j++;
+      }
+    }
+    job->lengths[w - job->begin] = (uint32_t)(job->edges - first);
+  }
+  dfree(row_b);
+  return NULL;
+}
+
+/* Match the dictionaries: b_ids[b ID] = merged ID, from_b the inverse.
+ * Returns the vocabulary of the merged model. */
+static vocab_t *merge_words(const model_t *a, const model_t *b,
+                            uint32_t *b_ids, uint32_t **from_b,
+                            uint32_t *shared) {
+  uint32_t na = model_num_words(a), nb = model_num_words(b);
+  uint32_t i = 0;
+  *shared = 0;
+  for (uint32_t j = 0; j < nb; ++j) {
+    uint32_t id = b->sorted_ids[j];
+    const int *word = model_word(b, id);
+    int cmp = 1;
+    while (i < na &&
+           (cmp = model_word_cmp(model_word(a, a->sorted_ids[i]), word)) < 0)
+      i++;
+    if (i < na && cmp == 0) {
+      b_ids[id] = a->sorted_ids[i++];
+      (*shared)++;
+    } else {
+      b_ids[id] = VOCAB_NO_ID;
+    }
+  }
+  uint32_t words = na;
+  for (uint32_t id = 0; id < nb; ++id)
+    if (b_ids[id] == VOCAB_NO_ID)
+      b_ids[id] = words++;
+
+  *from_b = dmalloc(sizeof(uint32_t) * ((size_t)words + 1));
+  for (uint32_t w = 0; w < words; ++w)
+    (*from_b)[w] = VOCAB_NO_ID;
+  for (uint32_t id = 0; id < nb; ++id)
+    (*from_b)[b_ids[id]] = id;
+
+  /* model_writer takes a vocabulary: the words in merged ID order */
+  vocab_t *vocab = create_vocab((int)words + 1);
+  for (uint32_t w = 0; w < na; ++w)
+    vocab_intern(vocab, model_word(a, w));
+  for (uint32_t w = na; w < words; ++w)
+    vocab_intern(vocab, model_word(b, (*from_b)[w]));
+  return vocab;
+}
+
+int model_merge(const model_t *a, const model_t *b, const char *path,
+                const model_merge_config_t *config,
+                model_merge_stats_t *stats) {
+  model_merge_config_t defaults = {1.0, 1.0, 1};
+  if (config == NULL)
+    config = &defaults;
+  model_merge_stats_t local;
+  if (stats == NULL)
+    stats = &local;
+  memset(stats, 0, sizeof(*stats));
+  if (a == NULL || b == NULL || path == NULL) {
+    fprintf(stderr, "model_merge: missing model or path\n");
+    return -1;
+  }
+  if (!(config->weight_a >= 0) || !(config->weight_b >= 0) ||
+      isinf(config->weight_a) || isinf(config->weight_b)) {
+    fprintf(stderr, "model_merge: weights must be finite and >= 0\n");
+    return -1;
+  }
+  int threads = config->threads > 0 ? config->threads : 1;
+
+  uint32_t nb = model_num_words(b);
+  uint32_t *b_ids = dmalloc(sizeof(uint32_t) * ((size_t)nb + 1));
+  uint32_t *from_b;
+  vocab_t *vocab = merge_words(a, b, b_ids, &from_b, &stats->shared);
+  uint32_t words = vocab_size(vocab);
+  stats->words = words;
+
+  model_writer_t *writer = model_writer_open(path, vocab);
+  if (writer == NULL) {
+    free_vocab(vocab);
+    dfree(from_b);
+    dfree(b_ids);
+    return -1;
+  }
+
+  uint64_t widest_b = 0;
+  for (uint32_t id = 0; id < nb; ++id)
+    if (row_length(b, id) > widest_b)
+      widest_b = row_length(b, id);
+  uint64_t total = model_num_edges(a) + model_num_edges(b);
+  uint64_t target = total / ((uint64_t)threads * 4);
+  if (target < MIN_CHUNK_EDGES)
+    target = MIN_CHUNK_EDGES;
+  if (target > MODEL_MERGE_CHUNK_EDGES)
+    target = MODEL_MERGE_CHUNK_EDGES;
+
+  merge_job_t *jobs = dmalloc(sizeof(merge_job_t) * threads);
+  pthread_t *tids = dmalloc(sizeof(pthread_t) * threads);
+  uint32_t words_a = model_num_words(a);
+  uint32_t w = 0;
+  int rc = 0;
+  while (w < words && rc == 0) {
+    /* Cut the next round of chunks, then merge them all at once. */
+    int n = 0;
+    for (; n < threads && w < words; ++n) {
+      merge_job_t *job = &jobs[n];
+      memset(job, 0, sizeof(*job));
+      job->a = a;
+      job->b = b;
+      job->from_b = from_b;
+      job->b_ids = b_ids;
+      job->weight_a = config->weight_a;
+      job->weight_b = config->weight_b;
+      job->widest_b = widest_b;
+      job->begin = w;
+      for (; w < words && (job->capacity < target || w == job->begin); ++w)
+        job->capacity +=
+            (w < words_a ? row_length(a, w) : 0) +
+            (from_b[w] != VOCAB_NO_ID ? row_length(b, from_b[w]) : 0);
+      job->end = w;
+      job->out = dmalloc_tag(sizeof(model_edge_t) * (job->capacity + 1),
+                             MEM_TRAIN);
+      job->lengths = dmalloc_tag(
+          sizeof(uint32_t) * ((size_t)(job->end - job->begin) + 1), MEM_TRAIN);
+    }
+    int started = 1;
+    for (; started < n; ++started) {
+      if (pthread_create(&tids[started], NULL, merge_rows, &jobs[started]) !=
+          0) {
+        perror("pthread_create");
+        break; /* the chunks left are merged here */
+      }
+    }
+    merge_rows(&jobs[0]);
+    for (int t = started; t < n; ++t)
+      merge_rows(&jobs[t]);
+    for (int t = 1; t < started; ++t)
+      pthread_join(tids[t], NULL);
+
+    for (int t = 0; t < n; ++t) {
+      merge_job_t *job = &jobs[t];
+      const model_edge_t *e = job->out;
+      for (uint32_t v = job->begin; v < job->end && rc == 0; ++v) {
+        uint32_t len = job->lengths[v - job->begin];
+        for (uint32_t k = 0; k < len && rc == 0; ++k, ++e)
+          rc = model_writer_add_edge(writer, v, e->next, e->count);
+      }
+      stats->edges += job->edges;
+      stats->dropped += job->dropped;
+      stats->resorted += job->resorted;
+      stats->chunks++;
+      dfree(job->out);
+      dfree(job->lengths);
+    }
+  }
+  dfree(tids);
+  dfree(jobs);
+
+  if (model_writer_close(writer) != 0)
+    rc = -1;
+  free_vocab(vocab);
+  dfree(from_b);
+  dfree(b_ids);
+  return rc;
+}
@@ -0,0 +1,516 @@
+#define _POSIX_C_SOURCE 200809L
+#include "../include/packed_model.h"
+#include "../include/generate.h"
+#include "../include/timing.h"
+#include "../include/utils.h"
+#include "../include/vocab.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SLACK 8 /* bytes after data, for the 64 bit loads of PACKED_BITS */
+
+static uint64_t align8(uint64_t n) { return (n + 7) & ~(uint64_t)7; }
+
+static void packed_layout(packed_model_header_t *h, uint32_t num_words,
+                          uint64_t pool_len, uint64_t data_len) {
+  uint64_t off = align8(sizeof(packed_model_header_t));
+  h->pool_off = off;
+  off += align8(pool_len * sizeof(int));
+  h->word_offsets_off = off;
+  off += (uint64_t)num_words * sizeof(uint64_t);
+  h->sorted_ids_off = off;
+  off += align8((uint64_t)num_words * sizeof(uint32_t));
+  h->row_offsets_off = off;
+  off += ((uint64_t)num_words + 1) * sizeof(uint64_t);
+  h->row_totals_off = off;
+  off += (uint64_t)num_words * sizeof(uint64_t);
+  h->data_off = off;
+  h->data_len = data_len;
+  h->image_size = off + align8(data_len);
+}
+
+static int check_rows(const packed_model_header_t *h, const char *base);
+
+static packed_model_t *packed_from_image(void *image, size_t size,
+                                         int mapped) {
+  const packed_model_header_t *h = image;
+  if (size < sizeof(packed_model_header_t) || h->magic != PACKED_MODEL_MAGIC) {
+    fprintf(stderr, "Not a packed model image\n");
+    return NULL;
+  }
+  if (h->version != PACKED_MODEL_VERSION) {
+    fprintf(stderr, "Packed model version %u, expected %u: pack again\n",
+            h->version, PACKED_MODEL_VERSION);
+    return NULL;
+  }
+  packed_model_header_t expected = *h;
+  packed_layout(&expected, h->num_words, h->pool_len, h->data_len);
+  char *base = image;
+  if (expected.image_size != h->image_size || h->image_size > size ||
+      expected.pool_off != h->pool_off ||
+      expected.word_offsets_off != h->word_offsets_off ||
+      expected.sorted_ids_off != h->sorted_ids_off ||
+      expected.row_offsets_off != h->row_offsets_off ||
+      expected.row_totals_off != h->row_totals_off ||
+      expected.data_off != h->data_off || h->data_len < SLACK ||
+      h->encoding > PACKED_BITS || check_rows(h, base) != 0) {
+    fprintf(stderr, "Corrupted packed model image\n");
+    return NULL;
+  }
+  packed_model_t *p = dmalloc_tag(sizeof(packed_model_t), MEM_MODEL);
+  p->header = h;
+  p->pool = (const int *)(base + h->pool_off);
+  p->word_offsets = (const uint64_t *)(base + h->word_offsets_off);
+  p->sorted_ids = (const uint32_t *)(base + h->sorted_ids_off);
+  p->row_offsets = (const uint64_t *)(base + h->row_offsets_off);
+  p->row_totals = (const uint64_t *)(base + h->row_totals_off);
+  p->data = (const uint8_t *)(base + h->data_off);
+  p->image = image;
+  p->image_size = size;
+  p->mapped = mapped;
+  return p;
+}
+
+/* ------------------------------------------------------------------
+ * Codes
+ * ------------------------------------------------------------------ */
+static inline uint64_t get_varint(const uint8_t **p) {
+  const uint8_t *q = *p;
+  uint64_t v = 0;
+  unsigned shift = 0;
+  uint8_t byte;
+  do {
+    byte = *q++;
+    v |= (uint64_t)(byte & 0x7F) << shift;
+    shift += 7;
+  } while (byte & 0x80);
+  *p = q;
+  return v;
+}
+
+/* width (0..32) bits at bit offset bit of base. */
+static inline uint32_t get_bits(const uint8_t *base, uint64_t bit,
+                                unsigned width) {
+  uint64_t word;
+  memcpy(&word, base + (bit >> 3), sizeof(word));
+  return (uint32_t)((word >> (bit & 7)) & ((1ULL << width) - 1));
+}
+
+static unsigned bit_width(uint32_t v) {
+  return v ? 32 - (unsigned)__builtin_clz(v) : 0;
+}
+
+typedef struct {
+  uint8_t *bytes;
+  uint64_t len, cap;
+} byte_buffer_t;
+
+static void reserve(byte_buffer_t *b, uint64_t extra) {
+  if (b->len + extra <= b->cap)
+    return;
+  while (b->len + extra > b->cap)
+    b->cap = b->cap ? b->cap * 2 : 1 << 16;
+  b->bytes = b->bytes ? drealloc(b->bytes, b->cap)
+                      : dmalloc_tag(b->cap, MEM_MODEL);
+}
+
+static void put_varint(byte_buffer_t *b, uint64_t v) {
+  reserve(b, 10);
+  while (v >= 0x80) {
+    b->bytes[b->len++] = (uint8_t)(v | 0x80);
+    v >>= 7;
+  }
+  b->bytes[b->len++] = (uint8_t)v;
+}
+
+/* Append width bits of v at bit offset *bit of a zeroed area. */
+static void put_bits(uint8_t *base, uint64_t *bit, uint32_t v,
+                     unsigned width) {
+  for (unsigned i = 0; i < width; ++i, ++*bit)
+    if (v >> i & 1)
+      base[*bit >> 3] |= (uint8_t)(1u << (*bit & 7));
+}
+
+static void encode_row(byte_buffer_t *b, const model_edge_t *row, uint32_t n,
+                       packed_encoding_t encoding) {
+  put_varint(b, n);
+  if (n == 0)
+    return;
+  if (encoding == PACKED_VARINT) {
+    for (uint32_t i = 0; i < n; ++i) {
+      put_varint(b, i ? row[i].next - row[i - 1].next - 1 : row[i].next);
+      put_varint(b, row[i].count);
+    }
+    return;
+  }
+  uint32_t widest_gap = 0, widest_count = 0;
+  for (uint32_t i = 0; i < n; ++i) {
+    if (i && row[i].next - row[i - 1].next - 1 > widest_gap)
+      widest_gap = row[i].next - row[i - 1].next - 1;
+    if (row[i].count > widest_count)
+      widest_count = row[i].count;
+  }
+  unsigned g = bit_width(widest_gap), c = bit_width(widest_count);
+  reserve(b, 2);
+  b->bytes[b->len++] = (uint8_t)g;
+  b->bytes[b->len++] = (uint8_t)c;
+  put_varint(b, row[0].next);
+  uint64_t bits = (uint64_t)(n - 1) * g + (uint64_t)n * c;
+  uint64_t bytes = (bits + 7) / 8;
+  reserve(b, bytes);
+  uint8_t *base = b->bytes + b->len;
+  memset(base, 0, bytes);
+  uint64_t bit = 0;
+  for (uint32_t i = 1; i < n; ++i)
+    put_bits(base, &bit, row[i].next - row[i - 1].next - 1, g);
+  for (uint32_t i = 0; i < n; ++i)
+    put_bits(base, &bit, row[i].count, c);
+  b->len += bytes;
+}
+
+/* ------------------------------------------------------------------
+ * Validation
+ * ------------------------------------------------------------------ */
+/* get_varint that stops at end and at 64 bits. Returns 0 or -1. */
+static int get_varint_bounded(const uint8_t **p, const uint8_t *end,
+                              uint64_t *v) {
+  const uint8_t *q = *p;
+  *v = 0;
+  for (unsigned shift = 0; q < end && shift < 64; shift += 7) {
+    uint8_t byte = *q++;
+    *v |= (uint64_t)(byte & 0x7F) << shift;
+    if (!(byte & 0x80)) {
+      *p = q;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+/* Decode row id within its bytes: at most widest followers, IDs below
+ * num_words, counts of 32 bits summing to its total. */
+static int check_row(const packed_model_header_t *h, const uint8_t *data,
+                     const uint64_t *row_offsets, uint64_t total,
+                     uint32_t id) {
+  const uint8_t *p = data + row_offsets[id];
+  const uint8_t *end = data + row_offsets[id + 1];
+  uint64_t n, next, value, sum = 0;
+  if (get_varint_bounded(&p, end, &n) != 0 || n > h->widest)
+    return -1;
+  if (n == 0)
+    return p == end && total == 0 ? 0 : -1;
+  if (h->encoding == PACKED_VARINT) {
+    next = 0;
+    for (uint64_t i = 0; i < n; ++i) {
+      if (get_varint_bounded(&p, end, &value) != 0 || value > UINT32_MAX)
+        return -1;
+      next += value + (i ? 1 : 0);
+      if (next >= h->num_words ||
+          get_varint_bounded(&p, end, &value) != 0 || value > UINT32_MAX)
+        return -1;
+      sum += value;
+    }
+    return p == end && sum == total ? 0 : -1;
+  }
+  if (end - p < 2 || p[0] > 32 || p[1] > 32)
+    return -1;
+  unsigned g = p[0], c = p[1];
+  p += 2;
+  if (get_varint_bounded(&p, end, &next) != 0 || next >= h->num_words)
+    return -1;
+  uint64_t bits = (n - 1) * g + n * c;
+  if ((uint64_t)(end - p) != (bits + 7) / 8)
+    return -1;
+  for (uint64_t i = 1; i < n; ++i)
+    if ((next += get_bits(p, (i - 1) * g, g) + 1) >= h->num_words)
+      return -1;
+  for (uint64_t i = 0; i < n; ++i)
+    sum += get_bits(p, (n - 1) * g + i * c, c);
+  return sum == total ? 0 : -1;
+}
+
+/* Section contents: word offsets inside a terminated pool, sorted IDs
+ * below num_words, rows in order inside data (before its slack), each row
+ * well formed. One pass over the rows. */
+static int check_rows(const packed_model_header_t *h, const char *base) {
+  const int *pool = (const int *)(base + h->pool_off);
+  const uint64_t *words = (const uint64_t *)(base + h->word_offsets_off);
+  const uint32_t *sorted = (const uint32_t *)(base + h->sorted_ids_off);
+  const uint64_t *rows = (const uint64_t *)(base + h->row_offsets_off);
+  const uint64_t *totals = (const uint64_t *)(base + h->row_totals_off);
+  const uint8_t *data = (const uint8_t *)(base + h->data_off);
+  uint64_t edges = 0;
+  if (rows[0] != 0 || rows[h->num_words] + SLACK > h->data_len)
+    return -1;
+  if (h->pool_len ? pool[h->pool_len - 1] != '\0' : h->num_words != 0)
+    return -1;
+  for (uint32_t id = 0; id < h->num_words; ++id) {
+    if (rows[id] > rows[id + 1] || words[id] >= h->pool_len ||
+        sorted[id] >= h->num_words)
+      return -1;
+  }
+  for (uint32_t id = 0; id < h->num_words; ++id) {
+    if (check_row(h, data, rows, totals[id], id) != 0)
+      return -1;
+    const uint8_t *p = data + rows[id];
+    edges += get_varint(&p);
+  }
+  return edges == h->num_edges ? 0 : -1;
+}
+
+/* ------------------------------------------------------------------
+ * Build, save, load
+ * ------------------------------------------------------------------ */
+packed_model_t *packed_model_build(const model_t *model,
+                                   packed_encoding_t encoding) {
+  if (model == NULL || (encoding != PACKED_VARINT && encoding != PACKED_BITS)) {
+    fprintf(stderr, "packed_model_build: no model or unknown encoding\n");
+    return NULL;
+  }
+  uint32_t n = model_num_words(model);
+  uint64_t *offsets = dmalloc(sizeof(uint64_t) * ((size_t)n + 1));
+  byte_buffer_t data = {NULL, 0, 0};
+  uint32_t widest = 0;
+  for (uint32_t id = 0; id < n; ++id) {
+    uint32_t len;
+    const model_edge_t *row = model_followers(model, id, &len);
+    offsets[id] = data.len;
+    encode_row(&data, row, len, encoding);
+    if (len > widest)
+      widest = len;
+  }
+  offsets[n] = data.len;
+  reserve(&data, SLACK);
+  memset(data.bytes + data.len, 0, SLACK);
+  data.len += SLACK;
+
+  const model_header_t *mh = model->header;
+  packed_model_header_t h;
+  memset(&h, 0, sizeof(h));
+  h.magic = PACKED_MODEL_MAGIC;
+  h.version = PACKED_MODEL_VERSION;
+  h.num_words = n;
+  h.encoding = encoding;
+  h.num_edges = mh->num_edges;
+  h.pool_len = mh->pool_len;
+  h.widest = widest;
+  packed_layout(&h, n, mh->pool_len, data.len);
+
+  char *image = dmalloc_tag(h.image_size, MEM_MODEL);
+  memcpy(image, &h, sizeof(h));
+  memcpy(image + h.pool_off, model->pool, sizeof(int) * mh->pool_len);
+  memcpy(image + h.word_offsets_off, model->word_offsets,
+         sizeof(uint64_t) * n);
+  memcpy(image + h.sorted_ids_off, model->sorted_ids, sizeof(uint32_t) * n);
+  memcpy(image + h.row_offsets_off, offsets, sizeof(uint64_t) * ((size_t)n + 1));
+  memcpy(image + h.row_totals_off, model->row_totals, sizeof(uint64_t) * n);
+  memcpy(image + h.data_off, data.bytes, data.len);
+  dfree(data.bytes);
+  dfree(offsets);
+  return packed_from_image(image, h.image_size, 0);
+}
+
+int packed_model_save(const packed_model_t *packed, const char *path) {
+  if (packed == NULL || path == NULL)
+    return -1;
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    perror(path);
+    return -1;
+  }
+  int rc = write_all(fd, packed->image, packed->header->image_size);
+  if (close(fd) != 0)
+    rc = -1;
+  if (rc != 0)
+    perror(path);
+  return rc;
+}
+
+packed_model_t *packed_model_load(const char *path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    perror(path);
+    return NULL;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 ||
+      st.st_size < (off_t)sizeof(packed_model_header_t)) {
+    fprintf(stderr, "%s: not a packed model file\n", path);
+    close(fd);
+    return NULL;
+  }
+  void *image = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (image == MAP_FAILED) {
+    perror(path);
+    return NULL;
+  }
+  packed_model_t *packed = packed_from_image(image, (size_t)st.st_size, 1);
+  if (packed == NULL)
+    munmap(image, (size_t)st.st_size);
+  return packed;
+}
+
+int packed_model_probe(const char *path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return 0;
+  uint32_t magic = 0;
+  ssize_t got = read_full(fd, &magic, sizeof(magic));
+  close(fd);
+  return got == (ssize_t)sizeof(magic) && magic == PACKED_MODEL_MAGIC;
+}
+
+void free_packed_model(packed_model_t *packed) {
+  if (packed == NULL)
+    return;
+  if (packed->mapped)
+    munmap(packed->image, packed->image_size);
+  else
+    dfree(packed->image);
+  dfree(packed);
+}
+
+/* ------------------------------------------------------------------
+ * Queries
+ * ------------------------------------------------------------------ */
+uint32_t packed_model_num_words(const packed_model_t *packed) {
+  return packed ? packed->header->num_words : 0;
+}
+
+uint64_t packed_model_num_edges(const packed_model_t *packed) {
+  return packed ? packed->header->num_edges : 0;
+}
+
+const int *packed_model_word(const packed_model_t *packed, uint32_t id) {
+  if (packed == NULL || id >= packed->header->num_words)
+    return NULL;
+  return packed->pool + packed->word_offsets[id];
+}
+
+uint32_t packed_model_find(const packed_model_t *packed, const int *word) {
+  if (packed == NULL || word == NULL)
+    return VOCAB_NO_ID;
+  uint32_t lo = 0, hi = packed->header->num_words;
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    uint32_t id = packed->sorted_ids[mid];
+    int cmp = model_word_cmp(packed_model_word(packed, id), word);
+    if (cmp == 0)
+      return id;
+    if (cmp < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return VOCAB_NO_ID;
+}
+
+uint64_t packed_model_row_total(const packed_model_t *packed, uint32_t id) {
+  if (packed == NULL || id >= packed->header->num_words)
+    return 0;
+  return packed->row_totals[id];
+}
+
+uint32_t packed_model_followers(const packed_model_t *packed, uint32_t id,
+                                model_edge_t *out) {
+  if (packed == NULL || id >= packed->header->num_words)
+    return 0;
+  const uint8_t *p = packed->data + packed->row_offsets[id];
+  uint32_t n = (uint32_t)get_varint(&p);
+  if (n == 0)
+    return 0;
+  if (packed->header->encoding == PACKED_VARINT) {
+    uint32_t next = 0;
+    for (uint32_t i = 0; i < n; ++i) {
+      next += (uint32_t)get_varint(&p) + (i ? 1 : 0);
+      out[i].next = next;
+      out[i].count = (uint32_t)get_varint(&p);
+    }
+    return n;
+  }
+  unsigned g = p[0], c = p[1];
+  p += 2;
+  uint32_t next = (uint32_t)get_varint(&p);
+  uint64_t counts = (uint64_t)(n - 1) * g;
+  out[0].next = next;
+  for (uint32_t i = 1; i < n; ++i) {
+    next += get_bits(p, (uint64_t)(i - 1) * g, g) + 1;
+    out[i].next = next;
+  }
+  for (uint32_t i = 0; i < n; ++i)
+    out[i].count = get_bits(p, counts + (uint64_t)i * c, c);
+  return n;
+}
+
+/* The follower whose cumulative count passes r, decoding no further. */
+static uint32_t draw_follower(const packed_model_t *packed, uint32_t id,
+                              uint64_t r) {
+  const uint8_t *p = packed->data + packed->row_offsets[id];
+  uint32_t n = (uint32_t)get_varint(&p);
+  if (packed->header->encoding == PACKED_VARINT) {
+    uint32_t next = 0;
+    for (uint32_t i = 0; i < n; ++i) {
+      next += (uint32_t)get_varint(&p) + (i ? 1 : 0);
+      uint32_t count = (uint32_t)get_varint(&p);
+      if (r < count)
+        return next;
+      r -= count;
+    }
+    return next; /* not reached */
+  }
+  unsigned g = p[0], c = p[1];
+  p += 2;
+  uint32_t next = (uint32_t)get_varint(&p);
+  uint64_t counts = (uint64_t)(n - 1) * g;
+  uint32_t i = 0;
+  for (; i + 1 < n; ++i) {
+    uint32_t count = get_bits(p, counts + (uint64_t)i * c, c);
+    if (r < count)
+      break;
+    r -= count;
+  }
+  /* the ID of follower i: the first plus its gaps */
+  for (uint32_t k = 0; k < i; ++k)
+    next += get_bits(p, (uint64_t)k * g, g) + 1;
+  return next;
+}
+
+uint32_t packed_model_next(const packed_model_t *packed, uint32_t id,
+                           uint64_t *state) {
+  TIMER_START(start);
+  uint32_t next = VOCAB_NO_ID;
+  uint64_t total = packed_model_row_total(packed, id);
+  if (total > 0)
+    next = draw_follower(packed, id, generate_rand(state) % total);
+  TIMER_STOP(TIMING_GENERATE_STEP, start);
+  return next;
+}
+
+size_t packed_model_walk(const packed_model_t *packed, uint32_t start,
+                         uint32_t *out, size_t max, uint64_t *state) {
+  size_t n = 0;
+  uint32_t id = start;
+  while (n < max && (id = packed_model_next(packed, id, state)) != VOCAB_NO_ID)
+    out[n++] = id;
+  return n;
+}
+
+int packed_encoding_from_name(const char *name,
+                              packed_encoding_t *encoding) {
+  if (strcmp(name, "varint") == 0)
+    *encoding = PACKED_VARINT;
+  else if (strcmp(name, "bits") == 0)
+    *encoding = PACKED_BITS;
+  else
+    return -1;
+  return 0;
+}
+
+const char *packed_encoding_name(packed_encoding_t encoding) {
+  return encoding == PACKED_BITS ? "bits" : "varint";
+}
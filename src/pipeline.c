@@ -0,0 +1,329 @@
+#define _DEFAULT_SOURCE
+#include "../include/pipeline.h"
+#include "../include/tokenizer.h"
+#include "../include/utf8_tools.h"
+#include "../include/utils.h"
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define DEFAULT_RING_SLOTS 16
+#define DEFAULT_SLOT_BYTES (64 * 1024)
+
+/* ---------------------------------------------------------------------
+ * Peers: a consumer watches the child producing into its ring, a producer
+ * watches the parent consuming from it.
+ * ------------------------------------------------------------------- */
+
+typedef struct {
+  pid_t pid;
+  int exited;
+  int status;
+} child_t;
+
+static int child_alive(void *ctx) {
+  child_t *child = ctx;
+  if (!child->exited && waitpid(child->pid, &child->status, WNOHANG) > 0)
+    child->exited = 1;
+  return !child->exited;
+}
+
+/* 0 if the child failed. */
+static int child_join(child_t *child) {
+  while (!child->exited) {
+    if (waitpid(child->pid, &child->status, 0) > 0)
+      child->exited = 1;
+    else
+      return 0;
+  }
+  return WIFEXITED(child->status) && WEXITSTATUS(child->status) == 0;
+}
+
+static int parent_alive(void *ctx) { return getppid() == *(pid_t *)ctx; }
+
+/* ---------------------------------------------------------------------
+ * Reader: UTF-8 into code point batches, with the decoder of
+ * tokenizer_feed_utf8 (utf8_stream_t); a malformed sequence becomes a ' '.
+ * ------------------------------------------------------------------- */
+
+/* One corpus; its end is an empty batch. */
+static int read_corpus(shm_ring_t *out, int fd, utf8_stream_t *d,
+                       unsigned char *buffer, size_t max_bytes,
+                       pipeline_stage_stats_t *stats) {
+  for (;;) {
+    int *slot = shm_ring_reserve(out);
+    if (slot == NULL)
+      return -1;
+    ssize_t got = read_full(fd, buffer, max_bytes);
+    if (got < 0) {
+      perror("pipeline reader");
+      return -1;
+    }
+    size_t n;
+    if (got == 0) {
+      /* a sequence cut by the end of the corpus is malformed */
+      n = utf8_stream_finish(d, slot, ' ');
+    } else {
+      stats->items += (uint64_t)got;
+      n = utf8_stream_decode(d, (const char *)buffer, (size_t)got, slot, ' ');
+    }
+    shm_ring_publish(out, n * sizeof(int));
+    stats->batches++;
+    if (got == 0 && n == 0)
+      return 0;
+  }
+}
+
+static int run_reader(shm_ring_t *out, const char *const *paths, int n,
+                      pipeline_stats_t *stats) {
+  uint64_t start = monotonic_ns();
+  /* one code point per byte at most, plus a pending sequence */
+  size_t max_bytes = shm_ring_slot_bytes(out) / sizeof(int) - 1;
+  unsigned char *buffer = dmalloc(max_bytes);
+  utf8_stream_t decoder = UTF8_STREAM_INIT;
+  int rc = 0;
+  for (int i = 0; rc == 0 && (i < n || (i == 0 && n == 0)); ++i) {
+    const char *path = n ? paths[i] : "-";
+    int fd = strcmp(path, "-") == 0 ? STDIN_FILENO : open(path, O_RDONLY);
+    if (fd < 0) {
+      perror(path);
+      rc = -1;
+      break;
+    }
+    rc = read_corpus(out, fd, &decoder, buffer, max_bytes, &stats->reader);
+    if (fd != STDIN_FILENO)
+      close(fd);
+  }
+  dfree(buffer);
+  stats->invalid = decoder.invalid;
+  stats->reader.elapsed_ns = monotonic_ns() - start;
+  return rc;
+}
+
+/* ---------------------------------------------------------------------
+ * Tokenizer: code point batches into token batches.
+ * ------------------------------------------------------------------- */
+
+typedef struct {
+  shm_ring_t *out;
+  int *slot;    /* batch being filled, NULL once the ring failed */
+  size_t used;  /* ints in it */
+  size_t capacity;
+  pipeline_stage_stats_t *stats;
+} token_writer_t;
+
+static void writer_flush(token_writer_t *w) {
+  if (w->slot == NULL)
+    return;
+  if (w->used > 0) {
+    shm_ring_publish(w->out, w->used * sizeof(int));
+    w->stats->batches++;
+  }
+  w->slot = NULL;
+  w->used = 0;
+}
+
+/* Append a token (length code points + NUL; length 0: corpus boundary). */
+static void writer_put(token_writer_t *w, const int *token, size_t length) {
+  if (w->slot && w->used + length + 1 > w->capacity)
+    writer_flush(w);
+  if (w->slot == NULL) {
+    if (shm_ring_failed(w->out))
+      return;
+    w->slot = shm_ring_reserve(w->out);
+    if (w->slot == NULL)
+      return;
+  }
+  if (length > 0)
+    memcpy(w->slot + w->used, token, length * sizeof(int));
+  w->slot[w->used + length] = '\0';
+  w->used += length + 1;
+}
+
+static void token_sink(void *ctx, const int *token, size_t length) {
+  token_writer_t *w = ctx;
+  writer_put(w, token, length);
+  w->stats->items++;
+}
+
+static int run_tokenizer(shm_ring_t *in, shm_ring_t *out,
+                         pipeline_stats_t *stats) {
+  uint64_t start = monotonic_ns();
+  token_writer_t writer = {out, NULL, 0,
+                           shm_ring_slot_bytes(out) / sizeof(int),
+                           &stats->tokenizer};
+  tokenizer_t *tok = create_tokenizer(token_sink, &writer);
+  const int *batch;
+  size_t bytes;
+  while (!shm_ring_failed(out) &&
+         (batch = shm_ring_peek(in, &bytes)) != NULL) {
+    if (bytes == 0) {
+      tokenizer_finish(tok);
+      writer_put(&writer, NULL, 0);
+    } else {
+      tokenizer_feed(tok, batch, bytes / sizeof(int));
+    }
+    shm_ring_release(in);
+  }
+  writer_flush(&writer);
+  free_tokenizer(tok);
+  stats->tokenizer.elapsed_ns = monotonic_ns() - start;
+  return shm_ring_failed(in) || shm_ring_failed(out) ? -1 : 0;
+}
+
+/* ---------------------------------------------------------------------
+ * Builder (the calling process): token batches into the trainer.
+ * ------------------------------------------------------------------- */
+
+static void run_builder(shm_ring_t *in, trainer_t *trainer,
+                        pipeline_stage_stats_t *stats) {
+  uint64_t start = monotonic_ns();
+  const int *batch;
+  size_t bytes;
+  while ((batch = shm_ring_peek(in, &bytes)) != NULL) {
+    size_t n = bytes / sizeof(int);
+    for (size_t i = 0; i < n; ++i) {
+      if (batch[i] == '\0') {
+        trainer_break(trainer);
+        continue;
+      }
+      trainer_add_word(trainer, batch + i);
+      stats->items++;
+      while (batch[i] != '\0')
+        i++;
+    }
+    stats->batches++;
+    shm_ring_release(in);
+  }
+  stats->elapsed_ns = monotonic_ns() - start;
+}
+
+/* Runs in the forked tokenizer process: forks the reader and never
+ * returns. */
+static void tokenizer_process(shm_ring_t *decoded, shm_ring_t *tokens,
+                              pid_t builder, const char *const *paths, int n,
+                              pipeline_stats_t *stats) {
+  shm_ring_set_peer(tokens, parent_alive, &builder);
+  pid_t self = getpid();
+  child_t reader = {fork(), 0, 0};
+  if (reader.pid < 0) {
+    perror("fork");
+    shm_ring_fail(tokens);
+    _exit(1);
+  }
+  if (reader.pid == 0) {
+    shm_ring_set_peer(decoded, parent_alive, &self);
+    if (run_reader(decoded, paths, n, stats) != 0) {
+      shm_ring_fail(decoded);
+      _exit(1);
+    }
+    shm_ring_close(decoded);
+    _exit(0);
+  }
+  shm_ring_set_peer(decoded, child_alive, &reader);
+  int rc = run_tokenizer(decoded, tokens, stats);
+  if (rc != 0) {
+    shm_ring_fail(decoded); /* stops the reader */
+    shm_ring_fail(tokens);
+  } else {
+    shm_ring_close(tokens);
+  }
+  _exit(child_join(&reader) && rc == 0 ? 0 : 1);
+}
+
+static void copy_waits(pipeline_stage_stats_t *stage,
+                       const shm_ring_stats_t *in,
+                       const shm_ring_stats_t *out) {
+  if (in) {
+    stage->starved = in->waits;
+    stage->starved_ns = in->wait_ns;
+  }
+  if (out) {
+    stage->stalled = out->waits;
+    stage->stalled_ns = out->wait_ns;
+  }
+}
+
+int pipeline_train(trainer_t *trainer, const char *const *paths, int n,
+                   const pipeline_config_t *config, pipeline_stats_t *stats) {
+  if (trainer == NULL) {
+    fprintf(stderr, "pipeline_train: trainer is NULL\n");
+    return -1;
+  }
+  size_t slots = config && config->ring_slots ? config->ring_slots
+                                              : DEFAULT_RING_SLOTS;
+  size_t slot_bytes = config && config->slot_bytes ? config->slot_bytes
+                                                   : DEFAULT_SLOT_BYTES;
+  if (slot_bytes < 4 * sizeof(int) * MAX_WORD_LENGTH) {
+    fprintf(stderr, "pipeline_train: batches of %zu bytes are too small\n",
+            slot_bytes);
+    return -1;
+  }
+  pipeline_stats_t *shared =
+      mmap(NULL, sizeof(pipeline_stats_t), PROT_READ | PROT_WRITE,
+           MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (shared == MAP_FAILED) {
+    perror("mmap");
+    return -1;
+  }
+  memset(shared, 0, sizeof(pipeline_stats_t));
+  shm_ring_t *decoded = create_shm_ring(slots, slot_bytes);
+  shm_ring_t *tokens = decoded ? create_shm_ring(slots, slot_bytes) : NULL;
+  if (tokens == NULL) {
+    free_shm_ring(decoded);
+    munmap(shared, sizeof(pipeline_stats_t));
+    return -1;
+  }
+
+  pid_t builder = getpid();
+  fflush(NULL); /* nothing buffered gets written twice */
+  child_t tokenizer = {fork(), 0, 0};
+  if (tokenizer.pid < 0) {
+    perror("fork");
+    free_shm_ring(decoded);
+    free_shm_ring(tokens);
+    munmap(shared, sizeof(pipeline_stats_t));
+    return -1;
+  }
+  if (tokenizer.pid == 0)
+    tokenizer_process(decoded, tokens, builder, paths, n, shared);
+
+  shm_ring_set_peer(tokens, child_alive, &tokenizer);
+  run_builder(tokens, trainer, &shared->builder);
+  int ok = child_join(&tokenizer) && !shm_ring_failed(tokens);
+
+  shm_ring_stats_t decoded_out, decoded_in, tokens_out, tokens_in;
+  shm_ring_get_stats(decoded, &decoded_out, &decoded_in);
+  shm_ring_get_stats(tokens, &tokens_out, &tokens_in);
+  copy_waits(&shared->reader, NULL, &decoded_out);
+  copy_waits(&shared->tokenizer, &decoded_in, &tokens_out);
+  copy_waits(&shared->builder, &tokens_in, NULL);
+  if (stats)
+    *stats = *shared;
+
+  free_shm_ring(decoded);
+  free_shm_ring(tokens);
+  munmap(shared, sizeof(pipeline_stats_t));
+  return ok ? 0 : -1;
+}
+
+static void print_stage(FILE *out, const char *name,
+                        const pipeline_stage_stats_t *s, const char *unit) {
+  double seconds = s->elapsed_ns / 1e9;
+  fprintf(out,
+          "%-10s %12llu %-6s %10.0f %s/s %8llu batches  starved %6llu "
+          "(%7.1f ms)  stalled %6llu (%7.1f ms)\n",
+          name, (unsigned long long)s->items, unit,
+          seconds > 0 ? s->items / seconds : 0.0, unit,
+          (unsigned long long)s->batches, (unsigned long long)s->starved,
+          s->starved_ns / 1e6, (unsigned long long)s->stalled,
+          s->stalled_ns / 1e6);
+}
+
+void pipeline_print_stats(const pipeline_stats_t *stats, FILE *out) {
+  print_stage(out, "reader", &stats->reader, "bytes");
+  print_stage(out, "tokenizer", &stats->tokenizer, "tokens");
+  print_stage(out, "builder", &stats->builder, "tokens");
+}
@@ -0,0 +1,499 @@
+#define _POSIX_C_SOURCE 200809L
+#include "../include/quant_model.h"
+#include "../include/generate.h"
+#include "../include/timing.h"
+#include "../include/utils.h"
+#include "../include/vocab.h"
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static uint64_t align8(uint64_t n) { return (n + 7) & ~(uint64_t)7; }
+
+static void quant_layout(quant_model_header_t *h, uint32_t num_words,
+                         uint64_t pool_len, uint64_t num_edges) {
+  uint64_t off = align8(sizeof(quant_model_header_t));
+  h->pool_off = off;
+  off += align8(pool_len * sizeof(int));
+  h->word_offsets_off = off;
+  off += (uint64_t)num_words * sizeof(uint64_t);
+  h->sorted_ids_off = off;
+  off += align8((uint64_t)num_words * sizeof(uint32_t));
+  h->row_offsets_off = off;
+  off += ((uint64_t)num_words + 1) * sizeof(uint64_t);
+  h->nexts_off = off;
+  off += align8(num_edges * sizeof(uint32_t));
+  h->probs_off = off;
+  off += align8(num_edges * (h->bits / 8));
+  h->aliases_off = off;
+  if (h->table == QUANT_ALIAS)
+    off += align8(num_edges * sizeof(uint32_t));
+  h->image_size = off;
+}
+
+static int check_rows(const quant_model_header_t *h, const char *base);
+
+static quant_model_t *quant_from_image(void *image, size_t size,
+                                       int mapped) {
+  const quant_model_header_t *h = image;
+  if (size < sizeof(quant_model_header_t) || h->magic != QUANT_MODEL_MAGIC) {
+    fprintf(stderr, "Not a quantized model image\n");
+    return NULL;
+  }
+  if (h->version != QUANT_MODEL_VERSION) {
+    fprintf(stderr, "Quantized model version %u, expected %u: quantize "
+                    "again\n",
+            h->version, QUANT_MODEL_VERSION);
+    return NULL;
+  }
+  quant_model_header_t expected = *h;
+  quant_layout(&expected, h->num_words, h->pool_len, h->num_edges);
+  char *base = image;
+  if ((h->bits != 8 && h->bits != 16) || h->table > QUANT_ALIAS ||
+      expected.image_size != h->image_size || h->image_size > size ||
+      expected.pool_off != h->pool_off ||
+      expected.word_offsets_off != h->word_offsets_off ||
+      expected.sorted_ids_off != h->sorted_ids_off ||
+      expected.row_offsets_off != h->row_offsets_off ||
+      expected.nexts_off != h->nexts_off ||
+      expected.probs_off != h->probs_off ||
+      expected.aliases_off != h->aliases_off || check_rows(h, base) != 0) {
+    fprintf(stderr, "Corrupted quantized model image\n");
+    return NULL;
+  }
+  quant_model_t *q = dmalloc_tag(sizeof(quant_model_t), MEM_MODEL);
+  q->header = h;
+  q->pool = (const int *)(base + h->pool_off);
+  q->word_offsets = (const uint64_t *)(base + h->word_offsets_off);
+  q->sorted_ids = (const uint32_t *)(base + h->sorted_ids_off);
+  q->row_offsets = (const uint64_t *)(base + h->row_offsets_off);
+  q->nexts = (const uint32_t *)(base + h->nexts_off);
+  q->probs = base + h->probs_off;
+  q->aliases = (const uint32_t *)(base + h->aliases_off);
+  q->image = image;
+  q->image_size = size;
+  q->mapped = mapped;
+  return q;
+}
+
+/* ------------------------------------------------------------------
+ * Quantization
+ * ------------------------------------------------------------------ */
+typedef struct {
+  uint64_t rem;
+  uint32_t index;
+} remainder_t;
+
+/* Largest remainder first, then lowest index: deterministic. */
+static int cmp_remainder(const void *a, const void *b) {
+  const remainder_t *x = a, *y = b;
+  if (x->rem != y->rem)
+    return x->rem < y->rem ? 1 : -1;
+  return (x->index > y->index) - (x->index < y->index);
+}
+
+/* Split scale quanta over the n followers of row, in proportion to their
+ * counts. Returns the largest probability error of the row. */
+static double quantize_row(const model_edge_t *row, uint32_t n,
+                           uint64_t total, uint32_t scale, uint32_t *quanta,
+                           remainder_t *scratch) {
+  uint64_t given = 0;
+  for (uint32_t i = 0; i < n; ++i) {
+    uint64_t scaled = (uint64_t)row[i].count * scale;
+    quanta[i] = (uint32_t)(scaled / total);
+    scratch[i].rem = scaled % total;
+    scratch[i].index = i;
+    given += quanta[i];
+  }
+  uint64_t missing = scale - given; /* < n: each floor lost less than 1 */
+  if (missing > 0) {
+    qsort(scratch, n, sizeof(remainder_t), cmp_remainder);
+    for (uint64_t k = 0; k < missing; ++k)
+      quanta[scratch[k].index]++;
+  }
+  double worst = 0;
+  for (uint32_t i = 0; i < n; ++i) {
+    double error = fabs((double)quanta[i] / scale -
+                        (double)row[i].count / (double)total);
+    if (error > worst)
+      worst = error;
+  }
+  return worst;
+}
+
+static void put_prob(void *probs, unsigned bits, uint64_t k, uint32_t v) {
+  if (bits == 8)
+    ((uint8_t *)probs)[k] = (uint8_t)v;
+  else
+    ((uint16_t *)probs)[k] = (uint16_t)v;
+}
+
+static inline uint32_t get_prob(const quant_model_t *quant, uint64_t k) {
+  if (quant->header->bits == 8)
+    return ((const uint8_t *)quant->probs)[k];
+  return ((const uint16_t *)quant->probs)[k];
+}
+
+/* Vose's alias table of the m quanta q (summing to scale), in integers:
+ * slot weights q_i * m against a capacity of scale per slot. */
+static void build_alias(const uint32_t *q, uint32_t m, uint32_t scale,
+                        uint64_t *weight, uint32_t *small, uint32_t *large,
+                        void *probs, unsigned bits, uint32_t *aliases) {
+  uint32_t ns = 0, nl = 0;
+  for (uint32_t i = 0; i < m; ++i) {
+    weight[i] = (uint64_t)q[i] * m;
+    if (weight[i] < scale)
+      small[ns++] = i;
+    else
+      large[nl++] = i;
+  }
+  while (ns > 0 && nl > 0) {
+    uint32_t l = small[--ns], g = large[--nl];
+    put_prob(probs, bits, l, (uint32_t)weight[l]);
+    aliases[l] = g;
+    weight[g] -= scale - weight[l];
+    if (weight[g] < scale)
+      small[ns++] = g;
+    else
+      large[nl++] = g;
+  }
+  /* full slots (exactly scale left, the arithmetic being exact): the
+   * threshold cannot hold scale, so they alias themselves */
+  while (nl > 0) {
+    uint32_t g = large[--nl];
+    put_prob(probs, bits, g, scale - 1);
+    aliases[g] = g;
+  }
+  while (ns > 0) {
+    uint32_t l = small[--ns];
+    put_prob(probs, bits, l, scale - 1);
+    aliases[l] = l;
+  }
+}
+
+/* Section contents: word offsets inside a terminated pool, sorted IDs
+ * and followers below num_words, rows in order covering the edges;
+ * cumulative quanta increasing to 2^bits - 1, alias entries inside their
+ * row. */
+static int check_rows(const quant_model_header_t *h, const char *base) {
+  const int *pool = (const int *)(base + h->pool_off);
+  const uint64_t *words = (const uint64_t *)(base + h->word_offsets_off);
+  const uint32_t *sorted = (const uint32_t *)(base + h->sorted_ids_off);
+  const uint64_t *rows = (const uint64_t *)(base + h->row_offsets_off);
+  const uint32_t *nexts = (const uint32_t *)(base + h->nexts_off);
+  const void *probs = base + h->probs_off;
+  const uint32_t *aliases = (const uint32_t *)(base + h->aliases_off);
+  if (rows[0] != 0 || rows[h->num_words] != h->num_edges)
+    return -1;
+  if (h->pool_len ? pool[h->pool_len - 1] != '\0' : h->num_words != 0)
+    return -1;
+  for (uint32_t id = 0; id < h->num_words; ++id) {
+    if (rows[id] > rows[id + 1] || words[id] >= h->pool_len ||
+        sorted[id] >= h->num_words)
+      return -1;
+    uint64_t m = rows[id + 1] - rows[id];
+    for (uint64_t k = rows[id]; k < rows[id + 1]; ++k) {
+      if (nexts[k] >= h->num_words)
+        return -1;
+      if (h->table == QUANT_ALIAS && aliases[k] >= m)
+        return -1;
+    }
+    if (h->table == QUANT_CDF && m > 0) {
+      uint32_t previous = 0;
+      for (uint64_t k = rows[id]; k < rows[id + 1]; ++k) {
+        uint32_t value = h->bits == 8 ? ((const uint8_t *)probs)[k]
+                                      : ((const uint16_t *)probs)[k];
+        if (k > rows[id] && value <= previous)
+          return -1;
+        previous = value;
+      }
+      if (previous != (1u << h->bits) - 1)
+        return -1;
+    }
+  }
+  return 0;
+}
+
+/* ------------------------------------------------------------------
+ * Build, save, load
+ * ------------------------------------------------------------------ */
+quant_model_t *quant_model_build(const model_t *model, unsigned bits,
+                                 quant_table_t table) {
+  if (model == NULL || (bits != 8 && bits != 16) ||
+      (table != QUANT_CDF && table != QUANT_ALIAS)) {
+    fprintf(stderr, "quant_model_build: no model, or not 8/16 bits\n");
+    return NULL;
+  }
+  uint32_t n = model_num_words(model);
+  uint32_t scale = 1u << bits;
+  uint64_t edges = model_num_edges(model);
+  uint32_t widest = 0;
+  for (uint32_t id = 0; id < n; ++id)
+    if (model->row_offsets[id + 1] - model->row_offsets[id] > widest)
+      widest = (uint32_t)(model->row_offsets[id + 1] - model->row_offsets[id]);
+
+  /* quanta of every edge, then only the nonzero ones are kept */
+  uint32_t *quanta = dmalloc(sizeof(uint32_t) * (edges + 1));
+  remainder_t *scratch = dmalloc(sizeof(remainder_t) * ((size_t)widest + 1));
+  double max_error = 0;
+  uint64_t kept = 0;
+  for (uint32_t id = 0; id < n; ++id) {
+    uint32_t len;
+    const model_edge_t *row = model_followers(model, id, &len);
+    if (len == 0)
+      continue;
+    uint32_t *q = quanta + model->row_offsets[id];
+    double error =
+        quantize_row(row, len, model_row_total(model, id), scale, q, scratch);
+    if (error > max_error)
+      max_error = error;
+    for (uint32_t i = 0; i < len; ++i)
+      kept += q[i] > 0;
+  }
+  dfree(scratch);
+
+  const model_header_t *mh = model->header;
+  quant_model_header_t h;
+  memset(&h, 0, sizeof(h));
+  h.magic = QUANT_MODEL_MAGIC;
+  h.version = QUANT_MODEL_VERSION;
+  h.num_words = n;
+  h.bits = bits;
+  h.table = table;
+  h.num_edges = kept;
+  h.dropped = edges - kept;
+  h.max_error = max_error;
+  h.pool_len = mh->pool_len;
+  quant_layout(&h, n, mh->pool_len, kept);
+
+  char *image = dmalloc_tag(h.image_size, MEM_MODEL);
+  memcpy(image, &h, sizeof(h));
+  memcpy(image + h.pool_off, model->pool, sizeof(int) * mh->pool_len);
+  memcpy(image + h.word_offsets_off, model->word_offsets,
+         sizeof(uint64_t) * n);
+  memcpy(image + h.sorted_ids_off, model->sorted_ids, sizeof(uint32_t) * n);
+  uint64_t *row_offsets = (uint64_t *)(image + h.row_offsets_off);
+  uint32_t *nexts = (uint32_t *)(image + h.nexts_off);
+  void *probs = image + h.probs_off;
+  uint32_t *aliases = (uint32_t *)(image + h.aliases_off);
+
+  uint32_t *q = dmalloc(sizeof(uint32_t) * ((size_t)widest + 1));
+  uint64_t *weight = NULL;
+  uint32_t *small = NULL, *large = NULL;
+  if (table == QUANT_ALIAS) {
+    weight = dmalloc(sizeof(uint64_t) * ((size_t)widest + 1));
+    small = dmalloc(sizeof(uint32_t) * ((size_t)widest + 1));
+    large = dmalloc(sizeof(uint32_t) * ((size_t)widest + 1));
+  }
+  uint64_t k = 0;
+  for (uint32_t id = 0; id < n; ++id) {
+    uint32_t len;
+    const model_edge_t *row = model_followers(model, id, &len);
+    const uint32_t *all = quanta + model->row_offsets[id];
+    row_offsets[id] = k;
+    uint32_t m = 0;
+    for (uint32_t i = 0; i < len; ++i) {
+      if (all[i] == 0)
+        continue;
+      nexts[k + m] = row[i].next;
+      q[m++] = all[i];
+    }
+    if (table == QUANT_CDF) {
+      uint32_t cumulative = 0;
+      for (uint32_t i = 0; i < m; ++i) {
+        cumulative += q[i];
+        put_prob(probs, bits, k + i, cumulative - 1);
+      }
+    } else if (m > 0) {
+      void *row_probs = (char *)probs + k * (bits / 8);
+      build_alias(q, m, scale, weight, small, large, row_probs, bits,
+                  aliases + k);
+    }
+    k += m;
+  }
+  row_offsets[n] = k;
+  dfree(large);
+  dfree(small);
+  dfree(weight);
+  dfree(q);
+  dfree(quanta);
+  return quant_from_image(image, h.image_size, 0);
+}
+
+int quant_model_save(const quant_model_t *quant, const char *path) {
+  if (quant == NULL || path == NULL)
+    return -1;
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    perror(path);
+    return -1;
+  }
+  int rc = write_all(fd, quant->image, quant->header->image_size);
+  if (close(fd) != 0)
+    rc = -1;
+  if (rc != 0)
+    perror(path);
+  return rc;
+}
+
+quant_model_t *quant_model_load(const char *path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    perror(path);
+    return NULL;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 ||
+      st.st_size < (off_t)sizeof(quant_model_header_t)) {
+    fprintf(stderr, "%s: not a quantized model file\n", path);
+    close(fd);
+    return NULL;
+  }
+  void *image = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (image == MAP_FAILED) {
+    perror(path);
+    return NULL;
+  }
+  quant_model_t *quant = quant_from_image(image, (size_t)st.st_size, 1);
+  if (quant == NULL)
+    munmap(image, (size_t)st.st_size);
+  return quant;
+}
+
+int quant_model_probe(const char *path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return 0;
+  uint32_t magic = 0;
+  ssize_t got = read_full(fd, &magic, sizeof(magic));
+  close(fd);
+  return got == (ssize_t)sizeof(magic) && magic == QUANT_MODEL_MAGIC;
+}
+
+void free_quant_model(quant_model_t *quant) {
+  if (quant == NULL)
+    return;
+  if (quant->mapped)
+    munmap(quant->image, quant->image_size);
+  else
+    dfree(quant->image);
+  dfree(quant);
+}
+
+/* ------------------------------------------------------------------
+ * Queries
+ * ------------------------------------------------------------------ */
+uint32_t quant_model_num_words(const quant_model_t *quant) {
+  return quant ? quant->header->num_words : 0;
+}
+
+uint64_t quant_model_num_edges(const quant_model_t *quant) {
+  return quant ? quant->header->num_edges : 0;
+}
+
+const int *quant_model_word(const quant_model_t *quant, uint32_t id) {
+  if (quant == NULL || id >= quant->header->num_words)
+    return NULL;
+  return quant->pool + quant->word_offsets[id];
+}
+
+uint32_t quant_model_find(const quant_model_t *quant, const int *word) {
+  if (quant == NULL || word == NULL)
+    return VOCAB_NO_ID;
+  uint32_t lo = 0, hi = quant->header->num_words;
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    uint32_t id = quant->sorted_ids[mid];
+    int cmp = model_word_cmp(quant_model_word(quant, id), word);
+    if (cmp == 0)
+      return id;
+    if (cmp < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return VOCAB_NO_ID;
+}
+
+uint32_t quant_model_followers(const quant_model_t *quant, uint32_t id,
+                               model_edge_t *out) {
+  if (quant == NULL || id >= quant->header->num_words)
+    return 0;
+  uint64_t first = quant->row_offsets[id];
+  uint32_t m = (uint32_t)(quant->row_offsets[id + 1] - first);
+  uint32_t scale = 1u << quant->header->bits;
+  for (uint32_t i = 0; i < m; ++i)
+    out[i].next = quant->nexts[first + i];
+  if (quant->header->table == QUANT_CDF) {
+    uint32_t previous = 0;
+    for (uint32_t i = 0; i < m; ++i) {
+      uint32_t cumulative = get_prob(quant, first + i) + 1;
+      out[i].count = cumulative - previous;
+      previous = cumulative;
+    }
+    return m;
+  }
+  /* every slot splits scale between itself and its alias: follower i
+   * collects q_i * m */
+  uint64_t *mass = dmalloc(sizeof(uint64_t) * ((size_t)m + 1));
+  for (uint32_t j = 0; j < m; ++j) {
+    uint32_t keep = get_prob(quant, first + j);
+    mass[j] += keep;
+    mass[quant->aliases[first + j]] += scale - keep;
+  }
+  for (uint32_t i = 0; i < m; ++i)
+    out[i].count = (uint32_t)(mass[i] / m);
+  dfree(mass);
+  return m;
+}
+
+static uint32_t draw(const quant_model_t *quant, uint32_t id, uint64_t x) {
+  uint64_t first = quant->row_offsets[id];
+  uint32_t m = (uint32_t)(quant->row_offsets[id + 1] - first);
+  if (m == 0)
+    return VOCAB_NO_ID;
+  unsigned bits = quant->header->bits;
+  if (quant->header->table == QUANT_ALIAS) {
+    /* high half picks the slot, low bits the side */
+    uint32_t j = (uint32_t)(((x >> 32) * m) >> 32);
+    uint32_t r = (uint32_t)(x & ((1u << bits) - 1));
+    if (r >= get_prob(quant, first + j))
+      j = quant->aliases[first + j];
+    return quant->nexts[first + j];
+  }
+  uint32_t r = (uint32_t)(x >> (64 - bits));
+  uint32_t lo = 0, hi = m - 1; /* the last value is scale - 1 >= r */
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    if (get_prob(quant, first + mid) >= r)
+      hi = mid;
+    else
+      lo = mid + 1;
+  }
+  return quant->nexts[first + lo];
+}
+
+uint32_t quant_model_next(const quant_model_t *quant, uint32_t id,
+                          uint64_t *state) {
+  if (quant == NULL || id >= quant->header->num_words)
+    return VOCAB_NO_ID;
+  TIMER_START(start);
+  uint32_t next = draw(quant, id, generate_rand(state));
+  TIMER_STOP(TIMING_GENERATE_STEP, start);
+  return next;
+}
+
+size_t quant_model_walk(const quant_model_t *quant, uint32_t start,
+                        uint32_t *out, size_t max, uint64_t *state) {
+  size_t n = 0;
+  uint32_t id = start;
+  while (n < max && (id = quant_model_next(quant, id, state)) != VOCAB_NO_ID)
+    out[n++] = id;
+  return n;
+}
@@ -0,0 +1,182 @@
+#define _POSIX_C_SOURCE 200809L
+#include "../include/radix_sort.h"
+#include "../include/utils.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#define RADIX_BUCKETS 256
+#define RADIX_PASSES 8
+/* Below this many keys per thread the extra threads cost more than they
+ * save. */
+#define MIN_KEYS_PER_THREAD (1 << 16)
+
+typedef struct radix_job radix_job_t;
+
+typedef struct {
+  radix_job_t *job;
+  int index;
+  int runs;                      /* slices run by the thread from this one */
+  size_t lo, hi;                 /* slice of the array */
+  size_t count[RADIX_BUCKETS];   /* histogram, then scatter cursor */
+  uint64_t or_bits, and_bits;
+} radix_worker_t;
+
+struct radix_job {
+  uint64_t *keys, *scratch;
+  size_t n;
+  int threads;                   /* slices */
+  int running;                   /* threads running them, caller included */
+  radix_worker_t *workers;
+  pthread_mutex_t gate;          /* held until running is known */
+  pthread_barrier_t barrier;
+  int shifts[RADIX_PASSES]; /* active passes, filled by worker 0 */
+  int num_passes;
+};
+
+static void radix_barrier(radix_job_t *job) {
+  if (job->running > 1)
+    pthread_barrier_wait(&job->barrier);
+}
+
+/* Run the slices first .. first + first->runs - 1, in step with the other
+ * threads. */
+static void *radix_worker(void *arg) {
+  radix_worker_t *first = arg;
+  radix_worker_t *last = first + first->runs;
+  radix_job_t *job = first->job;
+
+  /* Find the bytes that actually vary between keys. */
+  for (radix_worker_t *w = first; w < last; ++w) {
+    uint64_t or_bits = 0, and_bits = ~(uint64_t)0;
+    for (size_t i = w->lo; i < w->hi; ++i) {
+      or_bits |= job->keys[i];
+      and_bits &= job->keys[i];
+    }
+    w->or_bits = or_bits;
+    w->and_bits = and_bits;
+  }
+  radix_barrier(job);
+  if (first->index == 0) {
+    uint64_t or_bits = job->workers[0].or_bits;
+    uint64_t and_bits = job->workers[0].and_bits;
+    for (int t = 1; t < job->threads; ++t) {
+      or_bits |= job->workers[t].or_bits;
+      and_bits &= job->workers[t].and_bits;
+    }
+    uint64_t varying = or_bits ^ and_bits;
+    job->num_passes = 0;
+    for (int b = 0; b < RADIX_PASSES; ++b) {
+      if ((varying >> (8 * b)) & 0xFF)
+        job->shifts[job->num_passes++] = 8 * b;
+    }
+  }
+  radix_barrier(job);
+
+  uint64_t *src = job->keys, *dst = job->scratch;
+  for (int p = 0; p < job->num_passes; ++p) {
+    int shift = job->shifts[p];
+    for (radix_worker_t *w = first; w < last; ++w) {
+      memset(w->count, 0, sizeof(w->count));
+      for (size_t i = w->lo; i < w->hi; ++i)
+        w->count[(src[i] >> shift) & 0xFF]++;
+    }
+    radix_barrier(job);
+
+    if (first->index == 0) {
+      /* Turn the per-thread histograms into scatter offsets: digit-major,
+       * thread-minor, which keeps the sort stable. */
+      size_t offset = 0;
+      for (int d = 0; d < RADIX_BUCKETS; ++d) {
+        for (int t = 0; t < job->threads; ++t) {
+          size_t c = job->workers[t].count[d];
+          job->workers[t].count[d] = offset;
+          offset += c;
+        }
+      }
+    }
+    radix_barrier(job);
+
+    for (radix_worker_t *w = first; w < last; ++w) {
+      for (size_t i = w->lo; i < w->hi; ++i) {
+        uint64_t key = src[i];
+        dst[w->count[(key >> shift) & 0xFF]++] = key;
+      }
+    }
+    radix_barrier(job);
+
+    uint64_t *tmp = src;
+    src = dst;
+    dst = tmp;
+  }
+  return NULL;
+}
+
+static void *radix_thread(void *arg) {
+  radix_worker_t *w = arg;
+  pthread_mutex_lock(&w->job->gate);
+  pthread_mutex_unlock(&w->job->gate);
+  return radix_worker(w);
+}
+
+void radix_sort_u64(uint64_t *keys, uint64_t *scratch, size_t n,
+                    int threads) {
+  if (keys == NULL || scratch == NULL || n < 2)
+    return;
+  if (threads < 1)
+    threads = 1;
+  size_t max_threads = n / MIN_KEYS_PER_THREAD;
+  if (max_threads < 1)
+    max_threads = 1;
+  if ((size_t)threads > max_threads)
+    threads = (int)max_threads;
+
+  radix_job_t job;
+  memset(&job, 0, sizeof(job));
+  job.keys = keys;
+  job.scratch = scratch;
+  job.n = n;
+  job.threads = threads;
+  job.workers = dmalloc(sizeof(radix_worker_t) * threads);
+  for (int t = 0; t < threads; ++t) {
+    job.workers[t].job = &job;
+    job.workers[t].index = t;
+    job.workers[t].lo = n * t / threads;
+    job.workers[t].hi = n * (t + 1) / threads;
+  }
+
+  /* One thread per slice but the last, which is the caller's. The workers
+   * wait at the gate until the barrier knows how many of them started; the
+   * caller runs the slices of those that did not. */
+  pthread_t *tids = dmalloc(sizeof(pthread_t) * threads);
+  int started = 0;
+  pthread_mutex_init(&job.gate, NULL);
+  pthread_mutex_lock(&job.gate);
+  for (; started < threads - 1; ++started) {
+    job.workers[started].runs = 1;
+    int rc = pthread_create(&tids[started], NULL, radix_thread,
+                            &job.workers[started]);
+    if (rc != 0) {
+      fprintf(stderr, "radix_sort_u64: cannot start worker thread: %s\n",
+              strerror(rc));
+      break; /* the slices left are sorted here */
+    }
+  }
+  job.workers[started].runs = threads - started;
+  job.running = started + 1;
+  if (job.running > 1)
+    pthread_barrier_init(&job.barrier, NULL, (unsigned)job.running);
+  pthread_mutex_unlock(&job.gate);
+  radix_worker(&job.workers[started]);
+  for (int t = 0; t < started; ++t)
+    pthread_join(tids[t], NULL);
+  if (job.running > 1)
+    pthread_barrier_destroy(&job.barrier);
+  pthread_mutex_destroy(&job.gate);
+  dfree(tids);
+
+  /* An odd number of passes leaves the result in scratch. */
+  if (job.num_passes % 2 == 1)
+    memcpy(keys, scratch, sizeof(uint64_t) * n);
+  dfree(job.workers);
+}
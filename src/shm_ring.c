@@ -0,0 +1,213 @@
+#define _POSIX_C_SOURCE 200809L
+#include "../include/shm_ring.h"
+#include "../include/utils.h"
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#define CACHE_LINE 64
+#define SPIN_ROUNDS 64
+#define YIELD_ROUNDS 256
+#define SLEEP_NS 50000
+
+/* Shared part, at the start of the segment; slot lengths and the slots
+ * follow. Every line is written by one side only. */
+typedef struct {
+  uint64_t head; /* batches published: producer */
+  shm_ring_stats_t producer;
+  char pad0[CACHE_LINE - sizeof(uint64_t) - sizeof(shm_ring_stats_t)];
+  uint64_t tail; /* batches released: consumer */
+  shm_ring_stats_t consumer;
+  char pad1[CACHE_LINE - sizeof(uint64_t) - sizeof(shm_ring_stats_t)];
+  uint32_t closed;
+  uint32_t failed;
+  uint64_t slots;
+  uint64_t slot_bytes;
+} ring_header_t;
+
+struct shm_ring {
+  ring_header_t *header;
+  uint64_t *lengths;     /* bytes held by every slot */
+  unsigned char *data;   /* slots * slot_bytes */
+  size_t map_bytes;
+  int (*alive)(void *ctx);
+  void *alive_ctx;
+};
+
+shm_ring_t *create_shm_ring(size_t slots, size_t slot_bytes) {
+  if (slots < 2 || slot_bytes == 0) {
+    fprintf(stderr, "create_shm_ring: need at least 2 non empty slots\n");
+    return NULL;
+  }
+  static unsigned counter;
+  char name[64];
+  snprintf(name, sizeof name, "/markov_first-%ld-%u", (long)getpid(),
+           counter++);
+  int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd < 0) {
+    perror("shm_open");
+    return NULL;
+  }
+  shm_unlink(name); /* the mappings keep it alive */
+
+  size_t lengths_offset = sizeof(ring_header_t);
+  size_t data_offset =
+      (lengths_offset + sizeof(uint64_t) * slots + CACHE_LINE - 1) &
+      ~(size_t)(CACHE_LINE - 1);
+  size_t map_bytes = data_offset + slots * slot_bytes;
+  if (ftruncate(fd, (off_t)map_bytes) != 0) {
+    perror("ftruncate");
+    close(fd);
+    return NULL;
+  }
+  void *base =
+      mmap(NULL, map_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    perror("mmap");
+    return NULL;
+  }
+
+  shm_ring_t *ring = dmalloc(sizeof(shm_ring_t));
+  ring->header = base; /* zero filled by ftruncate */
+  ring->header->slots = slots;
+  ring->header->slot_bytes = slot_bytes;
+  ring->lengths = (uint64_t *)((char *)base + lengths_offset);
+  ring->data = (unsigned char *)base + data_offset;
+  ring->map_bytes = map_bytes;
+  return ring;
+}
+
+void free_shm_ring(shm_ring_t *ring) {
+  if (ring == NULL)
+    return;
+  munmap(ring->header, ring->map_bytes);
+  dfree(ring);
+}
+
+size_t shm_ring_slot_bytes(const shm_ring_t *ring) {
+  return ring->header->slot_bytes;
+}
+
+void shm_ring_set_peer(shm_ring_t *ring, int (*alive)(void *ctx), void *ctx) {
+  ring->alive = alive;
+  ring->alive_ctx = ctx;
+}
+
+/* One round of waiting: spin, then yield, then sleep and check the peer.
+ * Returns 0 if the peer is gone. */
+static int wait_round(shm_ring_t *ring, unsigned *round, uint64_t *start) {
+  if (*round == 0)
+    *start = monotonic_ns();
+  ++*round;
+  if (*round < SPIN_ROUNDS) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+    return 1;
+  }
+  if (*round < YIELD_ROUNDS) {
+    sched_yield();
+    return 1;
+  }
+  struct timespec pause = {0, SLEEP_NS};
+  nanosleep(&pause, NULL);
+  return ring->alive == NULL || ring->alive(ring->alive_ctx);
+}
+
+static void wait_done(shm_ring_stats_t *stats, unsigned round,
+                      uint64_t start) {
+  if (round == 0)
+    return;
+  stats->waits++;
+  stats->wait_ns += monotonic_ns() - start;
+}
+
+void *shm_ring_reserve(shm_ring_t *ring) {
+  ring_header_t *h = ring->header;
+  uint64_t head = h->head;
+  unsigned round = 0;
+  uint64_t start = 0;
+  void *slot = NULL;
+  for (;;) {
+    if (__atomic_load_n(&h->failed, __ATOMIC_ACQUIRE))
+      break;
+    if (head - __atomic_load_n(&h->tail, __ATOMIC_ACQUIRE) < h->slots) {
+      slot = ring->data + (head % h->slots) * h->slot_bytes;
+      break;
+    }
+    if (!wait_round(ring, &round, &start)) {
+      shm_ring_fail(ring);
+      break;
+    }
+  }
+  wait_done(&h->producer, round, start);
+  return slot;
+}
+
+void shm_ring_publish(shm_ring_t *ring, size_t bytes) {
+  ring_header_t *h = ring->header;
+  ring->lengths[h->head % h->slots] = bytes;
+  h->producer.batches++;
+  h->producer.bytes += bytes;
+  __atomic_store_n(&h->head, h->head + 1, __ATOMIC_RELEASE);
+}
+
+void shm_ring_close(shm_ring_t *ring) {
+  __atomic_store_n(&ring->header->closed, 1, __ATOMIC_RELEASE);
+}
+
+void shm_ring_fail(shm_ring_t *ring) {
+  __atomic_store_n(&ring->header->failed, 1, __ATOMIC_RELEASE);
+}
+
+const void *shm_ring_peek(shm_ring_t *ring, size_t *bytes) {
+  ring_header_t *h = ring->header;
+  uint64_t tail = h->tail;
+  unsigned round = 0;
+  uint64_t start = 0;
+  const void *slot = NULL;
+  for (;;) {
+    /* closed is read before head: a batch published before closing is
+     * seen by the head load that follows */
+    uint32_t closed = __atomic_load_n(&h->closed, __ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&h->head, __ATOMIC_ACQUIRE) != tail) {
+      slot = ring->data + (tail % h->slots) * h->slot_bytes;
+      *bytes = ring->lengths[tail % h->slots];
+      break;
+    }
+    if (closed || __atomic_load_n(&h->failed, __ATOMIC_ACQUIRE))
+      break;
+    if (!wait_round(ring, &round, &start)) {
+      /* the producer may have closed just before going away */
+      if (!__atomic_load_n(&h->closed, __ATOMIC_ACQUIRE) &&
+          __atomic_load_n(&h->head, __ATOMIC_ACQUIRE) == tail)
+        shm_ring_fail(ring);
+    }
+  }
+  wait_done(&h->consumer, round, start);
+  return slot;
+}
+
+void shm_ring_release(shm_ring_t *ring) {
+  ring_header_t *h = ring->header;
+  h->consumer.batches++;
+  h->consumer.bytes += ring->lengths[h->tail % h->slots];
+  __atomic_store_n(&h->tail, h->tail + 1, __ATOMIC_RELEASE);
+}
+
+int shm_ring_failed(const shm_ring_t *ring) {
+  return (int)__atomic_load_n(&ring->header->failed, __ATOMIC_ACQUIRE);
+}
+
+void shm_ring_get_stats(const shm_ring_t *ring, shm_ring_stats_t *producer,
+                        shm_ring_stats_t *consumer) {
+  if (producer)
+    *producer = ring->header->producer;
+  if (consumer)
+    *consumer = ring->header->consumer;
+}
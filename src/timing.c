@@ -0,0 +1,211 @@
+#include "../include/timing.h"
+#include "../include/utils.h"
+#include <pthread.h>
+#include <string.h>
+
+#define SUB_BITS 5
+#define SUB (1u << SUB_BITS)       /* linear buckets per power of two */
+#define DIRECT (2 * SUB)           /* values below have a bucket each */
+#define BUCKETS ((64 - SUB_BITS) * SUB)
+
+typedef struct thread_hist {
+  struct thread_hist *next;
+  uint64_t count[TIMING_POINTS];
+  uint64_t sum[TIMING_POINTS];
+  uint64_t min[TIMING_POINTS];
+  uint64_t max[TIMING_POINTS];
+  uint64_t buckets[TIMING_POINTS][BUCKETS];
+} thread_hist_t;
+
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static thread_hist_t *registry;
+static __thread thread_hist_t *mine;
+
+static pthread_once_t clock_once = PTHREAD_ONCE_INIT;
+static uint64_t base_ticks, base_ns;
+
+static void start_clock(void) {
+  base_ns = monotonic_ns();
+  base_ticks = timing_now();
+}
+
+int timing_enabled(void) {
+#ifdef TIMING_ENABLED
+  return 1;
+#else
+  return 0;
+#endif
+}
+
+static unsigned bucket_of(uint64_t v) {
+  if (v < DIRECT)
+    return (unsigned)v;
+  unsigned shift = 63 - (unsigned)__builtin_clzll(v) - SUB_BITS;
+  return (shift + 1) * SUB + (unsigned)(v >> shift) - SUB;
+}
+
+/* Middle of the values that fall in bucket b. */
+static uint64_t bucket_value(unsigned b) {
+  if (b < DIRECT)
+    return b;
+  unsigned shift = b / SUB - 1;
+  uint64_t low = (uint64_t)(b % SUB + SUB) << shift;
+  return low + ((uint64_t)1 << shift) / 2;
+}
+
+static thread_hist_t *register_thread(void) {
+  pthread_once(&clock_once, start_clock);
+  thread_hist_t *h = dmalloc(sizeof(thread_hist_t));
+  for (int p = 0; p < TIMING_POINTS; ++p)
+    h->min[p] = UINT64_MAX;
+  pthread_mutex_lock(&registry_lock);
+  h->next = registry;
+  registry = h;
+  pthread_mutex_unlock(&registry_lock);
+  return h;
+}
+
+void timing_record(timing_point_t point, uint64_t ticks) {
+  /* a delta with the top bit set is a clock that went backwards (TSC skew
+   * after a migration), not a duration: BUCKETS ends at 2^63 */
+  if ((unsigned)point >= TIMING_POINTS || ticks >> 63)
+    return;
+  thread_hist_t *h = mine;
+  if (h == NULL)
+    h = mine = register_thread();
+  h->count[point]++;
+  h->sum[point] += ticks;
+  if (ticks < h->min[point])
+    h->min[point] = ticks;
+  if (ticks > h->max[point])
+    h->max[point] = ticks;
+  h->buckets[point][bucket_of(ticks)]++;
+}
+
+double timing_ns_per_tick(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  pthread_once(&clock_once, start_clock);
+  uint64_t ticks = timing_now() - base_ticks;
+  uint64_t ns = monotonic_ns() - base_ns;
+  return ticks > 0 && ns > 0 ? (double)ns / (double)ticks : 1.0;
+#else
+  return 1.0; /* the ticks are nanoseconds */
+#endif
+}
+
+/* Merged buckets of point (BUCKETS entries) and the summary fields that
+ * do not need them. */
+static void merge(timing_point_t point, uint64_t *buckets,
+                  timing_summary_t *out) {
+  memset(out, 0, sizeof(timing_summary_t));
+  memset(buckets, 0, sizeof(uint64_t) * BUCKETS);
+  out->min = UINT64_MAX;
+  double sum = 0;
+  pthread_mutex_lock(&registry_lock);
+  for (const thread_hist_t *h = registry; h; h = h->next) {
+    if (h->count[point] == 0)
+      continue;
+    out->count += h->count[point];
+    sum += (double)h->sum[point];
+    if (h->min[point] < out->min)
+      out->min = h->min[point];
+    if (h->max[point] > out->max)
+      out->max = h->max[point];
+    for (unsigned b = 0; b < BUCKETS; ++b)
+      buckets[b] += h->buckets[point][b];
+  }
+  pthread_mutex_unlock(&registry_lock);
+  if (out->count == 0)
+    out->min = 0;
+  else
+    out->mean = sum / (double)out->count;
+}
+
+static uint64_t quantile(const uint64_t *buckets, const timing_summary_t *s,
+                         double q) {
+  if (s->count == 0)
+    return 0;
+  if (q <= 0)
+    return s->min;
+  if (q >= 1)
+    return s->max;
+  uint64_t rank = (uint64_t)(q * (double)s->count);
+  if ((double)rank < q * (double)s->count || rank == 0)
+    rank++; /* ceil, at least the first sample */
+  uint64_t seen = 0;
+  for (unsigned b = 0; b < BUCKETS; ++b) {
+    seen += buckets[b];
+    if (seen >= rank) {
+      uint64_t v = bucket_value(b);
+      return v < s->min ? s->min : v > s->max ? s->max : v;
+    }
+  }
+  return s->max;
+}
+
+uint64_t timing_summary(timing_point_t point, timing_summary_t *out) {
+  memset(out, 0, sizeof(timing_summary_t));
+  if ((unsigned)point >= TIMING_POINTS)
+    return 0;
+  uint64_t *buckets = dmalloc(sizeof(uint64_t) * BUCKETS);
+  merge(point, buckets, out);
+  out->p50 = quantile(buckets, out, 0.50);
+  out->p90 = quantile(buckets, out, 0.90);
+  out->p99 = quantile(buckets, out, 0.99);
+  out->p999 = quantile(buckets, out, 0.999);
+  dfree(buckets);
+  return out->count;
+}
+
+uint64_t timing_percentile(timing_point_t point, double q) {
+  if ((unsigned)point >= TIMING_POINTS)
+    return 0;
+  timing_summary_t s;
+  uint64_t *buckets = dmalloc(sizeof(uint64_t) * BUCKETS);
+  merge(point, buckets, &s);
+  uint64_t v = quantile(buckets, &s, q);
+  dfree(buckets);
+  return v;
+}
+
+const char *timing_point_name(timing_point_t point) {
+  static const char *const names[TIMING_POINTS] = {
+      "decode", "tokenize", "ht_insert", "follower update", "resize",
+      "generate step"};
+  return (unsigned)point < TIMING_POINTS ? names[point] : "?";
+}
+
+void timing_report(FILE *out) {
+  double ns = timing_ns_per_tick();
+  int header = 0;
+  for (int p = 0; p < TIMING_POINTS; ++p) {
+    timing_summary_t s;
+    if (timing_summary((timing_point_t)p, &s) == 0)
+      continue;
+    if (!header) {
+      fprintf(out, "%-16s %12s %10s %10s %10s %10s %10s %12s\n", "timer",
+              "count", "mean ns", "p50", "p90", "p99", "p99.9", "max");
+      header = 1;
+    }
+    fprintf(out, "%-16s %12llu %10.1f %10.1f %10.1f %10.1f %10.1f %12.1f\n",
+            timing_point_name((timing_point_t)p), (unsigned long long)s.count,
+            s.mean * ns, (double)s.p50 * ns, (double)s.p90 * ns,
+            (double)s.p99 * ns, (double)s.p999 * ns, (double)s.max * ns);
+  }
+  if (!header)
+    fprintf(out, "timing: no samples%s\n",
+            timing_enabled() ? "" : " (build with TIMERS=1)");
+}
+
+void timing_reset(void) {
+  pthread_mutex_lock(&registry_lock);
+  for (thread_hist_t *h = registry; h; h = h->next) {
+    memset(h->count, 0, sizeof(h->count));
+    memset(h->sum, 0, sizeof(h->sum));
+    memset(h->max, 0, sizeof(h->max));
+    memset(h->buckets, 0, sizeof(h->buckets));
+    for (int p = 0; p < TIMING_POINTS; ++p)
+      h->min[p] = UINT64_MAX;
+  }
+  pthread_mutex_unlock(&registry_lock);
+}
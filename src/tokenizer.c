@@ -0,0 +1,163 @@
+#include "../include/tokenizer.h"
+#include "../include/tokenizer_class_table.h"
+#include "../include/timing.h"
+#include "../include/train.h"
+#include "../include/utf8_tools.h"
+#include "../include/utils.h"
+#include "../include/word.h"
+#include <stdio.h>
+#include <unistd.h>
+
+#define READ_BUFFER (1 << 16)
+#define FEED_CHUNK 1024 /* bytes decoded per batch of code points */
+
+enum { STATE_START, STATE_WORD, NUM_STATES };
+
+/* Actions, applied in this order. */
+#define ACT_APPEND 1     /* add the code point to the word */
+#define ACT_APOSTROPHE 2 /* add '\'' to the word */
+#define ACT_EMIT_WORD 4  /* hand the word to the sink */
+#define ACT_EMIT_PUNCT 8 /* hand the code point to the sink */
+
+typedef struct {
+  unsigned char actions;
+  unsigned char next;
+} transition_t;
+
+static const transition_t transitions[NUM_STATES][4] = {
+    [STATE_START] =
+        {
+            [TOKEN_CLASS_SEPARATOR] = {0, STATE_START},
+            [TOKEN_CLASS_LETTER] = {ACT_APPEND, STATE_WORD},
+            [TOKEN_CLASS_APOSTROPHE] = {0, STATE_START},
+            [TOKEN_CLASS_PUNCT] = {ACT_EMIT_PUNCT, STATE_START},
+        },
+    [STATE_WORD] =
+        {
+            [TOKEN_CLASS_SEPARATOR] = {ACT_EMIT_WORD, STATE_START},
+            [TOKEN_CLASS_LETTER] = {ACT_APPEND, STATE_WORD},
+            [TOKEN_CLASS_APOSTROPHE] = {ACT_APOSTROPHE | ACT_EMIT_WORD,
+                                        STATE_START},
+            [TOKEN_CLASS_PUNCT] = {ACT_EMIT_WORD | ACT_EMIT_PUNCT,
+                                   STATE_START},
+        },
+};
+
+struct tokenizer {
+  token_sink_t sink;
+  void *ctx;
+  int state;
+  size_t len;                  /* code points seen in the current word */
+  int word[MAX_WORD_LENGTH];   /* the first MAX_WORD_LENGTH - 1 of them */
+  utf8_stream_t utf8;          /* UTF-8 sequence split between two feeds */
+  tokenizer_stats_t stats;
+};
+
+token_class_t token_class(int codepoint) {
+  if ((unsigned)codepoint >= CLASS_MAX_CODEPOINT)
+    return TOKEN_CLASS_SEPARATOR;
+  unsigned block = class_stage1[codepoint >> CLASS_BLOCK_SHIFT];
+  return (token_class_t)
+      class_blocks[(block << CLASS_BLOCK_SHIFT) | (codepoint & CLASS_BLOCK_MASK)];
+}
+
+tokenizer_t *create_tokenizer(token_sink_t sink, void *ctx) {
+  if (sink == NULL) {
+    fprintf(stderr, "create_tokenizer: sink is NULL\n");
+    return NULL;
+  }
+  tokenizer_t *tok = dmalloc(sizeof(tokenizer_t));
+  tok->sink = sink;
+  tok->ctx = ctx;
+  tok->state = STATE_START;
+  return tok;
+}
+
+static void emit_word(tokenizer_t *tok) {
+  size_t len = tok->len < MAX_WORD_LENGTH - 1 ? tok->len : MAX_WORD_LENGTH - 1;
+  if (tok->len > len)
+    tok->stats.cut++;
+  tok->word[len] = '\0';
+  tok->sink(tok->ctx, tok->word, len);
+  tok->stats.words++;
+  tok->len = 0;
+}
+
+static inline void step(tokenizer_t *tok, int codepoint) {
+  const transition_t *tr = &transitions[tok->state][token_class(codepoint)];
+  unsigned actions = tr->actions;
+  tok->state = tr->next;
+  if (actions == ACT_APPEND) { /* the common case */
+    if (tok->len < MAX_WORD_LENGTH - 1)
+      tok->word[tok->len] = codepoint;
+    tok->len++;
+    return;
+  }
+  if (actions & ACT_APOSTROPHE) {
+    if (tok->len < MAX_WORD_LENGTH - 1)
+      tok->word[tok->len] = '\'';
+    tok->len++;
+  }
+  if (actions & ACT_EMIT_WORD)
+    emit_word(tok);
+  if (actions & ACT_EMIT_PUNCT) {
+    int punct[2] = {codepoint, '\0'};
+    tok->sink(tok->ctx, punct, 1);
+    tok->stats.punct++;
+  }
+}
+
+void tokenizer_feed(tokenizer_t *tok, const int *codepoints, size_t n) {
+  for (size_t i = 0; i < n; ++i)
+    step(tok, codepoints[i]);
+}
+
+/* A malformed sequence separates tokens: it decodes as a ' '. */
+void tokenizer_feed_utf8(tokenizer_t *tok, const char *bytes, size_t len) {
+  TIMER_START(start);
+  int codepoints[FEED_CHUNK + 1];
+  tok->stats.bytes += len;
+  for (size_t i = 0; i < len; i += FEED_CHUNK) {
+    size_t part = len - i < FEED_CHUNK ? len - i : FEED_CHUNK;
+    size_t n = utf8_stream_decode(&tok->utf8, bytes + i, part, codepoints, ' ');
+    for (size_t k = 0; k < n; ++k)
+      step(tok, codepoints[k]);
+  }
+  tok->stats.invalid = tok->utf8.invalid;
+  TIMER_STOP(TIMING_TOKENIZE, start);
+}
+
+int tokenizer_feed_fd(tokenizer_t *tok, int fd) {
+  char *buffer = dmalloc(READ_BUFFER);
+  ssize_t n;
+  while ((n = read_full(fd, buffer, READ_BUFFER)) > 0)
+    tokenizer_feed_utf8(tok, buffer, (size_t)n);
+  dfree(buffer);
+  if (n < 0) {
+    perror("tokenizer_feed_fd");
+    return -1;
+  }
+  return 0;
+}
+
+void tokenizer_finish(tokenizer_t *tok) {
+  int replacement;
+  if (utf8_stream_finish(&tok->utf8, &replacement, ' ') > 0) {
+    tok->stats.invalid = tok->utf8.invalid;
+    step(tok, replacement);
+  }
+  if (tok->state == STATE_WORD)
+    emit_word(tok);
+  tok->state = STATE_START;
+}
+
+const tokenizer_stats_t *tokenizer_get_stats(const tokenizer_t *tok) {
+  return &tok->stats;
+}
+
+void free_tokenizer(tokenizer_t *tok) { dfree(tok); }
+
+void tokenizer_train_sink(void *trainer, const int *token, size_t length) {
+  (void)length;
+  trainer_add_word((trainer_t *)trainer, token);
+}
@@ -0,0 +1,408 @@
+#include "../include/train.h"
+#include "../include/hash_table.h"
+#include "../include/radix_sort.h"
+#include "../include/utf8_tools.h"
+#include "../include/utils.h"
+#include "../include/word.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TRAIN_INITIAL_SIZE 1024
+#define TRAIN_BATCH (4 * HT_BATCH_GROUP) /* pairs per ht_insert_batch */
+
+struct trainer {
+  train_config_t config;
+  uint64_t tokens;
+
+  /* TRAIN_BACKEND_HASH_TABLE */
+  hash_table_t *table;
+  int prev_word[MAX_WORD_LENGTH];
+  int has_prev;
+  ht_item *batch[TRAIN_BATCH]; /* pairs waiting for ht_insert_batch */
+  int batch_len;
+  ll_pool_t *followers; /* nodes of every follower list */
+
+  /* TRAIN_BACKEND_RADIX */
+  vocab_t *vocab;
+  uint32_t prev;
+  uint64_t *pairs;
+  size_t pairs_len;
+  size_t pairs_cap;
+
+  /* TRAIN_BACKEND_EXTERNAL */
+  ext_trainer_t *external;
+};
+
+trainer_t *create_trainer(const train_config_t *config) {
+  trainer_t *t = dmalloc(sizeof(trainer_t));
+  if (config)
+    t->config = *config;
+  if (t->config.threads < 1)
+    t->config.threads = 1;
+
+  switch (t->config.backend) {
+  case TRAIN_BACKEND_HASH_TABLE:
+    t->table = create_hash_table_ops(TRAIN_INITIAL_SIZE, word_hash,
+                                     word_hashtable_keycmp, &word_ht_item_ops);
+    t->followers = create_ll_pool(0);
+    break;
+  case TRAIN_BACKEND_RADIX:
+    t->vocab = create_vocab(TRAIN_INITIAL_SIZE);
+    t->prev = VOCAB_NO_ID;
+    break;
+  case TRAIN_BACKEND_EXTERNAL:
+    if (t->config.model_path == NULL) {
+      fprintf(stderr, "External training needs a model path\n");
+      dfree(t);
+      return NULL;
+    }
+    t->external = create_ext_trainer(&t->config.external);
+    if (t->external == NULL) {
+      dfree(t);
+      return NULL;
+    }
+    break;
+  default:
+    fprintf(stderr, "Unknown training backend\n");
+    dfree(t);
+    return NULL;
+  }
+  return t;
+}
+
+/* Lowercase and truncate word into out (MAX_WORD_LENGTH code points). */
+static void normalise_word(const int *word, int *out) {
+  size_t len = 0;
+  while (len < MAX_WORD_LENGTH - 1 && word[len] != '\0')
+    len++;
+  utf8_codepoints_to_lower(out, word, len);
+  out[len] = '\0';
+}
+
+static void hash_add_word(trainer_t *t, const int *word) {
+  if (t->has_prev) {
+    word_t prev = {t->prev_word, 1};
+    word_t next = {(int *)word, 1};
+    t->batch[t->batch_len++] =
+        word_ht_item_create_pooled(&prev, &next, t->followers);
+    if (t->batch_len == TRAIN_BATCH) {
+      ht_insert_batch(t->table, t->batch, t->batch_len);
+      t->batch_len = 0;
+    }
+  }
+  memcpy(t->prev_word, word, sizeof(t->prev_word));
+  t->has_prev = 1;
+}
+
+static void radix_add_word(trainer_t *t, const int *word) {
+  uint32_t id = vocab_intern(t->vocab, word);
+  if (t->prev != VOCAB_NO_ID) {
+    if (t->pairs_len == t->pairs_cap) {
+      t->pairs_cap = t->pairs_cap ? t->pairs_cap * 2 : 4096;
+      t->pairs = t->pairs
+                     ? drealloc(t->pairs, sizeof(uint64_t) * t->pairs_cap)
+                     : dmalloc_tag(sizeof(uint64_t) * t->pairs_cap, MEM_TRAIN);
+    }
+    t->pairs[t->pairs_len++] = (uint64_t)t->prev << 32 | id;
+  }
+  t->prev = id;
+}
+
+void trainer_add_word(trainer_t *t, const int *word) {
+  if (t == NULL || word == NULL || word[0] == '\0')
+    return;
+  int norm[MAX_WORD_LENGTH];
+  normalise_word(word, norm);
+  t->tokens++;
+
+  switch (t->config.backend) {
+  case TRAIN_BACKEND_HASH_TABLE:
+    hash_add_word(t, norm);
+    break;
+  case TRAIN_BACKEND_RADIX:
+    radix_add_word(t, norm);
+    break;
+  case TRAIN_BACKEND_EXTERNAL:
+    ext_trainer_add_word(t->external, norm);
+    break;
+  }
+}
+
+void trainer_break(trainer_t *t) {
+  if (t == NULL)
+    return;
+  t->has_prev = 0;
+  t->prev = VOCAB_NO_ID;
+  if (t->external)
+    ext_trainer_break(t->external);
+}
+
+/* Sort packed (prev << 32 | next) pairs of vocab IDs and count runs of
+ * equal keys into CSR rows. */
+static model_t *count_pairs(const vocab_t *vocab, uint64_t *pairs,
+                            size_t pairs_len, int threads) {
+  uint32_t n = vocab_size(vocab);
+  uint64_t *scratch =
+      dmalloc_tag(sizeof(uint64_t) * (pairs_len + 1), MEM_TRAIN);
+  radix_sort_u64(pairs, scratch, pairs_len, threads);
+
+  /* The sorted pairs are no longer needed once counted: reuse scratch for
+   * the edges (one edge is as large as one pair). */
+  model_edge_t *edges = (model_edge_t *)scratch;
+  uint64_t *rows = dmalloc(sizeof(uint64_t) * ((size_t)n + 1));
+  uint64_t num_edges = 0;
+  uint32_t row = 0;
+  size_t i = 0;
+  while (i < pairs_len) {
+    uint64_t key = pairs[i];
+    size_t j = i + 1;
+    while (j < pairs_len && pairs[j] == key)
+      j++;
+    uint32_t prev = (uint32_t)(key >> 32);
+    while (row < prev)
+      rows[++row] = num_edges;
+    edges[num_edges].next = (uint32_t)key;
+    edges[num_edges].count =
+        j - i > UINT32_MAX ? UINT32_MAX : (uint32_t)(j - i);
+    num_edges++;
+    i = j;
+  }
+  while (row < n)
+    rows[++row] = num_edges;
+  rows[0] = 0;
+
+  model_t *model = model_build(vocab, rows, edges);
+  dfree(rows);
+  dfree(scratch);
+  return model;
+}
+
+static model_t *radix_finish(trainer_t *t) {
+  return count_pairs(t->vocab, t->pairs, t->pairs_len, t->config.threads);
+}
+
+model_t *trainer_finish(trainer_t *t) {
+  if (t == NULL)
+    return NULL;
+  switch (t->config.backend) {
+  case TRAIN_BACKEND_HASH_TABLE:
+    ht_insert_batch(t->table, t->batch, t->batch_len);
+    t->batch_len = 0;
+    return model_from_word_table(t->table, t->config.threads);
+  case TRAIN_BACKEND_RADIX:
+    return radix_finish(t);
+  case TRAIN_BACKEND_EXTERNAL:
+    if (ext_trainer_finish(t->external, t->config.model_path) != 0)
+      return NULL;
+    return model_load(t->config.model_path);
+  }
+  return NULL;
+}
+
+model_t *trainer_merge(trainer_t *const *trainers, int n, int threads) {
+  for (int i = 0; i < n; ++i) {
+    if (trainers[i] == NULL ||
+        trainers[i]->config.backend != TRAIN_BACKEND_RADIX) {
+      fprintf(stderr, "trainer_merge: only radix trainers can be merged\n");
+      return NULL;
+    }
+  }
+
+  /* The union of the dictionaries, numbered in code point order. */
+  vocab_t *all = create_vocab(TRAIN_INITIAL_SIZE);
+  size_t pairs_len = 0;
+  for (int i = 0; i < n; ++i) {
+    for (uint32_t id = 0; id < vocab_size(trainers[i]->vocab); ++id)
+      vocab_intern(all, vocab_word(trainers[i]->vocab, id));
+    pairs_len += trainers[i]->pairs_len;
+  }
+  uint32_t *order = vocab_sorted_ids(all);
+  vocab_t *vocab = create_vocab((int)vocab_size(all) + 1);
+  for (uint32_t rank = 0; rank < vocab_size(all); ++rank)
+    vocab_intern(vocab, vocab_word(all, order[rank]));
+  dfree(order);
+  free_vocab(all);
+
+  /* Every pair in terms of the merged IDs; the trainers' arrays are
+   * released as they are copied. */
+  uint64_t *pairs = dmalloc_tag(sizeof(uint64_t) * (pairs_len + 1), MEM_TRAIN);
+  size_t len = 0;
+  for (int i = 0; i < n; ++i) {
+    trainer_t *t = trainers[i];
+    uint32_t words = vocab_size(t->vocab);
+    uint32_t *remap = dmalloc(sizeof(uint32_t) * ((size_t)words + 1));
+    for (uint32_t id = 0; id < words; ++id)
+      remap[id] = vocab_find(vocab, vocab_word(t->vocab, id));
+    for (size_t k = 0; k < t->pairs_len; ++k)
+      pairs[len++] = (uint64_t)remap[t->pairs[k] >> 32] << 32 |
+                     remap[(uint32_t)t->pairs[k]];
+    dfree(remap);
+    dfree(t->pairs);
+    t->pairs = NULL;
+    t->pairs_len = t->pairs_cap = 0;
+  }
+
+  model_t *model = count_pairs(vocab, pairs, len, threads < 1 ? 1 : threads);
+  dfree(pairs);
+  free_vocab(vocab);
+  return model;
+}
+
+uint64_t trainer_get_tokens(const trainer_t *t) { return t ? t->tokens : 0; }
+
+void free_trainer(trainer_t *t) {
+  if (t == NULL)
+    return;
+  for (int i = 0; i < t->batch_len; ++i)
+    ht_item_free_word(t->batch[i]);
+  if (t->table)
+    free_hash_table(t->table);
+  free_ll_pool(t->followers);
+  if (t->vocab)
+    free_vocab(t->vocab);
+  dfree(t->pairs);
+  free_ext_trainer(t->external);
+  dfree(t);
+}
+
+int train_backend_from_name(const char *name, train_backend_t *backend) {
+  if (name == NULL || backend == NULL)
+    return -1;
+  if (strcmp(name, "hash") == 0)
+    *backend = TRAIN_BACKEND_HASH_TABLE;
+  else if (strcmp(name, "radix") == 0)
+    *backend = TRAIN_BACKEND_RADIX;
+  else if (strcmp(name, "external") == 0)
+    *backend = TRAIN_BACKEND_EXTERNAL;
+  else
+    return -1;
+  return 0;
+}
+
+const char *train_backend_name(train_backend_t backend) {
+  switch (backend) {
+  case TRAIN_BACKEND_HASH_TABLE:
+    return "hash";
+  case TRAIN_BACKEND_RADIX:
+    return "radix";
+  case TRAIN_BACKEND_EXTERNAL:
+    return "external";
+  }
+  return "unknown";
+}
+
+/* ------------------------------------------------------------------
+ * Freezing the word follower table
+ * ------------------------------------------------------------------ */
+static int cmp_edge_next(const void *a, const void *b) {
+  uint32_t x = ((const model_edge_t *)a)->next;
+  uint32_t y = ((const model_edge_t *)b)->next;
+  return (x > y) - (x < y);
+}
+
+typedef struct {
+  const hash_table_t *table;
+  const vocab_t *vocab;
+  const uint64_t *rows;
+  model_edge_t *edges;
+  int begin, end; /* bucket range */
+} freeze_job_t;
+
+/* Fill and sort the rows of the keys in one bucket range. Rows of
+ * different keys never overlap, so ranges run in parallel. */
+static void *freeze_rows(void *arg) {
+  freeze_job_t *job = arg;
+  ht_iter_t it;
+  ht_item *item;
+  ht_iter_init_range(&it, job->table, job->begin, job->end);
+  while ((item = ht_iter_next(&it)) != NULL) {
+    uint32_t id = vocab_find(job->vocab, ((word_t *)item->key)->word);
+    model_edge_t *row = job->edges + job->rows[id];
+    uint32_t k = 0;
+    linked_list_iterator_t f;
+    void *data;
+    ll_iter_init(&f, item->value);
+    while (ll_iter_next(&f, &data)) {
+      word_t *w = data;
+      row[k].next = vocab_find(job->vocab, w->word);
+      row[k].count = (uint32_t)w->occurrences;
+      k++;
+    }
+    qsort(row, k, sizeof(model_edge_t), cmp_edge_next);
+  }
+  return NULL;
+}
+
+model_t *model_from_word_table(const hash_table_t *table, int threads) {
+  if (table == NULL)
+    return NULL;
+  vocab_t *vocab = create_vocab(ht_get_count(table) + 1);
+  uint32_t keys = (uint32_t)ht_get_count(table);
+  uint64_t *key_rows = dmalloc(sizeof(uint64_t) * ((size_t)keys + 1));
+
+  /* Pass 1: number every word and size every row. Keys are interned
+   * before followers so row IDs are dense from 0. */
+  uint64_t num_edges = 0;
+  ht_iter_t it;
+  ht_item *item;
+  ht_iter_init(&it, table);
+  while ((item = ht_iter_next(&it)) != NULL) {
+    uint32_t id = vocab_intern(vocab, ((word_t *)item->key)->word);
+    key_rows[id] = (uint64_t)get_list_size(item->value);
+    num_edges += key_rows[id];
+  }
+  ht_iter_init(&it, table);
+  while ((item = ht_iter_next(&it)) != NULL) {
+    linked_list_iterator_t f;
+    void *data;
+    ll_iter_init(&f, item->value);
+    while (ll_iter_next(&f, &data))
+      vocab_intern(vocab, ((word_t *)data)->word);
+  }
+
+  uint32_t words = vocab_size(vocab);
+  uint64_t *rows = dmalloc(sizeof(uint64_t) * ((size_t)words + 1));
+  for (uint32_t i = 0; i < words; ++i)
+    rows[i + 1] = rows[i] + (i < keys ? key_rows[i] : 0);
+  dfree(key_rows);
+  model_edge_t *edges =
+      dmalloc_tag(sizeof(model_edge_t) * (num_edges + 1), MEM_TRAIN);
+
+  /* Pass 2: fill every row and order it by follower ID, split by bucket
+   * ranges between the threads. */
+  if (threads < 1)
+    threads = 1;
+  freeze_job_t *jobs = dmalloc(sizeof(freeze_job_t) * threads);
+  pthread_t *tids = dmalloc(sizeof(pthread_t) * threads);
+  for (int i = 0; i < threads; ++i) {
+    jobs[i].table = table;
+    jobs[i].vocab = vocab;
+    jobs[i].rows = rows;
+    jobs[i].edges = edges;
+    ht_partition(table, i, threads, &jobs[i].begin, &jobs[i].end);
+  }
+  int started = 1;
+  for (; started < threads; ++started) {
+    int rc = pthread_create(&tids[started], NULL, freeze_rows, &jobs[started]);
+    if (rc != 0) {
+      fprintf(stderr, "model_from_word_table: cannot start thread: %s\n",
+              strerror(rc));
+      break; /* the rows left are frozen here */
+    }
+  }
+  freeze_rows(&jobs[0]);
+  for (int i = started; i < threads; ++i)
+    freeze_rows(&jobs[i]);
+  for (int i = 1; i < started; ++i)
+    pthread_join(tids[i], NULL);
+  dfree(tids);
+  dfree(jobs);
+
+  model_t *model = model_build(vocab, rows, edges);
+  dfree(edges);
+  dfree(rows);
+  free_vocab(vocab);
+  return model;
+}
@@ -1,25 +1,56 @@
 #include "../include/utf8_tools.h"
+#include "../include/utf8_case_table.h"
+#include "../include/timing.h"
 #include "../include/utils.h"
 #include <stdio.h>
 #include <unistd.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 /*
  * Expected length of character sequence referenced by the leading byte.
  * return 1 for ASCII characters (ASCII is Subset of UTF-8)
  * return 2 for 2-byte sequences, 3 for 3-byte sequences, and
- * 4 for 4-byte sequences.
+ * 4 for 4-byte sequences, 0 for bytes that cannot lead one: continuation
+ * bytes, C0 and C1 (always overlong) and F5-FF (past U+10FFFF).
  */
 static unsigned utf8_length(unsigned char lead) {
   if (lead < 0x80)
     return 1; // 0xxxxxxx
-  if ((lead >> 5) == 0x6)
+  if (lead >= 0xC2 && lead <= 0xDF)
     return 2; // 110xxxxx
   if ((lead >> 4) == 0xE)
     return 3; // 1110xxxx
-  if ((lead >> 3) == 0x1E)
+  if (lead >= 0xF0 && lead <= 0xF4)
     return 4; // 11110xxx
   return 0;   // invalid
 }
+
+/*
+ * Whether byte can follow as byte k (1 to 3) of the sequence led by lead.
+ * The second byte is restricted so that overlong forms (E0 80-9F,
+ * F0 80-8F), surrogates (ED A0-BF) and values past U+10FFFF (F4 90-BF)
+ * are malformed (Unicode, table 3-7).
+ */
+static int utf8_continues(unsigned char lead, unsigned k, unsigned char byte) {
+  if ((byte >> 6) != 0x2)
+    return 0;
+  if (k != 1)
+    return 1;
+  switch (lead) {
+  case 0xE0:
+    return byte >= 0xA0;
+  case 0xED:
+    return byte <= 0x9F;
+  case 0xF0:
+    return byte >= 0x90;
+  case 0xF4:
+    return byte <= 0x8F;
+  default:
+    return 1;
+  }
+}
 /*
  * https://en.wikipedia.org/wiki/UTF-8
  * https://www.youtube.com/watch?v=c_hfKgektt4
@@ -48,7 +79,7 @@ int utf8_getchar(void) {
     if (ci == EOF)
       return EOF; // End of input before completing the character
     unsigned char byte = (unsigned char)ci;
-    if ((byte >> 6) != 0x2)
+    if (!utf8_continues(lead, i, byte))
       return UTF8_ERROR; // invalid continuation byte
     codepoint =
         (codepoint << 6) | (byte & 0x3F); // append the continuation byte
@@ -75,12 +106,13 @@ int utf8_getchar_fd(int fd) {
   uint32_t codepoint =
       lead & ((1u << (7 - len)) - 1); // Mask to get the leading bits
   for (unsigned i = 1; i < len; ++i) {
-    if (read(fd, &lead, 1) != 1) // Read the next byte
+    unsigned char byte;
+    if (read(fd, &byte, 1) != 1) // Read the next byte
       return EOF;                // End of input before completing the character
-    if ((lead >> 6) != 0x2)
+    if (!utf8_continues(lead, i, byte))
       return UTF8_ERROR; // invalid continuation byte
     codepoint =
-        (codepoint << 6) | (lead & 0x3F); // append the continuation byte
+        (codepoint << 6) | (byte & 0x3F); // append the continuation byte
   }
 
   return (int)codepoint;
@@ -115,39 +147,51 @@ void utf8_putchar(int codepoint, int fd) {
   write(fd, buffer, len); // Write the UTF-8 sequence to the file descriptor
 }
 
+/* Both directions go through the generated two-level tables; code points
+ * outside the Unicode range map to themselves. */
 int utf8_char_to_lower(int codepoint) {
-  // Handle ASCII characters
-  if (codepoint >= 'A' && codepoint <= 'Z') {
-    return codepoint + ('a' - 'A');
-  }
-
-  // Specific Unicode characters for italian accented Lowercase
-  switch (codepoint) {
-  case 200:
-    return 232; 
-  case 201:
-    return 233; 
-  default:
-    return codepoint; // No italian special character keep it like that
-                      // codepoint
-  }
+  if ((unsigned)codepoint >= CASE_MAX_CODEPOINT)
+    return codepoint;
+  unsigned block = case_lower_stage1[codepoint >> CASE_BLOCK_SHIFT];
+  return codepoint + case_lower_deltas[(block << CASE_BLOCK_SHIFT) |
+                                       (codepoint & CASE_BLOCK_MASK)];
 }
 
 int utf8_char_to_upper(int codepoint) {
-  // Handle ASCII characters
-  if (codepoint >= 'a' && codepoint <= 'z') {
-    return codepoint - ('a' - 'A');
-  }
+  if ((unsigned)codepoint >= CASE_MAX_CODEPOINT)
+    return codepoint;
+  unsigned block = case_upper_stage1[codepoint >> CASE_BLOCK_SHIFT];
+  return codepoint + case_upper_deltas[(block << CASE_BLOCK_SHIFT) |
+                                       (codepoint & CASE_BLOCK_MASK)];
+}
 
-  // Specific Unicode characters for italian accented Uppercase
-  switch (codepoint) {
-    case 232:
-      return 200;
-    case 233:
-      return 201;
-  default:
-    return codepoint; // not italian special characther keep it like that                      // codepoint
+void utf8_codepoints_to_lower(int *dst, const int *src, size_t n) {
+  size_t i = 0;
+#ifdef __SSE2__
+  /* Four code points at a time: ASCII capitals get the case bit added, and
+   * a group holding anything outside ASCII goes through the table. */
+  const __m128i below_a = _mm_set1_epi32('A' - 1);
+  const __m128i above_z = _mm_set1_epi32('Z' + 1);
+  const __m128i ascii_top = _mm_set1_epi32(0x7F);
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i case_bit = _mm_set1_epi32('a' - 'A');
+  for (; i + 4 <= n; i += 4) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+    __m128i other = _mm_or_si128(_mm_cmpgt_epi32(v, ascii_top),
+                                 _mm_cmplt_epi32(v, zero));
+    if (_mm_movemask_epi8(other) != 0) {
+      for (size_t k = i; k < i + 4; ++k)
+        dst[k] = utf8_char_to_lower(src[k]);
+      continue;
+    }
+    __m128i capital = _mm_and_si128(_mm_cmpgt_epi32(v, below_a),
+                                    _mm_cmpgt_epi32(above_z, v));
+    _mm_storeu_si128((__m128i *)(dst + i),
+                     _mm_add_epi32(v, _mm_and_si128(capital, case_bit)));
   }
+#endif
+  for (; i < n; ++i)
+    dst[i] = utf8_char_to_lower(src[i]);
 }
 
 void utf8_print_word(const int *word, int fd) {
@@ -167,15 +211,146 @@ int *utf8_word_to_lower(const int *word, int word_length) {
     return NULL;
   }
 
-  int *lower_word =
-      dmalloc(sizeof(int) * (word_length)); // Allocate memory for the new word
-  int i = 0;
+  int len = 0;
+  while (word[len] != '\0')
+    len++;
+  // Allocate memory for the new word, at least word_length code points
+  int *lower_word = dmalloc_tag(sizeof(int) *
+                            (size_t)(len + 1 > word_length ? len + 1 : word_length),
+                                MEM_WORDS);
+  utf8_codepoints_to_lower(lower_word, word, (size_t)len);
+  lower_word[len] = '\0'; // Null-terminate the new word
 
-  while (word[i] != '\0') {
-    lower_word[i] = utf8_char_to_lower(word[i]);
-    i++;
+  return lower_word;
+}
+
+size_t utf8_encode(int codepoint, char *out) {
+  if (codepoint < 0x80) {
+    out[0] = (char)codepoint;
+    return 1;
   }
-  lower_word[i] = '\0'; // Null-terminate the new word
+  if (codepoint < 0x800) {
+    out[0] = (char)(0xC0 | (codepoint >> 6));
+    out[1] = (char)(0x80 | (codepoint & 0x3F));
+    return 2;
+  }
+  if (codepoint < 0x10000) {
+    out[0] = (char)(0xE0 | (codepoint >> 12));
+    out[1] = (char)(0x80 | ((codepoint >> 6) & 0x3F));
+    out[2] = (char)(0x80 | (codepoint & 0x3F));
+    return 3;
+  }
+  out[0] = (char)(0xF0 | (codepoint >> 18));
+  out[1] = (char)(0x80 | ((codepoint >> 12) & 0x3F));
+  out[2] = (char)(0x80 | ((codepoint >> 6) & 0x3F));
+  out[3] = (char)(0x80 | (codepoint & 0x3F));
+  return 4;
+}
 
-  return lower_word;
+static int decode(const char *bytes, size_t len, int *out, size_t max_out) {
+  const unsigned char *p = (const unsigned char *)bytes;
+  size_t i = 0, n = 0;
+  while (i < len) {
+    if (n == max_out)
+      return -1;
+    unsigned char lead = p[i];
+    if (lead < 0x80) { // ASCII fast path
+      out[n++] = lead;
+      i++;
+      continue;
+    }
+    unsigned seq = utf8_length(lead);
+    if (seq < 2 || i + seq > len)
+      return UTF8_ERROR;
+    uint32_t codepoint = lead & ((1u << (7 - seq)) - 1);
+    for (unsigned k = 1; k < seq; ++k) {
+      if (!utf8_continues(lead, k, p[i + k]))
+        return UTF8_ERROR; // invalid continuation byte
+      codepoint = (codepoint << 6) | (p[i + k] & 0x3F);
+    }
+    out[n++] = (int)codepoint;
+    i += seq;
+  }
+  return (int)n;
+}
+
+int utf8_decode(const char *bytes, size_t len, int *out, size_t max_out) {
+  TIMER_START(start);
+  int n = decode(bytes, len, out, max_out);
+  TIMER_STOP(TIMING_DECODE, start);
+  return n;
+}
+
+static int utf8_sequence_value(const unsigned char *p, unsigned n) {
+  int codepoint = p[0] & (0x7F >> n);
+  for (unsigned k = 1; k < n; ++k)
+    codepoint = (codepoint << 6) | (p[k] & 0x3F);
+  return codepoint;
+}
+
+size_t utf8_stream_decode(utf8_stream_t *s, const char *bytes, size_t len,
+                          int *out, int replacement) {
+  const unsigned char *p = (const unsigned char *)bytes;
+  size_t i = 0, n = 0;
+
+  /* finish a sequence left over by the previous call */
+  while (s->pending_len > 0 && i < len) {
+    if (!utf8_continues(s->pending[0], s->pending_len, p[i])) {
+      s->pending_len = 0;
+      s->invalid++;
+      out[n++] = replacement;
+      break;
+    }
+    s->pending[s->pending_len++] = p[i++];
+    if (s->pending_len == s->pending_need) {
+      out[n++] = utf8_sequence_value(s->pending, s->pending_need);
+      s->pending_len = 0;
+    }
+  }
+
+  while (i < len) {
+    unsigned char lead = p[i];
+    if (lead < 0x80) { // ASCII runs
+      do
+        out[n++] = p[i++];
+      while (i < len && p[i] < 0x80);
+      continue;
+    }
+    unsigned need = utf8_length(lead);
+    if (need == 0) {
+      s->invalid++;
+      out[n++] = replacement;
+      i++;
+      continue;
+    }
+    unsigned have = 1;
+    while (have < need && i + have < len &&
+           utf8_continues(lead, have, p[i + have]))
+      have++;
+    if (have == need) {
+      out[n++] = utf8_sequence_value(p + i, need);
+      i += need;
+    } else if (i + have == len) {
+      /* cut by the end of the buffer: keep it for the next call */
+      for (unsigned k = 0; k < have; ++k)
+        s->pending[k] = p[i + k];
+      s->pending_len = have;
+      s->pending_need = need;
+      i = len;
+    } else {
+      s->invalid++;
+      out[n++] = replacement;
+      i += have;
+    }
+  }
+  return n;
+}
+
+size_t utf8_stream_finish(utf8_stream_t *s, int *out, int replacement) {
+  if (s->pending_len == 0)
+    return 0;
+  s->pending_len = 0;
+  s->invalid++;
+  out[0] = replacement;
+  return 1;
 }
@@ -1,9 +1,12 @@
+#define _POSIX_C_SOURCE 200809L
 #include "../include/utils.h"
 
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
 
 unsigned int is_prime(int n) {
 
@@ -40,7 +43,114 @@ unsigned int hash_function(int *key, int table_size){
     return hash % table_size;
 }
 
-void *dmalloc(size_t size) {
+#ifdef DMALLOC_ACCOUNTING
+#define DMALLOC_MAGIC 0xD3A110C5u
+
+typedef struct {
+    uint64_t size;
+    uint32_t tag;
+    uint32_t magic;
+} dmalloc_header_t; /* 16 bytes: the block stays 16 byte aligned */
+
+typedef struct {
+    uint64_t live, peak, allocs, frees;
+    char pad[32]; /* one cache line each: threads charging different
+                     subsystems do not contend */
+} mem_counter_t;
+
+static mem_counter_t mem_counters[MEM_TAGS + 1]; /* last: the total */
+
+static void raise_peak(mem_counter_t *c, uint64_t live) {
+    uint64_t peak = __atomic_load_n(&c->peak, __ATOMIC_RELAXED);
+    while (live > peak &&
+           !__atomic_compare_exchange_n(&c->peak, &peak, live, 1,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+static void charge(uint32_t tag, uint64_t bytes) {
+    mem_counter_t *c = &mem_counters[tag], *all = &mem_counters[MEM_TAGS];
+    raise_peak(c, __atomic_add_fetch(&c->live, bytes, __ATOMIC_RELAXED));
+    raise_peak(all, __atomic_add_fetch(&all->live, bytes, __ATOMIC_RELAXED));
+}
+
+static void discharge(uint32_t tag, uint64_t bytes) {
+    __atomic_sub_fetch(&mem_counters[tag].live, bytes, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&mem_counters[MEM_TAGS].live, bytes, __ATOMIC_RELAXED);
+}
+
+static dmalloc_header_t *header_of(void *ptr) {
+    dmalloc_header_t *h = (dmalloc_header_t *)ptr - 1;
+    if (h->magic != DMALLOC_MAGIC) {
+        fprintf(stderr, "dfree: %p was not allocated by dmalloc\n", ptr);
+        abort();
+    }
+    return h;
+}
+
+void *dmalloc_tag(size_t size, mem_tag_t tag) {
+    dmalloc_header_t *h = malloc(sizeof(dmalloc_header_t) + size);
+    if (h == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    h->size = size;
+    h->tag = (uint32_t)tag < MEM_TAGS ? (uint32_t)tag : MEM_OTHER;
+    h->magic = DMALLOC_MAGIC;
+    memset(h + 1, 0, size); // Initialize allocated memory to zero
+    charge(h->tag, size);
+    __atomic_add_fetch(&mem_counters[h->tag].allocs, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&mem_counters[MEM_TAGS].allocs, 1, __ATOMIC_RELAXED);
+    return h + 1;
+}
+
+void *drealloc(void *ptr, size_t size) {
+    if (ptr == NULL)
+        return size ? dmalloc_tag(size, MEM_OTHER) : NULL;
+    if (size == 0) {
+        dfree(ptr);
+        return NULL;
+    }
+    dmalloc_header_t *h = header_of(ptr);
+    uint64_t old = h->size;
+    uint32_t tag = h->tag;
+    h = realloc(h, sizeof(dmalloc_header_t) + size);
+    if (h == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    h->size = size;
+    if (size > old)
+        charge(tag, size - old);
+    else
+        discharge(tag, old - size);
+    return h + 1;
+}
+
+void dfree(void *ptr) {
+    if (ptr == NULL)
+        return;
+    dmalloc_header_t *h = header_of(ptr);
+    discharge(h->tag, h->size);
+    __atomic_add_fetch(&mem_counters[h->tag].frees, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&mem_counters[MEM_TAGS].frees, 1, __ATOMIC_RELAXED);
+    h->magic = 0; /* a second dfree aborts instead of corrupting counters */
+    free(h);
+}
+
+int dmalloc_accounting(void) { return 1; }
+
+void dmalloc_stats(mem_tag_t tag, mem_stats_t *out) {
+    uint32_t i = (uint32_t)tag <= MEM_TAGS ? (uint32_t)tag : MEM_TAGS;
+    const mem_counter_t *c = &mem_counters[i];
+    out->live = __atomic_load_n(&c->live, __ATOMIC_RELAXED);
+    out->peak = __atomic_load_n(&c->peak, __ATOMIC_RELAXED);
+    out->allocs = __atomic_load_n(&c->allocs, __ATOMIC_RELAXED);
+    out->frees = __atomic_load_n(&c->frees, __ATOMIC_RELAXED);
+}
+#else
+void *dmalloc_tag(size_t size, mem_tag_t tag) {
+    (void)tag;
     void *ptr = malloc(size);
     if (ptr == NULL) {
         fprintf(stderr, "Memory allocation failed\n");
@@ -49,4 +159,139 @@ void *dmalloc(size_t size) {
     memset(ptr, 0, size); // Initialize allocated memory to zero
     return ptr;
 }
+void *drealloc(void *ptr, size_t size) {
+    void *new_ptr = realloc(ptr, size);
+    if (new_ptr == NULL && size != 0) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    return new_ptr;
+}
+void dfree(void *ptr) { free(ptr); }
+
+int dmalloc_accounting(void) { return 0; }
+
+void dmalloc_stats(mem_tag_t tag, mem_stats_t *out) {
+    (void)tag;
+    memset(out, 0, sizeof(mem_stats_t));
+}
+#endif
+
+void *dmalloc(size_t size) { return dmalloc_tag(size, MEM_OTHER); }
+
+const char *mem_tag_name(mem_tag_t tag) {
+    static const char *const names[MEM_TAGS + 1] = {
+        "other", "words", "list nodes", "buckets",
+        "items", "model", "training",   "total"};
+    return (uint32_t)tag <= MEM_TAGS ? names[tag] : "?";
+}
+
+/* Append text, then spaces up to width (right aligned when right). */
+static size_t put_field(char *line, size_t pos, const char *text, size_t len,
+                        size_t width, int right) {
+    size_t pad = len < width ? width - len : 0;
+    if (right)
+        for (; pad > 0; --pad)
+            line[pos++] = ' ';
+    memcpy(line + pos, text, len);
+    pos += len;
+    for (; pad > 0; --pad)
+        line[pos++] = ' ';
+    return pos;
+}
+
+int dmalloc_report(int fd) {
+    static const char head[] =
+        "subsystem        live bytes     peak bytes"
+        "         allocs          frees\n";
+    if (!dmalloc_accounting()) {
+        static const char off[] =
+            "dmalloc: accounting not compiled in (build with MEMSTAT=1)\n";
+        return write_all(fd, off, sizeof off - 1);
+    }
+    if (write_all(fd, head, sizeof head - 1) < 0)
+        return -1;
+    for (int tag = 0; tag <= MEM_TAGS; ++tag) {
+        mem_stats_t st;
+        dmalloc_stats((mem_tag_t)tag, &st);
+        if (tag < MEM_TAGS && st.allocs == 0)
+            continue;
+        uint64_t values[4] = {st.live, st.peak, st.allocs, st.frees};
+        char line[128], digits[20];
+        const char *name = mem_tag_name((mem_tag_t)tag);
+        size_t pos = put_field(line, 0, name, strlen(name), 12, 0);
+        for (int v = 0; v < 4; ++v)
+            pos = put_field(line, pos, digits,
+                            (size_t)format_u64(values[v], digits), 15, 1);
+        line[pos++] = '\n';
+        if (write_all(fd, line, pos) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+int write_all(int fd, const void *buf, size_t len) {
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0)
+            return -1;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+ssize_t read_full(int fd, void *buf, size_t len) {
+    char *p = buf;
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = read(fd, p + done, len - done);
+        if (n < 0)
+            return -1;
+        if (n == 0)
+            break; // end of file
+        done += (size_t)n;
+    }
+    return (ssize_t)done;
+}
+static const char digit_pairs[201] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536"
+    "37383940414243444546474849505152535455565758596061626364656667686970717273"
+    "7475767778798081828384858687888990919293949596979899";
+
+int format_u64(uint64_t value, char *out) {
+    char buf[20];
+    int pos = 20;
+    while (value >= 100) {
+        unsigned idx = (unsigned)(value % 100) * 2;
+        value /= 100;
+        buf[--pos] = digit_pairs[idx + 1];
+        buf[--pos] = digit_pairs[idx];
+    }
+    if (value >= 10) {
+        unsigned idx = (unsigned)value * 2;
+        buf[--pos] = digit_pairs[idx + 1];
+        buf[--pos] = digit_pairs[idx];
+    } else {
+        buf[--pos] = (char)('0' + value);
+    }
+    memcpy(out, buf + pos, (size_t)(20 - pos));
+    return 20 - pos;
+}
+
+uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+int u64_digits(uint64_t value) {
+    int digits = 1;
+    while (value >= 10) {
+        value /= 10;
+        digits++;
+    }
+    return digits;
+}
 #define malloc(x) dont_use_malloc_usedmalloc // Use dmalloc instead
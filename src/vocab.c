@@ -0,0 +1,97 @@
+#include "../include/vocab.h"
+#include "../include/ht_item.h"
+#include "../include/utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Rough per-allocation overhead of the system allocator. */
+#define ALLOC_OVERHEAD 16
+
+static size_t index_bytes(const vocab_index_t *index) {
+  return (index->mask + 1) * (sizeof(vocab_index_entry_t) + sizeof(uint32_t));
+}
+
+vocab_t *create_vocab(int initial_size) {
+  vocab_t *vocab = dmalloc(sizeof(vocab_t));
+  vocab_index_init(&vocab->index, initial_size > 0 ? (size_t)initial_size : 0);
+  vocab->capacity = initial_size > 16 ? (uint32_t)initial_size : 16;
+  vocab->words = dmalloc_tag(sizeof(word_t *) * vocab->capacity, MEM_WORDS);
+  vocab->count = 0;
+  vocab->pool_len = 0;
+  vocab->bytes = sizeof(vocab_t) + sizeof(word_t *) * vocab->capacity +
+                 index_bytes(&vocab->index);
+  return vocab;
+}
+
+uint32_t vocab_find(const vocab_t *vocab, const int *word) {
+  if (vocab == NULL || word == NULL)
+    return VOCAB_NO_ID;
+
+  const uint32_t *id = vocab_index_find(&vocab->index, word);
+  return id ? *id : VOCAB_NO_ID;
+}
+
+uint32_t vocab_intern(vocab_t *vocab, const int *word) {
+  if (vocab == NULL || word == NULL) {
+    fprintf(stderr, "Vocabulary or word is NULL\n");
+    return VOCAB_NO_ID;
+  }
+
+  size_t old_index = index_bytes(&vocab->index);
+  int added;
+  vocab_index_entry_t *entry =
+      vocab_index_upsert_entry(&vocab->index, word, &added);
+  if (!added)
+    return entry->value;
+
+  if (vocab->count == vocab->capacity) {
+    vocab->bytes -= sizeof(word_t *) * vocab->capacity;
+    vocab->capacity *= 2;
+    vocab->words =
+        drealloc(vocab->words, sizeof(word_t *) * vocab->capacity);
+    vocab->bytes += sizeof(word_t *) * vocab->capacity;
+  }
+
+  size_t len = 0;
+  while (word[len] != '\0')
+    len++;
+
+  word_t *copy = dmalloc_tag(sizeof(word_t), MEM_WORDS);
+  copy->word = dmalloc_tag((len + 1) * sizeof(int), MEM_WORDS);
+  memcpy(copy->word, word, (len + 1) * sizeof(int));
+  copy->occurrences = 0;
+
+  /* the index must point at the copy, not at the caller's buffer */
+  uint32_t id = vocab->count++;
+  vocab->words[id] = copy;
+  entry->value = id;
+  entry->key = copy->word;
+
+  vocab->pool_len += len + 1;
+  vocab->bytes += index_bytes(&vocab->index) - old_index;
+  /* word_t + code points */
+  vocab->bytes += sizeof(word_t) + (len + 1) * sizeof(int) + 2 * ALLOC_OVERHEAD;
+  return id;
+}
+
+const int *vocab_word(const vocab_t *vocab, uint32_t id) {
+  if (vocab == NULL || id >= vocab->count)
+    return NULL;
+  return vocab->words[id]->word;
+}
+
+uint32_t vocab_size(const vocab_t *vocab) { return vocab ? vocab->count : 0; }
+
+size_t vocab_bytes(const vocab_t *vocab) { return vocab ? vocab->bytes : 0; }
+
+void free_vocab(vocab_t *vocab) {
+  if (vocab == NULL)
+    return;
+  vocab_index_destroy(&vocab->index);
+  for (uint32_t i = 0; i < vocab->count; ++i) {
+    free_word(vocab->words[i]);
+  }
+  dfree(vocab->words);
+  dfree(vocab);
+}
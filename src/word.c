@@ -1,6 +1,7 @@
 #include "../include/word.h"
 #include "../include/ht_item.h"
 #include "../include/linked_list.h"
+#include "../include/timing.h"
 #include "../include/utf8_tools.h"
 #include "../include/utils.h"
 #include <stdio.h>
@@ -8,13 +9,16 @@
 #include <unistd.h>
 #include <string.h>
 
+static void word_followers_free_list(linked_list_t *list);
+static word_t *word_deep_copy(const word_t *original);
+
 word_t *create_word(int *word) {
   if (word == NULL) {
     fprintf(stderr, "Word is NULL\n");
     return NULL;
   }
 
-  word_t *new_word = dmalloc(sizeof(word_t));
+  word_t *new_word = dmalloc_tag(sizeof(word_t), MEM_WORDS);
 
   new_word->word = utf8_word_to_lower(word, MAX_WORD_LENGTH);
   new_word->occurrences = 1;
@@ -23,18 +27,21 @@ word_t *create_word(int *word) {
 }
 
 ht_item *word_ht_item_create(word_t *key, word_t *value) {
+  return word_ht_item_create_pooled(key, value, NULL);
+}
+
+ht_item *word_ht_item_create_pooled(word_t *key, word_t *value,
+                                    ll_pool_t *pool) {
   if (key == NULL || value == NULL) {
     fprintf(stderr, "Key or value is NULL\n");
     return NULL;
   }
 
-  ht_item *item = dmalloc(sizeof(ht_item));
+  ht_item *item = dmalloc_tag(sizeof(ht_item), MEM_ITEMS);
   item->key = word_deep_copy(key); // Create a deep copy of the key
-  item->update_value = update_ht_item_value; // Set the update function
-  item->value = create_linked_list(); // Initialize value to the word_t pointer
+  item->value = create_linked_list_pool(pool); // List of follower word_t
   add_to_list((linked_list_t *)item->value,
               word_deep_copy(value)); // Add the value to the linked list
-  item->free_item = ht_item_free_word; // Set the free function to free_word
 
   return item;
 }
@@ -79,8 +86,8 @@ int word_str_cmp(const int *word, const int *str) {
     int *lower_word = utf8_word_to_lower(word, MAX_WORD_LENGTH);
     int *lower_str  = utf8_word_to_lower(str,  MAX_WORD_LENGTH);
     if (!lower_word || !lower_str) { /* gestione minima errore */
-        if (lower_word) free(lower_word);
-        if (lower_str)  free(lower_str);
+        if (lower_word) dfree(lower_word);
+        if (lower_str)  dfree(lower_str);
         return 0;
     }
 
@@ -88,59 +95,50 @@ int word_str_cmp(const int *word, const int *str) {
     while (lower_word[i] != 0 && lower_str[i] != 0) {
         if (lower_word[i] != lower_str[i]) {
             int diff = lower_word[i] - lower_str[i];
-            free(lower_word);
-            free(lower_str);
+            dfree(lower_word);
+            dfree(lower_str);
             return diff;
         }
         i++;
     }
 
     int diff = lower_word[i] - lower_str[i];  /* include il caso del terminatore */
-    free(lower_word);
-    free(lower_str);
+    dfree(lower_word);
+    dfree(lower_str);
     return diff;
 }
 
-static int *update_value_helper(const ht_item *item){
-  if (item == NULL || item->value == NULL) {
-    fprintf(stderr, "Item or value is NULL\n");
-    return NULL;
-  }
-  linked_list_t *list = (linked_list_t *)item->value;
-  ll_item_t *current = list->head;
-  if (current == NULL) {
-    fprintf(stderr, "List is empty\n");
-    return NULL;
-  }
-  word_t *word = (word_t *)current->data;
-  return word->word; // Return the word array from the first item in the list
-
-}
-
-void update_ht_item_value(const void *item, const void *actual_followers) {
-  if (item == NULL || actual_followers == NULL) {
+/*
+ * Merge the followers carried by a redundant item (new_followers, the value of
+ * the item passed to ht_insert) into the follower list stored in item: known
+ * followers get their occurrences added, unknown ones are appended.
+ */
+void update_ht_item_value(const void *item, const void *new_followers) {
+  if (item == NULL || new_followers == NULL) {
     fprintf(stderr, "Item or new value is NULL\n");
     return;
   }
+  TIMER_START(start);
   ht_item *htItem = (ht_item *)item;
-  linked_list_t *af_list = (linked_list_t *)actual_followers;
-  ll_item_t *current = af_list->head;
-  int *nw = update_value_helper(htItem); 
-  int *lower_nw = utf8_word_to_lower(nw, MAX_WORD_LENGTH);
-  while (current != NULL) {
-    word_t *word = (word_t *)current->data;
-    if (word_str_cmp(word->word, lower_nw) == 0) {
-      // If the word already exists, update its occurrences
-      update_word_occurrences(word);
-      free(lower_nw); // Free the lower_nw array
-      return;
+  linked_list_t *list = (linked_list_t *)htItem->value;
+  const linked_list_t *nf_list = (const linked_list_t *)new_followers;
+
+  for (ll_item_t *nf = nf_list->head; nf != NULL; nf = nf->next) {
+    const word_t *follower = (const word_t *)nf->data;
+    ll_item_t *current = list->head;
+    while (current != NULL) {
+      word_t *word = (word_t *)current->data;
+      if (wordcmp(word, follower) == 0) {
+        word->occurrences += follower->occurrences;
+        break;
+      }
+      current = current->next;
+    }
+    if (current == NULL) {
+      add_to_list(list, word_deep_copy(follower));
     }
-    current = current->next;
   }
-  free(lower_nw); // Free the lower_nw array
-  // If the word does not exist, add it to the linked list
-  word_t *new_word = create_word(nw);
-  add_to_list(af_list, new_word);
+  TIMER_STOP(TIMING_FOLLOWER_UPDATE, start);
 }
 
 unsigned int word_hash(const void *key, int size) {
@@ -166,17 +164,15 @@ void word_print(const word_t *word, int fd, int *between_char) {
     fprintf(stderr, "Word is NULL\n");
     return;
   }
-  int occurrences = get_word_occurrences(word);
+  print_utf8_word(word, fd);
   if (between_char != NULL) {
-    print_utf8_word(word, fd);
     for (int i = 0; between_char[i] != '\0'; i++) {
       utf8_putchar(between_char[i], fd); // Print the character between words
     }
-    write(fd, &occurrences, sizeof(int)); // Write the occurrences of the word
-    return;                               // Print the occurrences of the word
   }
-  print_utf8_word(word, fd);
-  write(fd, &occurrences, sizeof(int)); // Write the occurrences of the word
+  char digits[20];
+  int len = format_u64((uint64_t)get_word_occurrences(word), digits);
+  write(fd, digits, len); // Occurrences as decimal text
 }
 
 void free_word(word_t *word) {
@@ -184,11 +180,11 @@ void free_word(word_t *word) {
     return;
   }
   if (word->word != NULL) {
-    free((void *)word->word); // Free the word array
+    dfree((void *)word->word); // Free the word array
     word->word = NULL; // Set to NULL to avoid dangling pointer
   }
 
-  free(word);
+  dfree(word);
 }
 
 void ht_item_free_word(ht_item *item) {
@@ -201,22 +197,20 @@ void ht_item_free_word(ht_item *item) {
   if (item->value != NULL) {
     word_followers_free_list((linked_list_t *) item->value); // Free the linked list
   }
-  free(item);
+  dfree(item);
 }
 
+const ht_item_ops_t word_ht_item_ops = {update_ht_item_value,
+                                        ht_item_free_word};
+
+static void free_word_data(void *word) { free_word((word_t *)word); }
+
 static void word_followers_free_list(linked_list_t *list) {
   if (list == NULL) {
     fprintf(stderr, "List is NULL\n");
     return;
   }
-  ll_item_t *current = list->head;
-  while (current != NULL) {
-    ll_item_t *next = current->next;
-    free_word((word_t *)current->data); // Free each word in the list
-    free(current);
-    current = next;
-  }
-  free(list);
+  free_linked_list_with(list, free_word_data); // Free each word in the list
 }
 
 int word_hashtable_keycmp(const void *key1, const void *key2) {
@@ -236,8 +230,8 @@ static word_t *word_deep_copy(const word_t *original) {
     ++len;
   }
 
-  word_t *copy = dmalloc(sizeof(word_t));
-  copy->word = dmalloc((len + 1) * sizeof(int));
+  word_t *copy = dmalloc_tag(sizeof(word_t), MEM_WORDS);
+  copy->word = dmalloc_tag((len + 1) * sizeof(int), MEM_WORDS);
   if (len) memcpy(copy->word, original->word, len * sizeof(int));
   copy->word[len] = '\0'; 
   copy->occurrences = original->occurrences;
@@ -0,0 +1,286 @@
+#include "../include/word_trie.h"
+#include "../include/utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define TRIE_MAX_FANOUT UINT16_MAX
+#define TRIE_MAX_LABEL UINT16_MAX
+
+typedef struct {
+  uint32_t label; /* offset of the label in labels */
+  uint32_t child; /* first child; the others follow */
+  uint32_t id;    /* word ending here, or VOCAB_NO_ID */
+  uint16_t label_len;
+  uint16_t children;
+} trie_node_t;
+
+struct word_trie {
+  trie_node_t *nodes; /* nodes[0] is the root */
+  int *first;         /* first code point of every label (root: 0) */
+  int *labels;
+  uint32_t num_nodes;
+  uint32_t words;
+  size_t labels_len;
+  size_t max_len; /* longest word, in code points */
+};
+
+typedef struct {
+  const int *word;
+  uint32_t id;
+  uint32_t order; /* position in the input: the last duplicate wins */
+} trie_entry_t;
+
+static int cmp_entries(const void *a, const void *b) {
+  const trie_entry_t *x = a, *y = b;
+  int c = model_word_cmp(x->word, y->word);
+  if (c != 0)
+    return c;
+  return (x->order > y->order) - (x->order < y->order);
+}
+
+static size_t word_length(const int *word) {
+  size_t len = 0;
+  while (word[len] != '\0')
+    len++;
+  return len;
+}
+
+/* Node ranges during the build: node k covers entries [lo, hi), whose
+ * first depth code points are the path to it. */
+typedef struct {
+  uint32_t lo, hi, depth;
+} trie_range_t;
+
+word_trie_t *create_word_trie(const int *const *words, const uint32_t *ids,
+                              uint32_t n) {
+  if (n > 0 && words == NULL) {
+    fprintf(stderr, "create_word_trie: no words\n");
+    return NULL;
+  }
+  trie_entry_t *entries = dmalloc(sizeof(trie_entry_t) * (n ? n : 1));
+  size_t total = 0, max_len = 0;
+  for (uint32_t i = 0; i < n; ++i) {
+    entries[i].word = words[i];
+    entries[i].id = ids ? ids[i] : i;
+    entries[i].order = i;
+    size_t len = word_length(words[i]);
+    if (len > TRIE_MAX_LABEL) {
+      fprintf(stderr, "create_word_trie: word too long\n");
+      dfree(entries);
+      return NULL;
+    }
+    total += len;
+    if (len > max_len)
+      max_len = len;
+  }
+  qsort(entries, n, sizeof(trie_entry_t), cmp_entries);
+  uint32_t unique = 0;
+  for (uint32_t i = 0; i < n; ++i) {
+    if (unique > 0 &&
+        model_word_cmp(entries[unique - 1].word, entries[i].word) == 0)
+      unique--; /* same word, later in the input */
+    entries[unique++] = entries[i];
+  }
+
+  word_trie_t *trie = dmalloc(sizeof(word_trie_t));
+  size_t cap = 2 * (size_t)unique + 1;
+  trie->nodes = dmalloc(sizeof(trie_node_t) * cap);
+  trie->first = dmalloc(sizeof(int) * cap);
+  trie->labels = dmalloc(sizeof(int) * (total + 1));
+  trie->words = unique;
+  trie->max_len = max_len;
+  trie_range_t *ranges = dmalloc(sizeof(trie_range_t) * cap);
+  ranges[0].lo = 0;
+  ranges[0].hi = unique;
+  ranges[0].depth = 0;
+  trie->num_nodes = 1;
+
+  /* Breadth first, so the children of a node get consecutive slots. */
+  for (uint32_t k = 0; k < trie->num_nodes; ++k) {
+    trie_node_t *node = &trie->nodes[k];
+    uint32_t lo = ranges[k].lo, hi = ranges[k].hi, d = ranges[k].depth;
+    node->id = VOCAB_NO_ID;
+    node->label = (uint32_t)trie->labels_len;
+    if (lo == hi)
+      continue; /* empty dictionary */
+    const int *a = entries[lo].word, *b = entries[hi - 1].word;
+    uint32_t end = d; /* sorted: the range shares what first and last do */
+    while (a[end] != '\0' && a[end] == b[end])
+      end++;
+    for (uint32_t i = d; i < end; ++i)
+      trie->labels[trie->labels_len++] = a[i];
+    node->label_len = (uint16_t)(end - d);
+    trie->first[k] = end > d ? a[d] : 0;
+    if (a[end] == '\0')
+      node->id = entries[lo++].id; /* a prefix sorts first */
+
+    node->child = trie->num_nodes;
+    for (uint32_t i = lo; i < hi;) {
+      int c = entries[i].word[end];
+      uint32_t j = i + 1;
+      while (j < hi && entries[j].word[end] == c)
+        j++;
+      if (node->children == TRIE_MAX_FANOUT) {
+        fprintf(stderr, "create_word_trie: too many children\n");
+        dfree(ranges);
+        dfree(entries);
+        free_word_trie(trie);
+        return NULL;
+      }
+      ranges[trie->num_nodes].lo = i;
+      ranges[trie->num_nodes].hi = j;
+      ranges[trie->num_nodes].depth = end;
+      trie->num_nodes++;
+      node->children++;
+      i = j;
+    }
+  }
+  dfree(ranges);
+  dfree(entries);
+  trie->nodes =
+      drealloc(trie->nodes, sizeof(trie_node_t) * trie->num_nodes);
+  trie->first = drealloc(trie->first, sizeof(int) * trie->num_nodes);
+  trie->labels = drealloc(trie->labels,
+                          sizeof(int) * (trie->labels_len ? trie->labels_len
+                                                          : 1));
+  return trie;
+}
+
+word_trie_t *word_trie_from_vocab(const vocab_t *vocab) {
+  uint32_t n = vocab_size(vocab);
+  const int **words = dmalloc(sizeof(int *) * (n ? n : 1));
+  for (uint32_t id = 0; id < n; ++id)
+    words[id] = vocab_word(vocab, id);
+  word_trie_t *trie = create_word_trie(words, NULL, n);
+  dfree(words);
+  return trie;
+}
+
+word_trie_t *word_trie_from_model(const model_t *model) {
+  uint32_t n = model_num_words(model);
+  const int **words = dmalloc(sizeof(int *) * (n ? n : 1));
+  for (uint32_t id = 0; id < n; ++id)
+    words[id] = model_word(model, id);
+  word_trie_t *trie = create_word_trie(words, NULL, n);
+  dfree(words);
+  return trie;
+}
+
+/* Child of node whose label starts with c, or NULL. */
+static const trie_node_t *find_child(const word_trie_t *trie,
+                                     const trie_node_t *node, int c) {
+  uint32_t lo = node->child, hi = node->child + node->children;
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    if (trie->first[mid] < c)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  if (lo < node->child + node->children && trie->first[lo] == c)
+    return &trie->nodes[lo];
+  return NULL;
+}
+
+uint32_t word_trie_find(const word_trie_t *trie, const int *word) {
+  if (trie == NULL || word == NULL)
+    return VOCAB_NO_ID;
+  const trie_node_t *node = trie->nodes;
+  for (;;) {
+    const int *label = trie->labels + node->label;
+    for (uint32_t i = 0; i < node->label_len; ++i)
+      if (word[i] != label[i]) /* also stops at the end of word */
+        return VOCAB_NO_ID;
+    word += node->label_len;
+    if (*word == '\0')
+      return node->id;
+    node = find_child(trie, node, *word);
+    if (node == NULL)
+      return VOCAB_NO_ID;
+  }
+}
+
+typedef struct {
+  const word_trie_t *trie;
+  int *buffer; /* the word so far */
+  word_trie_visit_t visit;
+  void *ctx;
+  size_t visited;
+  int stop;
+} trie_walk_t;
+
+/* The words of the subtree of node, whose path (label excluded) is the
+ * first len code points of the buffer. */
+static void visit_subtree(trie_walk_t *walk, const trie_node_t *node,
+                          size_t len) {
+  const word_trie_t *trie = walk->trie;
+  for (uint32_t i = 0; i < node->label_len; ++i)
+    walk->buffer[len++] = trie->labels[node->label + i];
+  if (node->id != VOCAB_NO_ID) {
+    walk->buffer[len] = '\0';
+    walk->visited++;
+    if (walk->visit && walk->visit(walk->ctx, walk->buffer, len, node->id)) {
+      walk->stop = 1;
+      return;
+    }
+  }
+  for (uint32_t c = 0; c < node->children && !walk->stop; ++c)
+    visit_subtree(walk, &trie->nodes[node->child + c], len);
+}
+
+size_t word_trie_prefix(const word_trie_t *trie, const int *prefix,
+                        word_trie_visit_t visit, void *ctx) {
+  if (trie == NULL)
+    return 0;
+  static const int empty[1] = {'\0'};
+  if (prefix == NULL)
+    prefix = empty;
+
+  /* Descend to the first node whose path covers the prefix. */
+  const trie_node_t *node = trie->nodes;
+  size_t pos = 0; /* where the label of node starts in the prefix */
+  for (;;) {
+    const int *label = trie->labels + node->label;
+    uint32_t i = 0;
+    while (i < node->label_len && prefix[pos + i] != '\0') {
+      if (prefix[pos + i] != label[i])
+        return 0;
+      i++;
+    }
+    if (prefix[pos + i] == '\0')
+      break; /* the prefix ends in or right after this label */
+    pos += node->label_len;
+    node = find_child(trie, node, prefix[pos]);
+    if (node == NULL)
+      return 0;
+  }
+
+  trie_walk_t walk = {trie, NULL, visit, ctx, 0, 0};
+  walk.buffer = dmalloc(sizeof(int) * (trie->max_len + 1));
+  for (size_t i = 0; i < pos; ++i)
+    walk.buffer[i] = prefix[i];
+  visit_subtree(&walk, node, pos);
+  dfree(walk.buffer);
+  return walk.visited;
+}
+
+uint32_t word_trie_size(const word_trie_t *trie) {
+  return trie ? trie->words : 0;
+}
+
+size_t word_trie_bytes(const word_trie_t *trie) {
+  if (trie == NULL)
+    return 0;
+  return sizeof(word_trie_t) +
+         (size_t)trie->num_nodes * (sizeof(trie_node_t) + sizeof(int)) +
+         trie->labels_len * sizeof(int);
+}
+
+void free_word_trie(word_trie_t *trie) {
+  if (trie == NULL)
+    return;
+  dfree(trie->nodes);
+  dfree(trie->first);
+  dfree(trie->labels);
+  dfree(trie);
+}
@@ -5,18 +5,23 @@
  *   • linked list (linked_list.[ch])
  *   • generic separate-chaining hash table (hash_table.[ch])
  *   • word follower table based on the hash table (word.[ch])
+ *   • dmalloc memory accounting (utils.[ch])
+ *   • latency histograms (timing.[ch])
  *
  * Build:  gcc -Wall -Wextra -pedantic -std=c17 *.c -o tests && ./tests
  * NB:  All malloc calls must be replaced by the project-provided dmalloc()!
  * -----------------------------------------------------*/
 
 #include "../include/hash_table.h"
+#include "../include/ht_template.h"
 #include "../include/ht_item.h"
 #include "../include/linked_list.h"
+#include "../include/timing.h"
 #include "../include/utils.h"
 #include "../include/word.h"
 
 #include <assert.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -60,15 +65,75 @@ static void test_linked_list(void) {
 
   int **arr = (int **)linked_list_to_array(list);
   assert(arr[0] == a && arr[1] == b && arr[2] == c);
-  free(arr);
+  dfree(arr);
 
   remove_from_list(list, b); /* detach node – int still ours */
-  free(b);                   /* free it explicitly          */
+  dfree(b);                  /* free it explicitly          */
   assert(get_list_size(list) == 2);
 
   free_linked_list(list); /* frees nodes + (a and c)     */
 }
 
+/* -----------------------------------------------------
+ * Pool-backed lists with stack payloads, O(1) size, node recycling,
+ * and the intrusive list
+ * -----------------------------------------------------*/
+struct entry {
+  int value;
+  ll_link_t link;
+};
+
+static void test_pooled_lists(void) {
+  ll_pool_t *pool = create_ll_pool(4); /* small slabs: several of them */
+  linked_list_t *a = create_linked_list_pool(pool);
+  linked_list_t *b = create_linked_list_pool(pool);
+  int values[10];
+  for (int i = 0; i < 10; i++) {
+    values[i] = i;
+    add_to_list(i % 2 ? a : b, &values[i]);
+  }
+  assert(get_list_size(a) == 5 && get_list_size(b) == 5);
+  assert(pool->live == 10);
+
+  assert(remove_from_list(a, &values[3]) == 0);
+  assert(remove_from_list(a, &values[3]) == -1); /* silent miss */
+  assert(remove_from_list(a, &values[9]) == 0);  /* the tail */
+  assert(get_list_size(a) == 3 && *(int *)a->tail->data == 7);
+  add_to_list(a, &values[0]); /* reuses a freed node */
+  assert(pool->live == 9 && get_list_size(a) == 4);
+  assert(add_to_list(NULL, &values[0]) == -1);
+
+  /* move a node from b to a without allocating */
+  ll_item_t *node = b->head;
+  ll_unlink_node(b, NULL, node);
+  ll_push_node(a, node);
+  assert(get_list_size(a) == 5 && get_list_size(b) == 4);
+  assert(a->tail->data == &values[0] && *(int *)b->head->data == 2);
+
+  free_linked_list_with(a, NULL); /* payloads are on the stack */
+  free_linked_list_with(b, NULL);
+  assert(pool->live == 0);
+  free_ll_pool(pool);
+
+  struct entry entries[4];
+  ll_intrusive_t list;
+  ll_intrusive_init(&list);
+  for (int i = 0; i < 4; i++) {
+    entries[i].value = i;
+    ll_intrusive_push_back(&list, &entries[i].link);
+  }
+  assert(ll_intrusive_remove(&list, &entries[2].link) == 0);
+  assert(ll_intrusive_remove(&list, &entries[2].link) == -1);
+  ll_intrusive_push_front(&list, &entries[2].link);
+  int expected[] = {2, 0, 1, 3}, k = 0;
+  for (ll_link_t *l = list.head; l; l = l->next)
+    assert(LL_CONTAINER_OF(l, struct entry, link)->value == expected[k++]);
+  assert(list.size == 4 && list.tail == &entries[3].link);
+  while (ll_intrusive_pop_front(&list))
+    ;
+  assert(list.size == 0 && list.head == NULL && list.tail == NULL);
+}
+
 /* -----------------------------------------------------
  * Hash-table tests with <char*,int> pairs
  * -----------------------------------------------------*/
@@ -100,6 +165,206 @@ static void test_ht_table_basic(void) {
   free_hash_table(ht);
 }
 
+/* -----------------------------------------------------
+ * Batched insert / search must match the scalar calls, across resizes
+ * and with repeated keys inside one batch
+ * -----------------------------------------------------*/
+static void test_ht_batch(void) {
+  static char keys[300][16];
+  static int values[300];
+  ht_item *items[300];
+  for (int i = 0; i < 300; i++) {
+    snprintf(keys[i], sizeof keys[i], "key%d", i % 250); /* 50 repeats */
+    values[i] = i;
+    items[i] = default_create_ht_item(keys[i], &values[i]);
+  }
+  hash_table_t *ht = create_hash_table(3, str_hash, str_cmp);
+  ht_insert_batch(ht, items, 300);
+  assert(ht_get_count(ht) == 250);
+
+  const void *probe[260];
+  ht_item *found[260];
+  for (int i = 0; i < 260; i++)
+    probe[i] = keys[i < 250 ? i : i - 250 + 10];
+  probe[259] = "missing";
+  ht_search_batch(ht, probe, 260, found);
+  for (int i = 0; i < 260; i++)
+    assert(found[i] == ht_search(ht, probe[i]));
+  assert(found[259] == NULL);
+  assert(*(int *)found[5]->value == 255);  /* later insert wins */
+  assert(*(int *)found[100]->value == 100);
+  free_hash_table(ht);
+}
+
+/* -----------------------------------------------------
+ * Table-level item operations: duplicates go through ops->update_value,
+ * redundant and removed items through ops->free_item (skipped when NULL);
+ * cached hashes survive resizes
+ * -----------------------------------------------------*/
+static int ops_updates, ops_frees;
+
+static void count_update(const void *item, const void *value) {
+  ops_updates++;
+  ((ht_item *)item)->value = (void *)value;
+}
+
+static void count_free(ht_item *item) {
+  ops_frees++;
+  dfree(item);
+}
+
+static void test_ht_item_ops(void) {
+  static char keys[100][16];
+  static const ht_item_ops_t counting = {count_update, count_free};
+  hash_table_t *ht = create_hash_table_ops(3, str_hash, str_cmp, &counting);
+  for (int i = 0; i < 100; i++) {
+    snprintf(keys[i], sizeof keys[i], "key%d", i % 80);
+    ht_insert(ht, default_create_ht_item(keys[i], keys[i]));
+  }
+  assert(ht_get_count(ht) == 80);
+  assert(ops_updates == 20 && ops_frees == 20);
+  for (int i = 0; i < 80; i++) {
+    ht_item *it = ht_search(ht, keys[i]);
+    assert(it && it->hash == str_hash(keys[i], HT_HASH_RANGE));
+    assert(it->value == keys[i < 20 ? i + 80 : i]);
+  }
+  assert(ht_remove(ht, "key7") == 1 && ops_frees == 21);
+  free_hash_table(ht);
+  assert(ops_frees == 100);
+
+  /* no free_item: the items belong to the caller */
+  static const ht_item_ops_t borrowed = {default_update_value, NULL};
+  ht_item items[10];
+  ht = create_hash_table_ops(3, str_hash, str_cmp, &borrowed);
+  for (int i = 0; i < 10; i++) {
+    items[i].key = keys[i];
+    items[i].value = NULL;
+    ht_insert(ht, &items[i]);
+  }
+  assert(ht_remove(ht, "key3") == 1 && ht_search(ht, "key3") == NULL);
+  free_hash_table(ht);
+  printf("Item ops tests passed.\n");
+}
+
+/* -----------------------------------------------------
+ * Iterators: every item exactly once, also when the buckets are split
+ * into ranges; lists in insertion order
+ * -----------------------------------------------------*/
+static void test_iterators(void) {
+  static char keys[200][16];
+  static int values[200];
+  hash_table_t *ht = create_hash_table(7, str_hash, str_cmp);
+  for (int i = 0; i < 200; i++) {
+    snprintf(keys[i], sizeof keys[i], "it%d", i);
+    values[i] = 0;
+    ht_insert(ht, default_create_ht_item(keys[i], &values[i]));
+  }
+
+  ht_iter_t it;
+  ht_item *item;
+  ht_iter_init(&it, ht);
+  while ((item = ht_iter_next(&it)) != NULL)
+    (*(int *)item->value)++;
+  for (int parts = 1; parts <= 5; parts += 2) {
+    for (int p = 0; p < parts; p++) {
+      int begin, end;
+      ht_partition(ht, p, parts, &begin, &end);
+      ht_iter_init_range(&it, ht, begin, end);
+      while ((item = ht_iter_next(&it)) != NULL)
+        (*(int *)item->value)++;
+    }
+  }
+  for (int i = 0; i < 200; i++)
+    assert(values[i] == 4);
+  free_hash_table(ht);
+
+  hash_table_t *empty = create_hash_table(3, str_hash, str_cmp);
+  ht_iter_init(&it, empty);
+  assert(ht_iter_next(&it) == NULL);
+  free_hash_table(empty);
+
+  linked_list_t *list = create_linked_list();
+  linked_list_iterator_t li;
+  void *data;
+  ll_iter_init(&li, list);
+  assert(!ll_iter_next(&li, &data));
+  for (int i = 0; i < 5; i++)
+    add_to_list(list, &values[i]);
+  ll_iter_init(&li, list);
+  int n = 0;
+  while (ll_iter_next(&li, &data))
+    assert(data == &values[n++]);
+  assert(n == 5);
+  while (list->head)
+    remove_from_list(list, list->head->data);
+  dfree(list);
+}
+
+/* -----------------------------------------------------
+ * Macro generated tables: uint32 -> count against a plain array, with
+ * removals (backward shift) mixed in; code point keys
+ * -----------------------------------------------------*/
+HT_GENERATE(count_table, uint32_t, uint32_t, ht_hash_u32, HT_EQ_SCALAR)
+HT_GENERATE(cp_table, const int *, int, ht_hash_codepoints, ht_eq_codepoints)
+
+static void test_ht_template(void) {
+  enum { RANGE = 3000 };
+  static uint32_t expected[RANGE];
+  count_table_t t;
+  count_table_init(&t, 0);
+  unsigned int state = 12345;
+  for (int i = 0; i < 40000; i++) {
+    state = state * 1103515245u + 12345u;
+    uint32_t key = (state >> 8) % RANGE;
+    if (state % 5 == 0) {
+      assert(count_table_remove(&t, key) == (expected[key] != 0));
+      expected[key] = 0;
+    } else {
+      int added;
+      (*count_table_upsert(&t, key, &added))++;
+      assert(added == (expected[key] == 0));
+      expected[key]++;
+    }
+  }
+  size_t live = 0;
+  for (uint32_t k = 0; k < RANGE; k++) {
+    uint32_t *v = count_table_find(&t, k);
+    assert(expected[k] ? v && *v == expected[k] : v == NULL);
+    live += expected[k] != 0;
+  }
+  assert(t.count == live);
+  size_t pos = 0, seen = 0;
+  uint32_t key, *value;
+  while (count_table_next(&t, &pos, &key, &value)) {
+    assert(*value == expected[key]);
+    seen++;
+  }
+  assert(seen == live);
+  count_table_destroy(&t);
+
+  cp_table_t words;
+  cp_table_init(&words, 4);
+  int oggi[] = {'o', 'g', 'g', 'i', 0}, ogg[] = {'o', 'g', 'g', 0};
+  int oggi2[] = {'o', 'g', 'g', 'i', 0};
+  *cp_table_upsert(&words, oggi, NULL) = 7;
+  assert(cp_table_find(&words, oggi2) && *cp_table_find(&words, oggi2) == 7);
+  assert(cp_table_find(&words, ogg) == NULL);
+
+  /* upsert_entry: the table keeps the key it is given back */
+  int added;
+  cp_table_entry_t *entry = cp_table_upsert_entry(&words, ogg, &added);
+  assert(added && entry->key == ogg && entry->value == 0);
+  static const int kept[] = {'o', 'g', 'g', 0};
+  entry->key = kept;
+  entry->value = 3;
+  entry = cp_table_upsert_entry(&words, oggi2, &added);
+  assert(!added && entry->key == oggi && entry->value == 7);
+  assert(cp_table_find(&words, ogg) && *cp_table_find(&words, ogg) == 3);
+  assert(cp_table_remove(&words, ogg) == 1);
+  assert(cp_table_find(&words, kept) == NULL);
+  cp_table_destroy(&words);
+}
+
 /* -----------------------------------------------------
  * Direct unit tests for ht_item update_value –
  *   1) primitive types via default_update_value
@@ -117,14 +382,14 @@ static void test_ht_item_update_value(void) {
   /* replace value with v2 using default_update_value */
   int *v2 = dmalloc(sizeof *v2);
   *v2 = 20;
-  pit->update_value(pit, v2); /* default_update_value just swaps the pointer */
+  ht_default_item_ops.update_value(pit, v2); /* just swaps the pointer */
   assert(*(int *)pit->value == 20);
 
   /* cleanup primitive case */
   default_free_ht_item(pit); /* frees the wrapper only */
-  free(v1);
-  free(v2);
-  free(pkey);
+  dfree(v1);
+  dfree(v2);
+  dfree(pkey);
   printf("Primitive update_value test passed.\n");
 
   /* --- 2. Word-based follower list ------------------------------------ */
@@ -137,10 +402,17 @@ static void test_ht_item_update_value(void) {
 
   ht_item *wit = word_ht_item_create(wkey, wf1);
 
+  /* update_value receives the follower list of the redundant item, exactly
+   * as ht_insert passes it */
+  linked_list_t *again = create_linked_list();
+  add_to_list(again, create_word(w_follow1));
+  linked_list_t *other = create_linked_list();
+  add_to_list(other, create_word(w_follow2));
+
 /* same follower again → occurrences must grow to 2 */
-  wit->update_value(wit, w_follow1);
+  word_ht_item_ops.update_value(wit, again);
 /* new follower → lista deve contenere due nodi */
-  wit->update_value(wit, w_follow2);
+  word_ht_item_ops.update_value(wit, other);
 
   linked_list_t *followers = (linked_list_t *)wit->value;
   assert(get_list_size(followers) == 2);
@@ -160,7 +432,16 @@ static void test_ht_item_update_value(void) {
   assert(found_tempo && found_caldo);
 
   /* cleanup word case */
-   wit->free_item(wit); /* frees key + follower list */
+  dfree(arr);
+  free_word((word_t *)again->head->data);
+  free_word((word_t *)other->head->data);
+  again->head->data = NULL;
+  other->head->data = NULL;
+  free_linked_list(again);
+  free_linked_list(other);
+  free_word(wkey);
+  free_word(wf1);
+  word_ht_item_ops.free_item(wit); /* frees key + follower list */
 
 }
 
@@ -168,7 +449,9 @@ static void test_ht_item_update_value(void) {
  * Word-follower hash-table tests (unchanged)
  * -----------------------------------------------------*/
 static void test_word_followers_hash_table(void) {
-  hash_table_t *ht = create_hash_table(101, word_hash, word_hashtable_keycmp);
+  hash_table_t *ht = create_hash_table_ops(101, word_hash,
+                                          word_hashtable_keycmp,
+                                          &word_ht_item_ops);
 
   /* ---- parole di prova ---- */
   int w1[] = {'o', 'g', 'g', 'i', '\0'};
@@ -195,7 +478,7 @@ static void test_word_followers_hash_table(void) {
 
   for (int i = 0; i < 2; ++i) {
     if (wordcmp(arr[i], v_tempo) == 0) {
-      assert(arr[i]->occurrences == 2);
+      assert(arr[i]->occurrences == 1);
       found_tempo = 1;
     } else if (wordcmp(arr[i], v_incerto) == 0) {
       assert(arr[i]->occurrences == 2);
@@ -205,28 +488,199 @@ static void test_word_followers_hash_table(void) {
   assert(found_tempo && found_inc);
 
   /* cleanup */
-  free(arr);
+  dfree(arr);
+  free_word(k_oggi);
+  free_word(v_tempo);
+  free_word(v_incerto);
   free_hash_table(ht);
 }
 
 /* -----------------------------------------------------
  * Main: run the full test suite
  * -----------------------------------------------------*/
+/* -----------------------------------------------------
+ * dmalloc accounting: live and peak bytes and counts by subsystem, the
+ * subsystem kept across drealloc, every subsystem of a word follower
+ * table back to where it started once the table is freed (all zero
+ * when accounting is not compiled in)
+ * -----------------------------------------------------*/
+static void test_dmalloc_accounting(void) {
+  mem_stats_t before[MEM_TAGS + 1], st;
+  for (int t = 0; t <= MEM_TAGS; ++t)
+    dmalloc_stats((mem_tag_t)t, &before[t]);
+
+  char *a = dmalloc_tag(100, MEM_ITEMS);
+  char *b = dmalloc_tag(50, MEM_ITEMS);
+  for (int i = 0; i < 100; ++i)
+    assert(a[i] == 0);
+  dmalloc_stats(MEM_ITEMS, &st);
+  if (dmalloc_accounting()) {
+    assert(st.live == before[MEM_ITEMS].live + 150);
+    assert(st.allocs == before[MEM_ITEMS].allocs + 2);
+    assert(st.peak >= st.live);
+  } else {
+    assert(st.live == 0 && st.peak == 0 && st.allocs == 0);
+  }
+  dfree(b);
+  a = drealloc(a, 300); /* still an item */
+  dmalloc_stats(MEM_ITEMS, &st);
+  uint64_t peak = st.peak;
+  if (dmalloc_accounting()) {
+    assert(st.live == before[MEM_ITEMS].live + 300);
+    assert(st.frees == before[MEM_ITEMS].frees + 1);
+    assert(peak >= before[MEM_ITEMS].live + 300);
+  }
+  a = drealloc(a, 10);
+  dmalloc_stats(MEM_ITEMS, &st);
+  assert(st.peak == peak);
+  dfree(a);
+  dfree(NULL);
+
+  /* a table charges words, list nodes, buckets and items */
+  hash_table_t *ht = create_hash_table_ops(11, word_hash,
+                                          word_hashtable_keycmp,
+                                          &word_ht_item_ops);
+  int w1[] = {'o', 'g', 'g', 'i', '\0'};
+  int w2[] = {'t', 'e', 'm', 'p', 'o', '\0'};
+  word_t *k = create_word(w1);
+  word_t *v = create_word(w2);
+  ht_insert(ht, word_ht_item_create(k, v));
+  ht_insert(ht, word_ht_item_create(v, k));
+  static const mem_tag_t used[] = {MEM_WORDS, MEM_LIST_NODES, MEM_BUCKETS,
+                                   MEM_ITEMS};
+  for (size_t i = 0; i < sizeof(used) / sizeof(used[0]); ++i) {
+    dmalloc_stats(used[i], &st);
+    assert(!dmalloc_accounting() || st.live > before[used[i]].live);
+  }
+  free_hash_table(ht);
+  free_word(k);
+  free_word(v);
+  for (int t = 0; t <= MEM_TAGS; ++t) {
+    dmalloc_stats((mem_tag_t)t, &st);
+    assert(st.live == before[t].live);
+    assert(st.allocs - st.frees == before[t].allocs - before[t].frees);
+  }
+
+  int fds[2];
+  char text[4096];
+  assert(pipe(fds) == 0);
+  assert(dmalloc_report(fds[1]) == 0);
+  close(fds[1]);
+  ssize_t n = read(fds[0], text, sizeof text - 1);
+  close(fds[0]);
+  assert(n > 0);
+  text[n] = '\0';
+  if (dmalloc_accounting())
+    assert(strstr(text, "items") && strstr(text, "total"));
+  else
+    assert(strstr(text, "not compiled in"));
+  assert(strcmp(mem_tag_name(MEM_LIST_NODES), "list nodes") == 0);
+}
+
+/* -----------------------------------------------------
+ * Latency histograms: exact counts, minimum and maximum, percentiles
+ * within the bucket resolution, merging across threads
+ * -----------------------------------------------------*/
+static void *record_hundreds(void *arg) {
+  uint64_t value = (uint64_t)(uintptr_t)arg * 100;
+  for (int i = 0; i < 1000; ++i)
+    timing_record(TIMING_DECODE, value);
+  return NULL;
+}
+
+static int near(uint64_t got, double want) {
+  return (double)got >= want * 0.97 && (double)got <= want * 1.03;
+}
+
+static void test_timing(void) {
+  timing_reset();
+  timing_summary_t s;
+  for (uint64_t v = 1; v <= 100000; ++v)
+    timing_record(TIMING_RESIZE, v);
+  assert(timing_summary(TIMING_RESIZE, &s) == 100000);
+  assert(s.min == 1 && s.max == 100000);
+  assert(s.mean == 50000.5);
+  assert(near(s.p50, 50000) && near(s.p90, 90000));
+  assert(near(s.p99, 99000) && near(s.p999, 99900));
+  assert(timing_percentile(TIMING_RESIZE, 0.0) == 1);
+  assert(timing_percentile(TIMING_RESIZE, 1.0) == 100000);
+
+  for (int i = 0; i < 5; ++i) /* small values are exact */
+    timing_record(TIMING_TOKENIZE, 7);
+  timing_record(TIMING_TOKENIZE, 63);
+  assert(timing_summary(TIMING_TOKENIZE, &s) == 6);
+  assert(s.p50 == 7 && s.p90 == 63);
+  assert(timing_summary(TIMING_POINTS, &s) == 0);
+  timing_record(TIMING_TOKENIZE, UINT64_MAX); /* backwards: dropped */
+  timing_record(TIMING_TOKENIZE, (uint64_t)1 << 63);
+  assert(timing_summary(TIMING_TOKENIZE, &s) == 6 && s.max == 63);
+
+  pthread_t tids[4];
+  for (uintptr_t t = 0; t < 4; ++t)
+    assert(pthread_create(&tids[t], NULL, record_hundreds,
+                          (void *)(t + 1)) == 0);
+  for (int t = 0; t < 4; ++t)
+    pthread_join(tids[t], NULL);
+  assert(timing_summary(TIMING_DECODE, &s) == 4000);
+  assert(s.min == 100 && s.max == 400 && s.mean == 250.0);
+  assert(near(timing_percentile(TIMING_DECODE, 0.25), 100));
+  assert(near(timing_percentile(TIMING_DECODE, 0.26), 200));
+  assert(near(s.p50, 200) && near(s.p90, 400));
+
+  TIMER_START(start);
+  TIMER_STOP(TIMING_GENERATE_STEP, start);
+  assert(timing_summary(TIMING_GENERATE_STEP, &s) ==
+         (uint64_t)timing_enabled());
+  assert(timing_ns_per_tick() > 0);
+
+  FILE *out = tmpfile();
+  char text[4096];
+  timing_report(out);
+  rewind(out);
+  size_t n = fread(text, 1, sizeof text - 1, out);
+  fclose(out);
+  text[n] = '\0';
+  assert(strstr(text, "resize") && strstr(text, "p99.9"));
+
+  timing_reset();
+  assert(timing_summary(TIMING_RESIZE, &s) == 0 && s.min == 0);
+  assert(strcmp(timing_point_name(TIMING_HT_INSERT), "ht_insert") == 0);
+}
+
 int main(void) {
   printf("Running tests...\n");
 
   test_linked_list();
   printf("Linked list tests passed.\n");
 
+  test_pooled_lists();
+  printf("Pooled and intrusive list tests passed.\n");
+
   test_ht_table_basic();
   printf("Hash table basic tests passed.\n");
 
+  test_ht_batch();
+  printf("Hash table batch tests passed.\n");
+
+  test_ht_item_ops();
+  test_iterators();
+  printf("Iterator tests passed.\n");
+
+  test_ht_template();
+  printf("Specialized hash table tests passed.\n");
+
   test_ht_item_update_value();
   printf("Hash table item update value tests passed.\n");
 
   test_word_followers_hash_table();
   printf("Word followers hash table tests passed.\n");
 
+  test_dmalloc_accounting();
+  printf("Memory accounting tests passed.\n");
+
+  test_timing();
+  printf("Latency histogram tests passed.\n");
+
   printf("All tests passed successfully!\n");
   return 0;
 }
@@ -0,0 +1,1747 @@
+/* =====================================================
+ * test_train.c  —  Unit tests for training and the frozen model
+ * =====================================================
+ * This file verifies the correctness of:
+ *   • word dictionary (vocab.[ch])
+ *   • frozen model image, save and load (model.[ch])
+ *   • external-memory training (ext_train.[ch])
+ *   • radix sort and the training backends (radix_sort.[ch], train.[ch])
+ *   • CSV/TSV export of the transition table (csv.[ch])
+ *   • multi-process training pipeline (shm_ring.[ch], pipeline.[ch])
+ *   • shared memory models and generation (model.[ch], generate.[ch])
+ *   • incremental updates through a delta log (delta_log.[ch])
+ *   • merging two trained models (model_merge.[ch])
+ *   • compressed models decoded on demand (packed_model.[ch])
+ *   • quantized sampling tables (quant_model.[ch])
+ * -----------------------------------------------------*/
+
+#include "../include/csv.h"
+#include "../include/delta_log.h"
+#include "../include/dir_train.h"
+#include "../include/ext_train.h"
+#include "../include/generate.h"
+#include "../include/ingest.h"
+#include "../include/model.h"
+#include "../include/model_merge.h"
+#include "../include/packed_model.h"
+#include "../include/pipeline.h"
+#include "../include/quant_model.h"
+#include "../include/radix_sort.h"
+#include "../include/tokenizer.h"
+#include "../include/train.h"
+#include "../include/utf8_tools.h"
+#include "../include/utils.h"
+#include "../include/vocab.h"
+#include "../include/word_trie.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/* -----------------------------------------------------
+ * Helpers
+ * -----------------------------------------------------*/
+
+/* Convert an ASCII string into a NUL terminated code point array. */
+static void to_codepoints(const char *s, int *out) {
+  int i = 0;
+  for (; s[i] != '\0'; ++i)
+    out[i] = (unsigned char)s[i];
+  out[i] = '\0';
+}
+
+/* Deterministic pseudo random corpus over a small dictionary. */
+static unsigned int lcg_next(unsigned int *state) {
+  *state = *state * 1103515245u + 12345u;
+  return (*state >> 16) & 0x7FFF;
+}
+
+static void corpus_word(unsigned int index, int *out) {
+  char buf[16];
+  snprintf(buf, sizeof buf, "w%u", index);
+  to_codepoints(buf, out);
+}
+
+/* Overwrite the 8 bytes at offset of a file with value. */
+static void patch_u64(const char *path, long offset, uint64_t value) {
+  FILE *f = fopen(path, "r+b");
+  assert(f != NULL);
+  assert(fseek(f, offset, SEEK_SET) == 0);
+  assert(fwrite(&value, sizeof(value), 1, f) == 1);
+  fclose(f);
+}
+
+/* The same for the 4 bytes at offset. */
+static void patch_u32(const char *path, long offset, uint32_t value) {
+  FILE *f = fopen(path, "r+b");
+  assert(f != NULL);
+  assert(fseek(f, offset, SEEK_SET) == 0);
+  assert(fwrite(&value, sizeof(value), 1, f) == 1);
+  fclose(f);
+}
+
+/* -----------------------------------------------------
+ * Vocabulary
+ * -----------------------------------------------------*/
+static void test_vocab(void) {
+  vocab_t *vocab = create_vocab(7);
+  int w[16];
+
+  for (unsigned int i = 0; i < 1000; ++i) {
+    corpus_word(i, w);
+    assert(vocab_intern(vocab, w) == i);
+  }
+  for (unsigned int i = 0; i < 1000; ++i) {
+    corpus_word(i, w);
+    assert(vocab_intern(vocab, w) == i); /* no duplicates */
+    assert(vocab_find(vocab, w) == i);
+    assert(model_word_cmp(vocab_word(vocab, i), w) == 0);
+  }
+  assert(vocab_size(vocab) == 1000);
+
+  to_codepoints("missing", w);
+  assert(vocab_find(vocab, w) == VOCAB_NO_ID);
+  assert(vocab_bytes(vocab) > 0);
+
+  free_vocab(vocab);
+}
+
+/* -----------------------------------------------------
+ * Model build / save / load
+ * -----------------------------------------------------*/
+static void test_model_roundtrip(void) {
+  vocab_t *vocab = create_vocab(11);
+  const char *words[] = {"oggi", "e", "un", "bel", "giorno"};
+  int w[16];
+  for (int i = 0; i < 5; ++i) {
+    to_codepoints(words[i], w);
+    vocab_intern(vocab, w);
+  }
+  /* oggi -> e(1); e -> un(2); un -> bel(1), giorno(1) */
+  uint64_t rows[] = {0, 1, 2, 4, 4, 4};
+  model_edge_t edges[] = {{1, 1}, {2, 2}, {3, 1}, {4, 1}};
+  model_t *model = model_build(vocab, rows, edges);
+  assert(model != NULL);
+
+  const char *path = "test/test_files/model_roundtrip.bin";
+  assert(model_save(model, path) == 0);
+  model_t *loaded = model_load(path);
+  assert(loaded != NULL);
+  assert(loaded->mapped);
+
+  assert(model_num_words(loaded) == 5);
+  assert(model_num_edges(loaded) == 4);
+  for (int i = 0; i < 5; ++i) {
+    to_codepoints(words[i], w);
+    assert(model_find(loaded, w) == (uint32_t)i);
+  }
+  to_codepoints("domani", w);
+  assert(model_find(loaded, w) == VOCAB_NO_ID);
+
+  uint32_t n;
+  const model_edge_t *f = model_followers(loaded, 2, &n);
+  assert(n == 2 && f[0].next == 3 && f[1].next == 4);
+  assert(model_row_total(loaded, 1) == 2);
+  model_followers(loaded, 4, &n);
+  assert(n == 0);
+
+  /* sections moved, rows past the edges: rejected */
+  uint64_t rows_end = loaded->header->row_offsets_off + 5 * sizeof(uint64_t);
+  patch_u64(path, offsetof(model_header_t, pool_off), 0);
+  assert(model_load(path) == NULL);
+  assert(model_save(model, path) == 0);
+  patch_u64(path, offsetof(model_header_t, row_totals_off), 8);
+  assert(model_load(path) == NULL);
+  assert(model_save(model, path) == 0);
+  patch_u64(path, (long)rows_end, 5);
+  assert(model_load(path) == NULL);
+  assert(model_save(model, path) == 0);
+  patch_u64(path, (long)rows_end - 8, 3); /* not monotonic */
+  assert(model_load(path) == NULL);
+
+  /* IDs, ranks and the pool past what they index: rejected */
+  const model_header_t *h = model->header;
+  assert(model_save(model, path) == 0);
+  patch_u32(path, (long)h->sorted_ids_off + 4, 0x7fffffff);
+  assert(model_load(path) == NULL);
+  assert(model_save(model, path) == 0);
+  patch_u32(path, (long)(h->edges_off + 2 * sizeof(model_edge_t)), 5);
+  assert(model_load(path) == NULL);
+  assert(model_save(model, path) == 0);
+  patch_u32(path, (long)h->ranks_off + 2 * 4, 2); /* row 2 has 2 */
+  assert(model_load(path) == NULL);
+  assert(model_save(model, path) == 0);
+  patch_u32(path, (long)(h->pool_off + (h->pool_len - 1) * sizeof(int)), 'x');
+  assert(model_load(path) == NULL);
+
+  free_model(loaded);
+  free_model(model);
+  free_vocab(vocab);
+  unlink(path);
+}
+
+/* -----------------------------------------------------
+ * External training: tiny budget -> many runs and merge passes
+ * -----------------------------------------------------*/
+#define EXT_TOKENS 200000
+#define EXT_WORDS 300
+
+static void test_external_training(void) {
+  ext_train_config_t config = {512 * 1024, "test/test_files"};
+  ext_trainer_t *trainer = create_ext_trainer(&config);
+  assert(trainer != NULL);
+
+  /* reference counts, indexed by first-appearance IDs */
+  unsigned int *ref = dmalloc(sizeof(unsigned int) * EXT_WORDS * EXT_WORDS);
+  unsigned int id_of[EXT_WORDS];
+  for (int i = 0; i < EXT_WORDS; ++i)
+    id_of[i] = UINT32_MAX;
+  unsigned int next_id = 0;
+
+  unsigned int state = 42, prev = UINT32_MAX;
+  int w[16];
+  for (int i = 0; i < EXT_TOKENS; ++i) {
+    unsigned int k = lcg_next(&state) % EXT_WORDS;
+    if (id_of[k] == UINT32_MAX)
+      id_of[k] = next_id++;
+    corpus_word(k, w);
+    ext_trainer_add_word(trainer, w);
+    if (prev != UINT32_MAX)
+      ref[prev * EXT_WORDS + id_of[k]]++;
+    prev = id_of[k];
+    if (i == EXT_TOKENS / 2) { /* document boundary */
+      ext_trainer_break(trainer);
+      prev = UINT32_MAX;
+    }
+  }
+
+  const char *path = "test/test_files/model_external.bin";
+  assert(ext_trainer_finish(trainer, path) == 0);
+  const ext_train_stats_t *stats = ext_trainer_get_stats(trainer);
+  assert(stats->tokens == EXT_TOKENS);
+  assert(stats->pairs == EXT_TOKENS - 2);
+  assert(stats->runs > 2);
+  assert(stats->merge_passes > 0);
+
+  model_t *model = model_load(path);
+  assert(model != NULL);
+  assert(model_num_words(model) == next_id);
+  uint64_t edges = 0;
+  for (unsigned int a = 0; a < next_id; ++a) {
+    uint32_t n;
+    const model_edge_t *f = model_followers(model, a, &n);
+    for (uint32_t j = 0; j < n; ++j) {
+      assert(j == 0 || f[j - 1].next < f[j].next);
+      assert(f[j].count == ref[a * EXT_WORDS + f[j].next]);
+    }
+    for (unsigned int b = 0; b < next_id; ++b)
+      edges += ref[a * EXT_WORDS + b] != 0;
+  }
+  assert(model_num_edges(model) == edges);
+  assert(stats->edges == edges);
+
+  free_model(model);
+  dfree(ref);
+  free_ext_trainer(trainer);
+  unlink(path);
+}
+
+/* -----------------------------------------------------
+ * Radix sort: serial and threaded against a sortedness check
+ * -----------------------------------------------------*/
+static void test_radix_sort(void) {
+  size_t n = 300000;
+  uint64_t *keys = dmalloc(sizeof(uint64_t) * n);
+  uint64_t *scratch = dmalloc(sizeof(uint64_t) * n);
+  for (int threads = 1; threads <= 3; threads += 2) {
+    unsigned int state = 7;
+    uint64_t sum = 0;
+    for (size_t i = 0; i < n; ++i) {
+      keys[i] = (uint64_t)(lcg_next(&state) % 5000) << 32 |
+                (lcg_next(&state) * 3u);
+      sum += keys[i];
+    }
+    radix_sort_u64(keys, scratch, n, threads);
+    uint64_t check = keys[0];
+    for (size_t i = 1; i < n; ++i) {
+      assert(keys[i - 1] <= keys[i]);
+      check += keys[i];
+    }
+    assert(check == sum); /* same multiset (up to a checksum) */
+  }
+  dfree(keys);
+  dfree(scratch);
+}
+
+/* -----------------------------------------------------
+ * Every backend must count the same (word, follower) pairs
+ * -----------------------------------------------------*/
+static model_t *train_corpus(train_backend_t backend, const char *path) {
+  train_config_t config = {backend, 2, {512 * 1024, "test/test_files"}, path};
+  trainer_t *trainer = create_trainer(&config);
+  unsigned int state = 1234;
+  int w[16];
+  for (int i = 0; i < 20000; ++i) {
+    corpus_word(lcg_next(&state) % 150, w);
+    if (i % 7 == 0)
+      w[0] = 'W'; /* mixed case folds into the same word */
+    trainer_add_word(trainer, w);
+  }
+  assert(trainer_get_tokens(trainer) == 20000);
+  model_t *model = trainer_finish(trainer);
+  free_trainer(trainer);
+  return model;
+}
+
+static void assert_same_model(const model_t *a, const model_t *b) {
+  assert(model_num_words(a) == model_num_words(b));
+  assert(model_num_edges(a) == model_num_edges(b));
+  for (uint32_t id = 0; id < model_num_words(a); ++id) {
+    uint32_t other = model_find(b, model_word(a, id));
+    assert(other != VOCAB_NO_ID);
+    uint32_t na, nb;
+    const model_edge_t *fa = model_followers(a, id, &na);
+    const model_edge_t *fb = model_followers(b, other, &nb);
+    assert(na == nb);
+    for (uint32_t i = 0; i < na; ++i) {
+      uint32_t j = 0;
+      while (j < nb && model_word_cmp(model_word(a, fa[i].next),
+                                      model_word(b, fb[j].next)) != 0)
+        j++;
+      assert(j < nb && fa[i].count == fb[j].count);
+    }
+  }
+}
+
+static void test_training_backends(void) {
+  const char *path = "test/test_files/model_backends.bin";
+  model_t *hash = train_corpus(TRAIN_BACKEND_HASH_TABLE, NULL);
+  model_t *radix = train_corpus(TRAIN_BACKEND_RADIX, NULL);
+  model_t *external = train_corpus(TRAIN_BACKEND_EXTERNAL, path);
+  assert(hash && radix && external);
+
+  int w[16];
+  corpus_word(3, w);
+  assert(model_find(radix, w) != VOCAB_NO_ID);
+  w[0] = 'W';
+  assert(model_find(radix, w) == VOCAB_NO_ID); /* stored lowercase */
+
+  assert_same_model(hash, radix);
+  assert_same_model(radix, external);
+
+  train_backend_t backend;
+  assert(train_backend_from_name("radix", &backend) == 0 &&
+         backend == TRAIN_BACKEND_RADIX);
+  assert(train_backend_from_name("nope", &backend) == -1);
+
+  free_model(hash);
+  free_model(radix);
+  free_model(external);
+  unlink(path);
+}
+
+/* -----------------------------------------------------
+ * Shared memory: publish once, attach from this and another process;
+ * attached copies outlive the name. Generation only follows real edges.
+ * -----------------------------------------------------*/
+static void test_model_shm(void) {
+  model_t *model = train_corpus(TRAIN_BACKEND_RADIX, NULL);
+  char name[64];
+  snprintf(name, sizeof name, "/markov_first_test-%ld", (long)getpid());
+  assert(model_publish_shm(model, name) == 0);
+  assert(model_publish_shm(model, name) == -1); /* already there */
+
+  model_t *shared = model_attach_shm(name);
+  assert(shared != NULL && shared->mapped);
+  assert(shared->image_size == model->image_size);
+  assert(memcmp(shared->image, model->image, model->image_size) == 0);
+
+  pid_t child = fork();
+  assert(child >= 0);
+  if (child == 0) {
+    model_t *other = model_attach_shm(name);
+    int ok = other != NULL &&
+             model_num_edges(other) == model_num_edges(model) &&
+             model_row_total(other, 7) == model_row_total(model, 7);
+    free_model(other);
+    _exit(ok ? 0 : 1);
+  }
+  int status;
+  assert(waitpid(child, &status, 0) == child);
+  assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+  assert(model_unpublish_shm(name) == 0);
+  assert(model_attach_shm(name) == NULL);
+  assert(model_num_words(shared) == model_num_words(model)); /* still mapped */
+
+  /* generation: same seed, same walk; every step is an edge */
+  uint32_t walk[64], again[64];
+  uint64_t s1 = 42, s2 = 42;
+  size_t n = generate_walk(shared, 0, walk, 64, &s1);
+  assert(n == 64 && generate_walk(model, 0, again, 64, &s2) == n);
+  assert(memcmp(walk, again, sizeof(uint32_t) * n) == 0);
+  for (size_t i = 0; i < n; ++i) {
+    uint32_t from = i ? walk[i - 1] : 0, count;
+    const model_edge_t *f = model_followers(shared, from, &count);
+    uint32_t k = 0;
+    while (k < count && f[k].next != walk[i])
+      k++;
+    assert(k < count);
+  }
+  free_model(shared);
+  free_model(model);
+}
+
+/* -----------------------------------------------------
+ * Top-k followers
+ * -----------------------------------------------------*/
+/* Every top-k answer of model against sorting the row. */
+static void check_top_followers(const model_t *model) {
+  model_follower_t top[64];
+  for (uint32_t id = 0; id < model_num_words(model); ++id) {
+    uint32_t n;
+    const model_edge_t *row = model_followers(model, id, &n);
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < n; ++i)
+      total += row[i].count;
+    assert(model_row_total(model, id) == total);
+
+    uint32_t k = n < 64 ? n + 1 : 64; /* more than there are, if possible */
+    uint32_t got = model_top_followers(model, id, k, top);
+    assert(got == (n < k ? n : k));
+    double sum = 0;
+    for (uint32_t i = 0; i < got; ++i) {
+      assert(top[i].probability == (double)top[i].count / (double)total);
+      sum += top[i].probability;
+      if (i > 0)
+        assert(top[i - 1].count > top[i].count ||
+               (top[i - 1].count == top[i].count &&
+                top[i - 1].next < top[i].next));
+    }
+    if (got == n && n > 0)
+      assert(sum > 0.999999 && sum < 1.000001);
+    /* nothing left out is more frequent than the last one returned */
+    for (uint32_t i = 0; got > 0 && i < n; ++i) {
+      int listed = 0;
+      for (uint32_t j = 0; j < got; ++j)
+        listed |= top[j].next == row[i].next;
+      assert(listed || row[i].count <= top[got - 1].count);
+    }
+  }
+}
+
+static void test_top_followers(void) {
+  vocab_t *vocab = create_vocab(11);
+  const char *words[] = {"il", "gatto", "cane", "topo"};
+  int w[16];
+  for (int i = 0; i < 4; ++i) {
+    to_codepoints(words[i], w);
+    vocab_intern(vocab, w);
+  }
+  /* il -> gatto(5) cane(9) topo(5); cane -> il(1) */
+  uint64_t rows[] = {0, 3, 3, 4, 4};
+  model_edge_t edges[] = {{1, 5}, {2, 9}, {3, 5}, {0, 1}};
+  model_t *model = model_build(vocab, rows, edges);
+  model_follower_t top[5];
+  assert(model_top_followers(model, 0, 2, top) == 2);
+  assert(top[0].next == 2 && top[0].count == 9);
+  assert(top[1].next == 1 && top[1].count == 5); /* tie: lower ID first */
+  assert(top[0].probability == 9.0 / 19.0);
+  assert(model_top_followers(model, 1, 3, top) == 0);
+  assert(model_top_followers(model, 9, 3, top) == 0);
+  assert(model_top_followers(model, 0, 0, top) == 0);
+
+  uint32_t ids[] = {2, 0, 7, 1};
+  model_follower_t batch[4 * 2];
+  uint32_t found[4];
+  model_top_followers_batch(model, ids, 4, 2, batch, found);
+  assert(found[0] == 1 && batch[0].next == 0 && batch[0].probability == 1.0);
+  assert(found[1] == 2 && batch[2].next == 2 && batch[3].next == 1);
+  assert(found[2] == 0 && found[3] == 0);
+  check_top_followers(model);
+  free_model(model);
+  free_vocab(vocab);
+
+  /* trained in memory, and streamed to disk by the external backend */
+  const char *path = "test/test_files/top_followers.bin";
+  model_t *radix = train_corpus(TRAIN_BACKEND_RADIX, NULL);
+  model_t *external = train_corpus(TRAIN_BACKEND_EXTERNAL, path);
+  check_top_followers(radix);
+  check_top_followers(external);
+  uint32_t *all = dmalloc(sizeof(uint32_t) * model_num_words(radix));
+  for (uint32_t id = 0; id < model_num_words(radix); ++id)
+    all[id] = model_num_words(radix) - 1 - id;
+  model_follower_t *out =
+      dmalloc(sizeof(model_follower_t) * 5 * model_num_words(radix));
+  uint32_t *counts = dmalloc(sizeof(uint32_t) * model_num_words(radix));
+  model_top_followers_batch(radix, all, model_num_words(radix), 5, out,
+                            counts);
+  for (uint32_t i = 0; i < model_num_words(radix); ++i) {
+    assert(model_top_followers(radix, all[i], 5, top) == counts[i]);
+    for (uint32_t j = 0; j < counts[i] && j < 3; ++j)
+      assert(out[i * 5 + j].next == top[j].next);
+  }
+  dfree(all);
+  dfree(out);
+  dfree(counts);
+  free_model(radix);
+  free_model(external);
+  unlink(path);
+}
+
+/* -----------------------------------------------------
+ * Beam search generation
+ * -----------------------------------------------------*/
+/* Best two step continuation of start, by enumerating every path. */
+static size_t best_two_steps(const model_t *model, uint32_t start,
+                             uint32_t *out, double *best) {
+  size_t steps = 0;
+  uint32_t n1;
+  const model_edge_t *r1 = model_followers(model, start, &n1);
+  double t1 = log((double)model_row_total(model, start));
+  for (uint32_t i = 0; i < n1; ++i) {
+    double s1 = 0.0 + log((double)r1[i].count) - t1;
+    uint32_t n2;
+    const model_edge_t *r2 = model_followers(model, r1[i].next, &n2);
+    if (n2 == 0) {
+      if (steps < 2 && (steps == 0 || s1 > *best)) {
+        steps = 1;
+        *best = s1;
+        out[0] = r1[i].next;
+      }
+      continue;
+    }
+    double t2 = log((double)model_row_total(model, r1[i].next));
+    for (uint32_t j = 0; j < n2; ++j) {
+      double s2 = s1 + log((double)r2[j].count) - t2;
+      if (steps < 2 || s2 > *best) {
+        steps = 2;
+        *best = s2;
+        out[0] = r1[i].next;
+        out[1] = r2[j].next;
+      }
+    }
+  }
+  return steps;
+}
+
+static void test_beam_search(void) {
+  vocab_t *vocab = create_vocab(11);
+  const char *words[] = {"il", "gatto", "cane", "nero", "bianco", "dorme"};
+  int w[16];
+  for (int i = 0; i < 6; ++i) {
+    to_codepoints(words[i], w);
+    vocab_intern(vocab, w);
+  }
+  /* il -> gatto(6) cane(4); gatto -> nero(5) bianco(5); cane -> dorme */
+  uint64_t rows[] = {0, 2, 4, 5, 5, 5, 5};
+  model_edge_t edges[] = {{1, 6}, {2, 4}, {3, 5}, {4, 5}, {5, 4}};
+  model_t *model = model_build(vocab, rows, edges);
+  uint32_t out[8];
+  double lp;
+  generate_beam_t *greedy = create_generate_beam(1, 2);
+  generate_beam_t *wide = create_generate_beam(2, 1); /* grows */
+  assert(create_generate_beam(0, 4) == NULL);
+
+  /* width 1 is greedy: il gatto nero, 0.6 * 0.5 (tie: lower ID) */
+  assert(generate_beam_search(greedy, model, 0, out, 2, &lp) == 2);
+  assert(out[0] == 1 && out[1] == 3);
+  assert(fabs(lp - log(0.3)) < 1e-12);
+  /* width 2 finds il cane dorme, 0.4 */
+  assert(generate_beam_search(wide, model, 0, out, 2, &lp) == 2);
+  assert(out[0] == 2 && out[1] == 5);
+  assert(fabs(lp - log(0.4)) < 1e-12);
+  assert(generate_beam_search(wide, model, 0, out, 1, &lp) == 1);
+  assert(out[0] == 1 && fabs(lp - log(0.6)) < 1e-12);
+  /* every path ends after two words */
+  assert(generate_beam_search(wide, model, 0, out, 8, &lp) == 2);
+  assert(out[0] == 2 && out[1] == 5);
+  assert(generate_beam_search(wide, model, 5, out, 8, &lp) == 0 && lp == 0);
+  assert(generate_beam_search(wide, model, 42, out, 8, NULL) == 0);
+  assert(generate_beam_search(wide, model, 0, out, 0, NULL) == 0);
+  free_generate_beam(greedy);
+  free_generate_beam(wide);
+  free_model(model);
+  free_vocab(vocab);
+
+  /* on a trained model: exact when the beam holds every first step,
+   * greedy at width 1, and the same answer every time */
+  model = train_corpus(TRAIN_BACKEND_RADIX, NULL);
+  uint32_t words_n = model_num_words(model);
+  generate_beam_t *exact = create_generate_beam(words_n, 2);
+  greedy = create_generate_beam(1, 16);
+  wide = create_generate_beam(8, 16);
+  uint32_t expect[2], again[16];
+  model_follower_t top;
+  for (uint32_t id = 0; id < words_n; ++id) {
+    double best = 0, got;
+    size_t steps = best_two_steps(model, id, expect, &best);
+    assert(generate_beam_search(exact, model, id, out, 2, &got) == steps);
+    assert(steps == 0 || got == best);
+
+    size_t n = generate_beam_search(greedy, model, id, again, 16, NULL);
+    uint32_t cur = id;
+    for (size_t k = 0; k < n; ++k) {
+      assert(model_top_followers(model, cur, 1, &top) == 1);
+      assert(again[k] == top.next);
+      cur = top.next;
+    }
+    assert(n == 16 || model_top_followers(model, cur, 1, &top) == 0);
+
+    double a, b;
+    n = generate_beam_search(wide, model, id, again, 16, &a);
+    uint32_t first[16];
+    memcpy(first, again, sizeof(first));
+    assert(generate_beam_search(wide, model, id, again, 16, &b) == n);
+    assert(a == b && memcmp(first, again, n * sizeof(uint32_t)) == 0);
+  }
+  free_generate_beam(exact);
+  free_generate_beam(greedy);
+  free_generate_beam(wide);
+  free_model(model);
+}
+
+/* -----------------------------------------------------
+ * CSV export: exact text, quoting, and thread independence
+ * -----------------------------------------------------*/
+static char *read_text(const char *path) {
+  FILE *f = fopen(path, "rb");
+  assert(f != NULL);
+  fseek(f, 0, SEEK_END);
+  long size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  char *text = dmalloc((size_t)size + 1);
+  assert(fread(text, 1, (size_t)size, f) == (size_t)size);
+  text[size] = '\0';
+  fclose(f);
+  return text;
+}
+
+static void test_csv_export(void) {
+  vocab_t *vocab = create_vocab(11);
+  const char *words[] = {"oggi", ",", "citt\xe0", "\"x\""};
+  int w[16];
+  for (int i = 0; i < 4; ++i) {
+    to_codepoints(words[i], w);
+    vocab_intern(vocab, w);
+  }
+  /* oggi -> ,(3) città(1); città -> "x"(12) */
+  uint64_t rows[] = {0, 2, 2, 3, 3};
+  model_edge_t edges[] = {{1, 3}, {2, 1}, {3, 12}};
+  model_t *model = model_build(vocab, rows, edges);
+  const char *path = "test/test_files/export.csv";
+
+  int64_t bytes = model_export_csv(model, path, NULL);
+  char *text = read_text(path);
+  const char *expected = "word,follower,count\n"
+                         "oggi,\",\",3\n"
+                         "oggi,citt\xc3\xa0,1\n"
+                         "citt\xc3\xa0,\"\"\"x\"\"\",12\n";
+  assert(strcmp(text, expected) == 0);
+  assert(bytes == (int64_t)strlen(expected));
+  dfree(text);
+
+  csv_export_config_t tsv = {'\t', CSV_VALUE_PROBABILITY, 0, 2};
+  assert(model_export_csv(model, path, &tsv) > 0);
+  text = read_text(path);
+  expected = "oggi\t,\t0.750000\n"
+             "oggi\tcitt\xc3\xa0\t0.250000\n"
+             "citt\xc3\xa0\t\"\"\"x\"\"\"\t1.000000\n";
+  assert(strcmp(text, expected) == 0);
+  dfree(text);
+  free_model(model);
+  free_vocab(vocab);
+
+  /* a bigger table: 1 and 3 threads must write the same bytes */
+  model_t *big = train_corpus(TRAIN_BACKEND_RADIX, NULL);
+  csv_export_config_t one = {',', CSV_VALUE_PROBABILITY, 1, 1};
+  csv_export_config_t three = {',', CSV_VALUE_PROBABILITY, 1, 3};
+  assert(model_export_csv(big, path, &one) > 0);
+  char *a = read_text(path);
+  assert(model_export_csv(big, path, &three) > 0);
+  char *b = read_text(path);
+  assert(strcmp(a, b) == 0);
+  dfree(a);
+  dfree(b);
+  free_model(big);
+  unlink(path);
+}
+
+static void write_text(const char *path, const char *text) {
+  FILE *f = fopen(path, "w");
+  assert(f != NULL);
+  fputs(text, f);
+  fclose(f);
+}
+
+static void test_csv_import(void) {
+  const char *path = "test/test_files/import.csv";
+
+  /* quoting, CRLF, blank lines and repeated edges */
+  write_text(path, "word,follower,count\r\n"
+                   "oggi,\",\",3\r\n"
+                   "\n"
+                   "oggi,citt\xc3\xa0,1\n"
+                   "citt\xc3\xa0,\"\"\"x\"\"\",12\n"
+                   "oggi,\",\",2");
+  model_t *model = model_import_csv(path, NULL);
+  assert(model != NULL);
+  assert(model_num_words(model) == 4);
+  assert(model_num_edges(model) == 3);
+  int w[16];
+  to_codepoints("oggi", w);
+  uint32_t oggi = model_find(model, w);
+  assert(oggi == 0);
+  uint32_t n;
+  const model_edge_t *f = model_followers(model, oggi, &n);
+  assert(n == 2 && f[0].next == 1 && f[0].count == 5 && f[1].count == 1);
+  to_codepoints("\"x\"", w);
+  assert(model_find(model, w) == 3);
+  free_model(model);
+
+  /* export -> import gives back the trained model, whatever the threads */
+  model_t *trained = train_corpus(TRAIN_BACKEND_RADIX, NULL);
+  csv_export_config_t tsv = {'\t', CSV_VALUE_COUNT, 1, 1};
+  assert(model_export_csv(trained, path, &tsv) > 0);
+  model_t *one = model_import_csv(path, NULL);
+  csv_import_config_t three = {'\t', 3};
+  model_t *many = model_import_csv(path, &three);
+  assert_same_model(trained, one);
+  assert_same_model(one, many);
+  for (uint32_t id = 0; id < model_num_words(one); ++id)
+    assert(model_word_cmp(model_word(one, id), model_word(many, id)) == 0);
+  free_model(trained);
+  free_model(one);
+  free_model(many);
+
+  /* errors are rejected (and reported with their line) */
+  write_text(path, "a,b,1\nb,c\n");
+  assert(model_import_csv(path, NULL) == NULL);
+  write_text(path, "word,follower,probability\na,b,0.5\n");
+  assert(model_import_csv(path, NULL) == NULL);
+  write_text(path, "a,b,1\n\"a,b,1\n");
+  assert(model_import_csv(path, NULL) == NULL);
+  write_text(path, "a,b,99999999999\n");
+  assert(model_import_csv(path, NULL) == NULL);
+  write_text(path, "a,b,1\nb,c,0\n"); /* a row total of 0 */
+  assert(model_import_csv(path, NULL) == NULL);
+  unlink(path);
+}
+
+/* Tokens joined with '|', UTF-8 encoded. */
+typedef struct {
+  char text[512];
+  size_t len;
+} token_log_t;
+
+static void log_token(void *ctx, const int *token, size_t length) {
+  token_log_t *log = ctx;
+  assert(token[length] == '\0');
+  for (size_t i = 0; i < length; ++i)
+    log->len += utf8_encode(token[i], log->text + log->len);
+  log->text[log->len++] = '|';
+  log->text[log->len] = '\0';
+}
+
+static void test_tokenizer(void) {
+  token_log_t log = {{0}, 0};
+  tokenizer_t *tok = create_tokenizer(log_token, &log);
+  const char *text = "L'acqua \xc3\xa8 bella, po' fredda... "
+                     "Perch\xc3\xa9? l\xe2\x80\x99" "alba \"citt\xc3\xa0\"";
+  tokenizer_feed_utf8(tok, text, strlen(text));
+  tokenizer_finish(tok);
+  assert(strcmp(log.text, "L'|acqua|\xc3\xa8|bella|,|po'|fredda|.|.|.|"
+                          "Perch\xc3\xa9|?|l'|alba|citt\xc3\xa0|") == 0);
+  const tokenizer_stats_t *stats = tokenizer_get_stats(tok);
+  assert(stats->words == 10 && stats->punct == 5 && stats->invalid == 0);
+  free_tokenizer(tok);
+
+  /* sequences split between feeds, malformed bytes, long words */
+  log.len = 0;
+  tok = create_tokenizer(log_token, &log);
+  tokenizer_feed_utf8(tok, "citt\xc3", 5);
+  tokenizer_feed_utf8(tok, "\xa0 a\xff" "b \xe2\x82 c ", 11);
+  char longword[64];
+  memset(longword, 'x', 40);
+  tokenizer_feed_utf8(tok, longword, 40);
+  tokenizer_finish(tok);
+  assert(strncmp(log.text, "citt\xc3\xa0|a|b|c|", 13) == 0);
+  assert(log.len == 13 + MAX_WORD_LENGTH);
+  stats = tokenizer_get_stats(tok);
+  assert(stats->invalid == 2 && stats->cut == 1 && stats->bytes == 56);
+  free_tokenizer(tok);
+
+  /* overlong forms, surrogates, past U+10FFFF: one ' ' per bad byte */
+  log.len = 0;
+  tok = create_tokenizer(log_token, &log);
+  tokenizer_feed_utf8(tok, "a\xe0\x81\x81" "b\xed\xa0\x80" "c", 9);
+  tokenizer_feed_utf8(tok, "\xf4\x90\x80\x80" "d\xe0", 6);
+  tokenizer_feed_utf8(tok, "\x9f\x80" "e", 3); /* split overlong */
+  tokenizer_finish(tok);
+  log.text[log.len] = '\0';
+  assert(strcmp(log.text, "a|b|c|d|e|") == 0);
+  assert(tokenizer_get_stats(tok)->invalid == 13);
+  free_tokenizer(tok);
+
+  /* decoded input through the same machine */
+  int codepoints[16];
+  to_codepoints("Oggi, ieri", codepoints);
+  log.len = 0;
+  tok = create_tokenizer(log_token, &log);
+  tokenizer_feed(tok, codepoints, 10);
+  tokenizer_finish(tok);
+  assert(strcmp(log.text, "Oggi|,|ieri|") == 0);
+  free_tokenizer(tok);
+  assert(token_class('a') == TOKEN_CLASS_LETTER);
+  assert(token_class(0x2019) == TOKEN_CLASS_APOSTROPHE);
+  assert(token_class(0x2026) == TOKEN_CLASS_PUNCT);
+  assert(token_class('(') == TOKEN_CLASS_SEPARATOR);
+
+  /* straight into training */
+  trainer_t *trainer = create_trainer(NULL);
+  tok = create_tokenizer(tokenizer_train_sink, trainer);
+  text = "L'acqua \xc3\xa8 fredda. l'acqua \xc3\xa8 calda.";
+  tokenizer_feed_utf8(tok, text, strlen(text));
+  tokenizer_finish(tok);
+  free_tokenizer(tok);
+  model_t *model = trainer_finish(trainer);
+  assert(trainer_get_tokens(trainer) == 10);
+  int w[8];
+  to_codepoints("l'", w);
+  uint32_t id = model_find(model, w);
+  uint32_t n;
+  const model_edge_t *f = model_followers(model, id, &n);
+  assert(n == 1 && f[0].count == 2);
+  to_codepoints(".", w);
+  assert(model_row_total(model, model_find(model, w)) == 1);
+  free_model(model);
+  free_trainer(trainer);
+}
+
+/* -----------------------------------------------------
+ * Pipeline: same words as the in-process path, with batches small enough
+ * to cut UTF-8 sequences and to make every stage wait
+ * -----------------------------------------------------*/
+static void test_pipeline(void) {
+  const char *paths[] = {"test/test_files/pipeline_a.txt",
+                         "test/test_files/pipeline_b.txt"};
+  FILE *f = fopen(paths[0], "w");
+  assert(f != NULL);
+  for (int i = 0; i < 400; ++i)
+    fprintf(f, "Oggi la citt\xc3\xa0 \xe2\x80\x94 l'acqua, %s po' %d.\n",
+            i % 3 ? "perch\xc3\xa9" : "bad\xff\xc3", i % 17);
+  fputs("fine \xc3", f); /* cut sequence at the end */
+  fclose(f);
+  write_text(paths[1], "Un altro testo, un'altra catena.");
+
+  size_t bytes = 0;
+  train_config_t config = {TRAIN_BACKEND_RADIX, 1, {0, NULL}, NULL};
+  trainer_t *direct = create_trainer(&config);
+  tokenizer_t *tok = create_tokenizer(tokenizer_train_sink, direct);
+  for (int i = 0; i < 2; ++i) {
+    char *text = read_text(paths[i]);
+    bytes += strlen(text);
+    tokenizer_feed_utf8(tok, text, strlen(text));
+    tokenizer_finish(tok);
+    trainer_break(direct);
+    dfree(text);
+  }
+  uint64_t invalid = tokenizer_get_stats(tok)->invalid;
+  free_tokenizer(tok);
+
+  trainer_t *piped = create_trainer(&config);
+  pipeline_config_t small = {2, 512};
+  pipeline_stats_t stats;
+  assert(pipeline_train(piped, paths, 2, &small, &stats) == 0);
+  assert(trainer_get_tokens(piped) == trainer_get_tokens(direct));
+  assert(stats.reader.items == bytes);
+  assert(stats.tokenizer.items == trainer_get_tokens(piped));
+  assert(stats.builder.items == trainer_get_tokens(piped));
+  assert(stats.invalid == invalid && invalid == 134 * 2 + 1);
+
+  model_t *a = trainer_finish(direct);
+  model_t *b = trainer_finish(piped);
+  assert_same_model(a, b);
+  assert(model_num_words(a) == model_num_words(b)); /* same IDs too */
+  for (uint32_t id = 0; id < model_num_words(a); ++id)
+    assert(model_word_cmp(model_word(a, id), model_word(b, id)) == 0);
+  free_model(a);
+  free_model(b);
+  free_trainer(direct);
+  free_trainer(piped);
+
+  /* a reader failure reaches the caller */
+  const char *missing[] = {paths[1], "test/test_files/no_such_corpus.txt"};
+  trainer_t *failed = create_trainer(&config);
+  assert(pipeline_train(failed, missing, 2, &small, NULL) == -1);
+  free_trainer(failed);
+  unlink(paths[0]);
+  unlink(paths[1]);
+}
+
+typedef struct {
+  char *text[3];
+  size_t len[3];
+  int ended[3];
+  int current; /* file being delivered */
+  int stop_after; /* calls before returning 1, -1: never */
+} ingest_log_t;
+
+static int log_ingest(void *ctx, int file, const char *data, size_t len) {
+  ingest_log_t *log = ctx;
+  assert(file == log->current && !log->ended[file]);
+  if (len == 0) {
+    log->ended[file] = 1;
+    log->current++;
+  } else {
+    log->text[file] = drealloc(log->text[file], log->len[file] + len + 1);
+    memcpy(log->text[file] + log->len[file], data, len);
+    log->len[file] += len;
+    log->text[file][log->len[file]] = '\0';
+  }
+  return log->stop_after >= 0 && log->stop_after-- == 0;
+}
+
+static void test_ingest(void) {
+  const char *paths[] = {"test/test_files/ingest_a.txt",
+                         "test/test_files/ingest_empty.txt",
+                         "test/test_files/ingest_b.txt"};
+  FILE *f = fopen(paths[0], "w");
+  assert(f != NULL);
+  for (int i = 0; i < 300; ++i)
+    fprintf(f, "riga %d della prima catena, perch\xc3\xa9 s\xc3\xac.\n", i);
+  fclose(f);
+  write_text(paths[1], "");
+  write_text(paths[2], "Seconda catena.");
+  char *expected[3];
+  for (int i = 0; i < 3; ++i)
+    expected[i] = read_text(paths[i]);
+
+  ingest_backend_t backends[] = {INGEST_IO_URING, INGEST_PREAD, INGEST_AUTO};
+  for (int b = 0; b < 3; ++b) {
+    /* blocks cut UTF-8 sequences, fewer slots than blocks of one file */
+    ingest_config_t config = {backends[b], 4, 7, 2};
+    ingest_log_t log;
+    memset(&log, 0, sizeof log);
+    log.stop_after = -1;
+    ingest_stats_t stats;
+    int rc = ingest_files(paths, 3, &config, log_ingest, &log, &stats);
+    if (rc != 0 && backends[b] == INGEST_IO_URING)
+      continue; /* io_uring not allowed here: AUTO covers the fallback */
+    assert(rc == 0);
+    assert(backends[b] == INGEST_AUTO || stats.backend == backends[b]);
+    assert(stats.files == 3 && log.current == 3);
+    assert(stats.bytes == strlen(expected[0]) + strlen(expected[2]));
+    assert(stats.reads >= (strlen(expected[0]) + 6) / 7);
+    for (int i = 0; i < 3; ++i) {
+      assert(log.ended[i]);
+      assert(log.len[i] == strlen(expected[i]));
+      assert(log.len[i] == 0 || strcmp(log.text[i], expected[i]) == 0);
+      dfree(log.text[i]);
+    }
+
+    /* the same model as reading the files one after the other */
+    train_config_t train = {TRAIN_BACKEND_RADIX, 1, {0, NULL}, NULL};
+    trainer_t *direct = create_trainer(&train);
+    tokenizer_t *tok = create_tokenizer(tokenizer_train_sink, direct);
+    for (int i = 0; i < 3; ++i) {
+      tokenizer_feed_utf8(tok, expected[i], strlen(expected[i]));
+      tokenizer_finish(tok);
+      trainer_break(direct);
+    }
+    free_tokenizer(tok);
+    trainer_t *ingested = create_trainer(&train);
+    tok = create_tokenizer(tokenizer_train_sink, ingested);
+    memset(&log, 0, sizeof log);
+    log.stop_after = -1;
+    assert(ingest_files(paths, 3, &config, log_ingest, &log, NULL) == 0);
+    for (int i = 0; i < 3; ++i) {
+      tokenizer_feed_utf8(tok, log.text[i] ? log.text[i] : "", log.len[i]);
+      tokenizer_finish(tok);
+      trainer_break(ingested);
+      dfree(log.text[i]);
+    }
+    free_tokenizer(tok);
+    model_t *m1 = trainer_finish(direct);
+    model_t *m2 = trainer_finish(ingested);
+    assert_same_model(m1, m2);
+    free_model(m1);
+    free_model(m2);
+    free_trainer(direct);
+    free_trainer(ingested);
+
+    /* the sink stops the ingestion; reads in flight are drained */
+    memset(&log, 0, sizeof log);
+    log.stop_after = 5;
+    assert(ingest_files(paths, 3, &config, log_ingest, &log, NULL) == -1);
+    assert(log.current == 0 && log.len[0] == 6 * 7);
+    dfree(log.text[0]);
+
+    /* a missing file is an error */
+    const char *missing[] = {paths[2], "test/test_files/no_such_corpus.txt"};
+    memset(&log, 0, sizeof log);
+    log.stop_after = -1;
+    assert(ingest_files(missing, 2, &config, log_ingest, &log, NULL) == -1);
+    dfree(log.text[0]);
+  }
+
+  ingest_backend_t backend;
+  assert(ingest_backend_from_name("uring", &backend) == 0 &&
+         backend == INGEST_IO_URING);
+  assert(strcmp(ingest_backend_name(INGEST_PREAD), "pread") == 0);
+  assert(ingest_backend_from_name("aio", &backend) == -1);
+  for (int i = 0; i < 3; ++i) {
+    dfree(expected[i]);
+    unlink(paths[i]);
+  }
+}
+
+static void test_dir_train(void) {
+  const char *root = "test/test_files/dir_train";
+  /* in walk order: entries sorted by name, depth first */
+  const char *paths[] = {"test/test_files/dir_train/a/long.txt",
+                         "test/test_files/dir_train/a/sub/tiny.txt",
+                         "test/test_files/dir_train/b.txt",
+                         "test/test_files/dir_train/empty.txt"};
+  mkdir(root, 0700);
+  mkdir("test/test_files/dir_train/a", 0700);
+  mkdir("test/test_files/dir_train/a/sub", 0700);
+  FILE *f = fopen(paths[0], "w");
+  assert(f != NULL);
+  unsigned int state = 99;
+  int w[16];
+  for (int i = 0; i < 3000; ++i) {
+    corpus_word(lcg_next(&state) % 80, w);
+    for (int k = 0; w[k]; ++k)
+      fputc(w[k], f);
+    fputs(i % 11 == 0 ? ", perch\xc3\xa9\n" : i % 5 ? " " : "\t", f);
+    if (i == 1500) /* a run longer than a chunk, with no space */
+      for (int k = 0; k < 300; ++k)
+        fputs("\xc3\xa0", f);
+  }
+  fclose(f);
+  write_text(paths[1], "l'acqua.");
+  write_text(paths[2], "Un altro file, breve.\n");
+  write_text(paths[3], "");
+
+  train_config_t train = {TRAIN_BACKEND_RADIX, 1, {0, NULL}, NULL};
+  trainer_t *direct = create_trainer(&train);
+  tokenizer_t *tok = create_tokenizer(tokenizer_train_sink, direct);
+  for (int i = 0; i < 4; ++i) {
+    char *text = read_text(paths[i]);
+    tokenizer_feed_utf8(tok, text, strlen(text));
+    tokenizer_finish(tok);
+    trainer_break(direct);
+    dfree(text);
+  }
+  free_tokenizer(tok);
+  model_t *expected = trainer_finish(direct);
+
+  /* many chunks, a few threads: the same model, byte for byte */
+  model_t *first = NULL;
+  int threads[] = {1, 3, 8};
+  for (int t = 0; t < 3; ++t) {
+    dir_train_config_t config = {threads[t], 256};
+    dir_train_stats_t stats;
+    const char *roots[] = {root};
+    model_t *model = dir_train(roots, 1, &config, &stats);
+    assert(model != NULL);
+    assert(stats.files == 4 && stats.chunks > 40);
+    assert(stats.units < stats.chunks); /* small files are grouped */
+    assert(stats.tokens == trainer_get_tokens(direct));
+    assert_same_model(model, expected);
+    for (uint32_t id = 1; id < model_num_words(model); ++id)
+      assert(model_word_cmp(model_word(model, id - 1),
+                            model_word(model, id)) < 0);
+    if (first == NULL) {
+      first = model;
+      continue;
+    }
+    assert(model->image_size == first->image_size);
+    assert(memcmp(model->image, first->image, model->image_size) == 0);
+    free_model(model);
+  }
+  free_model(first);
+  free_model(expected);
+  free_trainer(direct);
+
+  /* files can be roots too, and a missing root is an error */
+  const char *roots[] = {paths[1], "test/test_files/no_such_dir"};
+  model_t *model = dir_train(roots, 1, NULL, NULL);
+  assert(model != NULL && model_num_words(model) == 3);
+  free_model(model);
+  assert(dir_train(roots, 2, NULL, NULL) == NULL);
+
+  for (int i = 0; i < 4; ++i)
+    unlink(paths[i]);
+  rmdir("test/test_files/dir_train/a/sub");
+  rmdir("test/test_files/dir_train/a");
+  rmdir(root);
+}
+
+typedef struct {
+  int words[8][16];
+  uint32_t ids[8];
+  size_t n;
+  size_t stop_at; /* 0: never */
+} trie_log_t;
+
+static int log_trie_word(void *ctx, const int *word, size_t length,
+                         uint32_t id) {
+  trie_log_t *log = ctx;
+  assert(length < 16 && word[length] == '\0');
+  if (log->n < 8) {
+    memcpy(log->words[log->n], word, sizeof(int) * (length + 1));
+    log->ids[log->n] = id;
+  }
+  log->n++;
+  return log->stop_at && log->n == log->stop_at;
+}
+
+static void test_word_trie(void) {
+  const char *text[] = {"parlavano", "parla", "parlare", "parlava", "pane",
+                        "parla", "p\xc3\xa0", "zero", "parlando"};
+  int words[9][16];
+  const int *ptrs[9];
+  for (int i = 0; i < 9; ++i) {
+    to_codepoints(text[i], words[i]);
+    ptrs[i] = words[i];
+  }
+  word_trie_t *trie = create_word_trie(ptrs, NULL, 9);
+  assert(word_trie_size(trie) == 8);
+  assert(word_trie_find(trie, words[0]) == 0);
+  assert(word_trie_find(trie, words[1]) == 5); /* last duplicate */
+  assert(word_trie_find(trie, words[6]) == 6);
+  int w[16];
+  to_codepoints("parl", w); /* inside a label */
+  assert(word_trie_find(trie, w) == VOCAB_NO_ID);
+  to_codepoints("parlavanoo", w);
+  assert(word_trie_find(trie, w) == VOCAB_NO_ID);
+  to_codepoints("", w);
+  assert(word_trie_find(trie, w) == VOCAB_NO_ID);
+
+  /* prefix ending inside a label, in code point order */
+  trie_log_t log;
+  memset(&log, 0, sizeof log);
+  to_codepoints("parl", w);
+  assert(word_trie_prefix(trie, w, log_trie_word, &log) == 5);
+  const char *expected[] = {"parla", "parlando", "parlare", "parlava",
+                            "parlavano"};
+  for (int i = 0; i < 5; ++i) {
+    to_codepoints(expected[i], w);
+    assert(model_word_cmp(log.words[i], w) == 0);
+    assert(log.ids[i] == word_trie_find(trie, w));
+  }
+  memset(&log, 0, sizeof log);
+  to_codepoints("parlava", w); /* a word and its continuations */
+  assert(word_trie_prefix(trie, w, log_trie_word, &log) == 2);
+  memset(&log, 0, sizeof log);
+  to_codepoints("pb", w);
+  assert(word_trie_prefix(trie, w, log_trie_word, &log) == 0);
+  memset(&log, 0, sizeof log);
+  log.stop_at = 3;
+  assert(word_trie_prefix(trie, NULL, log_trie_word, &log) == 3);
+  to_codepoints("pane", w);
+  assert(model_word_cmp(log.words[0], w) == 0);
+  free_word_trie(trie);
+
+  /* every word of a model, in the order of its sorted IDs */
+  model_t *model = train_corpus(TRAIN_BACKEND_RADIX, NULL);
+  trie = word_trie_from_model(model);
+  assert(word_trie_size(trie) == model_num_words(model));
+  for (uint32_t id = 0; id < model_num_words(model); ++id)
+    assert(word_trie_find(trie, model_word(model, id)) == id);
+  assert(word_trie_prefix(trie, NULL, NULL, NULL) == model_num_words(model));
+  for (uint32_t k = 0; k < 8 && k < model_num_words(model); ++k) {
+    memset(&log, 0, sizeof log);
+    log.stop_at = k + 1;
+    word_trie_prefix(trie, NULL, log_trie_word, &log);
+    assert(log.ids[k] == model->sorted_ids[k]);
+  }
+  assert(word_trie_bytes(trie) > 0);
+  free_word_trie(trie);
+  free_model(model);
+
+  trie = create_word_trie(NULL, NULL, 0);
+  assert(word_trie_size(trie) == 0);
+  assert(word_trie_find(trie, w) == VOCAB_NO_ID);
+  assert(word_trie_prefix(trie, NULL, NULL, NULL) == 0);
+  free_word_trie(trie);
+}
+
+/* -----------------------------------------------------
+ * Delta log: base + appended batches, torn tails, compaction
+ * -----------------------------------------------------*/
+
+/* Radix model of ranges of the test stream: words [bounds[2r],
+ * bounds[2r + 1]) for every r, each range a chain of its own. */
+static model_t *train_ranges(const int *bounds, int ranges) {
+  train_config_t config = {TRAIN_BACKEND_RADIX, 1, {0, NULL}, NULL};
+  trainer_t *trainer = create_trainer(&config);
+  unsigned int state = 99;
+  int w[16];
+  for (int i = 0, r = 0; r < ranges; ++i) {
+    corpus_word(lcg_next(&state) % 120, w);
+    if (i >= bounds[2 * r])
+      trainer_add_word(trainer, w);
+    if (i + 1 == bounds[2 * r + 1]) {
+      trainer_break(trainer);
+      r++;
+    }
+  }
+  model_t *model = trainer_finish(trainer);
+  free_trainer(trainer);
+  return model;
+}
+
+static uint32_t edge_count(const model_t *model, const char *word,
+                           const char *next) {
+  int w[16];
+  to_codepoints(word, w);
+  uint32_t id = model_find(model, w), n;
+  to_codepoints(next, w);
+  uint32_t next_id = model_find(model, w);
+  const model_edge_t *f = model_followers(model, id, &n);
+  for (uint32_t i = 0; i < n; ++i)
+    if (f[i].next == next_id)
+      return f[i].count;
+  return 0;
+}
+
+static long file_size(const char *path) {
+  struct stat st;
+  return stat(path, &st) == 0 ? (long)st.st_size : -1;
+}
+
+static void test_delta_log(void) {
+  const char *base_path = "test/test_files/delta_base.bin";
+  const char *log_path = "test/test_files/delta_base.bin.delta";
+  unlink(log_path);
+  int first[] = {0, 6000}, second[] = {6000, 9000};
+  int both[] = {0, 6000, 6000, 9000};
+  model_t *base = train_ranges(first, 1);
+  model_t *fresh = train_ranges(second, 1);
+  model_t *full = train_ranges(both, 2);
+  assert(model_save(base, base_path) == 0);
+
+  /* no log: the base as it is */
+  delta_log_stats_t stats;
+  model_t *loaded = delta_log_load(base_path, log_path, &stats);
+  assert(loaded && loaded->mapped && stats.batches == 0);
+  free_model(loaded);
+
+  /* base + the counts of the new text == training on both */
+  delta_log_t *log = delta_log_open(log_path, base);
+  assert(log != NULL);
+  assert(delta_log_add_model(log, fresh) == 0);
+  assert(delta_log_commit(log) == 0);
+  assert(delta_log_commit(log) == 0); /* nothing pending */
+  assert(delta_log_close(log) == 0);
+  loaded = delta_log_load(base_path, log_path, &stats);
+  assert(stats.batches == 1 && stats.ignored == 0 && stats.records > 0);
+  assert(stats.bytes == (uint64_t)file_size(log_path));
+  assert_same_model(full, loaded);
+  free_model(loaded);
+
+  /* single updates: a new pair of words, an edge taken away */
+  int a[16], b[16], c[16];
+  to_codepoints("nuova", a);
+  to_codepoints("parola", b);
+  to_codepoints("w7", c);
+  uint32_t before = edge_count(full, "w7", "w7");
+  log = delta_log_open(log_path, base);
+  assert(delta_log_add(log, a, b, 2) == 0);
+  assert(delta_log_add(log, a, b, 1) == 0);
+  assert(delta_log_add(log, c, c, -(int64_t)before - 5) == 0);
+  assert(delta_log_add(log, a, NULL, 1) == -1);
+  assert(delta_log_close(log) == 0);
+  loaded = delta_log_load(base_path, log_path, &stats);
+  assert(stats.batches == 2);
+  assert(model_num_words(loaded) == model_num_words(full) + 2);
+  assert(edge_count(loaded, "nuova", "parola") == 3);
+  assert(edge_count(loaded, "w7", "w7") == 0);
+  assert(model_num_edges(loaded) ==
+         model_num_edges(full) + 1 - (before > 0 ? 1 : 0));
+  free_model(loaded);
+
+  /* a torn batch is ignored on load and cut off when appending again */
+  long good = file_size(log_path);
+  FILE *f = fopen(log_path, "ab");
+  assert(f != NULL);
+  fwrite("MKDB torn batch", 1, 15, f);
+  fclose(f);
+  loaded = delta_log_load(base_path, log_path, &stats);
+  assert(loaded && stats.batches == 2 && stats.ignored == 15);
+  free_model(loaded);
+  log = delta_log_open(log_path, base);
+  assert(log && file_size(log_path) == good);
+  assert(delta_log_close(log) == 0);
+
+  /* a log belongs to its base */
+  assert(delta_log_open(log_path, fresh) == NULL);
+
+  /* a committed batch that no longer reads back stops the compaction */
+  uint64_t crc_words;
+  f = fopen(log_path, "rb");
+  assert(f && fseek(f, 16 + 4, SEEK_SET) == 0);
+  assert(fread(&crc_words, sizeof(crc_words), 1, f) == 1);
+  fclose(f);
+  log = delta_log_open(log_path, base);
+  patch_u64(log_path, 16 + 4, ~crc_words);
+  assert(delta_log_compact_start(log, base_path) == 0);
+  assert(delta_log_compact_wait(log) == -1);
+  patch_u64(log_path, 16 + 4, crc_words);
+  assert(delta_log_close(log) == 0);
+  assert(file_size(log_path) == good);
+
+  /* compaction, with a batch committed while it runs */
+  log = delta_log_open(log_path, base);
+  assert(delta_log_compact_start(log, base_path) == 0);
+  assert(delta_log_compact_start(log, base_path) == -1);
+  to_codepoints("dopo", c);
+  assert(delta_log_add(log, b, c, 4) == 0);
+  assert(delta_log_commit(log) == 0);
+  assert(delta_log_compact_wait(log) == 0);
+  assert(delta_log_close(log) == 0);
+  model_t *compacted = model_load(base_path);
+  assert(edge_count(compacted, "nuova", "parola") == 3);
+  assert(model_num_words(compacted) >= model_num_words(full) + 2);
+  loaded = delta_log_load(base_path, log_path, &stats);
+  assert(edge_count(loaded, "parola", "dopo") == 4);
+  assert(stats.batches <= 1);
+  assert(delta_log_open(log_path, base) == NULL); /* the old base */
+  free_model(loaded);
+  free_model(compacted);
+
+  free_model(base);
+  free_model(fresh);
+  free_model(full);
+  unlink(base_path);
+  unlink(log_path);
+}
+
+/* -----------------------------------------------------
+ * Model merge: sorted merge of two frozen models
+ * -----------------------------------------------------*/
+static int same_file(const char *x, const char *y) {
+  char *p = read_text(x), *q = read_text(y);
+  int same = file_size(x) == file_size(y) &&
+             memcmp(p, q, (size_t)file_size(x)) == 0;
+  dfree(p);
+  dfree(q);
+  return same;
+}
+
+static void test_model_merge(void) {
+  const char *path = "test/test_files/merged.bin";
+  const char *path3 = "test/test_files/merged3.bin";
+  /* the second range has words of its own, the stream draws from 120 */
+  int first[] = {0, 300}, second[] = {300, 9000};
+  int both[] = {0, 300, 300, 9000};
+  model_t *a = train_ranges(first, 1);
+  model_t *b = train_ranges(second, 1);
+  model_t *full = train_ranges(both, 2);
+  assert(model_num_words(a) < model_num_words(full));
+
+  model_merge_stats_t stats;
+  assert(model_merge(a, b, path, NULL, &stats) == 0);
+  model_t *merged = model_load(path);
+  assert(merged != NULL);
+  assert_same_model(full, merged);
+  assert(stats.words == model_num_words(full));
+  assert(stats.edges == model_num_edges(full) && stats.dropped == 0);
+  for (uint32_t id = 0; id < model_num_words(a); ++id) /* a keeps its IDs */
+    assert(model_word_cmp(model_word(a, id), model_word(merged, id)) == 0);
+
+  /* several threads, several chunks, the same file */
+  model_merge_config_t three = {1.0, 1.0, 3};
+  assert(model_merge(a, b, path3, &three, &stats) == 0);
+  assert(stats.chunks > 3);
+  assert(same_file(path, path3));
+  free_model(merged);
+
+  /* weights: round(wa * a + wb * b), zeros dropped */
+  model_merge_config_t weighted = {2.0, 0.25, 2};
+  assert(model_merge(a, b, path, &weighted, &stats) == 0);
+  merged = model_load(path);
+  uint64_t dropped = 0;
+  for (uint32_t id = 0; id < model_num_words(full); ++id) {
+    uint32_t n;
+    const model_edge_t *f = model_followers(full, id, &n);
+    const int *word = model_word(full, id);
+    char text[16];
+    for (int k = 0; (text[k] = (char)word[k]) != '\0'; ++k)
+      ;
+    for (uint32_t e = 0; e < n; ++e) {
+      char next[16];
+      const int *nw = model_word(full, f[e].next);
+      for (int k = 0; (next[k] = (char)nw[k]) != '\0'; ++k)
+        ;
+      double expected = 2.0 * edge_count(a, text, next) +
+                        0.25 * edge_count(b, text, next);
+      uint32_t rounded = (uint32_t)floor(expected + 0.5);
+      assert(edge_count(merged, text, next) == rounded);
+      dropped += rounded == 0;
+    }
+  }
+  assert(stats.dropped == dropped);
+  assert(model_num_edges(merged) == model_num_edges(full) - dropped);
+  free_model(merged);
+
+  /* merging with an empty side */
+  int none[] = {0, 1};
+  model_t *empty = train_ranges(none, 1);
+  assert(model_merge(empty, a, path, NULL, NULL) == 0);
+  merged = model_load(path);
+  assert_same_model(a, merged);
+  free_model(merged);
+  model_merge_config_t negative = {-1.0, 1.0, 1};
+  assert(model_merge(a, b, path, &negative, NULL) == -1);
+
+  free_model(empty);
+  free_model(a);
+  free_model(b);
+  free_model(full);
+  unlink(path);
+  unlink(path3);
+}
+
+/* -----------------------------------------------------
+ * Packed models
+ * -----------------------------------------------------*/
+static void assert_same_rows(const model_t *model,
+                             const packed_model_t *packed) {
+  assert(packed_model_num_words(packed) == model_num_words(model));
+  assert(packed_model_num_edges(packed) == model_num_edges(model));
+  model_edge_t *row =
+      malloc(sizeof(model_edge_t) * (packed->header->widest + 1));
+  for (uint32_t id = 0; id < model_num_words(model); ++id) {
+    uint32_t n;
+    const model_edge_t *f = model_followers(model, id, &n);
+    assert(packed_model_followers(packed, id, row) == n);
+    assert(n <= packed->header->widest);
+    for (uint32_t e = 0; e < n; ++e)
+      assert(row[e].next == f[e].next && row[e].count == f[e].count);
+    assert(packed_model_row_total(packed, id) == model_row_total(model, id));
+    assert(packed_model_find(packed, model_word(model, id)) == id);
+  }
+  free(row);
+}
+
+static void test_packed_model(void) {
+  const char *path = "test/test_files/packed.bin";
+  int range[] = {0, 9000};
+  model_t *model = train_ranges(range, 1);
+
+  /* counts of every width, up to 32 bits */
+  vocab_t *vocab = create_vocab(11);
+  const char *words[] = {"a", "b", "c", "d", "e"};
+  int w[16];
+  for (int i = 0; i < 5; ++i) {
+    to_codepoints(words[i], w);
+    vocab_intern(vocab, w);
+  }
+  uint64_t rows[] = {0, 3, 3, 4, 5, 5};
+  model_edge_t edges[] = {
+      {0, 1}, {2, UINT32_MAX}, {4, 70000}, {0, 128}, {3, 1u << 31}};
+  model_t *wide = model_build(vocab, rows, edges);
+  free_vocab(vocab);
+
+  static const packed_encoding_t encodings[] = {PACKED_VARINT, PACKED_BITS};
+  for (int k = 0; k < 2; ++k) {
+    packed_model_t *packed = packed_model_build(model, encodings[k]);
+    assert(packed != NULL && packed->header->encoding == encodings[k]);
+    assert(packed->header->image_size < model->header->image_size);
+    assert_same_rows(model, packed);
+
+    assert(packed_model_save(packed, path) == 0);
+    assert(packed_model_probe(path));
+    packed_model_t *loaded = packed_model_load(path);
+    assert(loaded != NULL && loaded->mapped);
+    assert_same_rows(model, loaded);
+    to_codepoints("missing", w);
+    assert(packed_model_find(loaded, w) == VOCAB_NO_ID);
+
+    /* the same draws, so the same walk as on the model */
+    uint32_t expected[200], walked[200];
+    uint64_t s1 = 7, s2 = 7;
+    size_t n = generate_walk(model, 3, expected, 200, &s1);
+    assert(n > 0);
+    assert(packed_model_walk(loaded, 3, walked, 200, &s2) == n);
+    assert(memcmp(expected, walked, n * sizeof(uint32_t)) == 0);
+    free_packed_model(loaded);
+    free_packed_model(packed);
+
+    packed = packed_model_build(wide, encodings[k]);
+    assert_same_rows(wide, packed);
+    s1 = s2 = 11;
+    n = generate_walk(wide, 0, expected, 200, &s1);
+    assert(packed_model_walk(packed, 0, walked, 200, &s2) == n);
+    assert(memcmp(expected, walked, n * sizeof(uint32_t)) == 0);
+    free_packed_model(packed);
+  }
+
+  /* sections moved, rows past the data, a row count too large, IDs and
+   * the pool past what they index */
+  packed_model_t *packed = packed_model_build(model, PACKED_BITS);
+  uint64_t rows_end = packed->header->row_offsets_off +
+                      sizeof(uint64_t) * model_num_words(model);
+  uint64_t data_off = packed->header->data_off;
+  assert(packed_model_save(packed, path) == 0);
+  patch_u64(path, offsetof(packed_model_header_t, sorted_ids_off), 8);
+  assert(packed_model_load(path) == NULL);
+  assert(packed_model_save(packed, path) == 0);
+  patch_u64(path, (long)rows_end, packed->header->data_len);
+  assert(packed_model_load(path) == NULL);
+  assert(packed_model_save(packed, path) == 0);
+  patch_u64(path, (long)data_off, UINT64_MAX); /* varint of row 0 */
+  assert(packed_model_load(path) == NULL);
+  const packed_model_header_t *ph = packed->header;
+  assert(packed_model_save(packed, path) == 0);
+  patch_u32(path, (long)ph->sorted_ids_off, 0x7fffffff);
+  assert(packed_model_load(path) == NULL);
+  assert(packed_model_save(packed, path) == 0);
+  patch_u32(path, (long)(ph->pool_off + (ph->pool_len - 1) * sizeof(int)),
+            'x');
+  assert(packed_model_load(path) == NULL);
+  free_packed_model(packed);
+
+  /* a model is not a packed model, nor the other way round */
+  const char *model_path = "test/test_files/packed_model.bin";
+  assert(model_save(wide, model_path) == 0);
+  assert(!packed_model_probe(model_path));
+  assert(packed_model_load(model_path) == NULL);
+  assert(model_load(path) == NULL);
+  packed_encoding_t encoding;
+  assert(packed_encoding_from_name("bits", &encoding) == 0 &&
+         encoding == PACKED_BITS);
+  assert(packed_encoding_from_name("zip", &encoding) == -1);
+
+  free_model(wide);
+  free_model(model);
+  unlink(model_path);
+  unlink(path);
+}
+
+/* -----------------------------------------------------
+ * Quantized models
+ * -----------------------------------------------------*/
+/* Every kept follower within 1 / 2^bits of its probability, the quanta
+ * of a row summing to 2^bits. Returns the followers dropped. */
+static uint64_t assert_quantized(const model_t *model,
+                                 const quant_model_t *quant) {
+  uint32_t scale = 1u << quant->header->bits;
+  uint64_t dropped = 0;
+  model_edge_t *row =
+      malloc(sizeof(model_edge_t) * (model_num_edges(model) + 1));
+  for (uint32_t id = 0; id < model_num_words(model); ++id) {
+    uint32_t n;
+    const model_edge_t *f = model_followers(model, id, &n);
+    uint32_t m = quant_model_followers(quant, id, row);
+    double total = (double)model_row_total(model, id);
+    uint64_t sum = 0;
+    uint32_t k = 0;
+    for (uint32_t e = 0; e < n; ++e) {
+      uint32_t q = 0;
+      if (k < m && row[k].next == f[e].next)
+        q = row[k++].count;
+      assert(k == m || row[k].next > f[e].next);
+      dropped += q == 0;
+      sum += q;
+      assert(fabs((double)q / scale - f[e].count / total) < 1.0 / scale);
+    }
+    assert(k == m);
+    assert(sum == (n ? scale : 0));
+  }
+  free(row);
+  assert(quant->header->max_error < 1.0 / scale);
+  assert(quant->header->dropped == dropped);
+  assert(quant_model_num_edges(quant) + dropped == model_num_edges(model));
+  return dropped;
+}
+
+static void test_quant_model(void) {
+  const char *path = "test/test_files/quant.bin";
+  int range[] = {0, 9000};
+  model_t *model = train_ranges(range, 1);
+  model_edge_t *cdf_row =
+      malloc(sizeof(model_edge_t) * (model_num_edges(model) + 1));
+  model_edge_t *alias_row =
+      malloc(sizeof(model_edge_t) * (model_num_edges(model) + 1));
+
+  static const unsigned bits[] = {8, 16};
+  for (int b = 0; b < 2; ++b) {
+    quant_model_t *cdf = quant_model_build(model, bits[b], QUANT_CDF);
+    quant_model_t *alias = quant_model_build(model, bits[b], QUANT_ALIAS);
+    assert(cdf != NULL && alias != NULL);
+    assert(cdf->header->image_size < model->header->image_size);
+    assert_quantized(model, cdf);
+    assert(assert_quantized(model, alias) == cdf->header->dropped);
+    /* the two tables hold the same quanta */
+    for (uint32_t id = 0; id < model_num_words(model); ++id) {
+      uint32_t m = quant_model_followers(cdf, id, cdf_row);
+      assert(quant_model_followers(alias, id, alias_row) == m);
+      assert(memcmp(cdf_row, alias_row, m * sizeof(model_edge_t)) == 0);
+    }
+
+    assert(quant_model_save(alias, path) == 0);
+    assert(quant_model_probe(path));
+    quant_model_t *loaded = quant_model_load(path);
+    assert(loaded != NULL && loaded->mapped);
+    assert_quantized(model, loaded);
+    for (uint32_t id = 0; id < model_num_words(model); ++id)
+      assert(quant_model_find(loaded, model_word(model, id)) == id);
+
+    /* every step of a walk is a kept follower of the previous word */
+    uint32_t ids[300];
+    uint64_t state = 5;
+    size_t n = quant_model_walk(loaded, 3, ids, 300, &state);
+    assert(n > 0);
+    for (size_t k = 0; k < n; ++k) {
+      uint32_t m = quant_model_followers(loaded, k ? ids[k - 1] : 3, cdf_row);
+      uint32_t e = 0;
+      while (e < m && cdf_row[e].next != ids[k])
+        e++;
+      assert(e < m && cdf_row[e].count > 0);
+    }
+    free_quant_model(loaded);
+    free_quant_model(alias);
+    free_quant_model(cdf);
+  }
+
+  /* sampled frequencies: a -> b 1, c 2, d 5 are 32, 64 and 160 of 256;
+   * e -> a 1, b 1000 drops a at 8 bits */
+  vocab_t *vocab = create_vocab(11);
+  const char *words[] = {"a", "b", "c", "d", "e"};
+  int w[16];
+  for (int i = 0; i < 5; ++i) {
+    to_codepoints(words[i], w);
+    vocab_intern(vocab, w);
+  }
+  uint64_t rows[] = {0, 3, 3, 3, 3, 5};
+  model_edge_t edges[] = {{1, 1}, {2, 2}, {3, 5}, {0, 1}, {1, 1000}};
+  model_t *small = model_build(vocab, rows, edges);
+  free_vocab(vocab);
+  for (int t = 0; t < 2; ++t) {
+    quant_model_t *quant =
+        quant_model_build(small, 8, t ? QUANT_ALIAS : QUANT_CDF);
+    assert(assert_quantized(small, quant) == 1);
+    uint32_t m = quant_model_followers(quant, 0, cdf_row);
+    assert(m == 3 && cdf_row[0].count == 32 && cdf_row[1].count == 64 &&
+           cdf_row[2].count == 160);
+    assert(quant_model_followers(quant, 4, cdf_row) == 1);
+    assert(cdf_row[0].next == 1 && cdf_row[0].count == 256);
+    uint64_t seen[4] = {0, 0, 0, 0}, state = 9;
+    for (int k = 0; k < 80000; ++k)
+      seen[quant_model_next(quant, 0, &state)]++;
+    assert(seen[0] == 0);
+    assert(fabs(seen[1] / 80000.0 - 0.125) < 0.01);
+    assert(fabs(seen[2] / 80000.0 - 0.25) < 0.01);
+    assert(fabs(seen[3] / 80000.0 - 0.625) < 0.01);
+    assert(quant_model_next(quant, 1, &state) == VOCAB_NO_ID);
+    free_quant_model(quant);
+  }
+
+  /* sections moved, rows past the edges, an alias outside its row, IDs
+   * and the pool past what they index */
+  quant_model_t *quant = quant_model_build(small, 8, QUANT_ALIAS);
+  assert(quant_model_save(quant, path) == 0);
+  patch_u64(path, offsetof(quant_model_header_t, nexts_off), 8);
+  assert(quant_model_load(path) == NULL);
+  assert(quant_model_save(quant, path) == 0);
+  patch_u64(path, (long)(quant->header->row_offsets_off + 5 * 8), 9);
+  assert(quant_model_load(path) == NULL);
+  assert(quant_model_save(quant, path) == 0);
+  patch_u64(path, (long)quant->header->aliases_off, 3); /* row 0 has 3 */
+  assert(quant_model_load(path) == NULL);
+  const quant_model_header_t *qh = quant->header;
+  assert(quant_model_save(quant, path) == 0);
+  patch_u32(path, (long)qh->sorted_ids_off, 0x7fffffff);
+  assert(quant_model_load(path) == NULL);
+  assert(quant_model_save(quant, path) == 0);
+  patch_u32(path, (long)(qh->pool_off + (qh->pool_len - 1) * sizeof(int)),
+            'x');
+  assert(quant_model_load(path) == NULL);
+  free_quant_model(quant);
+
+  assert(quant_model_build(small, 12, QUANT_CDF) == NULL);
+  assert(!quant_model_probe("test/test_files/no_such_model.bin"));
+  free_model(small);
+  free(alias_row);
+  free(cdf_row);
+  free_model(model);
+  unlink(path);
+}
+
+/* -----------------------------------------------------
+ * Main: run the full test suite
+ * -----------------------------------------------------*/
+int main(void) {
+  printf("Running training tests...\n");
+
+  test_vocab();
+  printf("Vocabulary tests passed.\n");
+
+  test_model_roundtrip();
+  printf("Model save/load tests passed.\n");
+
+  test_external_training();
+  printf("External training tests passed.\n");
+
+  test_radix_sort();
+  printf("Radix sort tests passed.\n");
+
+  test_training_backends();
+  printf("Training backend tests passed.\n");
+
+  test_model_shm();
+  printf("Shared memory model tests passed.\n");
+
+  test_top_followers();
+  printf("Top followers tests passed.\n");
+
+  test_beam_search();
+  printf("Beam search tests passed.\n");
+
+  test_csv_export();
+  printf("CSV export tests passed.\n");
+
+  test_csv_import();
+  printf("CSV import tests passed.\n");
+
+  test_tokenizer();
+  printf("Tokenizer tests passed.\n");
+
+  test_pipeline();
+  printf("Pipeline tests passed.\n");
+
+  test_ingest();
+  printf("Ingestion tests passed.\n");
+
+  test_dir_train();
+  printf("Directory training tests passed.\n");
+
+  test_word_trie();
+  printf("Word trie tests passed.\n");
+
+  test_delta_log();
+  printf("Delta log tests passed.\n");
+
+  test_model_merge();
+  printf("Model merge tests passed.\n");
+
+  test_packed_model();
+  printf("Packed model tests passed.\n");
+
+  test_quant_model();
+  printf("Quantized model tests passed.\n");
+
+  printf("All training tests passed successfully!\n");
+  return 0;
+}
@@ -1,4 +1,5 @@
 #include"../include/utf8_tools.h"
+#include <assert.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -23,7 +24,65 @@ void print_utf8_char(int codepoint) {
     }
     printf("%s", utf8);
 }
+static void test_case_mapping(void) {
+    /* ASCII, Latin-1 accents, Greek, Cyrillic, Deseret and no-ops */
+    assert(utf8_char_to_lower('A') == 'a' && utf8_char_to_upper('z') == 'Z');
+    assert(utf8_char_to_lower(0xC0) == 0xE0);   /* À -> à */
+    assert(utf8_char_to_lower(0xD2) == 0xF2);   /* Ò -> ò */
+    assert(utf8_char_to_upper(0xF9) == 0xD9);   /* ù -> Ù */
+    assert(utf8_char_to_upper(0xEC) == 0xCC);   /* ì -> Ì */
+    assert(utf8_char_to_lower(0xD7) == 0xD7);   /* × is not a letter */
+    assert(utf8_char_to_upper(0xFF) == 0x178);  /* ÿ -> Ÿ */
+    assert(utf8_char_to_lower(0x130) == 'i');   /* İ -> i */
+    assert(utf8_char_to_upper(0xDF) == 0xDF);   /* ß has no simple upper */
+    assert(utf8_char_to_lower(0x3A3) == 0x3C3); /* Σ -> σ */
+    assert(utf8_char_to_lower(0x416) == 0x436); /* Ж -> ж */
+    assert(utf8_char_to_upper(0x1F80) == 0x1F88);
+    assert(utf8_char_to_lower(0x10400) == 0x10428);
+    assert(utf8_char_to_lower('1') == '1' && utf8_char_to_lower(0x4E2D) == 0x4E2D);
+    assert(utf8_char_to_lower(-1) == -1 && utf8_char_to_lower(0x110000) == 0x110000);
+
+    /* the vectorized path must agree with the per-character one */
+    int word[23], lower[23];
+    for (int i = 0; i < 23; ++i)
+        word[i] = (i % 5 == 3) ? 0xC0 + i : 'A' + i * 2;
+    utf8_codepoints_to_lower(lower, word, 23);
+    for (int i = 0; i < 23; ++i)
+        assert(lower[i] == utf8_char_to_lower(word[i]));
+    utf8_codepoints_to_lower(word, word, 23);
+    assert(memcmp(word, lower, sizeof word) == 0);
+}
+
+static void test_decode_rules(void) {
+    int out[4];
+    assert(utf8_decode("\xf4\x8f\xbf\xbf", 4, out, 4) == 1 && out[0] == 0x10FFFF);
+    assert(utf8_decode("\xe0\xa0\x80", 3, out, 4) == 1 && out[0] == 0x800);
+    assert(utf8_decode("\xc0\x80", 2, out, 4) == UTF8_ERROR);     /* overlong */
+    assert(utf8_decode("\xe0\x81\x81", 3, out, 4) == UTF8_ERROR); /* overlong 'A' */
+    assert(utf8_decode("\xf0\x8f\xbf\xbf", 4, out, 4) == UTF8_ERROR);
+    assert(utf8_decode("\xed\xa0\x80", 3, out, 4) == UTF8_ERROR); /* surrogate */
+    assert(utf8_decode("\xf4\x90\x80\x80", 4, out, 4) == UTF8_ERROR);
+    assert(utf8_decode("\xf5\x80\x80\x80", 4, out, 4) == UTF8_ERROR);
+
+    /* the streaming decoder: same rules, sequences split anywhere */
+    utf8_stream_t s = UTF8_STREAM_INIT;
+    int buf[8];
+    assert(utf8_stream_decode(&s, "\xc3", 1, buf, '?') == 0);
+    assert(utf8_stream_decode(&s, "\xa0\xe0", 2, buf, '?') == 1 && buf[0] == 0xE0);
+    assert(utf8_stream_decode(&s, "\x81", 1, buf, '?') == 2);
+    assert(buf[0] == '?' && buf[1] == '?' && s.invalid == 2);
+    assert(utf8_stream_decode(&s, "\xf0\x9f", 2, buf, '?') == 0);
+    assert(utf8_stream_finish(&s, buf, '?') == 1 && s.invalid == 3);
+    assert(utf8_stream_finish(&s, buf, '?') == 0);
+}
+
 int main() {
+    test_decode_rules();
+    printf("Decoding rule tests passed.\n");
+
+    test_case_mapping();
+    printf("Case mapping tests passed.\n");
+
     FILE *file = freopen("test/test_files/test_file_utf8.txt", "rb", stdin);
     if (!file) {
         fprintf(stderr, "Could not open file\n");
@@ -0,0 +1,112 @@
+#!/usr/bin/env python3
+"""
+Generate include/utf8_case_table.h: the Unicode simple case mapping as
+two-level delta tables for utf8_char_to_lower / utf8_char_to_upper.
+
+Usage: tools/gen_case_table.py [UnicodeData.txt] > include/utf8_case_table.h
+
+With UnicodeData.txt the simple mappings are read from fields 12 and 13.
+Without it they come from Python's unicodedata: str.lower()/str.upper()
+give the full mappings, which agree with the simple ones whenever they
+are a single code point; the remaining cases are U+0130 (lowercase is
+its first code point) and the Greek letters with iota subscript (simple
+uppercase is the titlecase form).
+"""
+import sys
+import unicodedata
+
+MAX_CODEPOINT = 0x110000
+BLOCK_SHIFT = 7
+BLOCK = 1 << BLOCK_SHIFT
+
+
+def from_unicode_data(path):
+    lower, upper = {}, {}
+    with open(path) as f:
+        for line in f:
+            fields = line.split(";")
+            cp = int(fields[0], 16)
+            if fields[12]:
+                upper[cp] = int(fields[12], 16)
+            if fields[13]:
+                lower[cp] = int(fields[13], 16)
+    return lower, upper, "UnicodeData.txt"
+
+
+def from_python():
+    lower, upper = {}, {}
+    for cp in range(MAX_CODEPOINT):
+        if 0xD800 <= cp < 0xE000:
+            continue
+        c = chr(cp)
+        lo = c.lower()
+        if len(lo) > 1:
+            lo = lo[0]
+        if lo != c:
+            lower[cp] = ord(lo)
+        up = c.upper()
+        if len(up) > 1:
+            up = c.title()
+        if len(up) == 1 and up != c:
+            upper[cp] = ord(up)
+    return lower, upper, "Unicode %s (Python unicodedata)" % unicodedata.unidata_version
+
+
+def two_level(mapping):
+    """Stage 1: block number per 128 code points. Stage 2: unique blocks
+    of deltas (mapped - cp); block 0 is all zeros."""
+    blocks = [tuple([0] * BLOCK)]
+    index_of = {blocks[0]: 0}
+    stage1 = []
+    for start in range(0, MAX_CODEPOINT, BLOCK):
+        block = tuple(mapping.get(cp, cp) - cp for cp in range(start, start + BLOCK))
+        if block not in index_of:
+            index_of[block] = len(blocks)
+            blocks.append(block)
+        stage1.append(index_of[block])
+    return stage1, blocks
+
+
+def emit_array(out, ctype, name, values, per_line):
+    out.append("static const %s %s[%d] = {" % (ctype, name, len(values)))
+    for i in range(0, len(values), per_line):
+        out.append("    " + ", ".join(str(v) for v in values[i:i + per_line]) + ",")
+    out.append("};")
+
+
+def main():
+    if len(sys.argv) > 1:
+        lower, upper, source = from_unicode_data(sys.argv[1])
+    else:
+        lower, upper, source = from_python()
+
+    out = [
+        "/* Generated by tools/gen_case_table.py from %s. Do not edit. */" % source,
+        "#ifndef UTF8_CASE_TABLE_H",
+        "#define UTF8_CASE_TABLE_H",
+        "",
+        "/*",
+        " * Unicode simple case mapping, two levels: CASE_STAGE1 picks the block",
+        " * of 128 code points, the block holds mapped - codepoint for each entry.",
+        " * Identical blocks are shared (most of them are the all-zero block 0).",
+        " */",
+        "#define CASE_BLOCK_SHIFT %d" % BLOCK_SHIFT,
+        "#define CASE_BLOCK_MASK %d" % (BLOCK - 1),
+        "#define CASE_MAX_CODEPOINT 0x%X" % MAX_CODEPOINT,
+        "",
+    ]
+    for name, mapping in (("lower", lower), ("upper", upper)):
+        stage1, blocks = two_level(mapping)
+        assert len(blocks) <= 256
+        out.append("/* %d mappings, %d distinct blocks */" % (len(mapping), len(blocks)))
+        emit_array(out, "unsigned char", "case_%s_stage1" % name, stage1, 24)
+        out.append("")
+        flat = [d for block in blocks for d in block]
+        emit_array(out, "int", "case_%s_deltas" % name, flat, 12)
+        out.append("")
+    out.append("#endif /* UTF8_CASE_TABLE_H */")
+    print("\n".join(out))
+
+
+if __name__ == "__main__":
+    main()
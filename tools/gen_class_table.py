@@ -0,0 +1,78 @@
+#!/usr/bin/env python3
+"""
+Generate include/tokenizer_class_table.h: the tokenizer class of every
+code point as a two-level table (see tokenizer.h for the classes).
+
+Usage: tools/gen_class_table.py > include/tokenizer_class_table.h
+
+Letters are the general categories L*, M* (combining accents stay in the
+word) and N* (numbers are words too); apostrophes and sentence
+punctuation are listed below; everything else separates tokens.
+"""
+import unicodedata
+
+MAX_CODEPOINT = 0x110000
+BLOCK_SHIFT = 7
+BLOCK = 1 << BLOCK_SHIFT
+
+SEPARATOR, LETTER, APOSTROPHE, PUNCT = range(4)
+
+APOSTROPHES = [0x27, 0x2019, 0x02BC]
+PUNCTUATION = [
+    ord(c) for c in ".,;:!?"
+] + [0x00A1, 0x00BF, 0x037E, 0x2026, 0x3001, 0x3002, 0xFF01, 0xFF0C,
+     0xFF0E, 0xFF1A, 0xFF1B, 0xFF1F]
+
+
+def classify(cp):
+    if cp in APOSTROPHES:
+        return APOSTROPHE
+    if cp in PUNCTUATION:
+        return PUNCT
+    if 0xD800 <= cp < 0xE000:
+        return SEPARATOR
+    if unicodedata.category(chr(cp))[0] in "LMN":
+        return LETTER
+    return SEPARATOR
+
+
+def main():
+    blocks = [tuple([SEPARATOR] * BLOCK)]
+    index_of = {blocks[0]: 0}
+    stage1 = []
+    for start in range(0, MAX_CODEPOINT, BLOCK):
+        block = tuple(classify(cp) for cp in range(start, start + BLOCK))
+        if block not in index_of:
+            index_of[block] = len(blocks)
+            blocks.append(block)
+        stage1.append(index_of[block])
+    assert len(blocks) <= 256
+
+    out = [
+        "/* Generated by tools/gen_class_table.py from Unicode %s (Python"
+        % unicodedata.unidata_version,
+        " * unicodedata). Do not edit. */",
+        "#ifndef TOKENIZER_CLASS_TABLE_H",
+        "#define TOKENIZER_CLASS_TABLE_H",
+        "",
+        "/* Two levels: a block number per 128 code points, then the class of",
+        " * each code point in the block (%d distinct blocks). */" % len(blocks),
+        "#define CLASS_BLOCK_SHIFT %d" % BLOCK_SHIFT,
+        "#define CLASS_BLOCK_MASK %d" % (BLOCK - 1),
+        "#define CLASS_MAX_CODEPOINT 0x%X" % MAX_CODEPOINT,
+        "",
+    ]
+    for name, values, per_line in (("class_stage1", stage1, 24),
+                                   ("class_blocks",
+                                    [c for b in blocks for c in b], 32)):
+        out.append("static const unsigned char %s[%d] = {" % (name, len(values)))
+        for i in range(0, len(values), per_line):
+            out.append("    " + ", ".join(str(v) for v in values[i:i + per_line]) + ",")
+        out.append("};")
+        out.append("")
+    out.append("#endif /* TOKENIZER_CLASS_TABLE_H */")
+    print("\n".join(out))
+
+
+if __name__ == "__main__":
+    main()